@@ -0,0 +1,221 @@
+#pragma once
+
+#include "synchronization.hpp"
+#include "task.hpp"
+#include "thread_pool.hpp"
+#include "vk_dispatch.hpp"
+#include "vk_utils.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <future>
+#include <mutex>
+#include <stdexcept>
+#include <stop_token>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Where Tasks run. Blocking file reads go to a small I/O pool, everything
+// else to a worker pool, and GPU completion is watched by one poller thread
+// that hands finished waiters back to the workers. Hundreds of loads can be
+// in flight on a handful of threads, and none of it on the render thread.
+//
+// Every task awaiting on the executor has to finish before it is
+// destroyed; waiters still parked on the poller are never resumed.
+class AsyncExecutor
+{
+    public:
+    // How long a finished fence or timeline value can go unnoticed.
+    static constexpr std::chrono::microseconds POLL_INTERVAL{ 200 };
+
+    explicit AsyncExecutor(
+        const std::size_t io_threads = 4,
+        const std::size_t worker_threads =
+            std::max( 1u, std::thread::hardware_concurrency() ) )
+        : m_worker_pool( worker_threads ), m_io_pool( io_threads ) {
+        m_poller = std::jthread(
+            [this]( const std::stop_token stop ) { poll( stop ); } );
+    }
+
+    AsyncExecutor( const AsyncExecutor & ) = delete;
+    AsyncExecutor & operator=( const AsyncExecutor & ) = delete;
+
+    // co_await schedule() continues on a worker thread.
+    [[nodiscard]] auto schedule() noexcept {
+        return PoolAwaiter{ m_worker_pool };
+    }
+    // co_await schedule_io() continues on an I/O thread; only for blocking
+    // calls, hop back with schedule() afterwards.
+    [[nodiscard]] auto schedule_io() noexcept {
+        return PoolAwaiter{ m_io_pool };
+    }
+
+    // Whole file, read on the I/O pool, resuming on a worker.
+    [[nodiscard]] Task<std::vector<char>> read_file( std::string path ) {
+        co_await schedule_io();
+        auto contents{ ::read_file( path ) };
+        co_await schedule();
+        co_return contents;
+    }
+
+    // co_await until `fence` is signalled, resuming on a worker. Throws on
+    // device loss. The poller queries it through `dispatch`.
+    [[nodiscard]] auto wait_fence( const DeviceDispatch & dispatch,
+                                   const VkDevice         device,
+                                   const VkFence          fence ) noexcept {
+        GpuWait wait{};
+        wait.device = device;
+        wait.fence = fence;
+        wait.get_fence_status = dispatch.get_fence_status;
+        return GpuAwaiter{ *this, wait };
+    }
+    // co_await until the timeline semaphore reaches `value`.
+    [[nodiscard]] auto
+    wait_timeline( const VkDevice                   device,
+                   const SynchronizationFunctions & functions,
+                   const VkSemaphore                semaphore,
+                   const std::uint64_t              value ) noexcept {
+        GpuWait wait{};
+        wait.device = device;
+        wait.semaphore = semaphore;
+        wait.value = value;
+        wait.get_counter_value = functions.get_semaphore_counter_value;
+        return GpuAwaiter{ *this, wait };
+    }
+
+    // Starts `task` on a worker; the calling thread only gets the future,
+    // which the render loop can poll without blocking.
+    template <typename T>
+    [[nodiscard]] std::future<T> spawn( Task<T> task ) {
+        return start( on_worker( std::move( task ) ) );
+    }
+
+    private:
+    struct PoolAwaiter
+    {
+        ThreadPool & pool;
+
+        [[nodiscard]] bool await_ready() const noexcept { return false; }
+        void await_suspend( const std::coroutine_handle<> handle ) {
+            pool.submit( [handle]() { handle.resume(); } );
+        }
+        void await_resume() const noexcept {}
+    };
+
+    struct GpuWait
+    {
+        VkDevice                       device{ VK_NULL_HANDLE };
+        VkFence                        fence{ VK_NULL_HANDLE };
+        VkSemaphore                    semaphore{ VK_NULL_HANDLE };
+        std::uint64_t                  value{ 0 };
+        PFN_vkGetFenceStatus           get_fence_status{ nullptr };
+        PFN_vkGetSemaphoreCounterValue get_counter_value{ nullptr };
+        std::coroutine_handle<>        waiter;
+        // Lives in the suspended coroutine's frame.
+        VkResult * result{ nullptr };
+    };
+
+    struct GpuAwaiter
+    {
+        AsyncExecutor & executor;
+        GpuWait         wait;
+        VkResult        result{ VK_NOT_READY };
+
+        [[nodiscard]] bool await_ready() {
+            result = status( wait );
+            return result != VK_NOT_READY;
+        }
+        void await_suspend( const std::coroutine_handle<> handle ) {
+            wait.waiter = handle;
+            wait.result = &result;
+            executor.enqueue( wait );
+        }
+        void await_resume() const {
+            if ( result != VK_SUCCESS ) {
+                throw std::runtime_error(
+                    "GPU wait failed, error code: "
+                    + std::to_string( result ) );
+            }
+        }
+    };
+
+    // I/O completions hop onto the workers, so the I/O pool is drained
+    // and joined first.
+    ThreadPool                  m_worker_pool;
+    ThreadPool                  m_io_pool;
+    std::mutex                  m_mutex;
+    std::condition_variable_any m_wake;
+    std::vector<GpuWait>        m_waits;
+    bool                        m_new_waits{ false };
+    // Last, so it stops before the pools it feeds go away.
+    std::jthread                m_poller;
+
+    template <typename T>
+    Task<T> on_worker( Task<T> task ) {
+        co_await schedule();
+        co_return co_await task;
+    }
+
+    // VK_SUCCESS once done, VK_NOT_READY while pending, an error otherwise.
+    [[nodiscard]] static VkResult status( const GpuWait & wait ) {
+        if ( wait.fence != VK_NULL_HANDLE ) {
+            return wait.get_fence_status( wait.device, wait.fence );
+        }
+        std::uint64_t  value{ 0 };
+        const VkResult result{ wait.get_counter_value(
+            wait.device, wait.semaphore, &value ) };
+        if ( result != VK_SUCCESS ) {
+            return result;
+        }
+        return value >= wait.value ? VK_SUCCESS : VK_NOT_READY;
+    }
+
+    void enqueue( const GpuWait & wait ) {
+        {
+            std::lock_guard lock( m_mutex );
+            m_waits.push_back( wait );
+            m_new_waits = true;
+        }
+        m_wake.notify_one();
+    }
+
+    // Sleeps while nothing is pending, otherwise checks every wait each
+    // POLL_INTERVAL (or sooner when a new one arrives). Status queries are
+    // cheap next to a thread blocked per wait.
+    void poll( const std::stop_token stop ) {
+        std::vector<GpuWait> pending;
+        while ( !stop.stop_requested() ) {
+            {
+                std::unique_lock lock( m_mutex );
+                if ( pending.empty() ) {
+                    m_wake.wait( lock, stop,
+                                 [this]() { return !m_waits.empty(); } );
+                }
+                else {
+                    m_wake.wait_for( lock, stop, POLL_INTERVAL,
+                                     [this]() { return m_new_waits; } );
+                }
+                pending.insert( pending.end(), m_waits.begin(),
+                                m_waits.end() );
+                m_waits.clear();
+                m_new_waits = false;
+            }
+
+            std::erase_if( pending, [this]( const GpuWait & wait ) {
+                const VkResult result{ status( wait ) };
+                if ( result == VK_NOT_READY ) {
+                    return false;
+                }
+                *wait.result = result;
+                m_worker_pool.submit(
+                    [waiter = wait.waiter]() { waiter.resume(); } );
+                return true;
+            } );
+        }
+    }
+};
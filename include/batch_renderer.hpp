@@ -0,0 +1,441 @@
+#pragma once
+
+#include "headless_context.hpp"
+#include "offscreen_target.hpp"
+#include "pipeline.hpp"
+#include "vk_dispatch.hpp"
+#include "vk_utils.hpp"
+#include "work_stealing.hpp"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Headless batch rendering sharded over every graphics capable physical
+// device and every queue of its graphics family. A shard is one VkQueue with
+// its own render target, command pool and worker thread; shards on the same
+// logical device share its pipeline. Jobs are numbered 0..N-1 and handed out
+// through a WorkStealingScheduler.
+
+struct BatchRendererConfig
+{
+    VkExtent2D  extent{ 256, 256 };
+    std::string vertex_shader{ "shaders/triangle_vert.spv" };
+    std::string fragment_shader{ "shaders/triangle_frag.spv" };
+    // Logical devices created per physical device. Hardware gets nothing
+    // from more than one, but software ICDs such as lavapipe run each
+    // device's queue on its own thread, so this is how a CPU host scales.
+    std::uint32_t devices_per_gpu{ 1 };
+    // Queues used per logical device; 0 takes every queue in the family.
+    std::uint32_t max_queues_per_device{ 0 };
+};
+
+struct BatchShardStats
+{
+    std::string   device_name;
+    std::uint32_t device_index{ 0 };
+    std::uint32_t queue_index{ 0 };
+    std::uint64_t jobs{ 0 };
+    // Jobs taken from another shard's deque.
+    std::uint64_t stolen{ 0 };
+    // From the start of the run until this shard's last job completed.
+    double seconds{ 0.0 };
+};
+
+struct BatchRunStats
+{
+    std::uint64_t                jobs{ 0 };
+    double                       seconds{ 0.0 };
+    std::vector<BatchShardStats> shards;
+
+    [[nodiscard]] double jobs_per_second() const noexcept {
+        return seconds > 0.0 ? static_cast<double>( jobs ) / seconds : 0.0;
+    }
+};
+
+// One logical device and the state its shards share.
+struct BatchDevice
+{
+    VkPhysicalDevice     physical_device{ VK_NULL_HANDLE };
+    std::uint32_t        queue_family{ 0 };
+    std::uint32_t        index{ 0 };
+    std::string          name;
+    UniqueDevice         device;
+    // For everything the shards do per job.
+    DeviceDispatch       dispatch;
+    // Host callbacks for the device and every object created on it.
+    const VkAllocationCallbacks * allocator{ nullptr };
+    UniqueShaderModule   vertex_shader;
+    UniqueShaderModule   fragment_shader;
+    UniquePipelineLayout layout;
+    UniquePipeline       pipeline;
+};
+
+class BatchShard;
+
+// Records one job between vkBeginCommandBuffer and vkEndCommandBuffer,
+// preferably through shard.dispatch().
+using BatchRecordFn = std::function<void(
+    const BatchShard & shard, VkCommandBuffer command_buffer,
+    std::uint64_t job )>;
+
+class BatchShard
+{
+    public:
+    static constexpr std::uint32_t FRAMES_IN_FLIGHT{ 2 };
+
+    BatchShard( BatchDevice & device, const std::uint32_t queue_index,
+                const VkExtent2D extent ) :
+        m_device( device ), m_queue_index( queue_index ),
+        m_target( device.physical_device, device.device, extent,
+                  VK_FORMAT_R8G8B8A8_UNORM, device.allocator ) {
+        vkGetDeviceQueue( device.device, device.queue_family, queue_index,
+                          &m_queue );
+
+        VkCommandPoolCreateInfo pool_info{};
+        pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+        pool_info.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+        pool_info.queueFamilyIndex = device.queue_family;
+        if ( vkCreateCommandPool(
+                 device.device, &pool_info, device.allocator,
+                 m_command_pool.put( device.device, device.allocator ) )
+             != VK_SUCCESS ) {
+            throw std::runtime_error( "Failed to create command pool." );
+        }
+
+        VkCommandBufferAllocateInfo alloc_info{};
+        alloc_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        alloc_info.commandPool = m_command_pool;
+        alloc_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        alloc_info.commandBufferCount = FRAMES_IN_FLIGHT;
+        if ( vkAllocateCommandBuffers( device.device, &alloc_info,
+                                       m_command_buffers.data() )
+             != VK_SUCCESS ) {
+            throw std::runtime_error( "Failed to allocate command buffers." );
+        }
+
+        VkFenceCreateInfo fence_info{};
+        fence_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+        fence_info.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+        for ( auto & fence : m_fences ) {
+            if ( vkCreateFence( device.device, &fence_info, device.allocator,
+                                fence.put( device.device, device.allocator ) )
+                 != VK_SUCCESS ) {
+                throw std::runtime_error( "Failed to create fence." );
+            }
+        }
+    }
+
+    BatchShard( const BatchShard & ) = delete;
+    BatchShard & operator=( const BatchShard & ) = delete;
+
+    [[nodiscard]] const BatchDevice & device() const noexcept {
+        return m_device;
+    }
+    [[nodiscard]] std::uint32_t queue_index() const noexcept {
+        return m_queue_index;
+    }
+    [[nodiscard]] const OffscreenTarget & target() const noexcept {
+        return m_target;
+    }
+    [[nodiscard]] VkPipeline pipeline() const noexcept {
+        return m_device.pipeline;
+    }
+    [[nodiscard]] const DeviceDispatch & dispatch() const noexcept {
+        return m_device.dispatch;
+    }
+
+    // Worker loop: pulls jobs until the scheduler runs dry, keeping up to
+    // FRAMES_IN_FLIGHT submissions queued. Only this thread touches the
+    // shard's queue and command pool, so neither needs a lock. Whatever
+    // was submitted has finished by the time this returns or throws.
+    void run( WorkStealingScheduler<std::uint64_t> & scheduler,
+              const std::size_t worker, const BatchRecordFn & record,
+              BatchShardStats & stats, const std::atomic<bool> & cancelled ) {
+        try {
+            run_jobs( scheduler, worker, record, stats, cancelled );
+        }
+        catch ( ... ) {
+            // The pool and fences must outlive the earlier submissions.
+            wait_in_flight();
+            throw;
+        }
+        wait_in_flight();
+    }
+
+    private:
+    BatchDevice &                                 m_device;
+    std::uint32_t                                 m_queue_index;
+    VkQueue                                       m_queue{ VK_NULL_HANDLE };
+    OffscreenTarget                               m_target;
+    UniqueCommandPool                             m_command_pool;
+    std::array<VkCommandBuffer, FRAMES_IN_FLIGHT> m_command_buffers{};
+    std::array<UniqueFence, FRAMES_IN_FLIGHT>     m_fences{};
+    // Slots whose fence has a submission behind it. A fence reset for a
+    // submit that then failed never signals, so it is never waited on.
+    std::array<bool, FRAMES_IN_FLIGHT> m_in_flight{};
+
+    void run_jobs( WorkStealingScheduler<std::uint64_t> & scheduler,
+                   const std::size_t worker, const BatchRecordFn & record,
+                   BatchShardStats & stats,
+                   const std::atomic<bool> & cancelled ) {
+        const VkDevice         device{ m_device.device };
+        const DeviceDispatch & dispatch{ m_device.dispatch };
+        std::uint32_t          slot{ 0 };
+        while ( !cancelled.load( std::memory_order_relaxed ) ) {
+            const auto taken{ scheduler.take( worker ) };
+            if ( !taken.has_value() ) {
+                break;
+            }
+
+            const VkFence fence{ m_fences[slot] };
+            if ( m_in_flight[slot] ) {
+                dispatch.wait_for_fences(
+                    device, 1, &fence, VK_TRUE,
+                    std::numeric_limits<std::uint64_t>::max() );
+                m_in_flight[slot] = false;
+            }
+
+            const auto command_buffer{ m_command_buffers[slot] };
+            dispatch.reset_command_buffer( command_buffer, 0 );
+
+            VkCommandBufferBeginInfo begin_info{};
+            begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+            begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+            if ( dispatch.begin_command_buffer( command_buffer, &begin_info )
+                 != VK_SUCCESS ) {
+                throw std::runtime_error( "Failed to begin command buffer." );
+            }
+            record( *this, command_buffer, taken->job );
+            if ( dispatch.end_command_buffer( command_buffer ) != VK_SUCCESS ) {
+                throw std::runtime_error( "Failed to record command buffer." );
+            }
+
+            // Reset only once recording has succeeded.
+            dispatch.reset_fences( device, 1, &fence );
+
+            VkSubmitInfo submit_info{};
+            submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+            submit_info.commandBufferCount = 1;
+            submit_info.pCommandBuffers = &command_buffer;
+            if ( dispatch.queue_submit( m_queue, 1, &submit_info, fence )
+                 != VK_SUCCESS ) {
+                throw std::runtime_error( "Failed to submit batch job." );
+            }
+            m_in_flight[slot] = true;
+
+            ++stats.jobs;
+            stats.stolen += taken->stolen ? 1 : 0;
+            slot = ( slot + 1 ) % FRAMES_IN_FLIGHT;
+        }
+    }
+
+    void wait_in_flight() {
+        std::array<VkFence, FRAMES_IN_FLIGHT> fences{};
+        std::uint32_t                         count{ 0 };
+        for ( std::uint32_t slot{ 0 }; slot < FRAMES_IN_FLIGHT; ++slot ) {
+            if ( m_in_flight[slot] ) {
+                fences[count++] = m_fences[slot];
+                m_in_flight[slot] = false;
+            }
+        }
+        if ( count != 0 ) {
+            m_device.dispatch.wait_for_fences(
+                m_device.device, count, fences.data(), VK_TRUE,
+                std::numeric_limits<std::uint64_t>::max() );
+        }
+    }
+};
+
+class BatchRenderer
+{
+    public:
+    // `allocator`, if given, is used for every device and object created
+    // and has to outlive the renderer.
+    BatchRenderer( const VkInstance              instance,
+                   const BatchRendererConfig &   config = {},
+                   const VkAllocationCallbacks * allocator = nullptr ) {
+        std::vector<VkPhysicalDevice> gpus;
+        for ( const auto gpu : enumerate_physical_devices( instance ) ) {
+            if ( rate_headless_device( gpu ) > 0 ) {
+                gpus.push_back( gpu );
+            }
+        }
+        if ( gpus.empty() ) {
+            throw std::runtime_error(
+                "Failed to find GPUs with graphics queues." );
+        }
+
+        // Copy-major, so consecutive devices sit on different GPUs.
+        const auto vert_code{ read_file( config.vertex_shader ) };
+        const auto frag_code{ read_file( config.fragment_shader ) };
+        const auto instance_dispatch{ InstanceDispatch::load( instance ) };
+        for ( std::uint32_t copy{ 0 };
+              copy < std::max( config.devices_per_gpu, 1u ); ++copy ) {
+            for ( const auto gpu : gpus ) {
+                create_device( instance_dispatch, gpu, config, vert_code,
+                               frag_code, allocator );
+            }
+        }
+
+        // Interleave queues across devices so that running on the first N
+        // shards spreads the work as widely as N allows.
+        std::uint32_t max_queues{ 0 };
+        for ( const auto & shards : m_device_shards ) {
+            max_queues = std::max(
+                max_queues, static_cast<std::uint32_t>( shards.size() ) );
+        }
+        for ( std::uint32_t queue{ 0 }; queue < max_queues; ++queue ) {
+            for ( auto & shards : m_device_shards ) {
+                if ( queue < shards.size() ) {
+                    m_shards.push_back( shards[queue].get() );
+                }
+            }
+        }
+    }
+
+    BatchRenderer( const BatchRenderer & ) = delete;
+    BatchRenderer & operator=( const BatchRenderer & ) = delete;
+
+    [[nodiscard]] std::size_t shard_count() const noexcept {
+        return m_shards.size();
+    }
+    [[nodiscard]] std::size_t device_count() const noexcept {
+        return m_devices.size();
+    }
+
+    // Renders jobs 0..job_count-1 on the first `shards` shards (0 for all)
+    // and returns once the GPU has finished every one of them. Each shard
+    // starts with a contiguous block of jobs; an exception on any worker
+    // cancels the rest and is rethrown here.
+    BatchRunStats run( const std::uint64_t job_count,
+                       const BatchRecordFn & record,
+                       const std::size_t     shards = 0 ) {
+        const std::size_t count{ shards == 0
+                                     ? m_shards.size()
+                                     : std::min( shards, m_shards.size() ) };
+
+        WorkStealingScheduler<std::uint64_t> scheduler( count );
+        for ( std::uint64_t job{ 0 }; job < job_count; ++job ) {
+            scheduler.push( static_cast<std::size_t>( job * count / job_count ),
+                            job );
+        }
+
+        BatchRunStats stats{};
+        stats.jobs = job_count;
+        stats.shards.resize( count );
+        for ( std::size_t i{ 0 }; i < count; ++i ) {
+            stats.shards[i].device_name = m_shards[i]->device().name;
+            stats.shards[i].device_index = m_shards[i]->device().index;
+            stats.shards[i].queue_index = m_shards[i]->queue_index();
+        }
+
+        std::atomic<bool>  cancelled{ false };
+        std::mutex         error_mutex;
+        std::exception_ptr error;
+
+        using clock = std::chrono::steady_clock;
+        const auto start{ clock::now() };
+        {
+            std::vector<std::jthread> workers;
+            workers.reserve( count );
+            for ( std::size_t i{ 0 }; i < count; ++i ) {
+                workers.emplace_back( [&, i]() {
+                    try {
+                        m_shards[i]->run( scheduler, i, record,
+                                          stats.shards[i], cancelled );
+                    }
+                    catch ( ... ) {
+                        std::lock_guard lock( error_mutex );
+                        if ( !error ) {
+                            error = std::current_exception();
+                        }
+                        cancelled = true;
+                    }
+                    stats.shards[i].seconds =
+                        std::chrono::duration<double>( clock::now() - start )
+                            .count();
+                } );
+            }
+        }
+        stats.seconds =
+            std::chrono::duration<double>( clock::now() - start ).count();
+
+        if ( error ) {
+            std::rethrow_exception( error );
+        }
+        return stats;
+    }
+
+    private:
+    // Declared first so the devices outlive the shards referencing them.
+    std::vector<std::unique_ptr<BatchDevice>>             m_devices;
+    std::vector<std::vector<std::unique_ptr<BatchShard>>> m_device_shards;
+    // Interleaved across devices, see the constructor.
+    std::vector<BatchShard *> m_shards;
+
+    void create_device( const InstanceDispatch &    instance_dispatch,
+                        const VkPhysicalDevice      gpu,
+                        const BatchRendererConfig & config,
+                        const std::vector<char> &   vert_code,
+                        const std::vector<char> &   frag_code,
+                        const VkAllocationCallbacks * allocator ) {
+        auto device{ std::make_unique<BatchDevice>() };
+        device->allocator = allocator;
+        device->physical_device = gpu;
+        device->queue_family = find_graphics_queue_family( gpu ).value();
+        device->index = static_cast<std::uint32_t>( m_devices.size() );
+
+        VkPhysicalDeviceProperties properties;
+        vkGetPhysicalDeviceProperties( gpu, &properties );
+        device->name = properties.deviceName;
+
+        const auto    families{ get_queue_families( gpu ) };
+        std::uint32_t queue_count{
+            families[device->queue_family].queueCount };
+        if ( config.max_queues_per_device != 0 ) {
+            queue_count = std::min( queue_count, config.max_queues_per_device );
+        }
+
+        device->device = create_headless_device( gpu, device->queue_family,
+                                                 queue_count, allocator );
+        device->dispatch = DeviceDispatch::load( instance_dispatch,
+                                                 device->device );
+        device->vertex_shader =
+            create_shader_module( device->device, vert_code, allocator );
+        device->fragment_shader =
+            create_shader_module( device->device, frag_code, allocator );
+        device->layout =
+            create_pipeline_layout( device->device, 0, {}, allocator );
+
+        std::vector<std::unique_ptr<BatchShard>> shards;
+        for ( std::uint32_t queue{ 0 }; queue < queue_count; ++queue ) {
+            shards.push_back(
+                std::make_unique<BatchShard>( *device, queue, config.extent ) );
+        }
+
+        // Every shard's render pass is identical, hence compatible with the
+        // one the pipeline is built against.
+        GraphicsPipelineDesc desc{};
+        desc.vertex_shader = device->vertex_shader;
+        desc.fragment_shader = device->fragment_shader;
+        desc.layout = device->layout;
+        desc.render_pass = shards.front()->target().render_pass();
+        desc.allocator = allocator;
+        device->pipeline = build_graphics_pipeline( device->device, desc );
+
+        m_devices.push_back( std::move( device ) );
+        m_device_shards.push_back( std::move( shards ) );
+    }
+};
@@ -0,0 +1,195 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include "GLFW/glfw3.h"
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+
+// CPU decoders for BC1-BC3 (DXT1-DXT5), used when a device has no
+// textureCompressionBC support (most mobile and some software
+// implementations). Output is tightly packed RGBA8; the uncompressed image is
+// 4-8x larger, so this is a fallback rather than a way to ship textures.
+
+[[nodiscard]] constexpr bool
+can_decode_bc_to_rgba8( const VkFormat format ) noexcept {
+    switch ( format ) {
+    case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+    case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+    case VK_FORMAT_BC1_RGBA_UNORM_BLOCK:
+    case VK_FORMAT_BC1_RGBA_SRGB_BLOCK:
+    case VK_FORMAT_BC2_UNORM_BLOCK:
+    case VK_FORMAT_BC2_SRGB_BLOCK:
+    case VK_FORMAT_BC3_UNORM_BLOCK:
+    case VK_FORMAT_BC3_SRGB_BLOCK: return true;
+    default: return false;
+    }
+}
+
+// The RGBA8 format decode_bc_to_rgba8() output should be uploaded as.
+[[nodiscard]] constexpr VkFormat
+bc_decode_target_format( const VkFormat format ) noexcept {
+    switch ( format ) {
+    case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+    case VK_FORMAT_BC1_RGBA_SRGB_BLOCK:
+    case VK_FORMAT_BC2_SRGB_BLOCK:
+    case VK_FORMAT_BC3_SRGB_BLOCK: return VK_FORMAT_R8G8B8A8_SRGB;
+    default: return VK_FORMAT_R8G8B8A8_UNORM;
+    }
+}
+
+namespace bc_detail
+{
+using Texel = std::array<std::uint8_t, 4>;
+
+[[nodiscard]] inline std::uint16_t read_u16( const std::uint8_t * p ) noexcept {
+    return static_cast<std::uint16_t>( p[0] | ( p[1] << 8 ) );
+}
+
+[[nodiscard]] inline Texel expand_565( const std::uint16_t c ) noexcept {
+    const auto r{ ( c >> 11 ) & 0x1F };
+    const auto g{ ( c >> 5 ) & 0x3F };
+    const auto b{ c & 0x1F };
+    return { static_cast<std::uint8_t>( ( r << 3 ) | ( r >> 2 ) ),
+             static_cast<std::uint8_t>( ( g << 2 ) | ( g >> 4 ) ),
+             static_cast<std::uint8_t>( ( b << 3 ) | ( b >> 2 ) ), 255 };
+}
+
+[[nodiscard]] inline Texel mix( const Texel & a, const Texel & b,
+                                const int wa, const int wb ) noexcept {
+    Texel out{};
+    for ( int k{ 0 }; k < 3; ++k ) {
+        out[k] = static_cast<std::uint8_t>( ( a[k] * wa + b[k] * wb )
+                                            / ( wa + wb ) );
+    }
+    out[3] = 255;
+    return out;
+}
+
+// Colour part shared by all three formats. BC2/BC3 always use the four
+// colour mode; BC1 switches to three colours plus transparent black when the
+// endpoints are not in descending order.
+inline void decode_color_block( const std::uint8_t * block, const bool bc1,
+                                std::array<Texel, 16> & out ) noexcept {
+    const auto c0{ read_u16( block ) };
+    const auto c1{ read_u16( block + 2 ) };
+
+    std::array<Texel, 4> palette{};
+    palette[0] = expand_565( c0 );
+    palette[1] = expand_565( c1 );
+    if ( !bc1 || c0 > c1 ) {
+        palette[2] = mix( palette[0], palette[1], 2, 1 );
+        palette[3] = mix( palette[0], palette[1], 1, 2 );
+    }
+    else {
+        palette[2] = mix( palette[0], palette[1], 1, 1 );
+        palette[3] = { 0, 0, 0, 0 };
+    }
+
+    std::uint32_t indices{};
+    std::memcpy( &indices, block + 4, sizeof( indices ) );
+    for ( std::size_t i{ 0 }; i < 16; ++i ) {
+        out[i] = palette[( indices >> ( 2 * i ) ) & 0x3];
+    }
+}
+
+// BC2: explicit 4-bit alpha per texel.
+inline void decode_explicit_alpha( const std::uint8_t *    block,
+                                   std::array<Texel, 16> & out ) noexcept {
+    for ( std::size_t i{ 0 }; i < 16; ++i ) {
+        const auto nibble{ ( block[i / 2] >> ( 4 * ( i % 2 ) ) ) & 0xF };
+        out[i][3] = static_cast<std::uint8_t>( nibble * 17 );
+    }
+}
+
+// BC3: two 8-bit endpoints and 3-bit indices into an interpolated palette.
+inline void decode_interpolated_alpha( const std::uint8_t *    block,
+                                       std::array<Texel, 16> & out ) noexcept {
+    const int a0{ block[0] };
+    const int a1{ block[1] };
+
+    std::array<std::uint8_t, 8> palette{};
+    palette[0] = static_cast<std::uint8_t>( a0 );
+    palette[1] = static_cast<std::uint8_t>( a1 );
+    if ( a0 > a1 ) {
+        for ( int k{ 1 }; k < 7; ++k ) {
+            palette[k + 1] =
+                static_cast<std::uint8_t>( ( a0 * ( 7 - k ) + a1 * k ) / 7 );
+        }
+    }
+    else {
+        for ( int k{ 1 }; k < 5; ++k ) {
+            palette[k + 1] =
+                static_cast<std::uint8_t>( ( a0 * ( 5 - k ) + a1 * k ) / 5 );
+        }
+        palette[6] = 0;
+        palette[7] = 255;
+    }
+
+    std::uint64_t indices{ 0 };
+    for ( int k{ 0 }; k < 6; ++k ) {
+        indices |= std::uint64_t{ block[2 + k] } << ( 8 * k );
+    }
+    for ( std::size_t i{ 0 }; i < 16; ++i ) {
+        out[i][3] = palette[( indices >> ( 3 * i ) ) & 0x7];
+    }
+}
+} // namespace bc_detail
+
+// Decodes one mip level; `rgba` must hold width * height * 4 bytes.
+inline void
+decode_bc_to_rgba8( const VkFormat format, const std::uint8_t * blocks,
+                    const std::uint32_t width, const std::uint32_t height,
+                    std::uint8_t * rgba ) noexcept {
+    const bool bc1{ format == VK_FORMAT_BC1_RGB_UNORM_BLOCK
+                    || format == VK_FORMAT_BC1_RGB_SRGB_BLOCK
+                    || format == VK_FORMAT_BC1_RGBA_UNORM_BLOCK
+                    || format == VK_FORMAT_BC1_RGBA_SRGB_BLOCK };
+    const bool opaque{ format == VK_FORMAT_BC1_RGB_UNORM_BLOCK
+                       || format == VK_FORMAT_BC1_RGB_SRGB_BLOCK };
+    const bool bc2{ format == VK_FORMAT_BC2_UNORM_BLOCK
+                    || format == VK_FORMAT_BC2_SRGB_BLOCK };
+    const std::size_t block_bytes{ bc1 ? 8u : 16u };
+
+    const std::uint32_t blocks_x{ ( width + 3 ) / 4 };
+    const std::uint32_t blocks_y{ ( height + 3 ) / 4 };
+
+    std::array<bc_detail::Texel, 16> texels{};
+    for ( std::uint32_t by{ 0 }; by < blocks_y; ++by ) {
+        for ( std::uint32_t bx{ 0 }; bx < blocks_x; ++bx ) {
+            const std::uint8_t * block{
+                blocks + ( std::size_t{ by } * blocks_x + bx ) * block_bytes };
+            if ( bc1 ) {
+                bc_detail::decode_color_block( block, true, texels );
+            }
+            else {
+                bc_detail::decode_color_block( block + 8, false, texels );
+                if ( bc2 ) {
+                    bc_detail::decode_explicit_alpha( block, texels );
+                }
+                else {
+                    bc_detail::decode_interpolated_alpha( block, texels );
+                }
+            }
+
+            // Partial blocks at the right and bottom edges are clipped.
+            const auto columns{ std::min( 4u, width - bx * 4 ) };
+            const auto rows{ std::min( 4u, height - by * 4 ) };
+            for ( std::uint32_t y{ 0 }; y < rows; ++y ) {
+                for ( std::uint32_t x{ 0 }; x < columns; ++x ) {
+                    auto texel{ texels[y * 4 + x] };
+                    if ( opaque ) {
+                        texel[3] = 255;
+                    }
+                    std::memcpy( rgba
+                                     + ( ( std::size_t{ by } * 4 + y ) * width
+                                         + bx * 4 + x )
+                                           * 4,
+                                 texel.data(), 4 );
+                }
+            }
+        }
+    }
+}
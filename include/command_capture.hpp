@@ -0,0 +1,605 @@
+#pragma once
+
+#include "command_stream.hpp"
+#include "synchronization.hpp"
+#include "vk_dispatch.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+struct CommandCaptureStats
+{
+    std::size_t   commands{ 0 };
+    std::size_t   draws{ 0 };
+    std::size_t   pipelines{ 0 };
+    std::size_t   buffers{ 0 };
+    std::uint64_t file_bytes{ 0 };
+};
+
+// Writes one frame's command buffer out as a .vcmd file (see
+// command_stream.hpp) for vk_replay.
+//
+// Resources are registered as they're created so handles can be turned
+// into stream indices. begin() points the recording entries of the app's
+// dispatch tables at shims that log each call and forward it, and finish()
+// puts the originals back and writes the file. Commands outside the stream
+// format (copies, queries) are forwarded but not logged.
+//
+// A call the stream can't express, e.g. on a handle nobody registered, is
+// remembered rather than thrown from inside recording; finish() then fails
+// instead of writing a capture that would replay something else.
+class CommandCapture
+{
+    public:
+    CommandCapture( std::string path, const std::uint64_t frame )
+        : m_path( std::move( path ) ), m_frame( frame ) {}
+
+    CommandCapture( const CommandCapture & ) = delete;
+    CommandCapture & operator=( const CommandCapture & ) = delete;
+
+    // Frame number to capture.
+    [[nodiscard]] std::uint64_t frame() const noexcept { return m_frame; }
+
+    // Registration. Thread safe, and ignored once the file is written.
+
+    void set_formats( const VkFormat color, const VkFormat depth ) {
+        std::lock_guard lock( m_mutex );
+        m_stream.color_format = color;
+        m_stream.depth_format = depth;
+    }
+
+    // Every framebuffer and image of one window map to the same target.
+    void add_target( const VkExtent2D                  extent,
+                     const std::span<const VkFramebuffer> framebuffers,
+                     const std::span<const VkImage>       images ) {
+        std::lock_guard lock( m_mutex );
+        if ( m_finished ) {
+            return;
+        }
+        const auto index{ static_cast<std::uint32_t>(
+            m_stream.targets.size() ) };
+        m_stream.targets.push_back( { extent.width, extent.height } );
+        for ( const auto framebuffer : framebuffers ) {
+            m_framebuffers[framebuffer] = index;
+        }
+        for ( const auto image : images ) {
+            m_images[image] = index;
+        }
+    }
+
+    // `desc` carries everything but the shader indices, which are assigned
+    // here.
+    void add_pipeline( const VkPipeline pipeline, const VkPipelineLayout layout,
+                       StreamPipeline                desc,
+                       const std::vector<char> &     vertex_code,
+                       const std::vector<char> &     fragment_code ) {
+        std::lock_guard lock( m_mutex );
+        if ( m_finished ) {
+            return;
+        }
+        desc.vertex_shader = add_shader( vertex_code );
+        desc.fragment_shader = add_shader( fragment_code );
+        const auto index{ static_cast<std::uint32_t>(
+            m_stream.pipelines.size() ) };
+        m_stream.pipelines.push_back( desc );
+        m_pipelines[pipeline] = index;
+        m_layouts[layout] = index;
+    }
+
+    void add_buffer( const VkBuffer buffer, const VkBufferUsageFlags usage,
+                     const void * contents, const std::size_t size ) {
+        std::lock_guard lock( m_mutex );
+        if ( m_finished ) {
+            return;
+        }
+        const auto * bytes{ static_cast<const std::uint8_t *>( contents ) };
+        auto &       added{ m_stream.buffers.emplace_back() };
+        added.usage = usage;
+        added.contents.assign( bytes, bytes + size );
+        m_buffers[buffer] =
+            static_cast<std::uint32_t>( m_stream.buffers.size() - 1 );
+    }
+
+    // Views are registered again whenever the one bound might have changed;
+    // repeats are dropped.
+    void add_texture( const VkImageView view, const VkFormat format,
+                      const VkExtent2D extent, const std::uint32_t levels ) {
+        std::lock_guard lock( m_mutex );
+        if ( m_finished || m_views.contains( view ) ) {
+            return;
+        }
+        m_stream.textures.push_back( { static_cast<std::uint32_t>( format ),
+                                       extent.width, extent.height,
+                                       levels } );
+        m_views[view] =
+            static_cast<std::uint32_t>( m_stream.textures.size() - 1 );
+    }
+
+    // Puts the tables back when dropped, so recording that throws between
+    // begin() and finish() doesn't leave them pointing at the shims.
+    class [[nodiscard]] Recording
+    {
+        public:
+        Recording( Recording && other ) noexcept
+            : m_capture( std::exchange( other.m_capture, nullptr ) ) {}
+        Recording & operator=( Recording && ) = delete;
+        ~Recording() { restore(); }
+
+        void restore() noexcept {
+            if ( m_capture != nullptr ) {
+                std::exchange( m_capture, nullptr )->restore();
+            }
+        }
+
+        private:
+        friend class CommandCapture;
+        explicit Recording( CommandCapture & capture ) noexcept
+            : m_capture( &capture ) {}
+
+        CommandCapture * m_capture;
+    };
+
+    // Recording on this thread through `dispatch` and `sync` is captured
+    // until finish() or the returned Recording is dropped.
+    Recording begin( DeviceDispatch & dispatch,
+                     SynchronizationFunctions & sync ) {
+        {
+            std::lock_guard lock( m_mutex );
+            if ( s_active != nullptr || m_finished ) {
+                throw std::runtime_error( "Command capture already used." );
+            }
+        }
+        m_hooked_dispatch = &dispatch;
+        m_hooked_sync = &sync;
+        m_next = dispatch;
+        m_saved_sync = sync;
+        m_next_barrier = sync.cmd_pipeline_barrier != nullptr
+                             ? sync.cmd_pipeline_barrier
+                             : vkCmdPipelineBarrier;
+        m_next_barrier2 = sync.cmd_pipeline_barrier2;
+        s_active = this;
+
+        dispatch.update_descriptor_sets = update_descriptor_sets;
+        dispatch.cmd_begin_render_pass = cmd_begin_render_pass;
+        dispatch.cmd_end_render_pass = cmd_end_render_pass;
+        dispatch.cmd_bind_pipeline = cmd_bind_pipeline;
+        dispatch.cmd_set_viewport = cmd_set_viewport;
+        dispatch.cmd_set_scissor = cmd_set_scissor;
+        dispatch.cmd_bind_vertex_buffers = cmd_bind_vertex_buffers;
+        dispatch.cmd_bind_index_buffer = cmd_bind_index_buffer;
+        dispatch.cmd_bind_descriptor_sets = cmd_bind_descriptor_sets;
+        dispatch.cmd_push_constants = cmd_push_constants;
+        dispatch.cmd_draw = cmd_draw;
+        dispatch.cmd_draw_indexed = cmd_draw_indexed;
+        dispatch.cmd_pipeline_barrier = cmd_pipeline_barrier;
+        sync.cmd_pipeline_barrier = cmd_pipeline_barrier;
+        if ( m_next_barrier2 != nullptr ) {
+            sync.cmd_pipeline_barrier2 = cmd_pipeline_barrier2;
+        }
+        return Recording{ *this };
+    }
+
+    // Restores the tables passed to begin() and writes the file. Throws if
+    // anything recorded couldn't be captured.
+    CommandCaptureStats finish( Recording recording ) {
+        recording.restore();
+
+        std::lock_guard lock( m_mutex );
+        m_finished = true;
+        if ( !m_error.empty() ) {
+            throw std::runtime_error( "Command capture failed: " + m_error );
+        }
+        if ( m_stream.commands.empty() ) {
+            throw std::runtime_error( "Command capture recorded nothing." );
+        }
+
+        CommandCaptureStats stats{};
+        stats.commands = m_stream.commands.size();
+        stats.draws = m_stream.draw_count();
+        stats.pipelines = m_stream.pipelines.size();
+        stats.buffers = m_stream.buffers.size();
+        stats.file_bytes = save_command_stream( m_path, m_stream );
+        m_stream = {};
+        return stats;
+    }
+
+    [[nodiscard]] const std::string & path() const noexcept { return m_path; }
+
+    private:
+    // The capture recording on this thread, if any.
+    static inline thread_local CommandCapture * s_active{ nullptr };
+
+    std::string                m_path;
+    std::uint64_t              m_frame;
+    std::mutex                 m_mutex;
+    CommandStream              m_stream;
+    bool                       m_finished{ false };
+    // First thing that couldn't be captured.
+    std::string                m_error;
+    // The tables begin() was given, and copies the shims forward to.
+    DeviceDispatch *           m_hooked_dispatch{ nullptr };
+    SynchronizationFunctions * m_hooked_sync{ nullptr };
+    DeviceDispatch             m_next;
+    SynchronizationFunctions   m_saved_sync;
+    PFN_vkCmdPipelineBarrier   m_next_barrier{ nullptr };
+    PFN_vkCmdPipelineBarrier2  m_next_barrier2{ nullptr };
+
+    std::unordered_map<VkFramebuffer, std::uint32_t>    m_framebuffers;
+    std::unordered_map<VkImage, std::uint32_t>          m_images;
+    std::unordered_map<VkPipeline, std::uint32_t>       m_pipelines;
+    std::unordered_map<VkPipelineLayout, std::uint32_t> m_layouts;
+    std::unordered_map<VkBuffer, std::uint32_t>         m_buffers;
+    std::unordered_map<VkImageView, std::uint32_t>      m_views;
+    std::unordered_map<VkDescriptorSet, std::uint32_t>  m_set_textures;
+
+    [[nodiscard]] std::uint32_t add_shader( const std::vector<char> & code ) {
+        m_stream.shaders.push_back( code );
+        return static_cast<std::uint32_t>( m_stream.shaders.size() - 1 );
+    }
+
+    void restore() noexcept {
+        if ( s_active != this ) {
+            return;
+        }
+        *m_hooked_dispatch = m_next;
+        *m_hooked_sync = m_saved_sync;
+        s_active = nullptr;
+    }
+
+    void fail( const std::string & what ) {
+        if ( m_error.empty() ) {
+            m_error = what;
+        }
+    }
+
+    // Index of `handle`, or nullopt with the failure noted. Needs m_mutex.
+    template <typename Handle>
+    [[nodiscard]] std::optional<std::uint32_t>
+    find( const std::unordered_map<Handle, std::uint32_t> & indices,
+          const Handle handle, const char * what ) {
+        if ( const auto it{ indices.find( handle ) }; it != indices.end() ) {
+            return it->second;
+        }
+        fail( std::string{ "unregistered " } + what );
+        return std::nullopt;
+    }
+
+    template <typename Record>
+    void log( const Record & record ) {
+        m_stream.commands.emplace_back( record );
+    }
+
+    void log_image_barrier( const VkImage image, const VkImageLayout old_layout,
+                            const VkImageLayout         new_layout,
+                            const VkPipelineStageFlags2 src_stages,
+                            const VkAccessFlags2        src_access,
+                            const VkPipelineStageFlags2 dst_stages,
+                            const VkAccessFlags2        dst_access ) {
+        const auto target{ find( m_images, image, "image in barrier" ) };
+        if ( !target ) {
+            return;
+        }
+        StreamImageBarrier record{};
+        record.target = *target;
+        record.old_layout = static_cast<std::uint32_t>( old_layout );
+        record.new_layout = static_cast<std::uint32_t>( new_layout );
+        record.src_stages = src_stages;
+        record.src_access = src_access;
+        record.dst_stages = dst_stages;
+        record.dst_access = dst_access;
+        log( record );
+    }
+
+    // Shims. Each logs under the lock and then forwards.
+
+    static VKAPI_ATTR void VKAPI_CALL update_descriptor_sets(
+        VkDevice device, uint32_t write_count,
+        const VkWriteDescriptorSet * writes, uint32_t copy_count,
+        const VkCopyDescriptorSet * copies ) {
+        auto & self{ *s_active };
+        {
+            std::lock_guard lock( self.m_mutex );
+            for ( uint32_t i{ 0 }; i < write_count; ++i ) {
+                const auto & write{ writes[i] };
+                if ( write.descriptorType
+                         != VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER
+                     || write.dstBinding != 0 || write.descriptorCount != 1 ) {
+                    self.fail( "unsupported descriptor write" );
+                    continue;
+                }
+                if ( const auto texture{ self.find(
+                         self.m_views, write.pImageInfo->imageView,
+                         "image view" ) } ) {
+                    self.m_set_textures[write.dstSet] = *texture;
+                }
+            }
+            if ( copy_count > 0 ) {
+                self.fail( "descriptor copies" );
+            }
+        }
+        self.m_next.update_descriptor_sets( device, write_count, writes,
+                                            copy_count, copies );
+    }
+
+    static VKAPI_ATTR void VKAPI_CALL
+    cmd_begin_render_pass( VkCommandBuffer               command_buffer,
+                           const VkRenderPassBeginInfo * info,
+                           VkSubpassContents             contents ) {
+        auto & self{ *s_active };
+        {
+            std::lock_guard lock( self.m_mutex );
+            if ( const auto target{ self.find(
+                     self.m_framebuffers, info->framebuffer,
+                     "framebuffer" ) } ) {
+                StreamBeginRenderPass record{};
+                record.target = *target;
+                if ( info->clearValueCount >= 2 ) {
+                    std::copy_n( info->pClearValues[0].color.float32, 4,
+                                 record.clear_color );
+                    record.clear_depth =
+                        info->pClearValues[1].depthStencil.depth;
+                    record.clear_stencil =
+                        info->pClearValues[1].depthStencil.stencil;
+                }
+                self.log( record );
+            }
+        }
+        self.m_next.cmd_begin_render_pass( command_buffer, info, contents );
+    }
+
+    static VKAPI_ATTR void VKAPI_CALL
+    cmd_end_render_pass( VkCommandBuffer command_buffer ) {
+        auto & self{ *s_active };
+        {
+            std::lock_guard lock( self.m_mutex );
+            self.log( StreamEndRenderPass{} );
+        }
+        self.m_next.cmd_end_render_pass( command_buffer );
+    }
+
+    static VKAPI_ATTR void VKAPI_CALL
+    cmd_bind_pipeline( VkCommandBuffer command_buffer,
+                       VkPipelineBindPoint bind_point, VkPipeline pipeline ) {
+        auto & self{ *s_active };
+        {
+            std::lock_guard lock( self.m_mutex );
+            if ( const auto index{ self.find( self.m_pipelines, pipeline,
+                                              "pipeline" ) } ) {
+                self.log( StreamBindPipeline{ *index } );
+            }
+        }
+        self.m_next.cmd_bind_pipeline( command_buffer, bind_point, pipeline );
+    }
+
+    static VKAPI_ATTR void VKAPI_CALL
+    cmd_set_viewport( VkCommandBuffer command_buffer, uint32_t first,
+                      uint32_t count, const VkViewport * viewports ) {
+        auto & self{ *s_active };
+        {
+            std::lock_guard lock( self.m_mutex );
+            if ( first != 0 || count != 1 ) {
+                self.fail( "multiple viewports" );
+            }
+            else {
+                const auto & v{ viewports[0] };
+                self.log( StreamSetViewport{ v.x, v.y, v.width, v.height,
+                                             v.minDepth, v.maxDepth } );
+            }
+        }
+        self.m_next.cmd_set_viewport( command_buffer, first, count,
+                                      viewports );
+    }
+
+    static VKAPI_ATTR void VKAPI_CALL
+    cmd_set_scissor( VkCommandBuffer command_buffer, uint32_t first,
+                     uint32_t count, const VkRect2D * scissors ) {
+        auto & self{ *s_active };
+        {
+            std::lock_guard lock( self.m_mutex );
+            if ( first != 0 || count != 1 ) {
+                self.fail( "multiple scissors" );
+            }
+            else {
+                const auto & s{ scissors[0] };
+                self.log( StreamSetScissor{ s.offset.x, s.offset.y,
+                                            s.extent.width,
+                                            s.extent.height } );
+            }
+        }
+        self.m_next.cmd_set_scissor( command_buffer, first, count, scissors );
+    }
+
+    static VKAPI_ATTR void VKAPI_CALL cmd_bind_vertex_buffers(
+        VkCommandBuffer command_buffer, uint32_t first, uint32_t count,
+        const VkBuffer * buffers, const VkDeviceSize * offsets ) {
+        auto & self{ *s_active };
+        {
+            std::lock_guard lock( self.m_mutex );
+            for ( uint32_t i{ 0 }; i < count; ++i ) {
+                if ( const auto index{ self.find( self.m_buffers, buffers[i],
+                                                  "vertex buffer" ) } ) {
+                    self.log( StreamBindVertexBuffer{ first + i, *index,
+                                                      offsets[i] } );
+                }
+            }
+        }
+        self.m_next.cmd_bind_vertex_buffers( command_buffer, first, count,
+                                             buffers, offsets );
+    }
+
+    static VKAPI_ATTR void VKAPI_CALL
+    cmd_bind_index_buffer( VkCommandBuffer command_buffer, VkBuffer buffer,
+                           VkDeviceSize offset, VkIndexType index_type ) {
+        auto & self{ *s_active };
+        {
+            std::lock_guard lock( self.m_mutex );
+            if ( const auto index{ self.find( self.m_buffers, buffer,
+                                              "index buffer" ) } ) {
+                self.log( StreamBindIndexBuffer{
+                    *index, static_cast<std::uint32_t>( index_type ),
+                    offset } );
+            }
+        }
+        self.m_next.cmd_bind_index_buffer( command_buffer, buffer, offset,
+                                           index_type );
+    }
+
+    static VKAPI_ATTR void VKAPI_CALL cmd_bind_descriptor_sets(
+        VkCommandBuffer command_buffer, VkPipelineBindPoint bind_point,
+        VkPipelineLayout layout, uint32_t first_set, uint32_t set_count,
+        const VkDescriptorSet * sets, uint32_t dynamic_offset_count,
+        const uint32_t * dynamic_offsets ) {
+        auto & self{ *s_active };
+        {
+            std::lock_guard lock( self.m_mutex );
+            if ( first_set != 0 || set_count != 1
+                 || dynamic_offset_count != 0 ) {
+                self.fail( "unsupported descriptor set binding" );
+            }
+            else {
+                const auto pipeline{ self.find( self.m_layouts, layout,
+                                                "pipeline layout" ) };
+                const auto texture{ self.find( self.m_set_textures, sets[0],
+                                               "descriptor set" ) };
+                if ( pipeline && texture ) {
+                    self.log( StreamBindTexture{ *pipeline, *texture } );
+                }
+            }
+        }
+        self.m_next.cmd_bind_descriptor_sets(
+            command_buffer, bind_point, layout, first_set, set_count, sets,
+            dynamic_offset_count, dynamic_offsets );
+    }
+
+    static VKAPI_ATTR void VKAPI_CALL
+    cmd_push_constants( VkCommandBuffer command_buffer, VkPipelineLayout layout,
+                        VkShaderStageFlags stages, uint32_t offset,
+                        uint32_t size, const void * values ) {
+        auto & self{ *s_active };
+        {
+            std::lock_guard lock( self.m_mutex );
+            const auto pipeline{ self.find( self.m_layouts, layout,
+                                            "pipeline layout" ) };
+            if ( size > StreamPushConstants::MAX_SIZE
+                 || offset > StreamPushConstants::MAX_SIZE - size ) {
+                self.fail( "push constant range too large" );
+            }
+            else if ( pipeline ) {
+                StreamPushConstants record{};
+                record.pipeline = *pipeline;
+                record.stages = stages;
+                record.offset = offset;
+                record.size = size;
+                std::memcpy( record.data, values, size );
+                self.log( record );
+            }
+        }
+        self.m_next.cmd_push_constants( command_buffer, layout, stages, offset,
+                                        size, values );
+    }
+
+    static VKAPI_ATTR void VKAPI_CALL
+    cmd_draw( VkCommandBuffer command_buffer, uint32_t vertex_count,
+              uint32_t instance_count, uint32_t first_vertex,
+              uint32_t first_instance ) {
+        auto & self{ *s_active };
+        {
+            std::lock_guard lock( self.m_mutex );
+            self.log( StreamDraw{ vertex_count, instance_count, first_vertex,
+                                  first_instance } );
+        }
+        self.m_next.cmd_draw( command_buffer, vertex_count, instance_count,
+                              first_vertex, first_instance );
+    }
+
+    static VKAPI_ATTR void VKAPI_CALL
+    cmd_draw_indexed( VkCommandBuffer command_buffer, uint32_t index_count,
+                      uint32_t instance_count, uint32_t first_index,
+                      int32_t vertex_offset, uint32_t first_instance ) {
+        auto & self{ *s_active };
+        {
+            std::lock_guard lock( self.m_mutex );
+            self.log( StreamDrawIndexed{ index_count, instance_count,
+                                         first_index, vertex_offset,
+                                         first_instance } );
+        }
+        self.m_next.cmd_draw_indexed( command_buffer, index_count,
+                                      instance_count, first_index,
+                                      vertex_offset, first_instance );
+    }
+
+    // Legacy stage and access bits have the same values in the 2 flags.
+    static VKAPI_ATTR void VKAPI_CALL cmd_pipeline_barrier(
+        VkCommandBuffer command_buffer, VkPipelineStageFlags src_stages,
+        VkPipelineStageFlags dst_stages, VkDependencyFlags flags,
+        uint32_t memory_count, const VkMemoryBarrier * memory_barriers,
+        uint32_t buffer_count, const VkBufferMemoryBarrier * buffer_barriers,
+        uint32_t image_count, const VkImageMemoryBarrier * image_barriers ) {
+        auto & self{ *s_active };
+        {
+            std::lock_guard lock( self.m_mutex );
+            for ( uint32_t i{ 0 }; i < memory_count; ++i ) {
+                self.log( StreamMemoryBarrier{
+                    src_stages, memory_barriers[i].srcAccessMask, dst_stages,
+                    memory_barriers[i].dstAccessMask } );
+            }
+            for ( uint32_t i{ 0 }; i < buffer_count; ++i ) {
+                self.log( StreamMemoryBarrier{
+                    src_stages, buffer_barriers[i].srcAccessMask, dst_stages,
+                    buffer_barriers[i].dstAccessMask } );
+            }
+            for ( uint32_t i{ 0 }; i < image_count; ++i ) {
+                const auto & barrier{ image_barriers[i] };
+                self.log_image_barrier(
+                    barrier.image, barrier.oldLayout, barrier.newLayout,
+                    src_stages, barrier.srcAccessMask, dst_stages,
+                    barrier.dstAccessMask );
+            }
+            self.log( StreamBarrierFlush{} );
+        }
+        self.m_next_barrier( command_buffer, src_stages, dst_stages, flags,
+                             memory_count, memory_barriers, buffer_count,
+                             buffer_barriers, image_count, image_barriers );
+    }
+
+    static VKAPI_ATTR void VKAPI_CALL
+    cmd_pipeline_barrier2( VkCommandBuffer          command_buffer,
+                           const VkDependencyInfo * dependency ) {
+        auto & self{ *s_active };
+        {
+            std::lock_guard lock( self.m_mutex );
+            for ( uint32_t i{ 0 }; i < dependency->memoryBarrierCount; ++i ) {
+                const auto & barrier{ dependency->pMemoryBarriers[i] };
+                self.log( StreamMemoryBarrier{
+                    barrier.srcStageMask, barrier.srcAccessMask,
+                    barrier.dstStageMask, barrier.dstAccessMask } );
+            }
+            for ( uint32_t i{ 0 }; i < dependency->bufferMemoryBarrierCount;
+                  ++i ) {
+                const auto & barrier{ dependency->pBufferMemoryBarriers[i] };
+                self.log( StreamMemoryBarrier{
+                    barrier.srcStageMask, barrier.srcAccessMask,
+                    barrier.dstStageMask, barrier.dstAccessMask } );
+            }
+            for ( uint32_t i{ 0 }; i < dependency->imageMemoryBarrierCount;
+                  ++i ) {
+                const auto & barrier{ dependency->pImageMemoryBarriers[i] };
+                self.log_image_barrier(
+                    barrier.image, barrier.oldLayout, barrier.newLayout,
+                    barrier.srcStageMask, barrier.srcAccessMask,
+                    barrier.dstStageMask, barrier.dstAccessMask );
+            }
+            self.log( StreamBarrierFlush{} );
+        }
+        self.m_next_barrier2( command_buffer, dependency );
+    }
+};
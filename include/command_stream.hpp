@@ -0,0 +1,603 @@
+#pragma once
+
+#include "mapped_file.hpp"
+#include "vk_handle.hpp"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <initializer_list>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <variant>
+#include <vector>
+
+// On-disk layout of captured frames (.vcmd), written by hello_triangle's
+// --capture-stream and replayed by vk_replay. Little-endian:
+//
+//   CommandStreamHeader
+//   { StreamRecordHeader, payload[size] } * record_count
+//
+// Resource records come first and are numbered per kind in file order;
+// commands refer to them by that index. Payloads are the POD structs below,
+// except for shaders (SPIR-V words) and buffers (StreamBufferInfo followed
+// by the contents).
+//
+// Only what replay needs to reproduce the GPU work is kept: handles become
+// indices, swapchain images and framebuffers become "targets", and textures
+// keep their shape but not their texels.
+
+constexpr std::array<char, 4> COMMAND_STREAM_MAGIC{ 'V', 'C', 'M', 'D' };
+constexpr std::uint32_t       COMMAND_STREAM_VERSION{ 1 };
+
+struct CommandStreamHeader
+{
+    std::array<char, 4> magic{ COMMAND_STREAM_MAGIC };
+    std::uint32_t       version{ COMMAND_STREAM_VERSION };
+    // Attachment formats shared by every target.
+    std::uint32_t color_format{ 0 };
+    std::uint32_t depth_format{ 0 };
+    std::uint32_t record_count{ 0 };
+    std::uint32_t reserved{ 0 };
+};
+static_assert( sizeof( CommandStreamHeader ) == 24 );
+
+enum class StreamRecordType : std::uint32_t
+{
+    target = 1,
+    shader,
+    buffer,
+    texture,
+    pipeline,
+    begin_render_pass = 16,
+    end_render_pass,
+    bind_pipeline,
+    set_viewport,
+    set_scissor,
+    bind_vertex_buffer,
+    bind_index_buffer,
+    bind_texture,
+    push_constants,
+    draw,
+    draw_indexed,
+    image_barrier,
+    memory_barrier,
+    barrier_flush,
+};
+
+struct StreamRecordHeader
+{
+    StreamRecordType type{};
+    // Payload bytes following this header.
+    std::uint32_t size{ 0 };
+};
+static_assert( sizeof( StreamRecordHeader ) == 8 );
+
+// Resources
+
+// A color + depth framebuffer; one per window in the capturing app.
+struct StreamTarget
+{
+    static constexpr auto type{ StreamRecordType::target };
+    std::uint32_t         width{ 0 };
+    std::uint32_t         height{ 0 };
+};
+
+struct StreamBufferInfo
+{
+    std::uint32_t usage{ 0 };
+    std::uint32_t reserved{ 0 };
+    std::uint64_t size{ 0 };
+};
+static_assert( sizeof( StreamBufferInfo ) == 16 );
+
+// Sampled image; replay gives it undefined contents.
+struct StreamTexture
+{
+    static constexpr auto type{ StreamRecordType::texture };
+    std::uint32_t         format{ 0 };
+    std::uint32_t         width{ 0 };
+    std::uint32_t         height{ 0 };
+    std::uint32_t         levels{ 0 };
+};
+
+enum StreamPipelineFlags : std::uint32_t
+{
+    STREAM_PIPELINE_MESH_VERTICES = 1u << 0,
+    STREAM_PIPELINE_DEPTH_TEST = 1u << 1,
+    // One combined image sampler at set 0, binding 0.
+    STREAM_PIPELINE_TEXTURED = 1u << 2,
+};
+
+struct StreamPipeline
+{
+    static constexpr auto type{ StreamRecordType::pipeline };
+    std::uint32_t         vertex_shader{ 0 };
+    std::uint32_t         fragment_shader{ 0 };
+    // Vertex stage push constants, 0 for none.
+    std::uint32_t push_constant_size{ 0 };
+    std::uint32_t front_face{ 0 };
+    std::uint32_t flags{ 0 };
+};
+
+// Commands
+
+struct StreamBeginRenderPass
+{
+    static constexpr auto type{ StreamRecordType::begin_render_pass };
+    std::uint32_t         target{ 0 };
+    float                 clear_color[4]{};
+    float                 clear_depth{ 1.0f };
+    std::uint32_t         clear_stencil{ 0 };
+};
+
+struct StreamEndRenderPass
+{
+    static constexpr auto type{ StreamRecordType::end_render_pass };
+    std::uint32_t         reserved{ 0 };
+};
+
+struct StreamBindPipeline
+{
+    static constexpr auto type{ StreamRecordType::bind_pipeline };
+    std::uint32_t         pipeline{ 0 };
+};
+
+struct StreamSetViewport
+{
+    static constexpr auto type{ StreamRecordType::set_viewport };
+    float                 x{ 0.0f };
+    float                 y{ 0.0f };
+    float                 width{ 0.0f };
+    float                 height{ 0.0f };
+    float                 min_depth{ 0.0f };
+    float                 max_depth{ 1.0f };
+};
+
+struct StreamSetScissor
+{
+    static constexpr auto type{ StreamRecordType::set_scissor };
+    std::int32_t          x{ 0 };
+    std::int32_t          y{ 0 };
+    std::uint32_t         width{ 0 };
+    std::uint32_t         height{ 0 };
+};
+
+struct StreamBindVertexBuffer
+{
+    static constexpr auto type{ StreamRecordType::bind_vertex_buffer };
+    std::uint32_t         binding{ 0 };
+    std::uint32_t         buffer{ 0 };
+    std::uint64_t         offset{ 0 };
+};
+
+struct StreamBindIndexBuffer
+{
+    static constexpr auto type{ StreamRecordType::bind_index_buffer };
+    std::uint32_t         buffer{ 0 };
+    std::uint32_t         index_type{ 0 };
+    std::uint64_t         offset{ 0 };
+};
+
+// `pipeline` only picks the layout the set is bound with.
+struct StreamBindTexture
+{
+    static constexpr auto type{ StreamRecordType::bind_texture };
+    std::uint32_t         pipeline{ 0 };
+    std::uint32_t         texture{ 0 };
+};
+
+struct StreamPushConstants
+{
+    static constexpr auto type{ StreamRecordType::push_constants };
+    // The guaranteed minimum of maxPushConstantsSize.
+    static constexpr std::uint32_t MAX_SIZE{ 128 };
+
+    std::uint32_t pipeline{ 0 };
+    std::uint32_t stages{ 0 };
+    std::uint32_t offset{ 0 };
+    std::uint32_t size{ 0 };
+    std::uint8_t  data[MAX_SIZE]{};
+};
+
+struct StreamDraw
+{
+    static constexpr auto type{ StreamRecordType::draw };
+    std::uint32_t         vertex_count{ 0 };
+    std::uint32_t         instance_count{ 0 };
+    std::uint32_t         first_vertex{ 0 };
+    std::uint32_t         first_instance{ 0 };
+};
+
+struct StreamDrawIndexed
+{
+    static constexpr auto type{ StreamRecordType::draw_indexed };
+    std::uint32_t         index_count{ 0 };
+    std::uint32_t         instance_count{ 0 };
+    std::uint32_t         first_index{ 0 };
+    std::int32_t          vertex_offset{ 0 };
+    std::uint32_t         first_instance{ 0 };
+};
+
+// Barriers keep their synchronization2 masks whichever path recorded them.
+// Barrier records up to the next flush went out as one call.
+struct StreamImageBarrier
+{
+    static constexpr auto type{ StreamRecordType::image_barrier };
+    std::uint32_t         target{ 0 };
+    std::uint32_t         old_layout{ 0 };
+    std::uint32_t         new_layout{ 0 };
+    std::uint32_t         reserved{ 0 };
+    std::uint64_t         src_stages{ 0 };
+    std::uint64_t         src_access{ 0 };
+    std::uint64_t         dst_stages{ 0 };
+    std::uint64_t         dst_access{ 0 };
+};
+
+// Buffer barriers are widened to memory barriers.
+struct StreamMemoryBarrier
+{
+    static constexpr auto type{ StreamRecordType::memory_barrier };
+    std::uint64_t         src_stages{ 0 };
+    std::uint64_t         src_access{ 0 };
+    std::uint64_t         dst_stages{ 0 };
+    std::uint64_t         dst_access{ 0 };
+};
+
+struct StreamBarrierFlush
+{
+    static constexpr auto type{ StreamRecordType::barrier_flush };
+    std::uint32_t         reserved{ 0 };
+};
+
+using StreamCommand =
+    std::variant<StreamBeginRenderPass, StreamEndRenderPass,
+                 StreamBindPipeline, StreamSetViewport, StreamSetScissor,
+                 StreamBindVertexBuffer, StreamBindIndexBuffer,
+                 StreamBindTexture, StreamPushConstants, StreamDraw,
+                 StreamDrawIndexed, StreamImageBarrier, StreamMemoryBarrier,
+                 StreamBarrierFlush>;
+
+struct StreamBuffer
+{
+    VkBufferUsageFlags        usage{ 0 };
+    std::vector<std::uint8_t> contents;
+};
+
+// A whole capture in memory.
+struct CommandStream
+{
+    VkFormat                       color_format{ VK_FORMAT_UNDEFINED };
+    VkFormat                       depth_format{ VK_FORMAT_UNDEFINED };
+    std::vector<StreamTarget>      targets;
+    std::vector<std::vector<char>> shaders;
+    std::vector<StreamBuffer>      buffers;
+    std::vector<StreamTexture>     textures;
+    std::vector<StreamPipeline>    pipelines;
+    std::vector<StreamCommand>     commands;
+
+    [[nodiscard]] std::size_t draw_count() const noexcept {
+        std::size_t count{ 0 };
+        for ( const auto & command : commands ) {
+            count += std::holds_alternative<StreamDraw>( command )
+                     || std::holds_alternative<StreamDrawIndexed>( command );
+        }
+        return count;
+    }
+};
+
+namespace command_stream_detail
+{
+inline void
+write_record( std::ofstream & file, const StreamRecordType type,
+              const void * head, const std::size_t head_size,
+              const void * tail = nullptr, const std::size_t tail_size = 0 ) {
+    const StreamRecordHeader header{
+        type, static_cast<std::uint32_t>( head_size + tail_size ) };
+    file.write( reinterpret_cast<const char *>( &header ), sizeof( header ) );
+    file.write( static_cast<const char *>( head ),
+                static_cast<std::streamsize>( head_size ) );
+    if ( tail_size > 0 ) {
+        file.write( static_cast<const char *>( tail ),
+                    static_cast<std::streamsize>( tail_size ) );
+    }
+}
+
+template <typename Record>
+void
+write_record( std::ofstream & file, const Record & record ) {
+    static_assert( std::is_trivially_copyable_v<Record> );
+    write_record( file, Record::type, &record, sizeof( record ) );
+}
+
+template <typename Record>
+[[nodiscard]] Record
+read_record( const std::uint8_t * payload, const std::uint32_t size ) {
+    if ( size != sizeof( Record ) ) {
+        throw std::runtime_error( "Malformed command stream record." );
+    }
+    Record record{};
+    std::memcpy( &record, payload, sizeof( record ) );
+    return record;
+}
+
+inline void
+check_index( const std::uint32_t index, const std::size_t count,
+             const char * what ) {
+    if ( index >= count ) {
+        throw std::runtime_error( std::string{ "Command stream refers to a "
+                                               "missing " }
+                                  + what + "." );
+    }
+}
+
+template <typename Enum>
+void
+check_enum( const std::uint32_t value, const std::initializer_list<Enum> known,
+            const char * what ) {
+    for ( const Enum candidate : known ) {
+        if ( value == static_cast<std::uint32_t>( candidate ) ) {
+            return;
+        }
+    }
+    throw std::runtime_error( std::string{ "Command stream has an unknown " }
+                              + what + "." );
+}
+
+// What replay can recreate on an offscreen target; PRESENT_SRC is mapped to
+// TRANSFER_SRC there.
+inline void
+check_layout( const std::uint32_t layout ) {
+    check_enum( layout,
+                { VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL,
+                  VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+                  VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+                  VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL,
+                  VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                  VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                  VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                  VK_IMAGE_LAYOUT_PREINITIALIZED,
+                  VK_IMAGE_LAYOUT_PRESENT_SRC_KHR },
+                "image layout" );
+}
+
+// The formats TextureStreamer can upload (see ktx2.hpp), so a captured
+// texture always has one of them.
+inline void
+check_texture( const StreamTexture & texture ) {
+    check_enum( texture.format,
+                { VK_FORMAT_R8_UNORM, VK_FORMAT_R8G8_UNORM,
+                  VK_FORMAT_R8G8B8A8_UNORM, VK_FORMAT_R8G8B8A8_SRGB,
+                  VK_FORMAT_R8G8B8A8_SNORM, VK_FORMAT_B8G8R8A8_UNORM,
+                  VK_FORMAT_B8G8R8A8_SRGB, VK_FORMAT_R16G16B16A16_SFLOAT,
+                  VK_FORMAT_R32G32B32A32_SFLOAT,
+                  VK_FORMAT_BC1_RGB_UNORM_BLOCK, VK_FORMAT_BC1_RGB_SRGB_BLOCK,
+                  VK_FORMAT_BC1_RGBA_UNORM_BLOCK,
+                  VK_FORMAT_BC1_RGBA_SRGB_BLOCK, VK_FORMAT_BC2_UNORM_BLOCK,
+                  VK_FORMAT_BC2_SRGB_BLOCK, VK_FORMAT_BC3_UNORM_BLOCK,
+                  VK_FORMAT_BC3_SRGB_BLOCK, VK_FORMAT_BC4_UNORM_BLOCK,
+                  VK_FORMAT_BC4_SNORM_BLOCK, VK_FORMAT_BC5_UNORM_BLOCK,
+                  VK_FORMAT_BC5_SNORM_BLOCK, VK_FORMAT_BC6H_UFLOAT_BLOCK,
+                  VK_FORMAT_BC6H_SFLOAT_BLOCK, VK_FORMAT_BC7_UNORM_BLOCK,
+                  VK_FORMAT_BC7_SRGB_BLOCK },
+                "texture format" );
+
+    // At least one level and no more than the full mip chain.
+    const std::uint32_t largest{ std::max( texture.width, texture.height ) };
+    if ( texture.width == 0 || texture.height == 0 || texture.levels == 0
+         || texture.levels > std::bit_width( largest ) ) {
+        throw std::runtime_error( "Command stream has a texture with a bad "
+                                  "size or level count." );
+    }
+}
+} // namespace command_stream_detail
+
+// Returns the bytes written.
+inline std::uint64_t
+save_command_stream( const std::string & path, const CommandStream & stream ) {
+    using command_stream_detail::write_record;
+
+    std::ofstream file( path, std::ios::binary | std::ios::trunc );
+    if ( !file.is_open() ) {
+        throw std::runtime_error( "Couldn't open file: " + path );
+    }
+
+    CommandStreamHeader header{};
+    header.color_format = static_cast<std::uint32_t>( stream.color_format );
+    header.depth_format = static_cast<std::uint32_t>( stream.depth_format );
+    header.record_count = static_cast<std::uint32_t>(
+        stream.targets.size() + stream.shaders.size() + stream.buffers.size()
+        + stream.textures.size() + stream.pipelines.size()
+        + stream.commands.size() );
+    file.write( reinterpret_cast<const char *>( &header ), sizeof( header ) );
+
+    for ( const auto & target : stream.targets ) {
+        write_record( file, target );
+    }
+    for ( const auto & code : stream.shaders ) {
+        write_record( file, StreamRecordType::shader, code.data(),
+                      code.size() );
+    }
+    for ( const auto & buffer : stream.buffers ) {
+        const StreamBufferInfo info{ buffer.usage, 0,
+                                     buffer.contents.size() };
+        write_record( file, StreamRecordType::buffer, &info, sizeof( info ),
+                      buffer.contents.data(), buffer.contents.size() );
+    }
+    for ( const auto & texture : stream.textures ) {
+        write_record( file, texture );
+    }
+    for ( const auto & pipeline : stream.pipelines ) {
+        write_record( file, pipeline );
+    }
+    for ( const auto & command : stream.commands ) {
+        std::visit(
+            [&file]( const auto & record ) { write_record( file, record ); },
+            command );
+    }
+
+    if ( !file ) {
+        throw std::runtime_error( "Failed to write command stream: " + path );
+    }
+    return static_cast<std::uint64_t>( file.tellp() );
+}
+
+// Throws on anything malformed, including commands that refer to resources
+// the file doesn't define or carry enum values replay doesn't know.
+[[nodiscard]] inline CommandStream
+load_command_stream( const std::string & path ) {
+    using namespace command_stream_detail;
+
+    const MappedFile file( path );
+    if ( file.size() < sizeof( CommandStreamHeader ) ) {
+        throw std::runtime_error( "Command stream too small: " + path );
+    }
+    CommandStreamHeader header{};
+    std::memcpy( &header, file.data(), sizeof( header ) );
+    if ( header.magic != COMMAND_STREAM_MAGIC
+         || header.version != COMMAND_STREAM_VERSION ) {
+        throw std::runtime_error( "Not a supported .vcmd file: " + path );
+    }
+
+    CommandStream stream{};
+    stream.color_format = static_cast<VkFormat>( header.color_format );
+    stream.depth_format = static_cast<VkFormat>( header.depth_format );
+
+    std::size_t offset{ sizeof( header ) };
+    for ( std::uint32_t i{ 0 }; i < header.record_count; ++i ) {
+        StreamRecordHeader record{};
+        if ( file.size() - offset < sizeof( record ) ) {
+            throw std::runtime_error( "Truncated command stream: " + path );
+        }
+        std::memcpy( &record, file.data() + offset, sizeof( record ) );
+        offset += sizeof( record );
+        if ( file.size() - offset < record.size ) {
+            throw std::runtime_error( "Truncated command stream: " + path );
+        }
+        const std::uint8_t * payload{ file.data() + offset };
+        offset += record.size;
+
+        switch ( record.type ) {
+        case StreamRecordType::target:
+            stream.targets.push_back(
+                read_record<StreamTarget>( payload, record.size ) );
+            break;
+        case StreamRecordType::shader:
+            if ( record.size == 0 || record.size % 4 != 0 ) {
+                throw std::runtime_error( "Malformed shader in " + path );
+            }
+            stream.shaders.emplace_back( payload, payload + record.size );
+            break;
+        case StreamRecordType::buffer: {
+            if ( record.size < sizeof( StreamBufferInfo ) ) {
+                throw std::runtime_error( "Malformed buffer in " + path );
+            }
+            StreamBufferInfo info{};
+            std::memcpy( &info, payload, sizeof( info ) );
+            if ( info.size != record.size - sizeof( info ) ) {
+                throw std::runtime_error( "Malformed buffer in " + path );
+            }
+            auto & buffer{ stream.buffers.emplace_back() };
+            buffer.usage = info.usage;
+            buffer.contents.assign( payload + sizeof( info ),
+                                    payload + record.size );
+            break;
+        }
+        case StreamRecordType::texture:
+            stream.textures.push_back(
+                read_record<StreamTexture>( payload, record.size ) );
+            break;
+        case StreamRecordType::pipeline:
+            stream.pipelines.push_back(
+                read_record<StreamPipeline>( payload, record.size ) );
+            break;
+#define COMMAND_STREAM_READ( Record )                                         \
+    case Record::type:                                                       \
+        stream.commands.emplace_back(                                        \
+            read_record<Record>( payload, record.size ) );                   \
+        break;
+            COMMAND_STREAM_READ( StreamBeginRenderPass )
+            COMMAND_STREAM_READ( StreamEndRenderPass )
+            COMMAND_STREAM_READ( StreamBindPipeline )
+            COMMAND_STREAM_READ( StreamSetViewport )
+            COMMAND_STREAM_READ( StreamSetScissor )
+            COMMAND_STREAM_READ( StreamBindVertexBuffer )
+            COMMAND_STREAM_READ( StreamBindIndexBuffer )
+            COMMAND_STREAM_READ( StreamBindTexture )
+            COMMAND_STREAM_READ( StreamPushConstants )
+            COMMAND_STREAM_READ( StreamDraw )
+            COMMAND_STREAM_READ( StreamDrawIndexed )
+            COMMAND_STREAM_READ( StreamImageBarrier )
+            COMMAND_STREAM_READ( StreamMemoryBarrier )
+            COMMAND_STREAM_READ( StreamBarrierFlush )
+#undef COMMAND_STREAM_READ
+        default:
+            throw std::runtime_error( "Unknown record type in " + path );
+        }
+    }
+
+    // Resolve every index and enum once here so replay can use them
+    // unchecked.
+    for ( const auto & texture : stream.textures ) {
+        check_texture( texture );
+    }
+    for ( const auto & pipeline : stream.pipelines ) {
+        check_index( pipeline.vertex_shader, stream.shaders.size(),
+                     "shader" );
+        check_index( pipeline.fragment_shader, stream.shaders.size(),
+                     "shader" );
+        check_enum(
+            pipeline.front_face,
+            { VK_FRONT_FACE_COUNTER_CLOCKWISE, VK_FRONT_FACE_CLOCKWISE },
+            "front face" );
+        if ( pipeline.push_constant_size > StreamPushConstants::MAX_SIZE ) {
+            throw std::runtime_error( "Push constant range too large in "
+                                      + path );
+        }
+    }
+    for ( const auto & command : stream.commands ) {
+        std::visit(
+            [&stream]( const auto & record ) {
+                if constexpr ( requires { record.target; } ) {
+                    check_index( record.target, stream.targets.size(),
+                                 "target" );
+                }
+                if constexpr ( requires { record.pipeline; } ) {
+                    check_index( record.pipeline, stream.pipelines.size(),
+                                 "pipeline" );
+                }
+                if constexpr ( requires { record.buffer; } ) {
+                    check_index( record.buffer, stream.buffers.size(),
+                                 "buffer" );
+                }
+                if constexpr ( requires { record.texture; } ) {
+                    check_index( record.texture, stream.textures.size(),
+                                 "texture" );
+                }
+                if constexpr ( requires { record.index_type; } ) {
+                    check_enum( record.index_type,
+                                { VK_INDEX_TYPE_UINT16, VK_INDEX_TYPE_UINT32 },
+                                "index type" );
+                }
+                if constexpr ( requires { record.new_layout; } ) {
+                    check_layout( record.old_layout );
+                    check_layout( record.new_layout );
+                }
+                if constexpr ( requires { record.data; } ) {
+                    if ( record.size > StreamPushConstants::MAX_SIZE
+                         || record.offset > StreamPushConstants::MAX_SIZE
+                                                - record.size ) {
+                        throw std::runtime_error(
+                            "Malformed push constants." );
+                    }
+                }
+            },
+            command );
+    }
+    return stream;
+}
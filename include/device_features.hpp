@@ -0,0 +1,214 @@
+#pragma once
+
+#include "vk_handle.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Feature negotiation through the VkPhysicalDeviceFeatures2 pNext chain.
+//
+// The 1.1 / 1.2 / 1.3 aggregate structs are only chained where both the
+// instance and the device speak that version, and every requested feature
+// is dropped quietly when unsupported, so callers check the negotiated
+// flags rather than assuming what they asked for. A 1.2 device can still
+// get synchronization2 through VK_KHR_synchronization2.
+
+// Highest instance version the loader offers, capped at `wanted`.
+[[nodiscard]] inline std::uint32_t
+negotiate_instance_api_version(
+    const std::uint32_t wanted = VK_API_VERSION_1_3 ) {
+    // Missing from 1.0 loaders, which also reject any apiVersion above 1.0.
+    const auto enumerate_version =
+        reinterpret_cast<PFN_vkEnumerateInstanceVersion>(
+            vkGetInstanceProcAddr( nullptr, "vkEnumerateInstanceVersion" ) );
+    std::uint32_t version{ VK_API_VERSION_1_0 };
+    if ( enumerate_version == nullptr
+         || enumerate_version( &version ) != VK_SUCCESS ) {
+        version = VK_API_VERSION_1_0;
+    }
+    return std::min( version, wanted );
+}
+
+// One set of feature structs linked behind `core`. The links point into the
+// object itself, so it stays where it was built.
+struct DeviceFeatureChain
+{
+    VkPhysicalDeviceFeatures2                   core{};
+    VkPhysicalDeviceVulkan11Features            vulkan11{};
+    VkPhysicalDeviceVulkan12Features            vulkan12{};
+    VkPhysicalDeviceVulkan13Features            vulkan13{};
+    VkPhysicalDeviceSynchronization2FeaturesKHR synchronization2{};
+
+    DeviceFeatureChain( const std::uint32_t api_version,
+                        const bool          synchronization2_extension ) {
+        core.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+        void ** next{ &core.pNext };
+        const auto link = [&next]( auto &                features,
+                                   const VkStructureType type ) {
+            features.sType = type;
+            *next = &features;
+            next = &features.pNext;
+        };
+        // The aggregate structs arrived with 1.2, even the 1.1 one.
+        if ( api_version >= VK_API_VERSION_1_2 ) {
+            link( vulkan11,
+                  VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_1_FEATURES );
+            link( vulkan12,
+                  VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES );
+        }
+        if ( api_version >= VK_API_VERSION_1_3 ) {
+            link( vulkan13,
+                  VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES );
+        }
+        else if ( synchronization2_extension ) {
+            link( synchronization2,
+                  VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SYNCHRONIZATION_2_FEATURES );
+        }
+    }
+
+    DeviceFeatureChain( const DeviceFeatureChain & ) = delete;
+    DeviceFeatureChain & operator=( const DeviceFeatureChain & ) = delete;
+};
+
+struct DeviceFeatureRequest
+{
+    // Core features to turn on where supported.
+    VkPhysicalDeviceFeatures core{};
+    bool                     timeline_semaphore{ false };
+    bool                     synchronization2{ false };
+};
+
+struct NegotiatedDeviceFeatures
+{
+    // min( instance, device ); what the device may be used as.
+    std::uint32_t            api_version{ VK_API_VERSION_1_0 };
+    VkPhysicalDeviceFeatures core{};
+    bool                     timeline_semaphore{ false };
+    bool                     synchronization2{ false };
+    // Set when synchronization2 comes from the KHR extension, whose entry
+    // points carry the KHR suffix.
+    bool                     synchronization2_extension{ false };
+    // Device extensions the negotiated features need, on top of the app's.
+    std::vector<const char *> extensions;
+    // Null below 1.1, where the chain can't be expressed.
+    std::unique_ptr<DeviceFeatureChain> chain;
+
+    // Fills the feature part of a VkDeviceCreateInfo. With a chain the core
+    // features travel inside it and pEnabledFeatures has to stay null.
+    void apply( VkDeviceCreateInfo & create_info ) const noexcept {
+        if ( chain ) {
+            create_info.pNext = &chain->core;
+            create_info.pEnabledFeatures = nullptr;
+        }
+        else {
+            create_info.pEnabledFeatures = &core;
+        }
+    }
+};
+
+[[nodiscard]] inline bool
+has_device_extension( const VkPhysicalDevice physical_device,
+                      const std::string_view name ) {
+    std::uint32_t count{ 0 };
+    vkEnumerateDeviceExtensionProperties( physical_device, nullptr, &count,
+                                          nullptr );
+    std::vector<VkExtensionProperties> extensions( count );
+    vkEnumerateDeviceExtensionProperties( physical_device, nullptr, &count,
+                                          extensions.data() );
+    return std::any_of( extensions.begin(), extensions.end(),
+                        [name]( const VkExtensionProperties & extension ) {
+                            return name == extension.extensionName;
+                        } );
+}
+
+[[nodiscard]] inline NegotiatedDeviceFeatures
+negotiate_device_features( const VkPhysicalDevice     physical_device,
+                           const std::uint32_t        instance_api_version,
+                           const DeviceFeatureRequest & request ) {
+    VkPhysicalDeviceProperties properties{};
+    vkGetPhysicalDeviceProperties( physical_device, &properties );
+
+    NegotiatedDeviceFeatures negotiated{};
+    negotiated.api_version =
+        std::min( instance_api_version, properties.apiVersion );
+    const std::uint32_t api{ negotiated.api_version };
+
+    const bool synchronization2_extension{
+        request.synchronization2 && api >= VK_API_VERSION_1_2
+        && api < VK_API_VERSION_1_3
+        && has_device_extension( physical_device,
+                                 VK_KHR_SYNCHRONIZATION_2_EXTENSION_NAME )
+    };
+
+    // vkGetPhysicalDeviceFeatures2 is core from 1.1; below that only the
+    // plain struct can be queried.
+    VkPhysicalDeviceFeatures supported_core{};
+    std::unique_ptr<DeviceFeatureChain> supported;
+    if ( api >= VK_API_VERSION_1_1 ) {
+        supported = std::make_unique<DeviceFeatureChain>(
+            api, synchronization2_extension );
+        vkGetPhysicalDeviceFeatures2( physical_device, &supported->core );
+        supported_core = supported->core.features;
+        negotiated.chain = std::make_unique<DeviceFeatureChain>(
+            api, synchronization2_extension );
+    }
+    else {
+        vkGetPhysicalDeviceFeatures( physical_device, &supported_core );
+    }
+
+    // VkPhysicalDeviceFeatures is nothing but VkBool32s.
+    static_assert( sizeof( VkPhysicalDeviceFeatures ) % sizeof( VkBool32 )
+                   == 0 );
+    constexpr std::size_t core_count{ sizeof( VkPhysicalDeviceFeatures )
+                                      / sizeof( VkBool32 ) };
+    VkBool32 wanted[core_count];
+    VkBool32 available[core_count];
+    std::memcpy( wanted, &request.core, sizeof( wanted ) );
+    std::memcpy( available, &supported_core, sizeof( available ) );
+    for ( std::size_t i{ 0 }; i < core_count; ++i ) {
+        wanted[i] = wanted[i] == VK_TRUE && available[i] == VK_TRUE
+                        ? VK_TRUE
+                        : VK_FALSE;
+    }
+    std::memcpy( &negotiated.core, wanted, sizeof( wanted ) );
+
+    if ( !negotiated.chain ) {
+        return negotiated;
+    }
+    auto & enabled{ *negotiated.chain };
+    enabled.core.features = negotiated.core;
+
+    if ( request.timeline_semaphore && api >= VK_API_VERSION_1_2
+         && supported->vulkan12.timelineSemaphore == VK_TRUE ) {
+        enabled.vulkan12.timelineSemaphore = VK_TRUE;
+        negotiated.timeline_semaphore = true;
+    }
+
+    if ( request.synchronization2 && api >= VK_API_VERSION_1_3
+         && supported->vulkan13.synchronization2 == VK_TRUE ) {
+        enabled.vulkan13.synchronization2 = VK_TRUE;
+        negotiated.synchronization2 = true;
+    }
+    else if ( synchronization2_extension
+              && supported->synchronization2.synchronization2 == VK_TRUE ) {
+        enabled.synchronization2.synchronization2 = VK_TRUE;
+        negotiated.synchronization2 = true;
+        negotiated.synchronization2_extension = true;
+        negotiated.extensions.push_back(
+            VK_KHR_SYNCHRONIZATION_2_EXTENSION_NAME );
+    }
+    return negotiated;
+}
+
+// "1.3.250" for reports.
+[[nodiscard]] inline std::string
+to_version_string( const std::uint32_t version ) {
+    return std::to_string( VK_API_VERSION_MAJOR( version ) ) + "."
+           + std::to_string( VK_API_VERSION_MINOR( version ) ) + "."
+           + std::to_string( VK_API_VERSION_PATCH( version ) );
+}
@@ -0,0 +1,279 @@
+#pragma once
+
+#include "image_writer.hpp"
+#include "thread_pool.hpp"
+#include "vk_dispatch.hpp"
+#include "vk_memory.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <filesystem>
+#include <iostream>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+struct FrameCaptureConfig
+{
+    std::filesystem::path directory{ "frames" };
+    ImageFileFormat       format{ ImageFileFormat::png };
+    // Encoder threads, 0 picks one per hardware thread.
+    std::uint32_t worker_count{ 0 };
+};
+
+struct FrameCaptureStats
+{
+    std::uint64_t frames{ 0 };
+    std::uint64_t bytes{ 0 };
+    double        seconds{ 0.0 };
+
+    [[nodiscard]] double frames_per_second() const noexcept {
+        return seconds > 0.0 ? static_cast<double>( frames ) / seconds : 0.0;
+    }
+    [[nodiscard]] double bytes_per_second() const noexcept {
+        return seconds > 0.0 ? static_cast<double>( bytes ) / seconds : 0.0;
+    }
+};
+
+// Pipelined swapchain readback.
+//
+// Each captured frame is copied into one slot of a ring of persistently
+// mapped host-visible buffers by the frame's own command buffer. Once the
+// frame's fence is known to have signalled, the slot is handed to a worker
+// pool which encodes and writes it out, then returns the slot to the ring.
+// The render loop therefore never waits on the queue; it only blocks if every
+// slot is still queued for encoding, i.e. when disk can't keep up.
+class FrameCapture
+{
+    public:
+    FrameCapture( const VkPhysicalDevice physical_device, const VkDevice device,
+                  const DeviceDispatch & dispatch, const VkExtent2D extent,
+                  const VkFormat format, const std::uint32_t frames_in_flight,
+                  FrameCaptureConfig            config,
+                  const VkAllocationCallbacks * allocator = nullptr ) :
+        m_device( device ),
+        m_dispatch( dispatch ),
+        m_extent( extent ),
+        m_bgra( is_bgra( format ) ),
+        m_config( std::move( config ) ),
+        m_pool( m_config.worker_count != 0
+                    ? m_config.worker_count
+                    : std::max( 1u, std::thread::hardware_concurrency() ) ) {
+        if ( !is_bgra( format ) && !is_rgba( format ) ) {
+            throw std::runtime_error(
+                "Frame capture only supports 8-bit RGBA/BGRA swapchains." );
+        }
+        std::filesystem::create_directories( m_config.directory );
+
+        // Enough slots for every frame the GPU can have in flight plus one
+        // being encoded per worker before recording has to wait.
+        const auto slot_count{ frames_in_flight
+                               + static_cast<std::uint32_t>( m_pool.size() ) };
+        const VkDeviceSize frame_size{ VkDeviceSize{ extent.width }
+                                       * extent.height * 4 };
+
+        m_slots.resize( slot_count );
+        for ( auto & slot : m_slots ) {
+            // Cached memory keeps CPU reads of the readback fast.
+            slot.allocation = create_buffer(
+                physical_device, device, frame_size,
+                VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
+                VK_MEMORY_PROPERTY_HOST_CACHED_BIT, allocator );
+
+            void * mapped{ nullptr };
+            if ( vkMapMemory( device, slot.allocation.memory, 0, VK_WHOLE_SIZE,
+                              0, &mapped )
+                 != VK_SUCCESS ) {
+                throw std::runtime_error( "Failed to map readback buffer." );
+            }
+            slot.mapped = static_cast<const std::uint8_t *>( mapped );
+        }
+    }
+
+    FrameCapture( const FrameCapture & ) = delete;
+    FrameCapture & operator=( const FrameCapture & ) = delete;
+
+    ~FrameCapture() {
+        m_pool.wait_idle();
+        for ( auto & slot : m_slots ) {
+            if ( slot.mapped != nullptr ) {
+                vkUnmapMemory( m_device, slot.allocation.memory );
+            }
+        }
+    }
+
+    // Records a copy of `image` into the next free slot. The image must be in
+    // TRANSFER_SRC_OPTIMAL layout with colour writes already made available.
+    void record_copy( const VkCommandBuffer command_buffer, const VkImage image,
+                      const std::uint64_t frame_number ) {
+        const auto slot_index{ acquire_slot( frame_number ) };
+        auto &     slot{ m_slots[slot_index] };
+
+        VkBufferImageCopy region{};
+        region.bufferOffset = 0;
+        region.bufferRowLength = 0;
+        region.bufferImageHeight = 0;
+        region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        region.imageSubresource.mipLevel = 0;
+        region.imageSubresource.baseArrayLayer = 0;
+        region.imageSubresource.layerCount = 1;
+        region.imageOffset = { 0, 0, 0 };
+        region.imageExtent = { m_extent.width, m_extent.height, 1 };
+
+        m_dispatch.cmd_copy_image_to_buffer(
+            command_buffer, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+            slot.allocation.buffer, 1, &region );
+
+        // Make the copy visible to host reads once the fence has signalled.
+        VkBufferMemoryBarrier host_barrier{};
+        host_barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+        host_barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        host_barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+        host_barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        host_barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        host_barrier.buffer = slot.allocation.buffer;
+        host_barrier.offset = 0;
+        host_barrier.size = VK_WHOLE_SIZE;
+
+        m_dispatch.cmd_pipeline_barrier(
+            command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+            VK_PIPELINE_STAGE_HOST_BIT, 0, 0, nullptr, 1, &host_barrier, 0,
+            nullptr );
+    }
+
+    // Hands every recorded slot up to and including `completed_frame` to the
+    // encoders. Only call once that frame's fence has signalled.
+    void frame_completed( const std::uint64_t completed_frame ) {
+        std::unique_lock lock( m_mutex );
+        while ( !m_recorded.empty()
+                && m_slots[m_recorded.front()].frame <= completed_frame ) {
+            const auto slot_index{ m_recorded.front() };
+            m_recorded.pop_front();
+            m_slots[slot_index].state = SlotState::encoding;
+
+            lock.unlock();
+            dispatch( slot_index );
+            lock.lock();
+        }
+    }
+
+    // Waits for all dispatched frames to be written and returns the totals.
+    [[nodiscard]] FrameCaptureStats finish() {
+        m_pool.wait_idle();
+
+        FrameCaptureStats stats{};
+        stats.frames = m_frames_written.load();
+        stats.bytes = m_bytes_written.load();
+        if ( stats.frames != 0 ) {
+            stats.seconds =
+                std::chrono::duration<double>( m_last_write.load()
+                                               - m_first_capture )
+                    .count();
+        }
+        return stats;
+    }
+
+    private:
+    enum class SlotState { free, recorded, encoding };
+
+    struct Slot
+    {
+        BufferAllocation     allocation;
+        const std::uint8_t * mapped{ nullptr };
+        std::uint64_t        frame{ 0 };
+        SlotState            state{ SlotState::free };
+    };
+
+    using clock = std::chrono::steady_clock;
+
+    VkDevice                            m_device;
+    // A copy, so a CommandCapture on the caller's table skips the readback.
+    DeviceDispatch                      m_dispatch;
+    VkExtent2D                          m_extent;
+    bool                                m_bgra;
+    FrameCaptureConfig                  m_config;
+    std::vector<Slot>                   m_slots;
+    std::size_t                         m_next_slot{ 0 };
+    std::deque<std::size_t>             m_recorded;
+    std::mutex                          m_mutex;
+    std::condition_variable             m_slot_freed;
+    clock::time_point                   m_first_capture{};
+    std::atomic<clock::time_point>      m_last_write{};
+    std::atomic<std::uint64_t>          m_frames_written{ 0 };
+    std::atomic<std::uint64_t>          m_bytes_written{ 0 };
+    // Last, so queued encodes finish before the slots go away.
+    ThreadPool m_pool;
+
+    [[nodiscard]] static constexpr bool is_bgra( const VkFormat format ) {
+        return format == VK_FORMAT_B8G8R8A8_SRGB
+               || format == VK_FORMAT_B8G8R8A8_UNORM;
+    }
+    [[nodiscard]] static constexpr bool is_rgba( const VkFormat format ) {
+        return format == VK_FORMAT_R8G8B8A8_SRGB
+               || format == VK_FORMAT_R8G8B8A8_UNORM;
+    }
+
+    [[nodiscard]] std::size_t acquire_slot( const std::uint64_t frame_number ) {
+        std::unique_lock lock( m_mutex );
+        const auto       slot_index{ m_next_slot };
+        m_slot_freed.wait( lock, [&]() {
+            return m_slots[slot_index].state == SlotState::free;
+        } );
+
+        if ( m_frames_written.load() == 0 && m_recorded.empty() ) {
+            m_first_capture = clock::now();
+        }
+        m_slots[slot_index].frame = frame_number;
+        m_slots[slot_index].state = SlotState::recorded;
+        m_recorded.push_back( slot_index );
+        m_next_slot = ( m_next_slot + 1 ) % m_slots.size();
+        return slot_index;
+    }
+
+    void dispatch( const std::size_t slot_index ) {
+        auto & slot{ m_slots[slot_index] };
+
+        if ( !( slot.allocation.properties
+                & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT ) ) {
+            VkMappedMemoryRange range{};
+            range.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+            range.memory = slot.allocation.memory;
+            range.offset = 0;
+            range.size = VK_WHOLE_SIZE;
+            vkInvalidateMappedMemoryRanges( m_device, 1, &range );
+        }
+
+        m_pool.submit( [this, slot_index]() {
+            auto & slot{ m_slots[slot_index] };
+
+            char name[32];
+            std::snprintf( name, sizeof( name ), "frame_%06llu",
+                           static_cast<unsigned long long>( slot.frame ) );
+            auto path{ m_config.directory / name };
+            path += image_file_extension( m_config.format );
+
+            try {
+                m_bytes_written += write_image( path.string(), m_config.format,
+                                                slot.mapped, m_extent.width,
+                                                m_extent.height, m_bgra );
+                ++m_frames_written;
+                m_last_write = clock::now();
+            }
+            catch ( const std::exception & err ) {
+                std::cerr << "Frame capture: " << err.what() << std::endl;
+            }
+
+            {
+                std::lock_guard lock( m_mutex );
+                slot.state = SlotState::free;
+            }
+            m_slot_freed.notify_one();
+        } );
+    }
+};
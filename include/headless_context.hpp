@@ -0,0 +1,181 @@
+#pragma once
+
+#include "host_allocator.hpp"
+#include "vk_handle.hpp"
+
+#include <cstdint>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// Surface-less Vulkan setup for offline tools (benchmarks, batch rendering,
+// replay). Works on software ICDs such as lavapipe.
+
+[[nodiscard]] inline UniqueInstance
+create_headless_instance( const char * application_name = "Headless",
+                          const VkAllocationCallbacks * allocator = nullptr ) {
+    auto app_info{ VkApplicationInfo{} };
+    app_info.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
+    app_info.pApplicationName = application_name;
+    app_info.applicationVersion = VK_MAKE_VERSION( 1, 0, 0 );
+    app_info.pEngineName = "No Engine";
+    app_info.engineVersion = VK_MAKE_VERSION( 1, 0, 0 );
+    app_info.apiVersion = VK_MAKE_VERSION( 1, 0, 0 );
+
+    auto create_info{ VkInstanceCreateInfo{} };
+    create_info.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
+    create_info.pApplicationInfo = &app_info;
+
+#ifdef __APPLE__
+    const char * extensions[] = {
+        VK_KHR_PORTABILITY_ENUMERATION_EXTENSION_NAME
+    };
+    create_info.flags |= VK_INSTANCE_CREATE_ENUMERATE_PORTABILITY_BIT_KHR;
+    create_info.enabledExtensionCount = 1;
+    create_info.ppEnabledExtensionNames = extensions;
+#endif
+
+    UniqueInstance instance{};
+    const VkResult result{ vkCreateInstance( &create_info, allocator,
+                                             instance.put( allocator ) ) };
+    if ( result != VK_SUCCESS ) {
+        throw std::runtime_error(
+            "Failed to create Vulkan instance, error code: "
+            + std::to_string( result ) );
+    }
+    return instance;
+}
+
+[[nodiscard]] inline std::vector<VkPhysicalDevice>
+enumerate_physical_devices( const VkInstance instance ) {
+    uint32_t device_count{ 0 };
+    vkEnumeratePhysicalDevices( instance, &device_count, nullptr );
+    std::vector<VkPhysicalDevice> devices( device_count );
+    vkEnumeratePhysicalDevices( instance, &device_count, devices.data() );
+    return devices;
+}
+
+[[nodiscard]] inline std::vector<VkQueueFamilyProperties>
+get_queue_families( const VkPhysicalDevice device ) {
+    uint32_t queue_family_count{ 0 };
+    vkGetPhysicalDeviceQueueFamilyProperties( device, &queue_family_count,
+                                              nullptr );
+    std::vector<VkQueueFamilyProperties> queue_families( queue_family_count );
+    vkGetPhysicalDeviceQueueFamilyProperties( device, &queue_family_count,
+                                              queue_families.data() );
+    return queue_families;
+}
+
+[[nodiscard]] inline std::optional<uint32_t>
+find_graphics_queue_family( const VkPhysicalDevice device ) {
+    const auto queue_families{ get_queue_families( device ) };
+    for ( uint32_t i{ 0 }; i < queue_families.size(); ++i ) {
+        if ( queue_families[i].queueFlags & VK_QUEUE_GRAPHICS_BIT ) {
+            return i;
+        }
+    }
+    return std::nullopt;
+}
+
+// Same scoring as the windowed app, minus the surface requirements.
+[[nodiscard]] inline int
+rate_headless_device( const VkPhysicalDevice device ) {
+    if ( !find_graphics_queue_family( device ).has_value() ) {
+        return 0;
+    }
+
+    VkPhysicalDeviceProperties device_properties;
+    vkGetPhysicalDeviceProperties( device, &device_properties );
+
+    int score{ 1 };
+    if ( device_properties.deviceType == VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU ) {
+        score += 1000;
+    }
+    score += static_cast<int>( device_properties.limits.maxImageDimension2D );
+    return score;
+}
+
+[[nodiscard]] inline VkPhysicalDevice
+pick_headless_device( const VkInstance instance ) {
+    VkPhysicalDevice best{ VK_NULL_HANDLE };
+    int              best_score{ 0 };
+    for ( const auto device : enumerate_physical_devices( instance ) ) {
+        const int score{ rate_headless_device( device ) };
+        if ( score > best_score ) {
+            best = device;
+            best_score = score;
+        }
+    }
+    if ( best == VK_NULL_HANDLE ) {
+        throw std::runtime_error( "Failed to find GPUs with graphics queues." );
+    }
+    return best;
+}
+
+[[nodiscard]] inline UniqueDevice
+create_headless_device( const VkPhysicalDevice        physical_device,
+                        const uint32_t                queue_family,
+                        const uint32_t                queue_count = 1,
+                        const VkAllocationCallbacks * allocator = nullptr ) {
+    const std::vector<float> queue_priorities( queue_count, 1.0f );
+
+    VkDeviceQueueCreateInfo queue_create_info{};
+    queue_create_info.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+    queue_create_info.queueFamilyIndex = queue_family;
+    queue_create_info.queueCount = queue_count;
+    queue_create_info.pQueuePriorities = queue_priorities.data();
+
+    VkPhysicalDeviceFeatures device_features{};
+
+    VkDeviceCreateInfo create_info{};
+    create_info.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+    create_info.queueCreateInfoCount = 1;
+    create_info.pQueueCreateInfos = &queue_create_info;
+    create_info.pEnabledFeatures = &device_features;
+
+    UniqueDevice device{};
+    if ( vkCreateDevice( physical_device, &create_info, allocator,
+                         device.put( allocator ) )
+         != VK_SUCCESS ) {
+        throw std::runtime_error( "Failed to create logical device." );
+    }
+    return device;
+}
+
+struct HeadlessContext
+{
+    UniqueInstance   instance;
+    VkPhysicalDevice physical_device{ VK_NULL_HANDLE };
+    uint32_t         queue_family{ 0 };
+    UniqueDevice     device;
+    VkQueue          queue{ VK_NULL_HANDLE };
+    // Host callbacks for the objects created on the device.
+    const VkAllocationCallbacks * allocator{ nullptr };
+
+    // `host_allocator`, if given, has to outlive the context.
+    [[nodiscard]] static HeadlessContext
+    create( const char *          application_name = "Headless",
+            const HostAllocator * host_allocator = nullptr ) {
+        const auto callbacks = [host_allocator](
+                                   const HostMemorySubsystem subsystem ) {
+            return host_allocator != nullptr
+                       ? host_allocator->callbacks( subsystem )
+                       : nullptr;
+        };
+        HeadlessContext context{};
+        context.allocator = callbacks( HostMemorySubsystem::resources );
+        context.instance = create_headless_instance(
+            application_name, callbacks( HostMemorySubsystem::instance ) );
+        context.physical_device = pick_headless_device( context.instance );
+        context.queue_family =
+            find_graphics_queue_family( context.physical_device ).value();
+        context.device =
+            create_headless_device( context.physical_device,
+                                    context.queue_family, 1,
+                                    callbacks( HostMemorySubsystem::device ) );
+        vkGetDeviceQueue( context.device, context.queue_family, 0,
+                          &context.queue );
+        return context;
+    }
+};
@@ -0,0 +1,568 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include "GLFW/glfw3.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <vector>
+
+// VkAllocationCallbacks that route driver host allocations by lifetime and
+// keep lock-free byte/count accounting per VkSystemAllocationScope and per
+// subsystem of the app.
+//
+//   COMMAND  lives for one vkCreate*/vkCmd* call: a thread-local bump arena,
+//            rewound whenever nothing allocated from it is still alive.
+//   OBJECT   lives as long as one Vulkan object: thread-local free lists in
+//            power-of-two size classes, refilled in batches from a shared
+//            pool (the same split tcmalloc makes).
+//   others   CACHE, DEVICE and INSTANCE allocations are few and long-lived,
+//            and go straight to malloc, as does anything too large for the
+//            arena or the biggest size class.
+//
+// Slabs behind the size classes are never returned to the system, so the
+// pool's footprint is its high water mark.
+
+enum class HostMemorySubsystem : std::uint8_t
+{
+    instance,
+    device,
+    swapchain,
+    pipeline,
+    commands,
+    sync,
+    resources,
+    count
+};
+
+[[nodiscard]] constexpr std::string_view
+to_string( const HostMemorySubsystem subsystem ) noexcept {
+    switch ( subsystem ) {
+    case HostMemorySubsystem::instance: return "instance";
+    case HostMemorySubsystem::device: return "device";
+    case HostMemorySubsystem::swapchain: return "swapchain";
+    case HostMemorySubsystem::pipeline: return "pipeline";
+    case HostMemorySubsystem::commands: return "commands";
+    case HostMemorySubsystem::sync: return "sync";
+    case HostMemorySubsystem::resources: return "resources";
+    default: return "unknown";
+    }
+}
+
+[[nodiscard]] constexpr std::string_view
+to_string( const VkSystemAllocationScope scope ) noexcept {
+    switch ( scope ) {
+    case VK_SYSTEM_ALLOCATION_SCOPE_COMMAND: return "command";
+    case VK_SYSTEM_ALLOCATION_SCOPE_OBJECT: return "object";
+    case VK_SYSTEM_ALLOCATION_SCOPE_CACHE: return "cache";
+    case VK_SYSTEM_ALLOCATION_SCOPE_DEVICE: return "device";
+    case VK_SYSTEM_ALLOCATION_SCOPE_INSTANCE: return "instance";
+    default: return "unknown";
+    }
+}
+
+constexpr std::size_t HOST_MEMORY_SCOPE_COUNT{
+    VK_SYSTEM_ALLOCATION_SCOPE_INSTANCE + 1
+};
+constexpr std::size_t HOST_MEMORY_SUBSYSTEM_COUNT{ static_cast<std::size_t>(
+    HostMemorySubsystem::count ) };
+
+// Snapshot of one counter.
+struct HostMemoryUsage
+{
+    std::uint64_t bytes{ 0 };
+    std::uint64_t peak_bytes{ 0 };
+    // Allocations ever made, and those not yet freed.
+    std::uint64_t allocations{ 0 };
+    std::uint64_t live{ 0 };
+};
+
+struct HostMemoryStats
+{
+    HostMemoryUsage                                          total;
+    std::array<HostMemoryUsage, HOST_MEMORY_SCOPE_COUNT>     scopes;
+    std::array<HostMemoryUsage, HOST_MEMORY_SUBSYSTEM_COUNT> subsystems;
+    // Driver allocations made outside the callbacks, reported through
+    // pfnInternalAllocation (executable memory for shaders, mostly).
+    std::array<HostMemoryUsage, HOST_MEMORY_SCOPE_COUNT> internal;
+    // Where callback allocations were served from.
+    std::uint64_t arena_allocations{ 0 };
+    std::uint64_t pool_allocations{ 0 };
+    std::uint64_t heap_allocations{ 0 };
+};
+
+namespace host_allocator_detail
+{
+// Every allocation is preceded by one of these, pfnFree only gets the
+// pointer.
+struct Header
+{
+    void *        owner;
+    std::size_t   size;
+    std::uint32_t offset;
+    std::uint8_t  scope;
+    std::uint8_t  source;
+    std::uint8_t  size_class;
+    std::uint8_t  subsystem;
+};
+
+enum Source : std::uint8_t
+{
+    heap,
+    pool,
+    arena
+};
+
+constexpr std::size_t MIN_ALIGNMENT{ alignof( std::max_align_t ) };
+
+class Counter
+{
+    public:
+    void add( const std::uint64_t size ) noexcept {
+        m_allocations.fetch_add( 1, std::memory_order_relaxed );
+        m_live.fetch_add( 1, std::memory_order_relaxed );
+        const auto bytes{ m_bytes.fetch_add( size, std::memory_order_relaxed )
+                          + size };
+        auto peak{ m_peak_bytes.load( std::memory_order_relaxed ) };
+        while ( bytes > peak
+                && !m_peak_bytes.compare_exchange_weak(
+                    peak, bytes, std::memory_order_relaxed ) ) {
+        }
+    }
+    void remove( const std::uint64_t size ) noexcept {
+        m_live.fetch_sub( 1, std::memory_order_relaxed );
+        m_bytes.fetch_sub( size, std::memory_order_relaxed );
+    }
+    [[nodiscard]] HostMemoryUsage load() const noexcept {
+        return { m_bytes.load( std::memory_order_relaxed ),
+                 m_peak_bytes.load( std::memory_order_relaxed ),
+                 m_allocations.load( std::memory_order_relaxed ),
+                 m_live.load( std::memory_order_relaxed ) };
+    }
+
+    private:
+    std::atomic<std::uint64_t> m_bytes{ 0 };
+    std::atomic<std::uint64_t> m_peak_bytes{ 0 };
+    std::atomic<std::uint64_t> m_allocations{ 0 };
+    std::atomic<std::uint64_t> m_live{ 0 };
+};
+
+// COMMAND scope arena. One per thread; the owning thread holds a reference
+// and so does every live allocation, which lets a block freed on another
+// thread, or after the owner exited, still find its arena.
+class CommandArena
+{
+    public:
+    static constexpr std::size_t CHUNK_SIZE{ 64 * 1024 };
+    // Larger requests would waste most of a chunk, they go to the heap.
+    static constexpr std::size_t MAX_ALLOCATION{ CHUNK_SIZE / 4 };
+
+    [[nodiscard]] std::byte * allocate( const std::size_t size ) {
+        // Only the owner's reference left: nothing is alive, start over.
+        if ( m_refs.load( std::memory_order_acquire ) == 1 ) {
+            m_chunk = 0;
+            m_cursor = 0;
+        }
+
+        const std::size_t rounded{ ( size + MIN_ALIGNMENT - 1 )
+                                   & ~( MIN_ALIGNMENT - 1 ) };
+        if ( m_chunk < m_chunks.size() && m_cursor + rounded > CHUNK_SIZE ) {
+            ++m_chunk;
+            m_cursor = 0;
+        }
+        if ( m_chunk == m_chunks.size() ) {
+            m_chunks.push_back(
+                std::make_unique_for_overwrite<std::byte[]>( CHUNK_SIZE ) );
+        }
+
+        std::byte * block{ m_chunks[m_chunk].get() + m_cursor };
+        m_cursor += rounded;
+        m_refs.fetch_add( 1, std::memory_order_relaxed );
+        return block;
+    }
+
+    // Drops one reference, the owner's or an allocation's.
+    static void release( CommandArena * arena ) noexcept {
+        if ( arena->m_refs.fetch_sub( 1, std::memory_order_acq_rel ) == 1 ) {
+            delete arena;
+        }
+    }
+
+    private:
+    std::atomic<std::uint32_t>                m_refs{ 1 };
+    std::vector<std::unique_ptr<std::byte[]>> m_chunks;
+    std::size_t                               m_chunk{ 0 };
+    std::size_t                               m_cursor{ 0 };
+};
+
+struct ThreadArena
+{
+    CommandArena * arena{ new CommandArena{} };
+    ~ThreadArena() { CommandArena::release( arena ); }
+};
+
+inline thread_local ThreadArena t_arena;
+
+// OBJECT scope size classes: 64 B to 8 KiB.
+constexpr std::size_t SIZE_CLASS_COUNT{ 8 };
+constexpr std::size_t MIN_CLASS_SIZE{ 64 };
+constexpr std::size_t MAX_CLASS_SIZE{ MIN_CLASS_SIZE
+                                      << ( SIZE_CLASS_COUNT - 1 ) };
+// Blocks moved between a thread cache and the shared pool at once.
+constexpr std::uint32_t TRANSFER_BATCH{ 32 };
+
+[[nodiscard]] constexpr std::size_t
+class_size( const std::size_t size_class ) noexcept {
+    return MIN_CLASS_SIZE << size_class;
+}
+
+[[nodiscard]] constexpr std::uint8_t
+size_class_for( const std::size_t size ) noexcept {
+    std::uint8_t size_class{ 0 };
+    while ( class_size( size_class ) < size ) {
+        ++size_class;
+    }
+    return size_class;
+}
+
+struct FreeBlock
+{
+    FreeBlock * next;
+};
+
+// Process-wide free lists and the slabs behind them. Deliberately leaked:
+// thread caches hand their blocks back from thread_local destructors, which
+// can run after static destruction has started.
+class SharedPool
+{
+    public:
+    [[nodiscard]] static SharedPool & instance() {
+        static SharedPool * pool{ new SharedPool{} };
+        return *pool;
+    }
+
+    // Returns a list of at least one block.
+    [[nodiscard]] FreeBlock * take( const std::size_t size_class ) {
+        std::lock_guard lock( m_mutex );
+        if ( m_free[size_class] == nullptr ) {
+            carve_slab( size_class );
+        }
+
+        FreeBlock * head{ m_free[size_class] };
+        FreeBlock * tail{ head };
+        for ( std::uint32_t i{ 1 }; i < TRANSFER_BATCH && tail->next != nullptr;
+              ++i ) {
+            tail = tail->next;
+        }
+        m_free[size_class] = tail->next;
+        tail->next = nullptr;
+        return head;
+    }
+
+    void give( const std::size_t size_class, FreeBlock * head ) {
+        if ( head == nullptr ) {
+            return;
+        }
+        FreeBlock * tail{ head };
+        while ( tail->next != nullptr ) {
+            tail = tail->next;
+        }
+        std::lock_guard lock( m_mutex );
+        tail->next = m_free[size_class];
+        m_free[size_class] = head;
+    }
+
+    private:
+    static constexpr std::size_t SLAB_SIZE{ 256 * 1024 };
+
+    std::mutex                                       m_mutex;
+    std::array<FreeBlock *, SIZE_CLASS_COUNT>        m_free{};
+    std::vector<std::unique_ptr<std::byte[]>>        m_slabs;
+
+    void carve_slab( const std::size_t size_class ) {
+        const std::size_t block_size{ class_size( size_class ) };
+        auto              slab{
+            std::make_unique_for_overwrite<std::byte[]>( SLAB_SIZE ) };
+        for ( std::size_t offset{ SLAB_SIZE }; offset >= block_size; ) {
+            offset -= block_size;
+            auto * block{
+                reinterpret_cast<FreeBlock *>( slab.get() + offset ) };
+            block->next = m_free[size_class];
+            m_free[size_class] = block;
+        }
+        m_slabs.push_back( std::move( slab ) );
+    }
+};
+
+// Per-thread free lists. A block freed on another thread simply joins that
+// thread's cache; lists that grow past two batches spill one back.
+class ThreadCache
+{
+    public:
+    ThreadCache() = default;
+    ThreadCache( const ThreadCache & ) = delete;
+    ThreadCache & operator=( const ThreadCache & ) = delete;
+    ~ThreadCache() {
+        for ( std::size_t i{ 0 }; i < SIZE_CLASS_COUNT; ++i ) {
+            SharedPool::instance().give( i, m_free[i] );
+        }
+    }
+
+    [[nodiscard]] std::byte * allocate( const std::size_t size_class ) {
+        if ( m_free[size_class] == nullptr ) {
+            m_free[size_class] = SharedPool::instance().take( size_class );
+            std::uint32_t count{ 0 };
+            for ( auto * block{ m_free[size_class] }; block != nullptr;
+                  block = block->next ) {
+                ++count;
+            }
+            m_count[size_class] = count;
+        }
+        FreeBlock * block{ m_free[size_class] };
+        m_free[size_class] = block->next;
+        --m_count[size_class];
+        return reinterpret_cast<std::byte *>( block );
+    }
+
+    void deallocate( const std::size_t size_class, std::byte * memory ) {
+        auto * block{ reinterpret_cast<FreeBlock *>( memory ) };
+        block->next = m_free[size_class];
+        m_free[size_class] = block;
+        if ( ++m_count[size_class] < 2 * TRANSFER_BATCH ) {
+            return;
+        }
+
+        FreeBlock * tail{ m_free[size_class] };
+        for ( std::uint32_t i{ 1 }; i < TRANSFER_BATCH; ++i ) {
+            tail = tail->next;
+        }
+        FreeBlock * spill{ m_free[size_class] };
+        m_free[size_class] = tail->next;
+        tail->next = nullptr;
+        m_count[size_class] -= TRANSFER_BATCH;
+        SharedPool::instance().give( size_class, spill );
+    }
+
+    private:
+    std::array<FreeBlock *, SIZE_CLASS_COUNT>   m_free{};
+    std::array<std::uint32_t, SIZE_CLASS_COUNT> m_count{};
+};
+
+inline thread_local ThreadCache t_cache;
+} // namespace host_allocator_detail
+
+class HostAllocator
+{
+    public:
+    HostAllocator() {
+        for ( std::size_t i{ 0 }; i < HOST_MEMORY_SUBSYSTEM_COUNT; ++i ) {
+            m_contexts[i] = { this, static_cast<HostMemorySubsystem>( i ) };
+
+            auto & callbacks{ m_callbacks[i] };
+            callbacks.pUserData = &m_contexts[i];
+            callbacks.pfnAllocation = &allocate;
+            callbacks.pfnReallocation = &reallocate;
+            callbacks.pfnFree = &free;
+            callbacks.pfnInternalAllocation = &internal_allocation;
+            callbacks.pfnInternalFree = &internal_free;
+        }
+    }
+
+    // The callbacks point back at this object.
+    HostAllocator( const HostAllocator & ) = delete;
+    HostAllocator & operator=( const HostAllocator & ) = delete;
+
+    // Pass as pAllocator; the same pointer has to be given when the object
+    // is destroyed, which UniqueHandle::put( parent, allocator ) takes care
+    // of.
+    [[nodiscard]] const VkAllocationCallbacks *
+    callbacks( const HostMemorySubsystem subsystem ) const noexcept {
+        return &m_callbacks[static_cast<std::size_t>( subsystem )];
+    }
+
+    [[nodiscard]] HostMemoryStats stats() const noexcept {
+        HostMemoryStats stats{};
+        stats.total = m_total.load();
+        for ( std::size_t i{ 0 }; i < HOST_MEMORY_SCOPE_COUNT; ++i ) {
+            stats.scopes[i] = m_scopes[i].load();
+            stats.internal[i] = m_internal[i].load();
+        }
+        for ( std::size_t i{ 0 }; i < HOST_MEMORY_SUBSYSTEM_COUNT; ++i ) {
+            stats.subsystems[i] = m_subsystems[i].load();
+        }
+        stats.arena_allocations = m_sources[host_allocator_detail::arena].load(
+            std::memory_order_relaxed );
+        stats.pool_allocations = m_sources[host_allocator_detail::pool].load(
+            std::memory_order_relaxed );
+        stats.heap_allocations = m_sources[host_allocator_detail::heap].load(
+            std::memory_order_relaxed );
+        return stats;
+    }
+
+    private:
+    struct Context
+    {
+        HostAllocator *     allocator{ nullptr };
+        HostMemorySubsystem subsystem{ HostMemorySubsystem::instance };
+    };
+
+    using Counter = host_allocator_detail::Counter;
+
+    std::array<Context, HOST_MEMORY_SUBSYSTEM_COUNT> m_contexts{};
+    std::array<VkAllocationCallbacks, HOST_MEMORY_SUBSYSTEM_COUNT>
+                                                     m_callbacks{};
+    Counter                                          m_total;
+    std::array<Counter, HOST_MEMORY_SCOPE_COUNT>     m_scopes;
+    std::array<Counter, HOST_MEMORY_SUBSYSTEM_COUNT> m_subsystems;
+    std::array<Counter, HOST_MEMORY_SCOPE_COUNT>     m_internal;
+    std::array<std::atomic<std::uint64_t>, 3>        m_sources{};
+
+    [[nodiscard]] static HostAllocator & owner( void * user_data ) noexcept {
+        return *static_cast<const Context *>( user_data )->allocator;
+    }
+
+    [[nodiscard]] static std::size_t
+    scope_index( const VkSystemAllocationScope scope ) noexcept {
+        return std::min( static_cast<std::size_t>( scope ),
+                         HOST_MEMORY_SCOPE_COUNT - 1 );
+    }
+
+    // Vulkan calls these from C, so nothing may escape; a null return turns
+    // into VK_ERROR_OUT_OF_HOST_MEMORY.
+    static VKAPI_ATTR void * VKAPI_CALL
+    allocate( void * user_data, const std::size_t size, std::size_t alignment,
+              const VkSystemAllocationScope scope ) noexcept {
+        using namespace host_allocator_detail;
+        if ( size == 0 ) {
+            return nullptr;
+        }
+        const auto & context{ *static_cast<const Context *>( user_data ) };
+        alignment = std::max( alignment, MIN_ALIGNMENT );
+        const std::size_t needed{ size + sizeof( Header ) + alignment };
+
+        std::byte *  block{ nullptr };
+        void *       owner{ nullptr };
+        Source       source{ heap };
+        std::uint8_t size_class{ 0 };
+        try {
+            if ( scope == VK_SYSTEM_ALLOCATION_SCOPE_COMMAND
+                 && needed <= CommandArena::MAX_ALLOCATION ) {
+                owner = t_arena.arena;
+                block = t_arena.arena->allocate( needed );
+                source = arena;
+            }
+            else if ( scope == VK_SYSTEM_ALLOCATION_SCOPE_OBJECT
+                      && needed <= MAX_CLASS_SIZE ) {
+                size_class = size_class_for( needed );
+                block = t_cache.allocate( size_class );
+                source = pool;
+            }
+            else {
+                block = static_cast<std::byte *>( std::malloc( needed ) );
+                if ( block == nullptr ) {
+                    return nullptr;
+                }
+            }
+        }
+        catch ( ... ) {
+            return nullptr;
+        }
+
+        const auto address{ reinterpret_cast<std::uintptr_t>( block )
+                            + sizeof( Header ) };
+        auto * memory{ reinterpret_cast<std::byte *>(
+            ( address + alignment - 1 ) & ~( alignment - 1 ) ) };
+
+        Header header{};
+        header.owner = owner;
+        header.size = size;
+        header.offset = static_cast<std::uint32_t>( memory - block );
+        header.scope = static_cast<std::uint8_t>( scope_index( scope ) );
+        header.source = source;
+        header.size_class = size_class;
+        header.subsystem = static_cast<std::uint8_t>( context.subsystem );
+        std::memcpy( memory - sizeof( Header ), &header, sizeof( header ) );
+
+        auto & allocator{ *context.allocator };
+        allocator.m_total.add( size );
+        allocator.m_scopes[header.scope].add( size );
+        allocator.m_subsystems[header.subsystem].add( size );
+        allocator.m_sources[source].fetch_add( 1, std::memory_order_relaxed );
+        return memory;
+    }
+
+    static VKAPI_ATTR void VKAPI_CALL free( void * user_data,
+                                            void * memory ) noexcept {
+        using namespace host_allocator_detail;
+        if ( memory == nullptr ) {
+            return;
+        }
+        auto * bytes{ static_cast<std::byte *>( memory ) };
+        Header header{};
+        std::memcpy( &header, bytes - sizeof( Header ), sizeof( header ) );
+
+        auto & allocator{ owner( user_data ) };
+        allocator.m_total.remove( header.size );
+        allocator.m_scopes[header.scope].remove( header.size );
+        allocator.m_subsystems[header.subsystem].remove( header.size );
+
+        std::byte * block{ bytes - header.offset };
+        switch ( header.source ) {
+        case arena:
+            CommandArena::release(
+                static_cast<CommandArena *>( header.owner ) );
+            break;
+        case pool: t_cache.deallocate( header.size_class, block ); break;
+        default: std::free( block ); break;
+        }
+    }
+
+    static VKAPI_ATTR void * VKAPI_CALL
+    reallocate( void * user_data, void * original, const std::size_t size,
+                const std::size_t             alignment,
+                const VkSystemAllocationScope scope ) noexcept {
+        if ( original == nullptr ) {
+            return allocate( user_data, size, alignment, scope );
+        }
+        if ( size == 0 ) {
+            free( user_data, original );
+            return nullptr;
+        }
+
+        // On failure the original must be left untouched.
+        void * memory{ allocate( user_data, size, alignment, scope ) };
+        if ( memory == nullptr ) {
+            return nullptr;
+        }
+        host_allocator_detail::Header header{};
+        std::memcpy( &header,
+                     static_cast<std::byte *>( original )
+                         - sizeof( host_allocator_detail::Header ),
+                     sizeof( header ) );
+        std::memcpy( memory, original, std::min( size, header.size ) );
+        free( user_data, original );
+        return memory;
+    }
+
+    static VKAPI_ATTR void VKAPI_CALL
+    internal_allocation( void * user_data, const std::size_t size,
+                         VkInternalAllocationType,
+                         const VkSystemAllocationScope scope ) noexcept {
+        owner( user_data ).m_internal[scope_index( scope )].add( size );
+    }
+
+    static VKAPI_ATTR void VKAPI_CALL
+    internal_free( void * user_data, const std::size_t size,
+                   VkInternalAllocationType,
+                   const VkSystemAllocationScope scope ) noexcept {
+        owner( user_data ).m_internal[scope_index( scope )].remove( size );
+    }
+};
@@ -0,0 +1,222 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Encoders for tightly packed 8-bit, 4-channel frames as read back from the
+// swapchain. `bgra` selects the channel order of the source pixels.
+
+enum class ImageFileFormat { raw, ppm, png };
+
+[[nodiscard]] inline ImageFileFormat
+parse_image_file_format( const std::string_view name ) {
+    if ( name == "raw" ) {
+        return ImageFileFormat::raw;
+    }
+    if ( name == "ppm" ) {
+        return ImageFileFormat::ppm;
+    }
+    if ( name == "png" ) {
+        return ImageFileFormat::png;
+    }
+    throw std::runtime_error( "Unknown image format: " + std::string{ name } );
+}
+
+[[nodiscard]] constexpr std::string_view
+image_file_extension( const ImageFileFormat format ) noexcept {
+    switch ( format ) {
+    case ImageFileFormat::raw: return ".raw";
+    case ImageFileFormat::ppm: return ".ppm";
+    case ImageFileFormat::png: return ".png";
+    }
+    return "";
+}
+
+namespace image_writer_detail
+{
+
+inline void
+pack_rgb_row( std::uint8_t * dst, const std::uint8_t * src,
+              const std::uint32_t width, const bool bgra ) noexcept {
+    const std::size_t r{ bgra ? 2u : 0u };
+    const std::size_t b{ bgra ? 0u : 2u };
+    for ( std::uint32_t x{ 0 }; x < width; ++x ) {
+        dst[0] = src[r];
+        dst[1] = src[1];
+        dst[2] = src[b];
+        dst += 3;
+        src += 4;
+    }
+}
+
+inline const std::array<std::uint32_t, 256> &
+crc_table() noexcept {
+    static const auto table{ []() {
+        std::array<std::uint32_t, 256> t{};
+        for ( std::uint32_t n{ 0 }; n < 256; ++n ) {
+            std::uint32_t c{ n };
+            for ( int k{ 0 }; k < 8; ++k ) {
+                c = ( c & 1u ) ? 0xEDB88320u ^ ( c >> 1 ) : c >> 1;
+            }
+            t[n] = c;
+        }
+        return t;
+    }() };
+    return table;
+}
+
+[[nodiscard]] inline std::uint32_t
+crc32( const std::uint8_t * data, const std::size_t size,
+       std::uint32_t crc = 0xFFFFFFFFu ) noexcept {
+    const auto & table{ crc_table() };
+    for ( std::size_t i{ 0 }; i < size; ++i ) {
+        crc = table[( crc ^ data[i] ) & 0xFFu] ^ ( crc >> 8 );
+    }
+    return crc;
+}
+
+inline void
+put_u32_be( std::vector<std::uint8_t> & out, const std::uint32_t v ) {
+    out.push_back( static_cast<std::uint8_t>( v >> 24 ) );
+    out.push_back( static_cast<std::uint8_t>( v >> 16 ) );
+    out.push_back( static_cast<std::uint8_t>( v >> 8 ) );
+    out.push_back( static_cast<std::uint8_t>( v ) );
+}
+
+inline void
+put_chunk( std::vector<std::uint8_t> & out, const char ( &type )[5],
+           const std::uint8_t * data, const std::size_t size ) {
+    put_u32_be( out, static_cast<std::uint32_t>( size ) );
+    const auto type_begin{ out.size() };
+    out.insert( out.end(), type, type + 4 );
+    out.insert( out.end(), data, data + size );
+    const auto crc{ crc32( out.data() + type_begin, size + 4 ) ^ 0xFFFFFFFFu };
+    put_u32_be( out, crc );
+}
+
+} // namespace image_writer_detail
+
+[[nodiscard]] inline std::vector<std::uint8_t>
+encode_ppm( const std::uint8_t * pixels, const std::uint32_t width,
+            const std::uint32_t height, const bool bgra ) {
+    const std::string header{ "P6\n" + std::to_string( width ) + " "
+                              + std::to_string( height ) + "\n255\n" };
+
+    std::vector<std::uint8_t> out( header.size()
+                                   + std::size_t{ width } * height * 3 );
+    std::copy( header.begin(), header.end(), out.begin() );
+
+    auto * dst{ out.data() + header.size() };
+    for ( std::uint32_t y{ 0 }; y < height; ++y ) {
+        image_writer_detail::pack_rgb_row(
+            dst, pixels + std::size_t{ y } * width * 4, width, bgra );
+        dst += std::size_t{ width } * 3;
+    }
+    return out;
+}
+
+// Writes an RGB PNG using stored (uncompressed) deflate blocks. Frames are
+// dumped at render rate, so encode cost matters more than file size here.
+[[nodiscard]] inline std::vector<std::uint8_t>
+encode_png( const std::uint8_t * pixels, const std::uint32_t width,
+            const std::uint32_t height, const bool bgra ) {
+    using namespace image_writer_detail;
+
+    // Filter type byte (0, none) followed by the RGB row.
+    const std::size_t row_size{ 1 + std::size_t{ width } * 3 };
+    std::vector<std::uint8_t> scanlines( row_size * height );
+    for ( std::uint32_t y{ 0 }; y < height; ++y ) {
+        auto * row{ scanlines.data() + row_size * y };
+        row[0] = 0;
+        pack_rgb_row( row + 1, pixels + std::size_t{ y } * width * 4, width,
+                      bgra );
+    }
+
+    // zlib stream: header, stored blocks of at most 65535 bytes, adler32.
+    constexpr std::size_t     max_block{ 65535 };
+    const std::size_t         block_count{ std::max<std::size_t>(
+        1, ( scanlines.size() + max_block - 1 ) / max_block ) };
+    std::vector<std::uint8_t> zlib;
+    zlib.reserve( 2 + scanlines.size() + block_count * 5 + 4 );
+    zlib.push_back( 0x78 );
+    zlib.push_back( 0x01 );
+
+    std::uint32_t adler_a{ 1 }, adler_b{ 0 };
+    std::size_t   offset{ 0 };
+    do {
+        const std::size_t block{ std::min( max_block,
+                                           scanlines.size() - offset ) };
+        const bool        last{ offset + block == scanlines.size() };
+        const auto        len{ static_cast<std::uint16_t>( block ) };
+        const auto        nlen{ static_cast<std::uint16_t>( ~len ) };
+        zlib.push_back( last ? 1 : 0 );
+        zlib.push_back( static_cast<std::uint8_t>( len & 0xFF ) );
+        zlib.push_back( static_cast<std::uint8_t>( len >> 8 ) );
+        zlib.push_back( static_cast<std::uint8_t>( nlen & 0xFF ) );
+        zlib.push_back( static_cast<std::uint8_t>( nlen >> 8 ) );
+        zlib.insert( zlib.end(), scanlines.begin() + offset,
+                     scanlines.begin() + offset + block );
+
+        for ( std::size_t i{ offset }; i < offset + block; ++i ) {
+            adler_a = ( adler_a + scanlines[i] ) % 65521u;
+            adler_b = ( adler_b + adler_a ) % 65521u;
+        }
+        offset += block;
+    } while ( offset < scanlines.size() );
+    put_u32_be( zlib, ( adler_b << 16 ) | adler_a );
+
+    std::vector<std::uint8_t> out{ 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+    out.reserve( out.size() + zlib.size() + 64 );
+
+    std::vector<std::uint8_t> ihdr;
+    put_u32_be( ihdr, width );
+    put_u32_be( ihdr, height );
+    ihdr.push_back( 8 ); // Bit depth
+    ihdr.push_back( 2 ); // Colour type: RGB
+    ihdr.push_back( 0 ); // Compression
+    ihdr.push_back( 0 ); // Filter
+    ihdr.push_back( 0 ); // Interlace
+    put_chunk( out, "IHDR", ihdr.data(), ihdr.size() );
+    put_chunk( out, "IDAT", zlib.data(), zlib.size() );
+    put_chunk( out, "IEND", nullptr, 0 );
+
+    return out;
+}
+
+// Encodes and writes one frame, returning the number of bytes written.
+inline std::size_t
+write_image( const std::string & path, const ImageFileFormat format,
+             const std::uint8_t * pixels, const std::uint32_t width,
+             const std::uint32_t height, const bool bgra ) {
+    std::ofstream file( path, std::ios::binary | std::ios::trunc );
+    if ( !file.is_open() ) {
+        throw std::runtime_error( "Couldn't open file: " + path );
+    }
+
+    std::size_t bytes{ 0 };
+    if ( format == ImageFileFormat::raw ) {
+        bytes = std::size_t{ width } * height * 4;
+        file.write( reinterpret_cast<const char *>( pixels ),
+                    static_cast<std::streamsize>( bytes ) );
+    }
+    else {
+        const auto encoded{ format == ImageFileFormat::ppm
+                                ? encode_ppm( pixels, width, height, bgra )
+                                : encode_png( pixels, width, height, bgra ) };
+        bytes = encoded.size();
+        file.write( reinterpret_cast<const char *>( encoded.data() ),
+                    static_cast<std::streamsize>( bytes ) );
+    }
+
+    if ( !file ) {
+        throw std::runtime_error( "Failed to write file: " + path );
+    }
+    return bytes;
+}
@@ -0,0 +1,244 @@
+#pragma once
+
+#include "thread_pool.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <initializer_list>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Start-up steps, each with the steps it needs finished first. run() starts
+// a step as soon as the last of its dependencies is done, on the pool or,
+// for steps bound to the main thread (most window system calls), on the
+// caller. run_serial() keeps to the order the steps were added in, which is
+// always a valid one as dependencies have to be added before their
+// dependents.
+//
+// Once a step throws nothing new is started; steps already running are
+// waited for and the first exception is rethrown.
+class InitGraph
+{
+    public:
+    using NodeId = std::size_t;
+
+    enum class Affinity
+    {
+        any,
+        main_thread
+    };
+
+    NodeId add( std::string name, std::function<void()> body,
+                const std::initializer_list<NodeId> dependencies = {},
+                const Affinity affinity = Affinity::any ) {
+        const NodeId id{ m_nodes.size() };
+        Node node{};
+        node.name = std::move( name );
+        node.body = std::move( body );
+        node.affinity = affinity;
+        for ( const NodeId dependency : dependencies ) {
+            if ( dependency >= id ) {
+                throw std::runtime_error( "Init step " + node.name
+                                          + " depends on a later step." );
+            }
+            m_nodes[dependency].dependents.push_back( id );
+        }
+        node.dependencies = dependencies;
+        m_nodes.push_back( std::move( node ) );
+        return id;
+    }
+
+    // Must be called from the main thread, which takes the main thread steps
+    // and otherwise just waits.
+    void run( ThreadPool & pool ) {
+        std::unique_lock lock( m_mutex );
+        begin_run();
+        for ( NodeId id{ 0 }; id < m_nodes.size(); ++id ) {
+            if ( m_nodes[id].pending == 0 ) {
+                schedule( id, pool );
+            }
+        }
+        while ( true ) {
+            m_changed.wait( lock, [this]() {
+                return !m_main_ready.empty() || m_outstanding == 0;
+            } );
+            if ( m_main_ready.empty() ) {
+                break;
+            }
+            const NodeId id{ m_main_ready.front() };
+            m_main_ready.pop_front();
+            lock.unlock();
+            execute( id, pool );
+            lock.lock();
+        }
+        end_run();
+        if ( m_error ) {
+            std::rethrow_exception( m_error );
+        }
+    }
+
+    void run_serial() {
+        begin_run();
+        for ( auto & node : m_nodes ) {
+            node.start_seconds = elapsed_seconds();
+            node.body();
+            node.end_seconds = elapsed_seconds();
+            node.ran = true;
+        }
+        end_run();
+    }
+
+    [[nodiscard]] std::size_t size() const noexcept { return m_nodes.size(); }
+    [[nodiscard]] const std::string & name( const NodeId id ) const {
+        return m_nodes[id].name;
+    }
+    // Per step, from the start of the run.
+    [[nodiscard]] double start_seconds( const NodeId id ) const {
+        return m_nodes[id].start_seconds;
+    }
+    [[nodiscard]] double end_seconds( const NodeId id ) const {
+        return m_nodes[id].end_seconds;
+    }
+    [[nodiscard]] double wall_seconds() const noexcept {
+        return m_wall_seconds;
+    }
+    // Sum over every step, what a serial run costs at best.
+    [[nodiscard]] double work_seconds() const noexcept {
+        double total{ 0.0 };
+        for ( const auto & node : m_nodes ) {
+            total += node.end_seconds - node.start_seconds;
+        }
+        return total;
+    }
+    // The chain of dependencies that finished last, first step first. In a
+    // parallel run this is what the wall time is made of.
+    [[nodiscard]] std::vector<NodeId> critical_path() const {
+        const auto later = [this]( const std::optional<NodeId> best,
+                                   const NodeId               id ) {
+            return m_nodes[id].ran
+                   && ( !best
+                        || m_nodes[id].end_seconds
+                               > m_nodes[*best].end_seconds );
+        };
+
+        std::optional<NodeId> last;
+        for ( NodeId id{ 0 }; id < m_nodes.size(); ++id ) {
+            if ( later( last, id ) ) {
+                last = id;
+            }
+        }
+        std::vector<NodeId> path;
+        while ( last ) {
+            path.push_back( *last );
+            std::optional<NodeId> previous;
+            for ( const NodeId id : m_nodes[*last].dependencies ) {
+                if ( later( previous, id ) ) {
+                    previous = id;
+                }
+            }
+            last = previous;
+        }
+        std::reverse( path.begin(), path.end() );
+        return path;
+    }
+
+    private:
+    struct Node
+    {
+        std::string           name;
+        std::function<void()> body;
+        Affinity              affinity{ Affinity::any };
+        std::vector<NodeId>   dependencies;
+        std::vector<NodeId>   dependents;
+        // Dependencies still running, counted down during run().
+        std::size_t pending{ 0 };
+        double      start_seconds{ 0.0 };
+        double      end_seconds{ 0.0 };
+        bool        ran{ false };
+    };
+
+    std::vector<Node>                     m_nodes;
+    std::mutex                            m_mutex;
+    std::condition_variable               m_changed;
+    std::deque<NodeId>                    m_main_ready;
+    // Scheduled steps that have not finished or been skipped yet.
+    std::size_t                           m_outstanding{ 0 };
+    std::exception_ptr                    m_error;
+    std::chrono::steady_clock::time_point m_start;
+    double                                m_wall_seconds{ 0.0 };
+
+    [[nodiscard]] double elapsed_seconds() const {
+        return std::chrono::duration<double>( std::chrono::steady_clock::now()
+                                              - m_start )
+            .count();
+    }
+
+    void begin_run() {
+        for ( auto & node : m_nodes ) {
+            node.pending = node.dependencies.size();
+            node.start_seconds = 0.0;
+            node.end_seconds = 0.0;
+            node.ran = false;
+        }
+        m_error = nullptr;
+        m_start = std::chrono::steady_clock::now();
+    }
+    void end_run() { m_wall_seconds = elapsed_seconds(); }
+
+    // With m_mutex held.
+    void schedule( const NodeId id, ThreadPool & pool ) {
+        ++m_outstanding;
+        if ( m_nodes[id].affinity == Affinity::main_thread ) {
+            m_main_ready.push_back( id );
+            m_changed.notify_all();
+            return;
+        }
+        pool.submit( [this, id, &pool]() { execute( id, pool ); } );
+    }
+
+    void execute( const NodeId id, ThreadPool & pool ) {
+        auto & node{ m_nodes[id] };
+        bool   skip{ false };
+        {
+            std::lock_guard lock( m_mutex );
+            skip = m_error != nullptr;
+        }
+
+        std::exception_ptr error;
+        if ( !skip ) {
+            node.start_seconds = elapsed_seconds();
+            try {
+                node.body();
+            }
+            catch ( ... ) {
+                error = std::current_exception();
+            }
+            node.end_seconds = elapsed_seconds();
+            node.ran = true;
+        }
+
+        // Moved so the caller holds the only reference once run() returns.
+        std::lock_guard lock( m_mutex );
+        if ( error && !m_error ) {
+            m_error = std::move( error );
+        }
+        if ( !m_error ) {
+            for ( const NodeId dependent : node.dependents ) {
+                if ( --m_nodes[dependent].pending == 0 ) {
+                    schedule( dependent, pool );
+                }
+            }
+        }
+        --m_outstanding;
+        m_changed.notify_all();
+    }
+};
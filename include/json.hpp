@@ -0,0 +1,375 @@
+#pragma once
+
+#include <cctype>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <iomanip>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <variant>
+#include <vector>
+
+// Minimal JSON document model, enough for benchmark baselines and glTF.
+
+class JsonValue
+{
+    public:
+    using Array = std::vector<JsonValue>;
+    using Object = std::vector<std::pair<std::string, JsonValue>>;
+
+    JsonValue() noexcept = default;
+    JsonValue( std::nullptr_t ) noexcept {}
+    JsonValue( const bool value ) : m_value( value ) {}
+    JsonValue( const double value ) : m_value( value ) {}
+    JsonValue( const char * value ) : m_value( std::string{ value } ) {}
+    JsonValue( std::string value ) : m_value( std::move( value ) ) {}
+    JsonValue( Array value ) : m_value( std::move( value ) ) {}
+    JsonValue( Object value ) : m_value( std::move( value ) ) {}
+
+    [[nodiscard]] bool is_null() const noexcept {
+        return std::holds_alternative<std::nullptr_t>( m_value );
+    }
+    [[nodiscard]] bool is_number() const noexcept {
+        return std::holds_alternative<double>( m_value );
+    }
+    [[nodiscard]] bool is_string() const noexcept {
+        return std::holds_alternative<std::string>( m_value );
+    }
+    [[nodiscard]] bool is_array() const noexcept {
+        return std::holds_alternative<Array>( m_value );
+    }
+    [[nodiscard]] bool is_object() const noexcept {
+        return std::holds_alternative<Object>( m_value );
+    }
+
+    [[nodiscard]] bool as_bool() const { return get<bool>( "boolean" ); }
+    [[nodiscard]] double as_number() const { return get<double>( "number" ); }
+    [[nodiscard]] const std::string & as_string() const {
+        return get<std::string>( "string" );
+    }
+    [[nodiscard]] const Array & as_array() const {
+        return get<Array>( "array" );
+    }
+    [[nodiscard]] const Object & as_object() const {
+        return get<Object>( "object" );
+    }
+    [[nodiscard]] Object & as_object() {
+        if ( !is_object() ) {
+            throw std::runtime_error( "JSON value is not an object." );
+        }
+        return std::get<Object>( m_value );
+    }
+
+    // Object member lookup; returns nullptr when absent.
+    [[nodiscard]] const JsonValue * find( const std::string_view key ) const {
+        if ( !is_object() ) {
+            return nullptr;
+        }
+        for ( const auto & [name, value] : std::get<Object>( m_value ) ) {
+            if ( name == key ) {
+                return &value;
+            }
+        }
+        return nullptr;
+    }
+    [[nodiscard]] const JsonValue & operator[]( const std::string_view key ) const {
+        const auto * value{ find( key ) };
+        if ( value == nullptr ) {
+            throw std::runtime_error( "Missing JSON member: "
+                                      + std::string{ key } );
+        }
+        return *value;
+    }
+    [[nodiscard]] const JsonValue & operator[]( const std::size_t index ) const {
+        const auto & array{ as_array() };
+        if ( index >= array.size() ) {
+            throw std::runtime_error( "JSON array index out of range." );
+        }
+        return array[index];
+    }
+
+    [[nodiscard]] double number_or( const std::string_view key,
+                                    const double fallback ) const {
+        const auto * value{ find( key ) };
+        return value != nullptr && value->is_number() ? value->as_number()
+                                                      : fallback;
+    }
+
+    void set( std::string key, JsonValue value ) {
+        auto & object{ as_object() };
+        for ( auto & [name, existing] : object ) {
+            if ( name == key ) {
+                existing = std::move( value );
+                return;
+            }
+        }
+        object.emplace_back( std::move( key ), std::move( value ) );
+    }
+
+    void write( std::ostream & out, const int indent = 0 ) const {
+        const std::string pad( static_cast<std::size_t>( indent ) + 2, ' ' );
+        const std::string close_pad( static_cast<std::size_t>( indent ), ' ' );
+
+        if ( is_null() ) {
+            out << "null";
+        }
+        else if ( const auto * b = std::get_if<bool>( &m_value ) ) {
+            out << ( *b ? "true" : "false" );
+        }
+        else if ( const auto * n = std::get_if<double>( &m_value ) ) {
+            out << std::setprecision( 17 ) << *n;
+        }
+        else if ( const auto * s = std::get_if<std::string>( &m_value ) ) {
+            write_string( out, *s );
+        }
+        else if ( const auto * a = std::get_if<Array>( &m_value ) ) {
+            out << '[';
+            for ( std::size_t i{ 0 }; i < a->size(); ++i ) {
+                out << ( i == 0 ? "\n" : ",\n" ) << pad;
+                ( *a )[i].write( out, indent + 2 );
+            }
+            out << ( a->empty() ? "" : "\n" + close_pad ) << ']';
+        }
+        else if ( const auto * o = std::get_if<Object>( &m_value ) ) {
+            out << '{';
+            for ( std::size_t i{ 0 }; i < o->size(); ++i ) {
+                out << ( i == 0 ? "\n" : ",\n" ) << pad;
+                write_string( out, ( *o )[i].first );
+                out << ": ";
+                ( *o )[i].second.write( out, indent + 2 );
+            }
+            out << ( o->empty() ? "" : "\n" + close_pad ) << '}';
+        }
+    }
+
+    [[nodiscard]] static JsonValue parse( const std::string_view text ) {
+        Parser     parser{ text, 0 };
+        JsonValue  value{ parser.parse_value() };
+        parser.skip_whitespace();
+        if ( parser.pos != text.size() ) {
+            throw std::runtime_error( "Trailing characters after JSON value." );
+        }
+        return value;
+    }
+
+    private:
+    std::variant<std::nullptr_t, bool, double, std::string, Array, Object>
+        m_value{ nullptr };
+
+    template <typename T>
+    [[nodiscard]] const T & get( const char * type_name ) const {
+        if ( const auto * value = std::get_if<T>( &m_value ) ) {
+            return *value;
+        }
+        throw std::runtime_error( std::string{ "JSON value is not a " }
+                                  + type_name + "." );
+    }
+
+    static void write_string( std::ostream & out, const std::string & s ) {
+        out << '"';
+        for ( const char c : s ) {
+            switch ( c ) {
+            case '"': out << "\\\""; break;
+            case '\\': out << "\\\\"; break;
+            case '\n': out << "\\n"; break;
+            case '\t': out << "\\t"; break;
+            case '\r': out << "\\r"; break;
+            default: out << c;
+            }
+        }
+        out << '"';
+    }
+
+    struct Parser
+    {
+        std::string_view text;
+        std::size_t      pos;
+
+        [[noreturn]] void fail( const char * what ) const {
+            throw std::runtime_error( std::string{ "JSON parse error: " }
+                                      + what + " at offset "
+                                      + std::to_string( pos ) );
+        }
+
+        void skip_whitespace() noexcept {
+            while ( pos < text.size()
+                    && std::isspace( static_cast<unsigned char>( text[pos] ) ) ) {
+                ++pos;
+            }
+        }
+
+        [[nodiscard]] char peek() {
+            skip_whitespace();
+            if ( pos >= text.size() ) {
+                fail( "unexpected end of input" );
+            }
+            return text[pos];
+        }
+
+        void expect( const char c ) {
+            if ( peek() != c ) {
+                fail( "unexpected character" );
+            }
+            ++pos;
+        }
+
+        [[nodiscard]] bool consume_literal( const std::string_view literal ) {
+            if ( text.substr( pos, literal.size() ) == literal ) {
+                pos += literal.size();
+                return true;
+            }
+            return false;
+        }
+
+        [[nodiscard]] JsonValue parse_value() {
+            const char c{ peek() };
+            if ( c == '{' ) {
+                return parse_object();
+            }
+            if ( c == '[' ) {
+                return parse_array();
+            }
+            if ( c == '"' ) {
+                return parse_string();
+            }
+            if ( consume_literal( "true" ) ) {
+                return JsonValue{ true };
+            }
+            if ( consume_literal( "false" ) ) {
+                return JsonValue{ false };
+            }
+            if ( consume_literal( "null" ) ) {
+                return JsonValue{};
+            }
+            return parse_number();
+        }
+
+        [[nodiscard]] JsonValue parse_object() {
+            expect( '{' );
+            Object object;
+            if ( peek() == '}' ) {
+                ++pos;
+                return JsonValue{ std::move( object ) };
+            }
+            while ( true ) {
+                if ( peek() != '"' ) {
+                    fail( "expected object key" );
+                }
+                auto key{ parse_string() };
+                expect( ':' );
+                object.emplace_back( key.as_string(), parse_value() );
+                const char c{ peek() };
+                ++pos;
+                if ( c == '}' ) {
+                    break;
+                }
+                if ( c != ',' ) {
+                    fail( "expected ',' or '}'" );
+                }
+            }
+            return JsonValue{ std::move( object ) };
+        }
+
+        [[nodiscard]] JsonValue parse_array() {
+            expect( '[' );
+            Array array;
+            if ( peek() == ']' ) {
+                ++pos;
+                return JsonValue{ std::move( array ) };
+            }
+            while ( true ) {
+                array.push_back( parse_value() );
+                const char c{ peek() };
+                ++pos;
+                if ( c == ']' ) {
+                    break;
+                }
+                if ( c != ',' ) {
+                    fail( "expected ',' or ']'" );
+                }
+            }
+            return JsonValue{ std::move( array ) };
+        }
+
+        [[nodiscard]] JsonValue parse_string() {
+            expect( '"' );
+            std::string out;
+            while ( true ) {
+                if ( pos >= text.size() ) {
+                    fail( "unterminated string" );
+                }
+                const char c{ text[pos++] };
+                if ( c == '"' ) {
+                    break;
+                }
+                if ( c != '\\' ) {
+                    out.push_back( c );
+                    continue;
+                }
+                if ( pos >= text.size() ) {
+                    fail( "unterminated escape" );
+                }
+                const char e{ text[pos++] };
+                switch ( e ) {
+                case 'b': out.push_back( '\b' ); break;
+                case 'f': out.push_back( '\f' ); break;
+                case 'n': out.push_back( '\n' ); break;
+                case 'r': out.push_back( '\r' ); break;
+                case 't': out.push_back( '\t' ); break;
+                case 'u': {
+                    if ( pos + 4 > text.size() ) {
+                        fail( "truncated unicode escape" );
+                    }
+                    const auto code{ static_cast<std::uint32_t>( std::strtoul(
+                        std::string{ text.substr( pos, 4 ) }.c_str(), nullptr,
+                        16 ) ) };
+                    pos += 4;
+                    // Basic multilingual plane only, encoded as UTF-8.
+                    if ( code < 0x80 ) {
+                        out.push_back( static_cast<char>( code ) );
+                    }
+                    else if ( code < 0x800 ) {
+                        out.push_back( static_cast<char>( 0xC0 | ( code >> 6 ) ) );
+                        out.push_back( static_cast<char>( 0x80 | ( code & 0x3F ) ) );
+                    }
+                    else {
+                        out.push_back( static_cast<char>( 0xE0 | ( code >> 12 ) ) );
+                        out.push_back(
+                            static_cast<char>( 0x80 | ( ( code >> 6 ) & 0x3F ) ) );
+                        out.push_back( static_cast<char>( 0x80 | ( code & 0x3F ) ) );
+                    }
+                    break;
+                }
+                default: out.push_back( e ); break;
+                }
+            }
+            return JsonValue{ std::move( out ) };
+        }
+
+        [[nodiscard]] JsonValue parse_number() {
+            skip_whitespace();
+            const std::size_t start{ pos };
+            while ( pos < text.size()
+                    && ( std::isdigit( static_cast<unsigned char>( text[pos] ) )
+                         || text[pos] == '-' || text[pos] == '+'
+                         || text[pos] == '.' || text[pos] == 'e'
+                         || text[pos] == 'E' ) ) {
+                ++pos;
+            }
+            if ( start == pos ) {
+                fail( "unexpected character" );
+            }
+            const std::string number{ text.substr( start, pos - start ) };
+            char *            end{ nullptr };
+            const double      value{ std::strtod( number.c_str(), &end ) };
+            if ( end != number.c_str() + number.size() ) {
+                fail( "malformed number" );
+            }
+            return JsonValue{ value };
+        }
+    };
+};
@@ -0,0 +1,209 @@
+#pragma once
+
+#include "mapped_file.hpp"
+
+#define GLFW_INCLUDE_VULKAN
+#include "GLFW/glfw3.h"
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// Reader for KTX 2.0 containers (https://registry.khronos.org/KTX/specs/2.0/).
+//
+// Only what a streamer needs: 2D textures with a single layer and face, no
+// supercompression, and a vkFormat the table below knows the block size of.
+// Mip levels are pre-built by the offline tool (toktx, basisu, ...); the file
+// stays mapped and levels are handed out as pointers into the mapping.
+
+constexpr std::array<std::uint8_t, 12> KTX2_IDENTIFIER{
+    0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n'
+};
+
+struct Ktx2Header
+{
+    std::array<std::uint8_t, 12> identifier;
+    std::uint32_t                vk_format;
+    std::uint32_t                type_size;
+    std::uint32_t                pixel_width;
+    std::uint32_t                pixel_height;
+    std::uint32_t                pixel_depth;
+    std::uint32_t                layer_count;
+    std::uint32_t                face_count;
+    std::uint32_t                level_count;
+    std::uint32_t                supercompression_scheme;
+    std::uint32_t                dfd_byte_offset;
+    std::uint32_t                dfd_byte_length;
+    std::uint32_t                kvd_byte_offset;
+    std::uint32_t                kvd_byte_length;
+    std::uint64_t                sgd_byte_offset;
+    std::uint64_t                sgd_byte_length;
+};
+static_assert( sizeof( Ktx2Header ) == 80 );
+
+struct Ktx2LevelIndex
+{
+    std::uint64_t byte_offset;
+    std::uint64_t byte_length;
+    std::uint64_t uncompressed_byte_length;
+};
+static_assert( sizeof( Ktx2LevelIndex ) == 24 );
+
+struct TextureFormatInfo
+{
+    std::uint32_t block_width{ 1 };
+    std::uint32_t block_height{ 1 };
+    std::uint32_t block_bytes{ 4 };
+};
+
+[[nodiscard]] inline std::optional<TextureFormatInfo>
+texture_format_info( const VkFormat format ) noexcept {
+    switch ( format ) {
+    case VK_FORMAT_R8_UNORM: return TextureFormatInfo{ 1, 1, 1 };
+    case VK_FORMAT_R8G8_UNORM: return TextureFormatInfo{ 1, 1, 2 };
+    case VK_FORMAT_R8G8B8A8_UNORM:
+    case VK_FORMAT_R8G8B8A8_SRGB:
+    case VK_FORMAT_R8G8B8A8_SNORM:
+    case VK_FORMAT_B8G8R8A8_UNORM:
+    case VK_FORMAT_B8G8R8A8_SRGB: return TextureFormatInfo{ 1, 1, 4 };
+    case VK_FORMAT_R16G16B16A16_SFLOAT: return TextureFormatInfo{ 1, 1, 8 };
+    case VK_FORMAT_R32G32B32A32_SFLOAT: return TextureFormatInfo{ 1, 1, 16 };
+    case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+    case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+    case VK_FORMAT_BC1_RGBA_UNORM_BLOCK:
+    case VK_FORMAT_BC1_RGBA_SRGB_BLOCK:
+    case VK_FORMAT_BC4_UNORM_BLOCK:
+    case VK_FORMAT_BC4_SNORM_BLOCK: return TextureFormatInfo{ 4, 4, 8 };
+    case VK_FORMAT_BC2_UNORM_BLOCK:
+    case VK_FORMAT_BC2_SRGB_BLOCK:
+    case VK_FORMAT_BC3_UNORM_BLOCK:
+    case VK_FORMAT_BC3_SRGB_BLOCK:
+    case VK_FORMAT_BC5_UNORM_BLOCK:
+    case VK_FORMAT_BC5_SNORM_BLOCK:
+    case VK_FORMAT_BC6H_UFLOAT_BLOCK:
+    case VK_FORMAT_BC6H_SFLOAT_BLOCK:
+    case VK_FORMAT_BC7_UNORM_BLOCK:
+    case VK_FORMAT_BC7_SRGB_BLOCK: return TextureFormatInfo{ 4, 4, 16 };
+    default: return std::nullopt;
+    }
+}
+
+[[nodiscard]] constexpr std::uint32_t
+mip_dimension( const std::uint32_t base, const std::uint32_t level ) noexcept {
+    return std::max( base >> level, 1u );
+}
+
+// Tightly packed size of one level, as stored in KTX2 and in staging buffers.
+[[nodiscard]] constexpr VkDeviceSize
+texture_level_size( const TextureFormatInfo & info, const std::uint32_t width,
+                    const std::uint32_t height ) noexcept {
+    const VkDeviceSize blocks_x{ ( width + info.block_width - 1 )
+                                 / info.block_width };
+    const VkDeviceSize blocks_y{ ( height + info.block_height - 1 )
+                                 / info.block_height };
+    return blocks_x * blocks_y * info.block_bytes;
+}
+
+struct Ktx2Level
+{
+    const std::uint8_t * data{ nullptr };
+    VkDeviceSize         size{ 0 };
+    std::uint32_t        width{ 0 };
+    std::uint32_t        height{ 0 };
+};
+
+class Ktx2File
+{
+    public:
+    explicit Ktx2File( const std::string & path ) :
+        m_file( path, MappedFile::Access::random ) {
+        if ( m_file.size() < sizeof( Ktx2Header ) ) {
+            throw std::runtime_error( "Texture file too small: " + path );
+        }
+        std::memcpy( &m_header, m_file.data(), sizeof( m_header ) );
+        if ( m_header.identifier != KTX2_IDENTIFIER ) {
+            throw std::runtime_error( "Not a KTX2 file: " + path );
+        }
+
+        m_format = static_cast<VkFormat>( m_header.vk_format );
+        const auto info{ texture_format_info( m_format ) };
+        if ( !info.has_value() ) {
+            // Includes VK_FORMAT_UNDEFINED, i.e. Basis Universal payloads.
+            throw std::runtime_error( "Unsupported KTX2 format "
+                                      + std::to_string( m_header.vk_format )
+                                      + ": " + path );
+        }
+        m_info = info.value();
+        if ( m_header.pixel_width == 0 || m_header.pixel_height == 0
+             || m_header.pixel_depth > 1 || m_header.layer_count > 1
+             || m_header.face_count != 1 ) {
+            throw std::runtime_error( "Only 2D KTX2 textures are supported: "
+                                      + path );
+        }
+        if ( m_header.supercompression_scheme != 0 ) {
+            throw std::runtime_error( "Supercompressed KTX2 is not supported: "
+                                      + path );
+        }
+
+        // level_count 0 asks the loader to generate mips; we only use level 0.
+        const std::uint32_t level_count{ std::max( m_header.level_count, 1u ) };
+        const auto          index_end{
+            sizeof( Ktx2Header ) + level_count * sizeof( Ktx2LevelIndex ) };
+        if ( index_end > m_file.size() ) {
+            throw std::runtime_error( "Truncated KTX2 level index: " + path );
+        }
+
+        m_levels.reserve( level_count );
+        for ( std::uint32_t level{ 0 }; level < level_count; ++level ) {
+            Ktx2LevelIndex index{};
+            std::memcpy( &index,
+                         m_file.data() + sizeof( Ktx2Header )
+                             + level * sizeof( Ktx2LevelIndex ),
+                         sizeof( index ) );
+
+            Ktx2Level entry{};
+            entry.width = mip_dimension( m_header.pixel_width, level );
+            entry.height = mip_dimension( m_header.pixel_height, level );
+            entry.size =
+                texture_level_size( m_info, entry.width, entry.height );
+            if ( index.byte_length < entry.size
+                 || index.byte_offset + index.byte_length > m_file.size() ) {
+                throw std::runtime_error( "Bad KTX2 level "
+                                          + std::to_string( level ) + ": "
+                                          + path );
+            }
+            entry.data = m_file.data() + index.byte_offset;
+            m_levels.push_back( entry );
+        }
+    }
+
+    [[nodiscard]] VkFormat format() const noexcept { return m_format; }
+    [[nodiscard]] const TextureFormatInfo & format_info() const noexcept {
+        return m_info;
+    }
+    [[nodiscard]] std::uint32_t width() const noexcept {
+        return m_header.pixel_width;
+    }
+    [[nodiscard]] std::uint32_t height() const noexcept {
+        return m_header.pixel_height;
+    }
+    // Level 0 is the full resolution image.
+    [[nodiscard]] std::uint32_t level_count() const noexcept {
+        return static_cast<std::uint32_t>( m_levels.size() );
+    }
+    [[nodiscard]] const Ktx2Level & level( const std::uint32_t index ) const {
+        return m_levels.at( index );
+    }
+
+    private:
+    MappedFile             m_file;
+    Ktx2Header             m_header{};
+    VkFormat               m_format{ VK_FORMAT_UNDEFINED };
+    TextureFormatInfo      m_info{};
+    std::vector<Ktx2Level> m_levels;
+};
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Read-only memory mapping of a whole file (POSIX).
+class MappedFile
+{
+    public:
+    enum class Access
+    {
+        // Read front to back exactly once; read ahead aggressively.
+        sequential,
+        // Parts are read on demand, e.g. single mip levels.
+        random,
+    };
+
+    explicit MappedFile( const std::string & path,
+                         const Access        access = Access::sequential ) {
+        const int fd{ ::open( path.c_str(), O_RDONLY ) };
+        if ( fd < 0 ) {
+            throw std::runtime_error( "Couldn't open file: " + path );
+        }
+
+        struct stat info{};
+        if ( ::fstat( fd, &info ) != 0 || info.st_size <= 0 ) {
+            ::close( fd );
+            throw std::runtime_error( "Couldn't stat file: " + path );
+        }
+        m_size = static_cast<std::size_t>( info.st_size );
+
+        void * data{ ::mmap( nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0 ) };
+        // The mapping keeps its own reference to the file.
+        ::close( fd );
+        if ( data == MAP_FAILED ) {
+            throw std::runtime_error( "Couldn't map file: " + path );
+        }
+        m_data = static_cast<const std::uint8_t *>( data );
+
+        if ( access == Access::sequential ) {
+            ::madvise( data, m_size, MADV_SEQUENTIAL );
+            ::madvise( data, m_size, MADV_WILLNEED );
+        }
+        else {
+            ::madvise( data, m_size, MADV_RANDOM );
+        }
+    }
+
+    MappedFile( const MappedFile & ) = delete;
+    MappedFile & operator=( const MappedFile & ) = delete;
+
+    ~MappedFile() {
+        if ( m_data != nullptr ) {
+            ::munmap( const_cast<std::uint8_t *>( m_data ), m_size );
+        }
+    }
+
+    [[nodiscard]] const std::uint8_t * data() const noexcept { return m_data; }
+    [[nodiscard]] std::size_t          size() const noexcept { return m_size; }
+
+    private:
+    const std::uint8_t * m_data{ nullptr };
+    std::size_t          m_size{ 0 };
+};
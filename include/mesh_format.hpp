@@ -0,0 +1,168 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include "GLFW/glfw3.h"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+
+// On-disk layout of converted meshes (.vmesh), shared by mesh_convert and the
+// runtime loader. Everything is little-endian and laid out so the vertex and
+// index sections can be copied into GPU buffers byte for byte:
+//
+//   MeshFileHeader
+//   PackedVertex[vertex_count]       at vertex_offset
+//   uint16/uint32[index_count]       at index_offset
+//
+// Section offsets are aligned to MESH_SECTION_ALIGNMENT.
+
+constexpr std::array<char, 4> MESH_FILE_MAGIC{ 'V', 'M', 'S', 'H' };
+constexpr std::uint32_t       MESH_FILE_VERSION{ 1 };
+constexpr std::uint64_t       MESH_SECTION_ALIGNMENT{ 16 };
+
+struct MeshFileHeader
+{
+    std::array<char, 4> magic{ MESH_FILE_MAGIC };
+    std::uint32_t       version{ MESH_FILE_VERSION };
+    std::uint32_t       vertex_count{ 0 };
+    std::uint32_t       vertex_stride{ 0 };
+    std::uint32_t       index_count{ 0 };
+    // Bytes per index, 2 or 4.
+    std::uint32_t index_size{ 0 };
+    float         bounds_min[3]{};
+    float         bounds_max[3]{};
+    std::uint64_t vertex_offset{ 0 };
+    std::uint64_t index_offset{ 0 };
+};
+static_assert( sizeof( MeshFileHeader ) == 64 );
+
+// 20 bytes per vertex against 32 for float position/normal/uv.
+//  - position: float32x3, kept exact so large scenes don't crack.
+//  - normal:   octahedral encoding in snorm16x2.
+//  - uv:       float16x2.
+struct PackedVertex
+{
+    float         position[3];
+    std::int16_t  normal[2];
+    std::uint16_t uv[2];
+};
+static_assert( sizeof( PackedVertex ) == 20 );
+
+[[nodiscard]] constexpr std::uint64_t
+align_mesh_section( const std::uint64_t offset ) noexcept {
+    return ( offset + MESH_SECTION_ALIGNMENT - 1 )
+           & ~( MESH_SECTION_ALIGNMENT - 1 );
+}
+
+[[nodiscard]] constexpr VkIndexType
+mesh_index_type( const std::uint32_t index_size ) noexcept {
+    return index_size == 2 ? VK_INDEX_TYPE_UINT16 : VK_INDEX_TYPE_UINT32;
+}
+
+// Vertex input state matching PackedVertex, binding 0.
+[[nodiscard]] inline VkVertexInputBindingDescription
+mesh_vertex_binding() noexcept {
+    VkVertexInputBindingDescription binding{};
+    binding.binding = 0;
+    binding.stride = sizeof( PackedVertex );
+    binding.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+    return binding;
+}
+
+[[nodiscard]] inline std::array<VkVertexInputAttributeDescription, 3>
+mesh_vertex_attributes() noexcept {
+    std::array<VkVertexInputAttributeDescription, 3> attributes{};
+
+    attributes[0].location = 0;
+    attributes[0].binding = 0;
+    attributes[0].format = VK_FORMAT_R32G32B32_SFLOAT;
+    attributes[0].offset = offsetof( PackedVertex, position );
+
+    // Unpacked to [-1, 1] by the fetch unit, decoded in the shader.
+    attributes[1].location = 1;
+    attributes[1].binding = 0;
+    attributes[1].format = VK_FORMAT_R16G16_SNORM;
+    attributes[1].offset = offsetof( PackedVertex, normal );
+
+    attributes[2].location = 2;
+    attributes[2].binding = 0;
+    attributes[2].format = VK_FORMAT_R16G16_SFLOAT;
+    attributes[2].offset = offsetof( PackedVertex, uv );
+
+    return attributes;
+}
+
+// Quantisation helpers used by the converter.
+
+[[nodiscard]] inline std::int16_t
+quantize_snorm16( const float v ) noexcept {
+    return static_cast<std::int16_t>(
+        std::lround( std::clamp( v, -1.0f, 1.0f ) * 32767.0f ) );
+}
+
+// Octahedral normal encoding (Meyer et al. 2010), see mesh_vert.vert for the
+// matching decode.
+inline void
+encode_octahedral_normal( const float n[3], std::int16_t out[2] ) noexcept {
+    const float length{ std::abs( n[0] ) + std::abs( n[1] ) + std::abs( n[2] ) };
+    if ( length == 0.0f ) {
+        out[0] = 0;
+        out[1] = 0;
+        return;
+    }
+    float x{ n[0] / length };
+    float y{ n[1] / length };
+    if ( n[2] < 0.0f ) {
+        const float ox{ x };
+        x = ( 1.0f - std::abs( y ) ) * ( ox >= 0.0f ? 1.0f : -1.0f );
+        y = ( 1.0f - std::abs( ox ) ) * ( y >= 0.0f ? 1.0f : -1.0f );
+    }
+    out[0] = quantize_snorm16( x );
+    out[1] = quantize_snorm16( y );
+}
+
+// IEEE 754 binary16, round to nearest even, with overflow to infinity.
+[[nodiscard]] inline std::uint16_t
+float_to_half( const float value ) noexcept {
+    const auto     bits{ std::bit_cast<std::uint32_t>( value ) };
+    const auto     sign{ static_cast<std::uint16_t>( ( bits >> 16 ) & 0x8000u ) };
+    const auto     exponent{ static_cast<std::int32_t>( ( bits >> 23 ) & 0xFFu ) };
+    std::uint32_t  mantissa{ bits & 0x7FFFFFu };
+
+    if ( exponent == 0xFF ) {
+        return static_cast<std::uint16_t>( sign | 0x7C00u
+                                           | ( mantissa != 0 ? 0x200u : 0u ) );
+    }
+
+    const std::int32_t half_exponent{ exponent - 127 + 15 };
+    if ( half_exponent >= 0x1F ) {
+        return static_cast<std::uint16_t>( sign | 0x7C00u );
+    }
+    if ( half_exponent <= 0 ) {
+        if ( half_exponent < -10 ) {
+            return sign;
+        }
+        mantissa |= 0x800000u;
+        const auto    shift{ static_cast<std::uint32_t>( 14 - half_exponent ) };
+        std::uint32_t half_mantissa{ mantissa >> shift };
+        const auto    remainder{ mantissa & ( ( 1u << shift ) - 1 ) };
+        const auto    halfway{ 1u << ( shift - 1 ) };
+        if ( remainder > halfway
+             || ( remainder == halfway && ( half_mantissa & 1u ) ) ) {
+            ++half_mantissa;
+        }
+        return static_cast<std::uint16_t>( sign | half_mantissa );
+    }
+
+    std::uint32_t half{ ( static_cast<std::uint32_t>( half_exponent ) << 10 )
+                        | ( mantissa >> 13 ) };
+    const auto    remainder{ mantissa & 0x1FFFu };
+    if ( remainder > 0x1000u || ( remainder == 0x1000u && ( half & 1u ) ) ) {
+        ++half; // May carry into the exponent, which is still correct.
+    }
+    return static_cast<std::uint16_t>( sign | half );
+}
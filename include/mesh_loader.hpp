@@ -0,0 +1,344 @@
+#pragma once
+
+#include "async_executor.hpp"
+#include "mapped_file.hpp"
+#include "mesh_format.hpp"
+#include "submit_thread.hpp"
+#include "vk_dispatch.hpp"
+#include "vk_memory.hpp"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+struct Mesh
+{
+    BufferAllocation vertex_buffer;
+    BufferAllocation index_buffer;
+    VkIndexType      index_type{ VK_INDEX_TYPE_UINT32 };
+    std::uint32_t    vertex_count{ 0 };
+    std::uint32_t    index_count{ 0 };
+    float            bounds_min[3]{};
+    float            bounds_max[3]{};
+
+    [[nodiscard]] VkDeviceSize gpu_bytes() const noexcept {
+        return vertex_buffer.size + index_buffer.size;
+    }
+};
+
+struct MeshLoadStats
+{
+    VkDeviceSize bytes{ 0 };
+    double       seconds{ 0.0 };
+    // Written straight into host visible device memory, no staging copy.
+    bool direct{ false };
+};
+
+// Checks a whole .vmesh file in memory and returns its header, which is
+// used in place; `data` has to be at least 8 byte aligned.
+[[nodiscard]] inline const MeshFileHeader &
+validate_mesh_file( const std::uint8_t * data, const std::size_t size,
+                    const std::string & path ) {
+    if ( size < sizeof( MeshFileHeader ) ) {
+        throw std::runtime_error( "Mesh file too small: " + path );
+    }
+    const auto & header{ *reinterpret_cast<const MeshFileHeader *>( data ) };
+    if ( header.magic != MESH_FILE_MAGIC
+         || header.version != MESH_FILE_VERSION ) {
+        throw std::runtime_error( "Not a supported .vmesh file: " + path );
+    }
+    if ( header.vertex_stride != sizeof( PackedVertex )
+         || ( header.index_size != 2 && header.index_size != 4 )
+         || header.vertex_count == 0 || header.index_count == 0 ) {
+        throw std::runtime_error( "Unsupported mesh layout: " + path );
+    }
+    const auto vertex_end{ header.vertex_offset
+                           + std::uint64_t{ header.vertex_count }
+                                 * header.vertex_stride };
+    const auto index_end{ header.index_offset
+                          + std::uint64_t{ header.index_count }
+                                * header.index_size };
+    if ( vertex_end > size || index_end > size ) {
+        throw std::runtime_error( "Truncated mesh file: " + path );
+    }
+    return header;
+}
+
+// Staging buffer size for meshes that can't be written in place.
+constexpr VkDeviceSize MESH_STAGING_CHUNK_SIZE{ 4ull << 20 };
+
+// Where load_mesh_async() puts its copies. They are pushed to
+// `submit_thread` like the frames, whose graphics queue they land on.
+struct MeshUploadTarget
+{
+    VkPhysicalDevice physical_device{ VK_NULL_HANDLE };
+    VkDevice         device{ VK_NULL_HANDLE };
+    // Records the copies.
+    DeviceDispatch dispatch;
+    SubmitThread * submit_thread{ nullptr };
+    std::uint32_t  queue_family{ 0 };
+    // For the buffers, staging and the per-load pool and fences.
+    const VkAllocationCallbacks * allocator{ nullptr };
+};
+
+// Loads a .vmesh file written by mesh_convert into device-local buffers.
+//
+// The file is mapped, and copied out of the mapping, on the executor's I/O
+// pool, so page faults never stall a worker and the only CPU copy is the one
+// into GPU-visible memory. On unified memory (integrated GPUs, software
+// rasterisers, resizable BAR) that copy targets the final buffers directly.
+// Otherwise the data streams through two staging buffers of at most
+// `chunk_size`: while the GPU copies one chunk, the next fills the other,
+// and each chunk's fence is awaited rather than waited on before its buffer
+// is reused. Any number of loads can overlap without tying up a thread
+// each, and staging memory stays bounded whatever the file size.
+[[nodiscard]] inline Task<Mesh>
+load_mesh_async( AsyncExecutor & executor, const MeshUploadTarget target,
+                 std::string path, MeshLoadStats * stats = nullptr,
+                 const VkDeviceSize chunk_size = MESH_STAGING_CHUNK_SIZE ) {
+    const auto start{ std::chrono::steady_clock::now() };
+    co_await executor.schedule_io();
+    const MappedFile file( path, MappedFile::Access::sequential );
+    co_await executor.schedule();
+    // mmap returns page aligned memory.
+    const auto & header{ validate_mesh_file( file.data(), file.size(),
+                                             path ) };
+
+    Mesh mesh{};
+    mesh.vertex_count = header.vertex_count;
+    mesh.index_count = header.index_count;
+    mesh.index_type = mesh_index_type( header.index_size );
+    std::copy_n( header.bounds_min, 3, mesh.bounds_min );
+    std::copy_n( header.bounds_max, 3, mesh.bounds_max );
+
+    const VkDeviceSize vertex_bytes{ VkDeviceSize{ header.vertex_count }
+                                     * header.vertex_stride };
+    const VkDeviceSize index_bytes{ VkDeviceSize{ header.index_count }
+                                    * header.index_size };
+    const auto create{ [&]( const VkDeviceSize size,
+                            const VkBufferUsageFlags usage ) {
+        return create_buffer( target.physical_device, target.device, size,
+                              usage | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                              VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                              VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT
+                                  | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                              target.allocator );
+    } };
+    mesh.vertex_buffer = create( vertex_bytes,
+                                 VK_BUFFER_USAGE_VERTEX_BUFFER_BIT );
+    mesh.index_buffer = create( index_bytes, VK_BUFFER_USAGE_INDEX_BUFFER_BIT );
+
+    struct Copy
+    {
+        BufferAllocation *   destination;
+        const std::uint8_t * source;
+        VkDeviceSize         size;
+        VkAccessFlags        read_access;
+    };
+    std::vector<Copy> staged;
+    VkDeviceSize      largest_staged{ 0 };
+    for ( const Copy copy :
+          { Copy{ &mesh.vertex_buffer, file.data() + header.vertex_offset,
+                  vertex_bytes, VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT },
+            Copy{ &mesh.index_buffer, file.data() + header.index_offset,
+                  index_bytes, VK_ACCESS_INDEX_READ_BIT } } ) {
+        if ( copy.destination->properties
+             & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT ) {
+            void * mapped{ nullptr };
+            if ( vkMapMemory( target.device, copy.destination->memory, 0,
+                              VK_WHOLE_SIZE, 0, &mapped )
+                 != VK_SUCCESS ) {
+                throw std::runtime_error( "Failed to map mesh buffer." );
+            }
+            co_await executor.schedule_io();
+            std::memcpy( mapped, copy.source, copy.size );
+            co_await executor.schedule();
+            vkUnmapMemory( target.device, copy.destination->memory );
+        }
+        else {
+            staged.push_back( copy );
+            largest_staged = std::max( largest_staged, copy.size );
+        }
+    }
+
+    if ( !staged.empty() ) {
+        VkCommandPoolCreateInfo pool_info{};
+        pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+        pool_info.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT
+                          | VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+        pool_info.queueFamilyIndex = target.queue_family;
+        UniqueCommandPool command_pool;
+        if ( vkCreateCommandPool( target.device, &pool_info, target.allocator,
+                                  command_pool.put( target.device,
+                                                    target.allocator ) )
+             != VK_SUCCESS ) {
+            throw std::runtime_error( "Failed to create command pool." );
+        }
+
+        // While the GPU copies out of one, the next chunk fills the other.
+        struct StagingSlot
+        {
+            BufferAllocation allocation;
+            std::uint8_t *   mapped{ nullptr };
+            VkCommandBuffer  command_buffer{ VK_NULL_HANDLE };
+            UniqueFence      fence;
+            bool             pending{ false };
+        };
+        const VkDeviceSize         slot_size{ std::min( chunk_size,
+                                                        largest_staged ) };
+        std::array<StagingSlot, 2> slots{};
+        for ( auto & slot : slots ) {
+            slot.allocation = create_buffer(
+                target.physical_device, target.device, slot_size,
+                VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT
+                    | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                0, target.allocator );
+            void * mapped{ nullptr };
+            if ( vkMapMemory( target.device, slot.allocation.memory, 0,
+                              VK_WHOLE_SIZE, 0, &mapped )
+                 != VK_SUCCESS ) {
+                throw std::runtime_error( "Failed to map staging buffer." );
+            }
+            // Freeing the memory unmaps it.
+            slot.mapped = static_cast<std::uint8_t *>( mapped );
+
+            VkCommandBufferAllocateInfo alloc_info{};
+            alloc_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+            alloc_info.commandPool = command_pool;
+            alloc_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+            alloc_info.commandBufferCount = 1;
+            if ( vkAllocateCommandBuffers( target.device, &alloc_info,
+                                           &slot.command_buffer )
+                 != VK_SUCCESS ) {
+                throw std::runtime_error(
+                    "Failed to allocate command buffer." );
+            }
+
+            VkFenceCreateInfo fence_info{};
+            fence_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+            if ( vkCreateFence( target.device, &fence_info, target.allocator,
+                                slot.fence.put( target.device,
+                                                target.allocator ) )
+                 != VK_SUCCESS ) {
+                throw std::runtime_error( "Failed to create fence." );
+            }
+        }
+
+        // A chunk still in flight reads its staging buffer, so an error
+        // is only rethrown once both fences have been awaited.
+        std::exception_ptr error;
+        try {
+            std::size_t next_slot{ 0 };
+            for ( const auto & copy : staged ) {
+                for ( VkDeviceSize offset{ 0 }; offset < copy.size;
+                      offset += slot_size ) {
+                    const auto chunk{ std::min( slot_size,
+                                                copy.size - offset ) };
+                    auto &     slot{ slots[next_slot] };
+                    next_slot = ( next_slot + 1 ) % slots.size();
+                    if ( slot.pending ) {
+                        co_await executor.wait_fence(
+                            target.dispatch, target.device, slot.fence );
+                        slot.pending = false;
+                        const VkFence fence{ slot.fence };
+                        target.dispatch.reset_fences( target.device, 1,
+                                                      &fence );
+                    }
+
+                    co_await executor.schedule_io();
+                    std::memcpy( slot.mapped, copy.source + offset, chunk );
+                    co_await executor.schedule();
+
+                    VkCommandBufferBeginInfo begin_info{};
+                    begin_info.sType =
+                        VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+                    begin_info.flags =
+                        VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+                    target.dispatch.reset_command_buffer( slot.command_buffer,
+                                                          0 );
+                    if ( target.dispatch.begin_command_buffer(
+                             slot.command_buffer, &begin_info )
+                         != VK_SUCCESS ) {
+                        throw std::runtime_error(
+                            "Failed to begin command buffer." );
+                    }
+                    VkBufferCopy region{};
+                    region.srcOffset = 0;
+                    region.dstOffset = offset;
+                    region.size = chunk;
+                    target.dispatch.cmd_copy_buffer(
+                        slot.command_buffer, slot.allocation.buffer,
+                        copy.destination->buffer, 1, &region );
+
+                    // The last chunk makes the whole buffer visible to
+                    // vertex input.
+                    if ( offset + chunk == copy.size ) {
+                        VkBufferMemoryBarrier barrier{};
+                        barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+                        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+                        barrier.dstAccessMask = copy.read_access;
+                        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+                        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+                        barrier.buffer = copy.destination->buffer;
+                        barrier.offset = 0;
+                        barrier.size = VK_WHOLE_SIZE;
+                        target.dispatch.cmd_pipeline_barrier(
+                            slot.command_buffer,
+                            VK_PIPELINE_STAGE_TRANSFER_BIT,
+                            VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, 0, 0,
+                            nullptr, 1, &barrier, 0, nullptr );
+                    }
+                    if ( target.dispatch.end_command_buffer(
+                             slot.command_buffer )
+                         != VK_SUCCESS ) {
+                        throw std::runtime_error(
+                            "Failed to record command buffer." );
+                    }
+
+                    QueueSubmission submission{};
+                    submission.command_buffers.push_back(
+                        slot.command_buffer );
+                    submission.fence = slot.fence;
+                    // A failed submit never signals the fence, so this
+                    // waits for the driver call (not the GPU) before
+                    // counting the chunk as in flight.
+                    target.submit_thread->wait_issued(
+                        target.submit_thread->submit(
+                            std::move( submission ) ) );
+                    target.submit_thread->check();
+                    slot.pending = true;
+                }
+            }
+        }
+        catch ( ... ) {
+            error = std::current_exception();
+        }
+        for ( auto & slot : slots ) {
+            if ( slot.pending ) {
+                co_await executor.wait_fence( target.dispatch, target.device,
+                                              slot.fence );
+            }
+        }
+        if ( error ) {
+            std::rethrow_exception( error );
+        }
+    }
+
+    if ( stats != nullptr ) {
+        stats->bytes = mesh.gpu_bytes();
+        stats->direct = staged.empty();
+        stats->seconds = std::chrono::duration<double>(
+                             std::chrono::steady_clock::now() - start )
+                             .count();
+    }
+    co_return mesh;
+}
@@ -0,0 +1,322 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <numeric>
+#include <span>
+#include <vector>
+
+// Offline index and vertex reordering for mesh_convert.
+//
+// optimize_vertex_cache() implements Tipsify (Sander, Nehab & Barczak, "Fast
+// Triangle Reordering for Vertex Locality and Reduced Overdraw", 2007). It
+// emits triangles fanning around recently used vertices and records where it
+// had to jump to an unrelated part of the mesh; those jumps split the output
+// into clusters which optimize_overdraw() can reorder freely without losing
+// cache locality inside each cluster.
+
+struct ClusteredIndices
+{
+    std::vector<std::uint32_t> indices;
+    // First index of every cluster, ascending, starting at 0.
+    std::vector<std::size_t> cluster_starts;
+};
+
+// Average post-transform cache misses per triangle for a FIFO cache.
+[[nodiscard]] inline double
+compute_acmr( const std::span<const std::uint32_t> indices,
+              const std::size_t vertex_count, const std::size_t cache_size ) {
+    if ( indices.size() < 3 ) {
+        return 0.0;
+    }
+    // Timestamp of the cache insertion, a vertex is cached while it is one of
+    // the last cache_size insertions.
+    std::vector<std::size_t> inserted_at( vertex_count, 0 );
+    std::size_t              time{ cache_size + 1 };
+    std::size_t              misses{ 0 };
+    for ( const auto index : indices ) {
+        if ( time - inserted_at[index] > cache_size ) {
+            inserted_at[index] = time++;
+            ++misses;
+        }
+    }
+    return static_cast<double>( misses )
+           / static_cast<double>( indices.size() / 3 );
+}
+
+[[nodiscard]] inline ClusteredIndices
+optimize_vertex_cache( const std::span<const std::uint32_t> indices,
+                       const std::size_t                    vertex_count,
+                       const std::size_t                    cache_size = 16 ) {
+    const std::size_t triangle_count{ indices.size() / 3 };
+
+    ClusteredIndices result{};
+    result.indices.reserve( triangle_count * 3 );
+    if ( triangle_count == 0 ) {
+        return result;
+    }
+
+    // Vertex -> triangle adjacency in CSR form.
+    std::vector<std::uint32_t> live( vertex_count, 0 );
+    for ( const auto index : indices ) {
+        ++live[index];
+    }
+    std::vector<std::size_t> adjacency_start( vertex_count + 1, 0 );
+    for ( std::size_t v{ 0 }; v < vertex_count; ++v ) {
+        adjacency_start[v + 1] = adjacency_start[v] + live[v];
+    }
+    std::vector<std::uint32_t> adjacency( indices.size() );
+    {
+        auto fill{ adjacency_start };
+        for ( std::size_t i{ 0 }; i < indices.size(); ++i ) {
+            adjacency[fill[indices[i]]++] = static_cast<std::uint32_t>( i / 3 );
+        }
+    }
+
+    std::vector<std::size_t>   cache_time( vertex_count, 0 );
+    std::vector<bool>          emitted( triangle_count, false );
+    std::vector<std::uint32_t> dead_end;
+    std::vector<std::uint32_t> candidates;
+    std::size_t                time{ cache_size + 1 };
+    std::size_t                cursor{ 0 };
+    bool                       jumped{ false };
+
+    const auto skip_dead_end = [&]() -> std::int64_t {
+        while ( !dead_end.empty() ) {
+            const auto v{ dead_end.back() };
+            dead_end.pop_back();
+            if ( live[v] > 0 ) {
+                return v;
+            }
+        }
+        for ( ; cursor < vertex_count; ++cursor ) {
+            if ( live[cursor] > 0 ) {
+                jumped = true;
+                return static_cast<std::int64_t>( cursor );
+            }
+        }
+        return -1;
+    };
+
+    std::int64_t fan{ skip_dead_end() };
+    result.cluster_starts.push_back( 0 );
+    while ( fan >= 0 ) {
+        candidates.clear();
+        for ( auto a{ adjacency_start[fan] }; a < adjacency_start[fan + 1];
+              ++a ) {
+            const auto triangle{ adjacency[a] };
+            if ( emitted[triangle] ) {
+                continue;
+            }
+            for ( std::size_t k{ 0 }; k < 3; ++k ) {
+                const auto v{ indices[triangle * 3 + k] };
+                result.indices.push_back( v );
+                dead_end.push_back( v );
+                candidates.push_back( v );
+                --live[v];
+                if ( time - cache_time[v] > cache_size ) {
+                    cache_time[v] = time++;
+                }
+            }
+            emitted[triangle] = true;
+        }
+
+        // Prefer the candidate that will still be in cache once all of its
+        // remaining triangles have been emitted, and among those the oldest.
+        std::int64_t next{ -1 };
+        std::size_t  best_priority{ 0 };
+        for ( const auto v : candidates ) {
+            if ( live[v] == 0 ) {
+                continue;
+            }
+            std::size_t priority{ 0 };
+            if ( time - cache_time[v] + 2 * live[v] <= cache_size ) {
+                priority = time - cache_time[v];
+            }
+            if ( next < 0 || priority > best_priority ) {
+                next = v;
+                best_priority = priority;
+            }
+        }
+
+        // Resuming from the dead-end stack stays near the last fan; only a
+        // jump to an unvisited region starts a new cluster.
+        if ( next < 0 ) {
+            jumped = false;
+            next = skip_dead_end();
+            if ( jumped && next >= 0 ) {
+                result.cluster_starts.push_back( result.indices.size() );
+            }
+        }
+        fan = next;
+    }
+
+    return result;
+}
+
+// Splits each Tipsify cluster further wherever the cluster's running ACMR has
+// dropped to within `threshold` of the ACMR of the whole cluster, so
+// connected meshes (a single cluster) can still be reordered for overdraw at
+// a bounded vertex cache cost.
+[[nodiscard]] inline std::vector<std::size_t>
+split_soft_clusters( const ClusteredIndices & clustered,
+                     const std::size_t vertex_count, const std::size_t cache_size,
+                     const double threshold ) {
+    const auto & indices{ clustered.indices };
+    const auto & hard{ clustered.cluster_starts };
+
+    std::vector<std::size_t> inserted_at( vertex_count, 0 );
+    std::size_t              time{ cache_size + 1 };
+    // Returns the misses for one triangle.
+    const auto simulate = [&]( const std::size_t first ) {
+        std::size_t misses{ 0 };
+        for ( std::size_t k{ 0 }; k < 3; ++k ) {
+            const auto v{ indices[first + k] };
+            if ( time - inserted_at[v] > cache_size ) {
+                inserted_at[v] = time++;
+                ++misses;
+            }
+        }
+        return misses;
+    };
+    const auto flush_cache = [&]() { time += cache_size + 1; };
+
+    std::vector<std::size_t> soft;
+    for ( std::size_t c{ 0 }; c < hard.size(); ++c ) {
+        const auto begin{ hard[c] };
+        const auto end{ c + 1 < hard.size() ? hard[c + 1] : indices.size() };
+
+        flush_cache();
+        std::size_t cluster_misses{ 0 };
+        for ( auto i{ begin }; i < end; i += 3 ) {
+            cluster_misses += simulate( i );
+        }
+        const double cluster_acmr{ static_cast<double>( cluster_misses )
+                                   / static_cast<double>( ( end - begin ) / 3 ) };
+
+        soft.push_back( begin );
+        flush_cache();
+        std::size_t misses{ 0 }, triangles{ 0 };
+        for ( auto i{ begin }; i < end; i += 3 ) {
+            misses += simulate( i );
+            ++triangles;
+            if ( i + 3 < end
+                 && static_cast<double>( misses )
+                        <= threshold * cluster_acmr
+                               * static_cast<double>( triangles ) ) {
+                soft.push_back( i + 3 );
+                flush_cache();
+                misses = 0;
+                triangles = 0;
+            }
+        }
+    }
+    return soft;
+}
+
+// Sorts clusters so outward facing, outer parts of the mesh are drawn first;
+// they are the most likely occluders, so later clusters fail the depth test
+// more often. Positions are read as three floats at `position_stride` bytes
+// apart.
+[[nodiscard]] inline std::vector<std::uint32_t>
+optimize_overdraw( const ClusteredIndices & clustered,
+                   const float * positions, const std::size_t position_stride,
+                   const std::size_t vertex_count,
+                   const std::size_t cache_size = 16,
+                   const double      threshold = 1.05 ) {
+    const auto position = [&]( const std::uint32_t v ) {
+        return reinterpret_cast<const float *>(
+            reinterpret_cast<const std::uint8_t *>( positions )
+            + std::size_t{ v } * position_stride );
+    };
+
+    double mesh_centroid[3]{ 0.0, 0.0, 0.0 };
+    for ( std::uint32_t v{ 0 }; v < vertex_count; ++v ) {
+        for ( int k{ 0 }; k < 3; ++k ) {
+            mesh_centroid[k] += position( v )[k];
+        }
+    }
+    for ( auto & c : mesh_centroid ) {
+        c /= static_cast<double>( std::max<std::size_t>( vertex_count, 1 ) );
+    }
+
+    const auto & indices{ clustered.indices };
+    const auto   starts{ split_soft_clusters( clustered, vertex_count,
+                                              cache_size, threshold ) };
+    std::vector<double> sort_key( starts.size(), 0.0 );
+
+    for ( std::size_t c{ 0 }; c < starts.size(); ++c ) {
+        const auto begin{ starts[c] };
+        const auto end{ c + 1 < starts.size() ? starts[c + 1] : indices.size() };
+
+        // Area weighted normal and centroid of the cluster.
+        double normal[3]{ 0.0, 0.0, 0.0 };
+        double centroid[3]{ 0.0, 0.0, 0.0 };
+        double area{ 0.0 };
+        for ( auto i{ begin }; i + 2 < end; i += 3 ) {
+            const float * p0{ position( indices[i] ) };
+            const float * p1{ position( indices[i + 1] ) };
+            const float * p2{ position( indices[i + 2] ) };
+            const double  e1[3]{ p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2] };
+            const double  e2[3]{ p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2] };
+            const double  n[3]{ e1[1] * e2[2] - e1[2] * e2[1],
+                                e1[2] * e2[0] - e1[0] * e2[2],
+                                e1[0] * e2[1] - e1[1] * e2[0] };
+            const double  a{ std::sqrt( n[0] * n[0] + n[1] * n[1]
+                                        + n[2] * n[2] ) };
+            for ( int k{ 0 }; k < 3; ++k ) {
+                normal[k] += n[k];
+                centroid[k] += a * ( p0[k] + p1[k] + p2[k] ) / 3.0;
+            }
+            area += a;
+        }
+        if ( area == 0.0 ) {
+            continue;
+        }
+
+        double dot{ 0.0 };
+        for ( int k{ 0 }; k < 3; ++k ) {
+            dot += ( centroid[k] / area - mesh_centroid[k] ) * normal[k];
+        }
+        sort_key[c] = dot / area;
+    }
+
+    std::vector<std::size_t> order( starts.size() );
+    std::iota( order.begin(), order.end(), 0 );
+    std::stable_sort( order.begin(), order.end(),
+                      [&]( const std::size_t a, const std::size_t b ) {
+                          return sort_key[a] > sort_key[b];
+                      } );
+
+    std::vector<std::uint32_t> out;
+    out.reserve( indices.size() );
+    for ( const auto c : order ) {
+        const auto begin{ starts[c] };
+        const auto end{ c + 1 < starts.size() ? starts[c + 1] : indices.size() };
+        out.insert( out.end(), indices.begin() + begin, indices.begin() + end );
+    }
+    return out;
+}
+
+// Renumbers vertices in order of first use so the vertex fetch walks memory
+// linearly, and drops unreferenced vertices. Returns the old index of every
+// new vertex; `indices` is rewritten in place.
+[[nodiscard]] inline std::vector<std::uint32_t>
+optimize_vertex_fetch( std::span<std::uint32_t> indices,
+                       const std::size_t        vertex_count ) {
+    constexpr auto             unassigned{ ~std::uint32_t{ 0 } };
+    std::vector<std::uint32_t> remap( vertex_count, unassigned );
+    std::vector<std::uint32_t> order;
+    order.reserve( vertex_count );
+
+    for ( auto & index : indices ) {
+        if ( remap[index] == unassigned ) {
+            remap[index] = static_cast<std::uint32_t>( order.size() );
+            order.push_back( index );
+        }
+        index = remap[index];
+    }
+    return order;
+}
@@ -0,0 +1,394 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <variant>
+#include <vector>
+
+// Process-wide metrics with a hot path of a few relaxed atomics and no
+// locks. Metrics are registered up front and the returned references are
+// kept by whoever records into them; only registration and export touch
+// the registry lock.
+//
+// Export is the Prometheus text format (version 0.0.4), histograms going
+// out as summaries with a fixed set of quantiles.
+
+class MetricCounter
+{
+    public:
+    void add( const std::uint64_t amount = 1 ) noexcept {
+        m_value.fetch_add( amount, std::memory_order_relaxed );
+    }
+    // Mirrors a monotonic total kept elsewhere, e.g. by a collector.
+    void set( const std::uint64_t total ) noexcept {
+        m_value.store( total, std::memory_order_relaxed );
+    }
+    [[nodiscard]] std::uint64_t value() const noexcept {
+        return m_value.load( std::memory_order_relaxed );
+    }
+
+    private:
+    std::atomic<std::uint64_t> m_value{ 0 };
+};
+
+class MetricGauge
+{
+    public:
+    void set( const double value ) noexcept {
+        m_value.store( value, std::memory_order_relaxed );
+    }
+    [[nodiscard]] double value() const noexcept {
+        return m_value.load( std::memory_order_relaxed );
+    }
+
+    private:
+    std::atomic<double> m_value{ 0.0 };
+};
+
+struct HistogramSnapshot
+{
+    std::uint64_t              count{ 0 };
+    std::uint64_t              sum{ 0 };
+    std::uint64_t              max{ 0 };
+    std::vector<std::uint64_t> buckets;
+
+    // Midpoint of the bucket holding quantile `q`, so within half a bucket
+    // (about 3%) of the recorded value; q = 1 is the exact maximum.
+    [[nodiscard]] std::uint64_t quantile( double q ) const noexcept;
+};
+
+// HDR-style log-linear histogram over non-negative integers (nanoseconds,
+// bytes). Every power of two is split into SUB_BUCKETS linear buckets, so
+// the relative error stays the same from nanoseconds to minutes while the
+// whole thing is one fixed array. Values past MAX_VALUE land in the last
+// bucket but still count towards sum and max.
+class MetricHistogram
+{
+    public:
+    static constexpr unsigned      SUB_BUCKET_BITS{ 4 };
+    static constexpr std::uint64_t SUB_BUCKETS{ 1ull << SUB_BUCKET_BITS };
+    // 2^40 ns is about 18 minutes.
+    static constexpr unsigned      MAX_EXPONENT{ 40 };
+    static constexpr std::uint64_t MAX_VALUE{ ( 1ull << ( MAX_EXPONENT + 1 ) )
+                                              - 1 };
+    static constexpr std::size_t   BUCKET_COUNT{
+        ( MAX_EXPONENT - SUB_BUCKET_BITS + 2 ) * SUB_BUCKETS
+    };
+
+    void record( const std::uint64_t value ) noexcept {
+        m_buckets[bucket_index( value )].fetch_add( 1,
+                                                    std::memory_order_relaxed );
+        m_count.fetch_add( 1, std::memory_order_relaxed );
+        m_sum.fetch_add( value, std::memory_order_relaxed );
+        std::uint64_t max{ m_max.load( std::memory_order_relaxed ) };
+        while ( value > max
+                && !m_max.compare_exchange_weak( max, value,
+                                                 std::memory_order_relaxed ) ) {
+        }
+    }
+
+    // Buckets are read one by one while writers carry on, so a snapshot
+    // taken mid-frame can be off by the few values recorded meanwhile.
+    [[nodiscard]] HistogramSnapshot snapshot() const {
+        HistogramSnapshot snapshot{};
+        snapshot.count = m_count.load( std::memory_order_relaxed );
+        snapshot.sum = m_sum.load( std::memory_order_relaxed );
+        snapshot.max = m_max.load( std::memory_order_relaxed );
+        snapshot.buckets.resize( BUCKET_COUNT );
+        for ( std::size_t i{ 0 }; i < BUCKET_COUNT; ++i ) {
+            snapshot.buckets[i] =
+                m_buckets[i].load( std::memory_order_relaxed );
+        }
+        return snapshot;
+    }
+
+    [[nodiscard]] static constexpr std::size_t
+    bucket_index( const std::uint64_t value ) noexcept {
+        if ( value < SUB_BUCKETS ) {
+            return static_cast<std::size_t>( value );
+        }
+        const std::uint64_t clamped{ std::min( value, MAX_VALUE ) };
+        const unsigned exponent{ static_cast<unsigned>(
+            std::bit_width( clamped ) - 1 ) };
+        const unsigned shift{ exponent - SUB_BUCKET_BITS };
+        const std::uint64_t mantissa{ ( clamped >> shift )
+                                      & ( SUB_BUCKETS - 1 ) };
+        return static_cast<std::size_t>( ( shift + 1 ) * SUB_BUCKETS
+                                         + mantissa );
+    }
+    [[nodiscard]] static constexpr std::uint64_t
+    bucket_lower_bound( const std::size_t index ) noexcept {
+        if ( index < SUB_BUCKETS ) {
+            return index;
+        }
+        const std::uint64_t shift{ index / SUB_BUCKETS - 1 };
+        return ( SUB_BUCKETS + index % SUB_BUCKETS ) << shift;
+    }
+    [[nodiscard]] static constexpr std::uint64_t
+    bucket_width( const std::size_t index ) noexcept {
+        return index < SUB_BUCKETS ? 1 : 1ull << ( index / SUB_BUCKETS - 1 );
+    }
+
+    private:
+    std::array<std::atomic<std::uint64_t>, BUCKET_COUNT> m_buckets{};
+    std::atomic<std::uint64_t>                           m_count{ 0 };
+    std::atomic<std::uint64_t>                           m_sum{ 0 };
+    std::atomic<std::uint64_t>                           m_max{ 0 };
+};
+
+inline std::uint64_t
+HistogramSnapshot::quantile( const double q ) const noexcept {
+    if ( count == 0 ) {
+        return 0;
+    }
+    if ( q >= 1.0 ) {
+        return max;
+    }
+    const auto rank{ static_cast<std::uint64_t>(
+        std::max( 1.0, std::ceil( q * static_cast<double>( count ) ) ) ) };
+    std::uint64_t seen{ 0 };
+    for ( std::size_t i{ 0 }; i < buckets.size(); ++i ) {
+        seen += buckets[i];
+        if ( seen >= rank ) {
+            return std::min( max, MetricHistogram::bucket_lower_bound( i )
+                                      + MetricHistogram::bucket_width( i )
+                                            / 2 );
+        }
+    }
+    return max;
+}
+
+using MetricLabels = std::vector<std::pair<std::string, std::string>>;
+
+class MetricsRegistry
+{
+    public:
+    MetricsRegistry() = default;
+    MetricsRegistry( const MetricsRegistry & ) = delete;
+    MetricsRegistry & operator=( const MetricsRegistry & ) = delete;
+
+    // Registering the same name and labels again hands back the same
+    // metric; reusing a name for another kind of metric throws.
+    MetricCounter & counter( const std::string &  name,
+                             const std::string &  help,
+                             const MetricLabels & labels = {} ) {
+        return add<MetricCounter>( name, help, 1.0, labels );
+    }
+    MetricGauge & gauge( const std::string &  name,
+                         const std::string &  help,
+                         const MetricLabels & labels = {} ) {
+        return add<MetricGauge>( name, help, 1.0, labels );
+    }
+    // Values are exported multiplied by `unit`, e.g. 1e-9 to record
+    // nanoseconds and report seconds as Prometheus expects.
+    MetricHistogram & histogram( const std::string &  name,
+                                 const std::string &  help,
+                                 const double         unit = 1.0,
+                                 const MetricLabels & labels = {} ) {
+        return add<MetricHistogram>( name, help, unit, labels );
+    }
+
+    // Runs on the exporting thread right before every export, to pull in
+    // values that are cheaper to sample than to push (allocator stats,
+    // memory budgets). Whatever it captures has to outlive the exporters.
+    void add_collector( std::function<void()> collector ) {
+        std::lock_guard lock( m_mutex );
+        m_collectors.push_back( std::move( collector ) );
+    }
+
+    void write_prometheus( std::ostream & out ) {
+        std::lock_guard lock( m_mutex );
+        for ( const auto & collector : m_collectors ) {
+            collector();
+        }
+
+        const auto flags{ out.flags() };
+        const auto precision{ out.precision() };
+        out.precision( 9 );
+        for ( const auto & family : m_families ) {
+            out << "# HELP " << family.name << ' ' << family.help << '\n'
+                << "# TYPE " << family.name << ' '
+                << type_name( family.series.front().metric ) << '\n';
+            for ( const auto & series : family.series ) {
+                write_series( out, family, series );
+            }
+        }
+        out.flags( flags );
+        out.precision( precision );
+    }
+
+    private:
+    using Metric = std::variant<std::unique_ptr<MetricCounter>,
+                                std::unique_ptr<MetricGauge>,
+                                std::unique_ptr<MetricHistogram>>;
+
+    struct Series
+    {
+        // Already rendered as `key="value",...`.
+        std::string labels;
+        Metric      metric;
+    };
+    struct Family
+    {
+        std::string         name;
+        std::string         help;
+        double              unit{ 1.0 };
+        std::vector<Series> series;
+    };
+
+    struct Quantile
+    {
+        double       q;
+        const char * label;
+    };
+    static constexpr Quantile QUANTILES[]{ { 0.5, "0.5" },
+                                           { 0.9, "0.9" },
+                                           { 0.99, "0.99" },
+                                           { 0.999, "0.999" },
+                                           { 1.0, "1" } };
+
+    std::mutex                         m_mutex;
+    std::vector<Family>                m_families;
+    std::vector<std::function<void()>> m_collectors;
+
+    template <typename T>
+    T & add( const std::string & name, const std::string & help,
+             const double unit, const MetricLabels & labels ) {
+        const std::string rendered{ render_labels( labels ) };
+
+        std::lock_guard lock( m_mutex );
+        auto            family{ std::find_if(
+            m_families.begin(), m_families.end(),
+            [&name]( const Family & f ) { return f.name == name; } ) };
+        if ( family == m_families.end() ) {
+            m_families.push_back( Family{ name, help, unit, {} } );
+            family = std::prev( m_families.end() );
+        }
+        else if ( !std::holds_alternative<std::unique_ptr<T>>(
+                      family->series.front().metric ) ) {
+            throw std::runtime_error( "Metric " + name
+                                      + " registered with another type." );
+        }
+
+        for ( auto & series : family->series ) {
+            if ( series.labels == rendered ) {
+                return *std::get<std::unique_ptr<T>>( series.metric );
+            }
+        }
+        auto   metric{ std::make_unique<T>() };
+        auto & result{ *metric };
+        family->series.push_back( Series{ rendered, std::move( metric ) } );
+        return result;
+    }
+
+    [[nodiscard]] static std::string
+    render_labels( const MetricLabels & labels ) {
+        std::string rendered;
+        for ( const auto & [key, value] : labels ) {
+            if ( !rendered.empty() ) {
+                rendered += ',';
+            }
+            rendered += key + "=\"";
+            for ( const char c : value ) {
+                if ( c == '\\' || c == '"' ) {
+                    rendered += '\\';
+                    rendered += c;
+                }
+                else if ( c == '\n' ) {
+                    rendered += "\\n";
+                }
+                else {
+                    rendered += c;
+                }
+            }
+            rendered += '"';
+        }
+        return rendered;
+    }
+
+    [[nodiscard]] static const char * type_name( const Metric & metric ) {
+        switch ( metric.index() ) {
+        case 0:
+            return "counter";
+        case 1:
+            return "gauge";
+        default:
+            return "summary";
+        }
+    }
+
+    static void write_series( std::ostream & out, const Family & family,
+                              const Series & series ) {
+        const auto braces = [&series]( const std::string & extra ) {
+            std::string labels{ series.labels };
+            if ( !extra.empty() ) {
+                labels += labels.empty() ? extra : "," + extra;
+            }
+            return labels.empty() ? std::string{} : "{" + labels + "}";
+        };
+
+        if ( const auto * counter{
+                 std::get_if<std::unique_ptr<MetricCounter>>(
+                     &series.metric ) } ) {
+            out << family.name << braces( {} ) << ' ' << ( *counter )->value()
+                << '\n';
+        }
+        else if ( const auto * gauge{ std::get_if<std::unique_ptr<MetricGauge>>(
+                      &series.metric ) } ) {
+            out << family.name << braces( {} ) << ' ' << ( *gauge )->value()
+                << '\n';
+        }
+        else {
+            const auto snapshot{
+                std::get<std::unique_ptr<MetricHistogram>>( series.metric )
+                    ->snapshot() };
+            for ( const auto & [q, label] : QUANTILES ) {
+                out << family.name
+                    << braces( "quantile=\"" + std::string{ label } + "\"" )
+                    << ' '
+                    << static_cast<double>( snapshot.quantile( q ) )
+                           * family.unit
+                    << '\n';
+            }
+            out << family.name << "_sum" << braces( {} ) << ' '
+                << static_cast<double>( snapshot.sum ) * family.unit << '\n'
+                << family.name << "_count" << braces( {} ) << ' '
+                << snapshot.count << '\n';
+        }
+    }
+};
+
+// Records the time from construction to destruction into `histogram`, in
+// nanoseconds.
+class ScopedMetricTimer
+{
+    public:
+    explicit ScopedMetricTimer( MetricHistogram & histogram ) noexcept
+        : m_histogram( histogram ),
+          m_start( std::chrono::steady_clock::now() ) {}
+    ScopedMetricTimer( const ScopedMetricTimer & ) = delete;
+    ScopedMetricTimer & operator=( const ScopedMetricTimer & ) = delete;
+    ~ScopedMetricTimer() {
+        m_histogram.record( static_cast<std::uint64_t>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - m_start )
+                .count() ) );
+    }
+
+    private:
+    MetricHistogram &                     m_histogram;
+    std::chrono::steady_clock::time_point m_start;
+};
@@ -0,0 +1,219 @@
+#pragma once
+
+#include "metrics.hpp"
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <stop_token>
+#include <string>
+#include <string_view>
+#include <thread>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+// Ways out for a MetricsRegistry, each on its own thread so nothing is
+// formatted on the render thread (POSIX).
+
+// Minimal HTTP/1.0 listener on 127.0.0.1 serving GET /metrics. One
+// connection at a time, which is plenty for a scraper every few seconds.
+class MetricsServer
+{
+    public:
+    // Port 0 picks a free one, see port().
+    MetricsServer( MetricsRegistry & registry, const std::uint16_t port )
+        : m_registry( registry ) {
+        m_socket = ::socket( AF_INET, SOCK_STREAM, 0 );
+        if ( m_socket < 0 ) {
+            throw std::runtime_error( "Couldn't create metrics socket." );
+        }
+        const int reuse{ 1 };
+        ::setsockopt( m_socket, SOL_SOCKET, SO_REUSEADDR, &reuse,
+                      sizeof( reuse ) );
+
+        sockaddr_in address{};
+        address.sin_family = AF_INET;
+        address.sin_port = htons( port );
+        // Loopback only; the endpoint has no authentication.
+        address.sin_addr.s_addr = htonl( INADDR_LOOPBACK );
+        socklen_t length{ sizeof( address ) };
+        if ( ::bind( m_socket, reinterpret_cast<sockaddr *>( &address ),
+                     length )
+                 != 0
+             || ::listen( m_socket, 4 ) != 0
+             || ::getsockname( m_socket,
+                               reinterpret_cast<sockaddr *>( &address ),
+                               &length )
+                    != 0 ) {
+            ::close( m_socket );
+            throw std::runtime_error( "Couldn't listen for metrics on port "
+                                      + std::to_string( port ) );
+        }
+        m_port = ntohs( address.sin_port );
+
+        m_thread = std::jthread(
+            [this]( const std::stop_token stop ) { serve( stop ); } );
+    }
+
+    MetricsServer( const MetricsServer & ) = delete;
+    MetricsServer & operator=( const MetricsServer & ) = delete;
+
+    ~MetricsServer() {
+        m_thread.request_stop();
+        m_thread.join();
+        ::close( m_socket );
+    }
+
+    [[nodiscard]] std::uint16_t port() const noexcept { return m_port; }
+
+    private:
+    // How long a stop request can go unnoticed.
+    static constexpr int POLL_TIMEOUT_MS{ 100 };
+
+    MetricsRegistry & m_registry;
+    int               m_socket{ -1 };
+    std::uint16_t     m_port{ 0 };
+    std::jthread      m_thread;
+
+    void serve( const std::stop_token stop ) {
+        while ( !stop.stop_requested() ) {
+            pollfd listener{ m_socket, POLLIN, 0 };
+            if ( ::poll( &listener, 1, POLL_TIMEOUT_MS ) <= 0 ) {
+                continue;
+            }
+            const int client{ ::accept( m_socket, nullptr, nullptr ) };
+            if ( client < 0 ) {
+                continue;
+            }
+            respond( client );
+            ::close( client );
+        }
+    }
+
+    void respond( const int client ) {
+        // A stalled client mustn't hold the thread past a stop request.
+        timeval timeout{ 1, 0 };
+        ::setsockopt( client, SOL_SOCKET, SO_RCVTIMEO, &timeout,
+                      sizeof( timeout ) );
+        ::setsockopt( client, SOL_SOCKET, SO_SNDTIMEO, &timeout,
+                      sizeof( timeout ) );
+
+        // Only the request line matters; headers and body are ignored.
+        std::string request;
+        char        buffer[1024];
+        while ( request.find( "\r\n" ) == std::string::npos
+                && request.size() < 8192 ) {
+            const auto received{ ::recv( client, buffer, sizeof( buffer ),
+                                         0 ) };
+            if ( received <= 0 ) {
+                return;
+            }
+            request.append( buffer, static_cast<std::size_t>( received ) );
+        }
+
+        const auto line_end{ request.find( "\r\n" ) };
+        if ( line_end == std::string::npos ) {
+            return;
+        }
+        const std::string_view line{ request.data(), line_end };
+        std::string            status{ "200 OK" };
+        std::string            body;
+        if ( line.starts_with( "GET /metrics " )
+             || line.starts_with( "GET / " ) ) {
+            std::ostringstream metrics;
+            m_registry.write_prometheus( metrics );
+            body = std::move( metrics ).str();
+        }
+        else {
+            status = "404 Not Found";
+            body = "Try /metrics\n";
+        }
+
+        const std::string response{
+            "HTTP/1.0 " + status
+            + "\r\nContent-Type: text/plain; version=0.0.4\r\n"
+              "Content-Length: "
+            + std::to_string( body.size() )
+            + "\r\nConnection: close\r\n\r\n" + body
+        };
+        std::size_t sent{ 0 };
+        while ( sent < response.size() ) {
+            const auto written{ ::send( client, response.data() + sent,
+                                        response.size() - sent,
+                                        MSG_NOSIGNAL ) };
+            if ( written <= 0 ) {
+                return;
+            }
+            sent += static_cast<std::size_t>( written );
+        }
+    }
+};
+
+// Rewrites `path` with the current metrics every `interval`, and once more
+// on destruction. The file is replaced by rename, so readers (e.g. the
+// node_exporter textfile collector) never see a half-written one.
+class MetricsFileWriter
+{
+    public:
+    MetricsFileWriter( MetricsRegistry &               registry,
+                       std::string                     path,
+                       const std::chrono::milliseconds interval )
+        : m_registry( registry ), m_path( std::move( path ) ),
+          m_interval( interval ) {
+        m_thread = std::jthread(
+            [this]( const std::stop_token stop ) { run( stop ); } );
+    }
+
+    MetricsFileWriter( const MetricsFileWriter & ) = delete;
+    MetricsFileWriter & operator=( const MetricsFileWriter & ) = delete;
+
+    ~MetricsFileWriter() {
+        m_thread.request_stop();
+        m_thread.join();
+    }
+
+    private:
+    MetricsRegistry &           m_registry;
+    std::string                 m_path;
+    std::chrono::milliseconds   m_interval;
+    std::mutex                  m_mutex;
+    std::condition_variable_any m_wake;
+    std::jthread                m_thread;
+
+    void run( const std::stop_token stop ) {
+        while ( !stop.stop_requested() ) {
+            {
+                std::unique_lock lock( m_mutex );
+                m_wake.wait_for( lock, stop, m_interval,
+                                 []() { return false; } );
+            }
+            write();
+        }
+    }
+
+    // Errors are swallowed: a full disk shouldn't take the renderer down,
+    // and the next interval tries again.
+    void write() {
+        const std::string temporary{ m_path + ".tmp" };
+        {
+            std::ofstream file( temporary, std::ios::trunc );
+            if ( !file.is_open() ) {
+                return;
+            }
+            m_registry.write_prometheus( file );
+            if ( !file ) {
+                return;
+            }
+        }
+        std::rename( temporary.c_str(), m_path.c_str() );
+    }
+};
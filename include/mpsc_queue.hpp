@@ -0,0 +1,102 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+// Bounded multi-producer, single-consumer queue, after Vyukov's bounded
+// MPMC queue. Every cell carries a sequence number that says whose turn it
+// is: a producer claims a position with one CAS and publishes the value with
+// one release store, and the consumer hands the cell back the same way.
+// Nothing locks or allocates after construction.
+//
+// Positions are handed out in queue order, so the ticket returned by
+// try_push() also says how many values come before this one.
+template <typename T>
+class MpscQueue
+{
+    public:
+    explicit MpscQueue( const std::size_t capacity )
+        : m_cells( capacity ), m_mask( capacity - 1 ) {
+        if ( capacity < 2 || ( capacity & m_mask ) != 0 ) {
+            throw std::runtime_error(
+                "MpscQueue capacity must be a power of two." );
+        }
+        for ( std::size_t i{ 0 }; i < capacity; ++i ) {
+            m_cells[i].sequence.store( i, std::memory_order_relaxed );
+        }
+    }
+
+    MpscQueue( const MpscQueue & ) = delete;
+    MpscQueue & operator=( const MpscQueue & ) = delete;
+
+    // Moves `value` in and returns its 1-based ticket, or 0 with `value`
+    // untouched when the queue is full. Safe from any number of threads.
+    [[nodiscard]] std::uint64_t try_push( T & value ) {
+        std::uint64_t position{ m_enqueue.load( std::memory_order_relaxed ) };
+        for ( ;; ) {
+            Cell &              cell{ m_cells[position & m_mask] };
+            const std::uint64_t sequence{ cell.sequence.load(
+                std::memory_order_acquire ) };
+            const auto          lag{ static_cast<std::int64_t>( sequence
+                                                       - position ) };
+            if ( lag == 0 ) {
+                if ( m_enqueue.compare_exchange_weak(
+                         position, position + 1,
+                         std::memory_order_relaxed ) ) {
+                    cell.value = std::move( value );
+                    cell.sequence.store( position + 1,
+                                         std::memory_order_release );
+                    return position + 1;
+                }
+            }
+            else if ( lag < 0 ) {
+                // The consumer hasn't freed this cell from the last lap.
+                return 0;
+            }
+            else {
+                position = m_enqueue.load( std::memory_order_relaxed );
+            }
+        }
+    }
+
+    // Consumer only. False when the next value isn't published yet, even if
+    // later ones are.
+    [[nodiscard]] bool try_pop( T & out ) {
+        Cell & cell{ m_cells[m_dequeue & m_mask] };
+        if ( cell.sequence.load( std::memory_order_acquire )
+             != m_dequeue + 1 ) {
+            return false;
+        }
+        out = std::move( cell.value );
+        cell.value = T{};
+        cell.sequence.store( m_dequeue + m_cells.size(),
+                             std::memory_order_release );
+        ++m_dequeue;
+        return true;
+    }
+
+    // Tickets handed out so far, published or not.
+    [[nodiscard]] std::uint64_t claimed() const noexcept {
+        return m_enqueue.load( std::memory_order_acquire );
+    }
+    [[nodiscard]] std::size_t capacity() const noexcept {
+        return m_cells.size();
+    }
+
+    private:
+    struct Cell
+    {
+        std::atomic<std::uint64_t> sequence{ 0 };
+        T                          value{};
+    };
+
+    std::vector<Cell> m_cells;
+    std::uint64_t     m_mask;
+    // Producers and the consumer each get their own cache line.
+    alignas( 64 ) std::atomic<std::uint64_t> m_enqueue{ 0 };
+    alignas( 64 ) std::uint64_t m_dequeue{ 0 };
+};
@@ -0,0 +1,145 @@
+#pragma once
+
+#include "vk_memory.hpp"
+
+#include <cstdint>
+#include <stdexcept>
+
+// Single colour attachment render target for headless rendering. The image
+// ends each render pass in TRANSFER_SRC_OPTIMAL so it can be read back.
+class OffscreenTarget
+{
+    public:
+    OffscreenTarget( const VkPhysicalDevice physical_device,
+                     const VkDevice         device,
+                     const VkExtent2D       extent,
+                     const VkFormat format = VK_FORMAT_R8G8B8A8_UNORM,
+                     const VkAllocationCallbacks * allocator = nullptr ) :
+        m_extent( extent ), m_format( format ) {
+        m_color = create_image( physical_device, device, extent, format,
+                                VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT
+                                    | VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+                                1, allocator );
+        m_view = create_image_view( device, m_color.image, format,
+                                    VK_IMAGE_ASPECT_COLOR_BIT, 0, 1,
+                                    allocator );
+        create_render_pass( device, allocator );
+
+        const VkImageView attachments[] = { m_view };
+
+        VkFramebufferCreateInfo framebuffer_info{};
+        framebuffer_info.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+        framebuffer_info.renderPass = m_render_pass;
+        framebuffer_info.attachmentCount = 1;
+        framebuffer_info.pAttachments = attachments;
+        framebuffer_info.width = extent.width;
+        framebuffer_info.height = extent.height;
+        framebuffer_info.layers = 1;
+
+        if ( vkCreateFramebuffer( device, &framebuffer_info, allocator,
+                                  m_framebuffer.put( device, allocator ) )
+             != VK_SUCCESS ) {
+            throw std::runtime_error( "Failed to create framebuffer." );
+        }
+    }
+
+    [[nodiscard]] VkRenderPass  render_pass() const noexcept { return m_render_pass; }
+    [[nodiscard]] VkFramebuffer framebuffer() const noexcept { return m_framebuffer; }
+    [[nodiscard]] VkImage       image() const noexcept { return m_color.image; }
+    [[nodiscard]] VkExtent2D    extent() const noexcept { return m_extent; }
+    [[nodiscard]] VkFormat      format() const noexcept { return m_format; }
+
+    // Begins the render pass and sets a full-target viewport and scissor.
+    void begin( const VkCommandBuffer command_buffer,
+                const VkClearValue &  clear_value ) const {
+        VkRenderPassBeginInfo render_pass_info{};
+        render_pass_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+        render_pass_info.renderPass = m_render_pass;
+        render_pass_info.framebuffer = m_framebuffer;
+        render_pass_info.renderArea.offset = { 0, 0 };
+        render_pass_info.renderArea.extent = m_extent;
+        render_pass_info.clearValueCount = 1;
+        render_pass_info.pClearValues = &clear_value;
+
+        vkCmdBeginRenderPass( command_buffer, &render_pass_info,
+                              VK_SUBPASS_CONTENTS_INLINE );
+
+        VkViewport viewport{};
+        viewport.x = 0.0f;
+        viewport.y = 0.0f;
+        viewport.width = static_cast<float>( m_extent.width );
+        viewport.height = static_cast<float>( m_extent.height );
+        viewport.minDepth = 0.0f;
+        viewport.maxDepth = 1.0f;
+        vkCmdSetViewport( command_buffer, 0, 1, &viewport );
+
+        VkRect2D scissor{};
+        scissor.offset = { 0, 0 };
+        scissor.extent = m_extent;
+        vkCmdSetScissor( command_buffer, 0, 1, &scissor );
+    }
+
+    private:
+    VkExtent2D        m_extent;
+    VkFormat          m_format;
+    ImageAllocation   m_color;
+    UniqueImageView   m_view;
+    UniqueRenderPass  m_render_pass;
+    UniqueFramebuffer m_framebuffer;
+
+    void create_render_pass( const VkDevice                device,
+                             const VkAllocationCallbacks * allocator ) {
+        VkAttachmentDescription color_attachment{};
+        color_attachment.format = m_format;
+        color_attachment.samples = VK_SAMPLE_COUNT_1_BIT;
+        color_attachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+        color_attachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+        color_attachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+        color_attachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+        color_attachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        color_attachment.finalLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+
+        VkAttachmentReference color_attachment_ref{};
+        color_attachment_ref.attachment = 0;
+        color_attachment_ref.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
+        VkSubpassDescription subpass{};
+        subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+        subpass.colorAttachmentCount = 1;
+        subpass.pColorAttachments = &color_attachment_ref;
+
+        // Previous frame's readback must finish before the clear, and this
+        // frame's writes must land before any copy that follows the pass.
+        VkSubpassDependency dependencies[2]{};
+        dependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
+        dependencies[0].dstSubpass = 0;
+        dependencies[0].srcStageMask = VK_PIPELINE_STAGE_TRANSFER_BIT;
+        dependencies[0].srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+        dependencies[0].dstStageMask =
+            VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+        dependencies[0].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+
+        dependencies[1].srcSubpass = 0;
+        dependencies[1].dstSubpass = VK_SUBPASS_EXTERNAL;
+        dependencies[1].srcStageMask =
+            VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+        dependencies[1].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+        dependencies[1].dstStageMask = VK_PIPELINE_STAGE_TRANSFER_BIT;
+        dependencies[1].dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+
+        VkRenderPassCreateInfo render_pass_info{};
+        render_pass_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+        render_pass_info.attachmentCount = 1;
+        render_pass_info.pAttachments = &color_attachment;
+        render_pass_info.subpassCount = 1;
+        render_pass_info.pSubpasses = &subpass;
+        render_pass_info.dependencyCount = 2;
+        render_pass_info.pDependencies = dependencies;
+
+        if ( vkCreateRenderPass( device, &render_pass_info, allocator,
+                                 m_render_pass.put( device, allocator ) )
+             != VK_SUCCESS ) {
+            throw std::runtime_error( "Failed to create render pass." );
+        }
+    }
+};
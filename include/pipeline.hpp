@@ -0,0 +1,206 @@
+#pragma once
+
+#include "vk_handle.hpp"
+
+#include <cstdint>
+#include <span>
+#include <stdexcept>
+#include <vector>
+
+struct GraphicsPipelineDesc
+{
+    VkShaderModule   vertex_shader{ VK_NULL_HANDLE };
+    VkShaderModule   fragment_shader{ VK_NULL_HANDLE };
+    VkPipelineLayout layout{ VK_NULL_HANDLE };
+    VkRenderPass     render_pass{ VK_NULL_HANDLE };
+    VkPipelineCache  cache{ VK_NULL_HANDLE };
+    // Empty when the vertex shader generates its own vertices.
+    std::span<const VkVertexInputBindingDescription>   vertex_bindings{};
+    std::span<const VkVertexInputAttributeDescription> vertex_attributes{};
+    VkFrontFace front_face{ VK_FRONT_FACE_CLOCKWISE };
+    // Only meaningful if the render pass has a depth attachment.
+    bool depth_test{ false };
+    // Host allocator for the pipeline, see host_allocator.hpp.
+    const VkAllocationCallbacks * allocator{ nullptr };
+};
+
+// Layout with the given descriptor sets and an optional vertex stage push
+// constant block of `push_constant_size` bytes.
+[[nodiscard]] inline UniquePipelineLayout
+create_pipeline_layout(
+    const VkDevice device, const std::uint32_t push_constant_size = 0,
+    const std::span<const VkDescriptorSetLayout> set_layouts = {},
+    const VkAllocationCallbacks *                allocator = nullptr ) {
+    VkPushConstantRange push_constant_range{};
+    push_constant_range.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+    push_constant_range.offset = 0;
+    push_constant_range.size = push_constant_size;
+
+    VkPipelineLayoutCreateInfo pipeline_layout_info{};
+    pipeline_layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipeline_layout_info.setLayoutCount =
+        static_cast<std::uint32_t>( set_layouts.size() );
+    pipeline_layout_info.pSetLayouts =
+        set_layouts.empty() ? nullptr : set_layouts.data();
+    pipeline_layout_info.pushConstantRangeCount = push_constant_size != 0 ? 1 : 0;
+    pipeline_layout_info.pPushConstantRanges =
+        push_constant_size != 0 ? &push_constant_range : nullptr;
+
+    UniquePipelineLayout pipeline_layout{};
+    if ( vkCreatePipelineLayout( device, &pipeline_layout_info, allocator,
+                                 pipeline_layout.put( device, allocator ) )
+         != VK_SUCCESS ) {
+        throw std::runtime_error( "Failed to create pipeline layout." );
+    }
+    return pipeline_layout;
+}
+
+// Builds the single-subpass, opaque, dynamic viewport pipeline shared by the
+// window app and the headless tools.
+[[nodiscard]] inline UniquePipeline
+build_graphics_pipeline( const VkDevice               device,
+                         const GraphicsPipelineDesc & desc ) {
+    VkPipelineShaderStageCreateInfo vert_shader_create_info{};
+    vert_shader_create_info.sType =
+        VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    vert_shader_create_info.stage = VK_SHADER_STAGE_VERTEX_BIT;
+    vert_shader_create_info.module = desc.vertex_shader;
+    vert_shader_create_info.pName = "main";
+
+    VkPipelineShaderStageCreateInfo frag_shader_create_info{};
+    frag_shader_create_info.sType =
+        VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    frag_shader_create_info.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+    frag_shader_create_info.module = desc.fragment_shader;
+    frag_shader_create_info.pName = "main";
+
+    VkPipelineShaderStageCreateInfo shader_stages[] = {
+        vert_shader_create_info, frag_shader_create_info
+    };
+
+    // Fixed functions
+
+    std::vector<VkDynamicState> dynamic_states{ VK_DYNAMIC_STATE_VIEWPORT,
+                                                VK_DYNAMIC_STATE_SCISSOR };
+
+    VkPipelineDynamicStateCreateInfo dynamic_state_info{};
+    dynamic_state_info.sType =
+        VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+    dynamic_state_info.dynamicStateCount =
+        static_cast<uint32_t>( dynamic_states.size() );
+    dynamic_state_info.pDynamicStates = dynamic_states.data();
+
+    VkPipelineVertexInputStateCreateInfo vertex_input_info{};
+    vertex_input_info.sType =
+        VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+    vertex_input_info.vertexBindingDescriptionCount =
+        static_cast<uint32_t>( desc.vertex_bindings.size() );
+    vertex_input_info.pVertexBindingDescriptions = desc.vertex_bindings.data();
+    vertex_input_info.vertexAttributeDescriptionCount =
+        static_cast<uint32_t>( desc.vertex_attributes.size() );
+    vertex_input_info.pVertexAttributeDescriptions =
+        desc.vertex_attributes.data();
+
+    VkPipelineInputAssemblyStateCreateInfo input_assembly{};
+    input_assembly.sType =
+        VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+    input_assembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+    input_assembly.primitiveRestartEnable = VK_FALSE;
+
+    // Viewport & scissor are dynamic, they're set when recording.
+    VkPipelineViewportStateCreateInfo viewport_state{};
+    viewport_state.sType =
+        VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+    viewport_state.viewportCount = 1;
+    viewport_state.scissorCount = 1;
+
+    VkPipelineRasterizationStateCreateInfo rasterizer{};
+    rasterizer.sType =
+        VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+    rasterizer.depthClampEnable = VK_FALSE;
+    rasterizer.rasterizerDiscardEnable = VK_FALSE;
+    rasterizer.polygonMode = VK_POLYGON_MODE_FILL;
+    rasterizer.lineWidth = 1.0f;
+    rasterizer.cullMode = VK_CULL_MODE_BACK_BIT;
+    rasterizer.frontFace = desc.front_face;
+    rasterizer.depthBiasEnable = VK_FALSE;
+    rasterizer.depthBiasConstantFactor = 0.0f;
+    rasterizer.depthBiasClamp = 0.0f;
+    rasterizer.depthBiasSlopeFactor = 0.0f;
+
+    // Multisampling (Disabled for now)
+    VkPipelineMultisampleStateCreateInfo multisampling{};
+    multisampling.sType =
+        VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+    multisampling.sampleShadingEnable = VK_FALSE;
+    multisampling.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+    multisampling.minSampleShading = 1.0f;
+    multisampling.pSampleMask = nullptr;
+    multisampling.alphaToCoverageEnable = VK_FALSE;
+    multisampling.alphaToOneEnable = VK_FALSE;
+
+    // Color blending
+    VkPipelineColorBlendAttachmentState color_blend_attachment{};
+    color_blend_attachment.colorWriteMask =
+        VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT
+        | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+    color_blend_attachment.blendEnable = VK_FALSE;
+    color_blend_attachment.srcColorBlendFactor =
+        VK_BLEND_FACTOR_ONE; // Optional
+    color_blend_attachment.dstColorBlendFactor =
+        VK_BLEND_FACTOR_ZERO;                              // Optional
+    color_blend_attachment.colorBlendOp = VK_BLEND_OP_ADD; // Optional
+    color_blend_attachment.srcAlphaBlendFactor =
+        VK_BLEND_FACTOR_ONE; // Optional
+    color_blend_attachment.dstAlphaBlendFactor =
+        VK_BLEND_FACTOR_ZERO;                              // Optional
+    color_blend_attachment.alphaBlendOp = VK_BLEND_OP_ADD; // Optional
+
+    VkPipelineColorBlendStateCreateInfo color_blend{};
+    color_blend.sType =
+        VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+    color_blend.logicOpEnable = VK_FALSE;
+    color_blend.logicOp = VK_LOGIC_OP_COPY;
+    color_blend.attachmentCount = 1;
+    color_blend.pAttachments = &color_blend_attachment;
+    color_blend.blendConstants[0] = 0.0f;
+    color_blend.blendConstants[1] = 0.0f;
+    color_blend.blendConstants[2] = 0.0f;
+    color_blend.blendConstants[3] = 0.0f;
+
+    VkPipelineDepthStencilStateCreateInfo depth_stencil{};
+    depth_stencil.sType =
+        VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+    depth_stencil.depthTestEnable = desc.depth_test ? VK_TRUE : VK_FALSE;
+    depth_stencil.depthWriteEnable = desc.depth_test ? VK_TRUE : VK_FALSE;
+    depth_stencil.depthCompareOp = VK_COMPARE_OP_LESS;
+    depth_stencil.depthBoundsTestEnable = VK_FALSE;
+    depth_stencil.stencilTestEnable = VK_FALSE;
+
+    VkGraphicsPipelineCreateInfo pipeline_info{};
+    pipeline_info.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+    pipeline_info.stageCount = 2;
+    pipeline_info.pStages = shader_stages;
+    pipeline_info.pVertexInputState = &vertex_input_info;
+    pipeline_info.pInputAssemblyState = &input_assembly;
+    pipeline_info.pViewportState = &viewport_state;
+    pipeline_info.pRasterizationState = &rasterizer;
+    pipeline_info.pMultisampleState = &multisampling;
+    pipeline_info.pDepthStencilState = &depth_stencil;
+    pipeline_info.pColorBlendState = &color_blend;
+    pipeline_info.pDynamicState = &dynamic_state_info;
+    pipeline_info.layout = desc.layout;
+    pipeline_info.renderPass = desc.render_pass;
+    pipeline_info.subpass = 0;
+    pipeline_info.basePipelineHandle = VK_NULL_HANDLE;
+    pipeline_info.basePipelineIndex = -1;
+
+    UniquePipeline pipeline{};
+    if ( vkCreateGraphicsPipelines( device, desc.cache, 1, &pipeline_info,
+                                    desc.allocator,
+                                    pipeline.put( device, desc.allocator ) )
+         != VK_SUCCESS ) {
+        throw std::runtime_error( "Failed to create graphics pipeline." );
+    }
+    return pipeline;
+}
@@ -0,0 +1,127 @@
+#pragma once
+
+#include "vk_handle.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <stdexcept>
+#include <unordered_map>
+
+// The subset of VkSamplerCreateInfo that materials actually vary.
+struct SamplerDesc
+{
+    VkFilter             mag_filter{ VK_FILTER_LINEAR };
+    VkFilter             min_filter{ VK_FILTER_LINEAR };
+    VkSamplerMipmapMode  mipmap_mode{ VK_SAMPLER_MIPMAP_MODE_LINEAR };
+    VkSamplerAddressMode address_u{ VK_SAMPLER_ADDRESS_MODE_REPEAT };
+    VkSamplerAddressMode address_v{ VK_SAMPLER_ADDRESS_MODE_REPEAT };
+    VkSamplerAddressMode address_w{ VK_SAMPLER_ADDRESS_MODE_REPEAT };
+    VkBorderColor border_color{ VK_BORDER_COLOR_FLOAT_TRANSPARENT_BLACK };
+    // 1 disables anisotropic filtering.
+    float max_anisotropy{ 1.0f };
+    float mip_lod_bias{ 0.0f };
+    float min_lod{ 0.0f };
+    float max_lod{ VK_LOD_CLAMP_NONE };
+
+    bool operator==( const SamplerDesc & ) const = default;
+};
+
+struct SamplerDescHash
+{
+    [[nodiscard]] std::size_t
+    operator()( const SamplerDesc & desc ) const noexcept {
+        std::size_t hash{ 0 };
+        const auto  combine = [&hash]( const std::uint64_t value ) {
+            hash ^= std::hash<std::uint64_t>{}( value ) + 0x9E3779B97F4A7C15ull
+                    + ( hash << 6 ) + ( hash >> 2 );
+        };
+        combine( desc.mag_filter );
+        combine( desc.min_filter );
+        combine( desc.mipmap_mode );
+        combine( desc.address_u );
+        combine( desc.address_v );
+        combine( desc.address_w );
+        combine( desc.border_color );
+        combine( std::bit_cast<std::uint32_t>( desc.max_anisotropy ) );
+        combine( std::bit_cast<std::uint32_t>( desc.mip_lod_bias ) );
+        combine( std::bit_cast<std::uint32_t>( desc.min_lod ) );
+        combine( std::bit_cast<std::uint32_t>( desc.max_lod ) );
+        return hash;
+    }
+};
+
+// Deduplicates VkSamplers. Devices may only have maxSamplerAllocationCount
+// (as low as 4000) samplers alive, and most textures share a handful of
+// states, so samplers are created once per distinct description and live as
+// long as the cache.
+class SamplerCache
+{
+    public:
+    // `max_anisotropy` is the device limit, or 1 when the samplerAnisotropy
+    // feature is not enabled; requests above it are clamped.
+    explicit SamplerCache(
+        const VkDevice device, const float max_anisotropy = 1.0f,
+        const VkAllocationCallbacks * allocator = nullptr ) :
+        m_device( device ),
+        m_max_anisotropy( max_anisotropy ),
+        m_allocator( allocator ) {}
+
+    SamplerCache( const SamplerCache & ) = delete;
+    SamplerCache & operator=( const SamplerCache & ) = delete;
+
+    // Thread safe; the returned handle stays valid for the cache's lifetime.
+    [[nodiscard]] VkSampler get( SamplerDesc desc ) {
+        desc.max_anisotropy = std::clamp( desc.max_anisotropy, 1.0f,
+                                          std::max( m_max_anisotropy, 1.0f ) );
+
+        std::lock_guard lock( m_mutex );
+        if ( const auto it{ m_samplers.find( desc ) };
+             it != m_samplers.end() ) {
+            return it->second;
+        }
+
+        VkSamplerCreateInfo info{};
+        info.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+        info.magFilter = desc.mag_filter;
+        info.minFilter = desc.min_filter;
+        info.mipmapMode = desc.mipmap_mode;
+        info.addressModeU = desc.address_u;
+        info.addressModeV = desc.address_v;
+        info.addressModeW = desc.address_w;
+        info.mipLodBias = desc.mip_lod_bias;
+        info.anisotropyEnable = desc.max_anisotropy > 1.0f ? VK_TRUE : VK_FALSE;
+        info.maxAnisotropy = desc.max_anisotropy;
+        info.compareEnable = VK_FALSE;
+        info.compareOp = VK_COMPARE_OP_ALWAYS;
+        info.minLod = desc.min_lod;
+        info.maxLod = desc.max_lod;
+        info.borderColor = desc.border_color;
+        info.unnormalizedCoordinates = VK_FALSE;
+
+        UniqueSampler sampler{};
+        if ( vkCreateSampler( m_device, &info, m_allocator,
+                              sampler.put( m_device, m_allocator ) )
+             != VK_SUCCESS ) {
+            throw std::runtime_error( "Failed to create sampler." );
+        }
+        const VkSampler handle{ sampler };
+        m_samplers.emplace( desc, std::move( sampler ) );
+        return handle;
+    }
+
+    [[nodiscard]] std::size_t size() const {
+        std::lock_guard lock( m_mutex );
+        return m_samplers.size();
+    }
+
+    private:
+    VkDevice                      m_device;
+    float                         m_max_anisotropy;
+    const VkAllocationCallbacks * m_allocator;
+    mutable std::mutex            m_mutex;
+    std::unordered_map<SamplerDesc, UniqueSampler, SamplerDescHash> m_samplers;
+};
@@ -0,0 +1,439 @@
+#pragma once
+
+#include "metrics.hpp"
+#include "mpsc_queue.hpp"
+#include "vk_dispatch.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <stdexcept>
+#include <stop_token>
+#include <string>
+#include <thread>
+#include <variant>
+#include <vector>
+
+// One VkSubmitInfo worth of work. Timeline values are only read when
+// non-empty, one per semaphore as in VkTimelineSemaphoreSubmitInfo.
+struct QueueSubmission
+{
+    std::vector<VkCommandBuffer>      command_buffers;
+    std::vector<VkSemaphore>          wait_semaphores;
+    std::vector<VkPipelineStageFlags> wait_stages;
+    std::vector<VkSemaphore>          signal_semaphores;
+    std::vector<std::uint64_t>        wait_values;
+    std::vector<std::uint64_t>        signal_values;
+    VkFence                           fence{ VK_NULL_HANDLE };
+};
+
+struct AcquiredImage
+{
+    std::uint32_t image_index{ 0 };
+    VkResult      result{ VK_SUCCESS };
+    // Time spent blocked in vkAcquireNextImageKHR.
+    std::uint64_t nanoseconds{ 0 };
+};
+
+struct QueuePresentation
+{
+    std::vector<VkSemaphore>    wait_semaphores;
+    std::vector<VkSwapchainKHR> swapchains;
+    std::vector<std::uint32_t>  image_indices;
+    // Called on the submit thread with the per-swapchain results.
+    std::function<void( const std::vector<VkResult> & )> on_presented;
+};
+
+// vkAcquireNextImageKHR for each swapchain, signalling the matching
+// semaphore. Kept on the submit thread so acquires never race a present.
+struct SwapchainAcquisition
+{
+    VkDevice                    device{ VK_NULL_HANDLE };
+    std::vector<VkSwapchainKHR> swapchains;
+    std::vector<VkSemaphore>    semaphores;
+    // Called on the submit thread once every acquire has returned.
+    std::function<void( const std::vector<AcquiredImage> & )> on_acquired;
+};
+
+struct SubmitStats
+{
+    std::uint64_t submissions{ 0 };
+    std::uint64_t submit_calls{ 0 };
+    std::uint64_t presents{ 0 };
+    std::uint64_t acquires{ 0 };
+    // Most submissions that went out in a single vkQueueSubmit.
+    std::uint64_t max_coalesced{ 0 };
+    // wait_issued() calls that had to block, and how long they did.
+    std::uint64_t issue_waits{ 0 };
+    double        issue_wait_seconds{ 0.0 };
+};
+
+// Owns every vkQueueSubmit, vkQueuePresentKHR and vkAcquireNextImageKHR of
+// the frame loop, so the threads recording commands never block in the
+// driver.
+//
+// Producers push work through a lock-free MpscQueue and get a ticket back.
+// The thread drains whatever has piled up and sends each run of submissions
+// out in one vkQueueSubmit, up to the first one with a fence (a call takes
+// only one) or the next present or acquire, which always goes out after the
+// work queued before it. Submissions keep their own VkSubmitInfo, so waits and
+// signals are exactly as pushed.
+//
+// Queues must be externally synchronized, so while the thread runs nothing
+// else may use them: uploads are pushed with their fences like frames are,
+// and vkQueueWaitIdle/vkDeviceWaitIdle need a wait_idle() first. Swapchains
+// are too, so acquires are pushed through acquire() rather than made on
+// the producer side; wait_issued() on the ticket before using the image.
+//
+// Failures are kept and rethrown by check() on the producer side.
+class SubmitThread
+{
+    public:
+    static constexpr std::size_t DEFAULT_CAPACITY{ 64 };
+
+    SubmitThread( const DeviceDispatch & dispatch,
+                  const VkQueue          graphics_queue,
+                  const VkQueue          present_queue,
+                  MetricHistogram *      submit_latency = nullptr,
+                  MetricHistogram *      present_latency = nullptr,
+                  const std::size_t      capacity = DEFAULT_CAPACITY )
+        : m_dispatch( dispatch ),
+          m_graphics_queue( graphics_queue ),
+          m_present_queue( present_queue ),
+          m_submit_latency( submit_latency ),
+          m_present_latency( present_latency ),
+          m_queue( capacity ) {
+        m_thread = std::jthread(
+            [this]( const std::stop_token stop ) { run( stop ); } );
+    }
+
+    SubmitThread( const SubmitThread & ) = delete;
+    SubmitThread & operator=( const SubmitThread & ) = delete;
+
+    // Everything pushed before this still goes out.
+    ~SubmitThread() {
+        m_thread.request_stop();
+        wake();
+        m_thread.join();
+    }
+
+    std::uint64_t submit( QueueSubmission submission ) {
+        return push( Item{ std::move( submission ) } );
+    }
+    std::uint64_t present( QueuePresentation presentation ) {
+        return push( Item{ std::move( presentation ) } );
+    }
+    std::uint64_t acquire( SwapchainAcquisition acquisition ) {
+        return push( Item{ std::move( acquisition ) } );
+    }
+
+    // Blocks until the driver calls for everything up to `ticket` have
+    // returned. Says nothing about the GPU.
+    void wait_issued( const std::uint64_t ticket ) const {
+        std::uint64_t issued{ m_issued.load( std::memory_order_acquire ) };
+        if ( issued >= ticket ) {
+            return;
+        }
+        const auto start{ std::chrono::steady_clock::now() };
+        while ( issued < ticket ) {
+            m_issued.wait( issued, std::memory_order_acquire );
+            issued = m_issued.load( std::memory_order_acquire );
+        }
+        m_issue_waits.fetch_add( 1, std::memory_order_relaxed );
+        m_issue_wait_ns.fetch_add(
+            static_cast<std::uint64_t>(
+                std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now() - start )
+                    .count() ),
+            std::memory_order_relaxed );
+    }
+    void wait_idle() const { wait_issued( m_queue.claimed() ); }
+
+    // Whether a submit, present or acquire has failed; check() says which.
+    [[nodiscard]] bool failed() const noexcept {
+        return m_submit_error.load( std::memory_order_acquire ) != VK_SUCCESS
+               || m_present_error.load( std::memory_order_acquire )
+                      != VK_SUCCESS
+               || m_acquire_error.load( std::memory_order_acquire )
+                      != VK_SUCCESS;
+    }
+    // Throws the first failed submit, present or acquire, if any.
+    void check() const {
+        const VkResult submit_error{ m_submit_error.load(
+            std::memory_order_acquire ) };
+        if ( submit_error != VK_SUCCESS ) {
+            throw std::runtime_error(
+                "Failed to submit draw command buffer, error code: "
+                + std::to_string( submit_error ) );
+        }
+        const VkResult present_error{ m_present_error.load(
+            std::memory_order_acquire ) };
+        if ( present_error != VK_SUCCESS ) {
+            throw std::runtime_error(
+                "Failed to present swapchain image, error code: "
+                + std::to_string( present_error ) );
+        }
+        const VkResult acquire_error{ m_acquire_error.load(
+            std::memory_order_acquire ) };
+        if ( acquire_error != VK_SUCCESS ) {
+            throw std::runtime_error(
+                "Failed to acquire swapchain image, error code: "
+                + std::to_string( acquire_error ) );
+        }
+    }
+
+    [[nodiscard]] SubmitStats stats() const noexcept {
+        SubmitStats stats{};
+        stats.submissions = m_submissions.load( std::memory_order_relaxed );
+        stats.submit_calls = m_submit_calls.load( std::memory_order_relaxed );
+        stats.presents = m_presents.load( std::memory_order_relaxed );
+        stats.acquires = m_acquires.load( std::memory_order_relaxed );
+        stats.max_coalesced =
+            m_max_coalesced.load( std::memory_order_relaxed );
+        stats.issue_waits = m_issue_waits.load( std::memory_order_relaxed );
+        stats.issue_wait_seconds =
+            static_cast<double>(
+                m_issue_wait_ns.load( std::memory_order_relaxed ) )
+            * 1e-9;
+        return stats;
+    }
+
+    private:
+    using Item = std::variant<QueueSubmission, QueuePresentation,
+                              SwapchainAcquisition>;
+
+    DeviceDispatch             m_dispatch;
+    VkQueue                    m_graphics_queue;
+    VkQueue                    m_present_queue;
+    MetricHistogram *          m_submit_latency;
+    MetricHistogram *          m_present_latency;
+    MpscQueue<Item>            m_queue;
+    // Bumped after every push; the thread sleeps on it when out of work.
+    std::atomic<std::uint64_t> m_pushed{ 0 };
+    // Tickets whose driver call has returned.
+    std::atomic<std::uint64_t> m_issued{ 0 };
+    std::atomic<VkResult>      m_submit_error{ VK_SUCCESS };
+    std::atomic<VkResult>      m_present_error{ VK_SUCCESS };
+    std::atomic<VkResult>      m_acquire_error{ VK_SUCCESS };
+    std::atomic<std::uint64_t> m_submissions{ 0 };
+    std::atomic<std::uint64_t> m_submit_calls{ 0 };
+    std::atomic<std::uint64_t> m_presents{ 0 };
+    std::atomic<std::uint64_t> m_acquires{ 0 };
+    std::atomic<std::uint64_t> m_max_coalesced{ 0 };
+    // Written by wait_issued(), on the producer side.
+    mutable std::atomic<std::uint64_t> m_issue_waits{ 0 };
+    mutable std::atomic<std::uint64_t> m_issue_wait_ns{ 0 };
+    // Last, so it is joined before anything it uses goes away.
+    std::jthread               m_thread;
+
+    // Only waits when the queue is full, i.e. the driver is a whole queue
+    // worth of work behind.
+    std::uint64_t push( Item item ) {
+        for ( ;; ) {
+            const std::uint64_t issued{ m_issued.load(
+                std::memory_order_acquire ) };
+            if ( const auto ticket{ m_queue.try_push( item ) } ) {
+                wake();
+                return ticket;
+            }
+            m_issued.wait( issued, std::memory_order_acquire );
+        }
+    }
+
+    void wake() {
+        m_pushed.fetch_add( 1, std::memory_order_release );
+        m_pushed.notify_one();
+    }
+
+    void run( const std::stop_token stop ) {
+        std::vector<Item> batch;
+        Item              item;
+        for ( ;; ) {
+            const std::uint64_t pushed{ m_pushed.load(
+                std::memory_order_acquire ) };
+            while ( batch.size() < m_queue.capacity()
+                    && m_queue.try_pop( item ) ) {
+                batch.push_back( std::move( item ) );
+            }
+            if ( batch.empty() ) {
+                if ( stop.stop_requested() ) {
+                    return;
+                }
+                m_pushed.wait( pushed, std::memory_order_acquire );
+                continue;
+            }
+            process( batch );
+            batch.clear();
+        }
+    }
+
+    void process( std::vector<Item> & batch ) {
+        std::size_t first{ 0 };
+        for ( std::size_t i{ 0 }; i < batch.size(); ++i ) {
+            if ( auto * presentation{
+                     std::get_if<QueuePresentation>( &batch[i] ) } ) {
+                submit_run( batch, first, i );
+                present_one( *presentation );
+                first = i + 1;
+            }
+            else if ( auto * acquisition{
+                          std::get_if<SwapchainAcquisition>( &batch[i] ) } ) {
+                submit_run( batch, first, i );
+                acquire_one( *acquisition );
+                first = i + 1;
+            }
+            else if ( std::get<QueueSubmission>( batch[i] ).fence
+                      != VK_NULL_HANDLE ) {
+                submit_run( batch, first, i + 1 );
+                first = i + 1;
+            }
+        }
+        submit_run( batch, first, batch.size() );
+    }
+
+    void issued( const std::uint64_t count ) {
+        m_issued.fetch_add( count, std::memory_order_release );
+        m_issued.notify_all();
+    }
+
+    // Submissions [begin, end) of `batch` in one vkQueueSubmit; only the
+    // last one may have a fence.
+    void submit_run( const std::vector<Item> & batch, const std::size_t begin,
+                     const std::size_t end ) {
+        if ( begin == end ) {
+            return;
+        }
+        const std::size_t count{ end - begin };
+        std::vector<VkSubmitInfo>                  infos( count );
+        std::vector<VkTimelineSemaphoreSubmitInfo> timeline_infos( count );
+        for ( std::size_t i{ 0 }; i < count; ++i ) {
+            const auto & submission{ std::get<QueueSubmission>(
+                batch[begin + i] ) };
+            auto &       info{ infos[i] };
+            info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+            info.waitSemaphoreCount = static_cast<std::uint32_t>(
+                submission.wait_semaphores.size() );
+            info.pWaitSemaphores = submission.wait_semaphores.data();
+            info.pWaitDstStageMask = submission.wait_stages.data();
+            info.commandBufferCount = static_cast<std::uint32_t>(
+                submission.command_buffers.size() );
+            info.pCommandBuffers = submission.command_buffers.data();
+            info.signalSemaphoreCount = static_cast<std::uint32_t>(
+                submission.signal_semaphores.size() );
+            info.pSignalSemaphores = submission.signal_semaphores.data();
+            if ( !submission.wait_values.empty()
+                 || !submission.signal_values.empty() ) {
+                auto & timeline{ timeline_infos[i] };
+                timeline.sType =
+                    VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+                timeline.waitSemaphoreValueCount = static_cast<std::uint32_t>(
+                    submission.wait_values.size() );
+                timeline.pWaitSemaphoreValues = submission.wait_values.data();
+                timeline.signalSemaphoreValueCount =
+                    static_cast<std::uint32_t>(
+                        submission.signal_values.size() );
+                timeline.pSignalSemaphoreValues =
+                    submission.signal_values.data();
+                info.pNext = &timeline;
+            }
+        }
+        const VkFence fence{
+            std::get<QueueSubmission>( batch[end - 1] ).fence };
+
+        const auto     start{ std::chrono::steady_clock::now() };
+        const VkResult result{ m_dispatch.queue_submit(
+            m_graphics_queue, static_cast<std::uint32_t>( count ),
+            infos.data(), fence ) };
+        record( m_submit_latency, start );
+        if ( result != VK_SUCCESS ) {
+            fail( m_submit_error, result );
+        }
+
+        m_submissions.fetch_add( count, std::memory_order_relaxed );
+        m_submit_calls.fetch_add( 1, std::memory_order_relaxed );
+        if ( count > m_max_coalesced.load( std::memory_order_relaxed ) ) {
+            m_max_coalesced.store( count, std::memory_order_relaxed );
+        }
+        issued( count );
+    }
+
+    void present_one( const QueuePresentation & presentation ) {
+        std::vector<VkResult> results( presentation.swapchains.size(),
+                                       VK_SUCCESS );
+
+        VkPresentInfoKHR present_info{};
+        present_info.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
+        present_info.waitSemaphoreCount = static_cast<std::uint32_t>(
+            presentation.wait_semaphores.size() );
+        present_info.pWaitSemaphores = presentation.wait_semaphores.data();
+        present_info.swapchainCount =
+            static_cast<std::uint32_t>( presentation.swapchains.size() );
+        present_info.pSwapchains = presentation.swapchains.data();
+        present_info.pImageIndices = presentation.image_indices.data();
+        present_info.pResults = results.data();
+
+        const auto     start{ std::chrono::steady_clock::now() };
+        const VkResult result{ m_dispatch.queue_present_khr( m_present_queue,
+                                                             &present_info ) };
+        record( m_present_latency, start );
+        if ( result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR ) {
+            fail( m_present_error, result );
+        }
+        else if ( presentation.on_presented ) {
+            presentation.on_presented( results );
+        }
+
+        m_presents.fetch_add( 1, std::memory_order_relaxed );
+        issued( 1 );
+    }
+
+    void acquire_one( const SwapchainAcquisition & acquisition ) {
+        std::vector<AcquiredImage> images( acquisition.swapchains.size() );
+        bool                       ok{ true };
+        for ( std::size_t i{ 0 }; i < images.size(); ++i ) {
+            auto &     image{ images[i] };
+            const auto start{ std::chrono::steady_clock::now() };
+            image.result = m_dispatch.acquire_next_image_khr(
+                acquisition.device, acquisition.swapchains[i],
+                std::numeric_limits<std::uint64_t>::max(),
+                acquisition.semaphores[i], VK_NULL_HANDLE,
+                &image.image_index );
+            image.nanoseconds = static_cast<std::uint64_t>(
+                std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now() - start )
+                    .count() );
+            if ( image.result != VK_SUCCESS
+                 && image.result != VK_SUBOPTIMAL_KHR ) {
+                fail( m_acquire_error, image.result );
+                ok = false;
+            }
+        }
+        if ( ok && acquisition.on_acquired ) {
+            acquisition.on_acquired( images );
+        }
+
+        m_acquires.fetch_add( 1, std::memory_order_relaxed );
+        issued( 1 );
+    }
+
+    static void record( MetricHistogram * const                    histogram,
+                        const std::chrono::steady_clock::time_point start ) {
+        if ( histogram != nullptr ) {
+            histogram->record( static_cast<std::uint64_t>(
+                std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now() - start )
+                    .count() ) );
+        }
+    }
+
+    // Keeps the first error only.
+    static void fail( std::atomic<VkResult> & error, const VkResult result ) {
+        VkResult expected{ VK_SUCCESS };
+        error.compare_exchange_strong( expected, result,
+                                       std::memory_order_release );
+    }
+};
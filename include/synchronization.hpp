@@ -0,0 +1,374 @@
+#pragma once
+
+#include "device_features.hpp"
+#include "vk_handle.hpp"
+
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include <vector>
+
+// synchronization2 barriers and timeline semaphores, with the legacy
+// entry points standing in wherever the device negotiated without them.
+
+// Device-level entry points, null when the feature isn't enabled. Loaded
+// through vkGetDeviceProcAddr, which also skips the loader trampoline.
+struct SynchronizationFunctions
+{
+    PFN_vkCmdPipelineBarrier        cmd_pipeline_barrier{ nullptr };
+    PFN_vkCmdPipelineBarrier2       cmd_pipeline_barrier2{ nullptr };
+    PFN_vkWaitSemaphores            wait_semaphores{ nullptr };
+    PFN_vkGetSemaphoreCounterValue  get_semaphore_counter_value{ nullptr };
+
+    [[nodiscard]] static SynchronizationFunctions
+    load( const VkDevice device, const NegotiatedDeviceFeatures & features ) {
+        SynchronizationFunctions functions{};
+        functions.cmd_pipeline_barrier =
+            reinterpret_cast<PFN_vkCmdPipelineBarrier>(
+                vkGetDeviceProcAddr( device, "vkCmdPipelineBarrier" ) );
+        if ( features.synchronization2 ) {
+            functions.cmd_pipeline_barrier2 =
+                reinterpret_cast<PFN_vkCmdPipelineBarrier2>(
+                    vkGetDeviceProcAddr( device,
+                                         features.synchronization2_extension
+                                             ? "vkCmdPipelineBarrier2KHR"
+                                             : "vkCmdPipelineBarrier2" ) );
+        }
+        if ( features.timeline_semaphore ) {
+            functions.wait_semaphores = reinterpret_cast<PFN_vkWaitSemaphores>(
+                vkGetDeviceProcAddr( device, "vkWaitSemaphores" ) );
+            functions.get_semaphore_counter_value =
+                reinterpret_cast<PFN_vkGetSemaphoreCounterValue>(
+                    vkGetDeviceProcAddr( device,
+                                         "vkGetSemaphoreCounterValue" ) );
+        }
+        return functions;
+    }
+
+    [[nodiscard]] bool has_synchronization2() const noexcept {
+        return cmd_pipeline_barrier2 != nullptr;
+    }
+    [[nodiscard]] bool has_timeline_semaphore() const noexcept {
+        return wait_semaphores != nullptr
+               && get_semaphore_counter_value != nullptr;
+    }
+};
+
+// Narrows a synchronization2 stage mask to the legacy flags. The 2-only
+// stages fold into the legacy stage containing them and an empty mask
+// becomes `none`, as the legacy call has no NONE.
+[[nodiscard]] inline VkPipelineStageFlags
+to_legacy_stages( VkPipelineStageFlags2 stages,
+                  const VkPipelineStageFlags none ) noexcept {
+    constexpr VkPipelineStageFlags2 transfer{
+        VK_PIPELINE_STAGE_2_COPY_BIT | VK_PIPELINE_STAGE_2_RESOLVE_BIT
+        | VK_PIPELINE_STAGE_2_BLIT_BIT | VK_PIPELINE_STAGE_2_CLEAR_BIT
+    };
+    constexpr VkPipelineStageFlags2 vertex_input{
+        VK_PIPELINE_STAGE_2_INDEX_INPUT_BIT
+        | VK_PIPELINE_STAGE_2_VERTEX_ATTRIBUTE_INPUT_BIT
+    };
+    if ( ( stages & transfer ) != 0 ) {
+        stages |= VK_PIPELINE_STAGE_2_TRANSFER_BIT;
+    }
+    if ( ( stages & vertex_input ) != 0 ) {
+        stages |= VK_PIPELINE_STAGE_2_VERTEX_INPUT_BIT;
+    }
+    // No tessellation or geometry here, so vertex covers pre-raster.
+    if ( ( stages & VK_PIPELINE_STAGE_2_PRE_RASTERIZATION_SHADERS_BIT ) != 0 ) {
+        stages |= VK_PIPELINE_STAGE_2_VERTEX_SHADER_BIT;
+    }
+    // The legacy bits share their values with the 32 low bits of the new ones.
+    const auto legacy{ static_cast<VkPipelineStageFlags>(
+        stages & std::numeric_limits<std::uint32_t>::max() ) };
+    return legacy != 0 ? legacy : none;
+}
+
+[[nodiscard]] inline VkAccessFlags
+to_legacy_access( VkAccessFlags2 access ) noexcept {
+    if ( ( access
+           & ( VK_ACCESS_2_SHADER_SAMPLED_READ_BIT
+               | VK_ACCESS_2_SHADER_STORAGE_READ_BIT ) )
+         != 0 ) {
+        access |= VK_ACCESS_2_SHADER_READ_BIT;
+    }
+    if ( ( access & VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT ) != 0 ) {
+        access |= VK_ACCESS_2_SHADER_WRITE_BIT;
+    }
+    return static_cast<VkAccessFlags>(
+        access & std::numeric_limits<std::uint32_t>::max() );
+}
+
+// Collects barriers while a pass is recorded and emits them as a single
+// vkCmdPipelineBarrier2, so N transitions cost one call and one
+// driver-side dependency instead of N. Global memory barriers are merged
+// into one as they arrive.
+//
+// Barriers in one batch are unordered with respect to each other, so two
+// barriers touching the same subresource need a flush between them.
+class BarrierBatch
+{
+    public:
+    explicit BarrierBatch( const SynchronizationFunctions & functions )
+        : m_functions( functions ) {}
+
+    void memory_barrier( const VkPipelineStageFlags2 src_stages,
+                         const VkAccessFlags2        src_access,
+                         const VkPipelineStageFlags2 dst_stages,
+                         const VkAccessFlags2        dst_access ) {
+        if ( m_memory_barriers.empty() ) {
+            VkMemoryBarrier2 barrier{};
+            barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2;
+            m_memory_barriers.push_back( barrier );
+        }
+        auto & merged{ m_memory_barriers.front() };
+        merged.srcStageMask |= src_stages;
+        merged.srcAccessMask |= src_access;
+        merged.dstStageMask |= dst_stages;
+        merged.dstAccessMask |= dst_access;
+    }
+
+    // Whole buffer when `size` is left at VK_WHOLE_SIZE.
+    void buffer_barrier( const VkBuffer              buffer,
+                         const VkPipelineStageFlags2 src_stages,
+                         const VkAccessFlags2        src_access,
+                         const VkPipelineStageFlags2 dst_stages,
+                         const VkAccessFlags2        dst_access,
+                         const VkDeviceSize          offset = 0,
+                         const VkDeviceSize          size = VK_WHOLE_SIZE ) {
+        VkBufferMemoryBarrier2 barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER_2;
+        barrier.srcStageMask = src_stages;
+        barrier.srcAccessMask = src_access;
+        barrier.dstStageMask = dst_stages;
+        barrier.dstAccessMask = dst_access;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.buffer = buffer;
+        barrier.offset = offset;
+        barrier.size = size;
+        m_buffer_barriers.push_back( barrier );
+    }
+
+    // Layout transition over the first mip and layer unless told otherwise.
+    void image_barrier( const VkImage               image,
+                        const VkImageLayout         old_layout,
+                        const VkImageLayout         new_layout,
+                        const VkPipelineStageFlags2 src_stages,
+                        const VkAccessFlags2        src_access,
+                        const VkPipelineStageFlags2 dst_stages,
+                        const VkAccessFlags2        dst_access,
+                        const VkImageSubresourceRange & range = {
+                            VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 } ) {
+        VkImageMemoryBarrier2 barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2;
+        barrier.srcStageMask = src_stages;
+        barrier.srcAccessMask = src_access;
+        barrier.dstStageMask = dst_stages;
+        barrier.dstAccessMask = dst_access;
+        barrier.oldLayout = old_layout;
+        barrier.newLayout = new_layout;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.image = image;
+        barrier.subresourceRange = range;
+        m_image_barriers.push_back( barrier );
+    }
+
+    [[nodiscard]] bool empty() const noexcept {
+        return m_memory_barriers.empty() && m_buffer_barriers.empty()
+               && m_image_barriers.empty();
+    }
+
+    // Records everything collected so far and starts a new batch. Nothing
+    // is recorded for an empty batch.
+    void flush( const VkCommandBuffer command_buffer ) {
+        if ( empty() ) {
+            return;
+        }
+        m_barrier_count += m_memory_barriers.size() + m_buffer_barriers.size()
+                           + m_image_barriers.size();
+        ++m_flush_count;
+
+        if ( m_functions.has_synchronization2() ) {
+            VkDependencyInfo dependency{};
+            dependency.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+            dependency.memoryBarrierCount =
+                static_cast<std::uint32_t>( m_memory_barriers.size() );
+            dependency.pMemoryBarriers = m_memory_barriers.data();
+            dependency.bufferMemoryBarrierCount =
+                static_cast<std::uint32_t>( m_buffer_barriers.size() );
+            dependency.pBufferMemoryBarriers = m_buffer_barriers.data();
+            dependency.imageMemoryBarrierCount =
+                static_cast<std::uint32_t>( m_image_barriers.size() );
+            dependency.pImageMemoryBarriers = m_image_barriers.data();
+            m_functions.cmd_pipeline_barrier2( command_buffer, &dependency );
+        }
+        else {
+            flush_legacy( command_buffer );
+        }
+
+        m_memory_barriers.clear();
+        m_buffer_barriers.clear();
+        m_image_barriers.clear();
+    }
+
+    // Barriers recorded and the pipeline barrier calls they took.
+    [[nodiscard]] std::uint64_t barrier_count() const noexcept {
+        return m_barrier_count;
+    }
+    [[nodiscard]] std::uint64_t flush_count() const noexcept {
+        return m_flush_count;
+    }
+
+    private:
+    SynchronizationFunctions            m_functions;
+    std::vector<VkMemoryBarrier2>       m_memory_barriers;
+    std::vector<VkBufferMemoryBarrier2> m_buffer_barriers;
+    std::vector<VkImageMemoryBarrier2>  m_image_barriers;
+    std::uint64_t                       m_barrier_count{ 0 };
+    std::uint64_t                       m_flush_count{ 0 };
+
+    // One vkCmdPipelineBarrier with the union of every stage mask; legacy
+    // barriers can't carry stages of their own.
+    void flush_legacy( const VkCommandBuffer command_buffer ) const {
+        VkPipelineStageFlags2 src_stages{ 0 };
+        VkPipelineStageFlags2 dst_stages{ 0 };
+
+        std::vector<VkMemoryBarrier> memory_barriers;
+        for ( const auto & barrier : m_memory_barriers ) {
+            src_stages |= barrier.srcStageMask;
+            dst_stages |= barrier.dstStageMask;
+            VkMemoryBarrier legacy{};
+            legacy.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+            legacy.srcAccessMask = to_legacy_access( barrier.srcAccessMask );
+            legacy.dstAccessMask = to_legacy_access( barrier.dstAccessMask );
+            memory_barriers.push_back( legacy );
+        }
+
+        std::vector<VkBufferMemoryBarrier> buffer_barriers;
+        for ( const auto & barrier : m_buffer_barriers ) {
+            src_stages |= barrier.srcStageMask;
+            dst_stages |= barrier.dstStageMask;
+            VkBufferMemoryBarrier legacy{};
+            legacy.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+            legacy.srcAccessMask = to_legacy_access( barrier.srcAccessMask );
+            legacy.dstAccessMask = to_legacy_access( barrier.dstAccessMask );
+            legacy.srcQueueFamilyIndex = barrier.srcQueueFamilyIndex;
+            legacy.dstQueueFamilyIndex = barrier.dstQueueFamilyIndex;
+            legacy.buffer = barrier.buffer;
+            legacy.offset = barrier.offset;
+            legacy.size = barrier.size;
+            buffer_barriers.push_back( legacy );
+        }
+
+        std::vector<VkImageMemoryBarrier> image_barriers;
+        for ( const auto & barrier : m_image_barriers ) {
+            src_stages |= barrier.srcStageMask;
+            dst_stages |= barrier.dstStageMask;
+            VkImageMemoryBarrier legacy{};
+            legacy.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+            legacy.srcAccessMask = to_legacy_access( barrier.srcAccessMask );
+            legacy.dstAccessMask = to_legacy_access( barrier.dstAccessMask );
+            legacy.oldLayout = barrier.oldLayout;
+            legacy.newLayout = barrier.newLayout;
+            legacy.srcQueueFamilyIndex = barrier.srcQueueFamilyIndex;
+            legacy.dstQueueFamilyIndex = barrier.dstQueueFamilyIndex;
+            legacy.image = barrier.image;
+            legacy.subresourceRange = barrier.subresourceRange;
+            image_barriers.push_back( legacy );
+        }
+
+        const auto cmd_pipeline_barrier{
+            m_functions.cmd_pipeline_barrier != nullptr
+                ? m_functions.cmd_pipeline_barrier
+                : vkCmdPipelineBarrier };
+        cmd_pipeline_barrier(
+            command_buffer,
+            to_legacy_stages( src_stages, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT ),
+            to_legacy_stages( dst_stages,
+                              VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT ),
+            0, static_cast<std::uint32_t>( memory_barriers.size() ),
+            memory_barriers.data(),
+            static_cast<std::uint32_t>( buffer_barriers.size() ),
+            buffer_barriers.data(),
+            static_cast<std::uint32_t>( image_barriers.size() ),
+            image_barriers.data() );
+    }
+};
+
+// One timeline semaphore in place of a fence per frame in flight. Frame N
+// signals N + 1, so the initial value of 0 means nothing has finished and
+// every wait is on a plain number rather than a slot that needs resetting.
+class FrameTimeline
+{
+    public:
+    FrameTimeline( const VkDevice                   device,
+                   const SynchronizationFunctions & functions,
+                   const VkAllocationCallbacks *    allocator = nullptr )
+        : m_device( device ), m_functions( functions ) {
+        if ( !m_functions.has_timeline_semaphore() ) {
+            throw std::runtime_error(
+                "Timeline semaphores are not enabled on this device." );
+        }
+
+        VkSemaphoreTypeCreateInfo type_info{};
+        type_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+        type_info.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+        type_info.initialValue = 0;
+
+        VkSemaphoreCreateInfo create_info{};
+        create_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+        create_info.pNext = &type_info;
+        if ( vkCreateSemaphore( device, &create_info, allocator,
+                                m_semaphore.put( device, allocator ) )
+             != VK_SUCCESS ) {
+            throw std::runtime_error(
+                "Failed to create timeline semaphore." );
+        }
+    }
+
+    [[nodiscard]] VkSemaphore semaphore() const noexcept {
+        return m_semaphore;
+    }
+
+    // What the submit for `frame` signals.
+    [[nodiscard]] static constexpr std::uint64_t
+    signal_value( const std::uint64_t frame ) noexcept {
+        return frame + 1;
+    }
+
+    // Blocks until the GPU has finished `frame`.
+    void wait( const std::uint64_t frame ) const {
+        const VkSemaphore   semaphore{ m_semaphore };
+        const std::uint64_t value{ signal_value( frame ) };
+
+        VkSemaphoreWaitInfo wait_info{};
+        wait_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+        wait_info.semaphoreCount = 1;
+        wait_info.pSemaphores = &semaphore;
+        wait_info.pValues = &value;
+        if ( m_functions.wait_semaphores(
+                 m_device, &wait_info,
+                 std::numeric_limits<std::uint64_t>::max() )
+             != VK_SUCCESS ) {
+            throw std::runtime_error( "Failed to wait for frame timeline." );
+        }
+    }
+
+    // Number of frames the GPU has finished, without blocking.
+    [[nodiscard]] std::uint64_t completed() const {
+        std::uint64_t value{ 0 };
+        if ( m_functions.get_semaphore_counter_value( m_device, m_semaphore,
+                                                      &value )
+             != VK_SUCCESS ) {
+            throw std::runtime_error( "Failed to read frame timeline." );
+        }
+        return value;
+    }
+
+    private:
+    VkDevice                 m_device;
+    SynchronizationFunctions m_functions;
+    UniqueSemaphore          m_semaphore;
+};
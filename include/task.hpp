@@ -0,0 +1,282 @@
+#pragma once
+
+#include <atomic>
+#include <coroutine>
+#include <cstddef>
+#include <exception>
+#include <future>
+#include <mutex>
+#include <optional>
+#include <type_traits>
+#include <utility>
+#include <variant>
+#include <vector>
+
+// Lazy coroutine task. Nothing runs until the task is awaited (or handed to
+// start()), and completion resumes the awaiting coroutine
+// directly through symmetric transfer, so chains of tasks don't grow the
+// stack. Where a task runs is up to the awaitables inside it; see
+// AsyncExecutor for hopping onto thread pools.
+template <typename T = void>
+class Task;
+
+namespace task_detail
+{
+struct FinalAwaiter
+{
+    [[nodiscard]] bool await_ready() const noexcept { return false; }
+    template <typename Promise>
+    [[nodiscard]] std::coroutine_handle<>
+    await_suspend( const std::coroutine_handle<Promise> handle ) noexcept {
+        if ( const auto continuation{ handle.promise().continuation } ) {
+            return continuation;
+        }
+        return std::noop_coroutine();
+    }
+    void await_resume() const noexcept {}
+};
+
+struct PromiseBase
+{
+    std::coroutine_handle<> continuation;
+    std::exception_ptr      error;
+
+    [[nodiscard]] std::suspend_always initial_suspend() const noexcept {
+        return {};
+    }
+    [[nodiscard]] FinalAwaiter final_suspend() const noexcept { return {}; }
+    void unhandled_exception() noexcept { error = std::current_exception(); }
+};
+
+template <typename T>
+struct Promise : PromiseBase
+{
+    std::optional<T> value;
+
+    [[nodiscard]] Task<T> get_return_object() noexcept;
+    template <typename U>
+    void return_value( U && result ) {
+        value.emplace( std::forward<U>( result ) );
+    }
+    [[nodiscard]] T take() {
+        if ( error ) {
+            std::rethrow_exception( error );
+        }
+        return std::move( *value );
+    }
+};
+
+template <>
+struct Promise<void> : PromiseBase
+{
+    [[nodiscard]] Task<void> get_return_object() noexcept;
+    void return_void() const noexcept {}
+    void take() const {
+        if ( error ) {
+            std::rethrow_exception( error );
+        }
+    }
+};
+
+// Fire-and-forget coroutine that runs eagerly and frees itself at the end.
+// Only used as the outermost driver of a Task, which catches everything.
+struct Detached
+{
+    struct promise_type
+    {
+        [[nodiscard]] Detached get_return_object() const noexcept {
+            return {};
+        }
+        [[nodiscard]] std::suspend_never initial_suspend() const noexcept {
+            return {};
+        }
+        [[nodiscard]] std::suspend_never final_suspend() const noexcept {
+            return {};
+        }
+        void return_void() const noexcept {}
+        void unhandled_exception() const noexcept { std::terminate(); }
+    };
+};
+} // namespace task_detail
+
+template <typename T>
+class [[nodiscard]] Task
+{
+    public:
+    using promise_type = task_detail::Promise<T>;
+    using Handle = std::coroutine_handle<promise_type>;
+
+    Task() = default;
+    explicit Task( const Handle handle ) noexcept : m_handle( handle ) {}
+
+    Task( Task && other ) noexcept
+        : m_handle( std::exchange( other.m_handle, nullptr ) ) {}
+    Task & operator=( Task && other ) noexcept {
+        if ( this != &other ) {
+            reset();
+            m_handle = std::exchange( other.m_handle, nullptr );
+        }
+        return *this;
+    }
+    Task( const Task & ) = delete;
+    Task & operator=( const Task & ) = delete;
+
+    ~Task() { reset(); }
+
+    [[nodiscard]] bool await_ready() const noexcept {
+        return !m_handle || m_handle.done();
+    }
+    [[nodiscard]] std::coroutine_handle<>
+    await_suspend( const std::coroutine_handle<> awaiting ) noexcept {
+        m_handle.promise().continuation = awaiting;
+        return m_handle;
+    }
+    T await_resume() { return m_handle.promise().take(); }
+
+    private:
+    Handle m_handle;
+
+    void reset() noexcept {
+        if ( m_handle ) {
+            m_handle.destroy();
+            m_handle = nullptr;
+        }
+    }
+};
+
+namespace task_detail
+{
+template <typename T>
+Task<T>
+Promise<T>::get_return_object() noexcept {
+    return Task<T>{ std::coroutine_handle<Promise<T>>::from_promise( *this ) };
+}
+inline Task<void>
+Promise<void>::get_return_object() noexcept {
+    return Task<void>{ std::coroutine_handle<Promise<void>>::from_promise(
+        *this ) };
+}
+
+template <typename T>
+Detached
+drive( Task<T> task, std::promise<T> promise ) {
+    try {
+        if constexpr ( std::is_void_v<T> ) {
+            co_await task;
+            promise.set_value();
+        }
+        else {
+            promise.set_value( co_await task );
+        }
+    }
+    catch ( ... ) {
+        promise.set_exception( std::current_exception() );
+    }
+}
+} // namespace task_detail
+
+// Runs `task` on the calling thread up to its first suspension and lets it
+// finish wherever it resumes. The future carries the result or exception.
+template <typename T>
+[[nodiscard]] std::future<T>
+start( Task<T> task ) {
+    std::promise<T> promise;
+    auto            future{ promise.get_future() };
+    task_detail::drive( std::move( task ), std::move( promise ) );
+    return future;
+}
+
+namespace task_detail
+{
+template <typename T>
+using Slot = std::conditional_t<std::is_void_v<T>, std::monostate, T>;
+
+template <typename T>
+struct WhenAllState
+{
+    std::vector<std::optional<Slot<T>>> results;
+    // One per task plus one for the awaiting coroutine, so whoever brings
+    // it to zero is the one to carry on.
+    std::atomic<std::size_t> remaining{ 0 };
+    std::coroutine_handle<>  continuation;
+    std::mutex               error_mutex;
+    std::exception_ptr       error;
+
+    void arrive() {
+        if ( remaining.fetch_sub( 1, std::memory_order_acq_rel ) == 1 ) {
+            continuation.resume();
+        }
+    }
+};
+
+template <typename T>
+Detached
+when_all_drive( Task<T> task, WhenAllState<T> & state,
+                const std::size_t index ) {
+    try {
+        if constexpr ( std::is_void_v<T> ) {
+            co_await task;
+            state.results[index].emplace();
+        }
+        else {
+            state.results[index].emplace( co_await task );
+        }
+    }
+    catch ( ... ) {
+        std::lock_guard lock( state.error_mutex );
+        if ( !state.error ) {
+            state.error = std::current_exception();
+        }
+    }
+    state.arrive();
+}
+
+template <typename T>
+struct WhenAllAwaiter
+{
+    std::vector<Task<T>> & tasks;
+    WhenAllState<T> &      state;
+
+    [[nodiscard]] bool await_ready() const noexcept { return tasks.empty(); }
+    [[nodiscard]] bool
+    await_suspend( const std::coroutine_handle<> awaiting ) {
+        state.continuation = awaiting;
+        state.results.resize( tasks.size() );
+        state.remaining.store( tasks.size() + 1, std::memory_order_relaxed );
+        for ( std::size_t i{ 0 }; i < tasks.size(); ++i ) {
+            when_all_drive( std::move( tasks[i] ), state, i );
+        }
+        // Stay running if everything already finished inline.
+        return state.remaining.fetch_sub( 1, std::memory_order_acq_rel ) != 1;
+    }
+    void await_resume() const noexcept {}
+};
+} // namespace task_detail
+
+// Starts every task at once and finishes when the last one does, resuming
+// on whichever thread that was. Results keep the order of `tasks`; the
+// first exception is rethrown once all have finished.
+template <typename T>
+Task<std::vector<T>>
+when_all( std::vector<Task<T>> tasks ) {
+    task_detail::WhenAllState<T> state;
+    co_await task_detail::WhenAllAwaiter<T>{ tasks, state };
+    if ( state.error ) {
+        std::rethrow_exception( state.error );
+    }
+    std::vector<T> results;
+    results.reserve( state.results.size() );
+    for ( auto & result : state.results ) {
+        results.push_back( std::move( *result ) );
+    }
+    co_return results;
+}
+
+inline Task<void>
+when_all( std::vector<Task<void>> tasks ) {
+    task_detail::WhenAllState<void> state;
+    co_await task_detail::WhenAllAwaiter<void>{ tasks, state };
+    if ( state.error ) {
+        std::rethrow_exception( state.error );
+    }
+}
@@ -0,0 +1,234 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+struct TextureResidencyStats
+{
+    std::uint64_t resident_bytes{ 0 };
+    std::uint64_t peak_resident_bytes{ 0 };
+    std::uint64_t uploads{ 0 };
+    std::uint64_t evictions{ 0 };
+};
+
+// An upload schedule() wants started: levels `first_level` to the last of
+// `texture`, replacing whatever is resident once it completes.
+struct TextureUploadPlan
+{
+    std::uint32_t texture{ 0 };
+    std::uint32_t first_level{ 0 };
+    // Drops the texture back to its tail rather than refining it.
+    bool eviction{ false };
+};
+
+// Which mips of each streamed texture should be resident, without any of
+// the Vulkan work; TextureStreamer carries the plans out. Textures are
+// refined one level at a time, coarsest first among the most recently used,
+// and the least recently used are dropped back to their tail when a
+// refinement would break the budget. Bytes are reserved when an upload is
+// planned and counted as resident once it completes.
+class TextureResidency
+{
+    public:
+    TextureResidency( const std::uint64_t budget,
+                      const std::uint32_t max_uploads ) :
+        m_budget( budget ), m_max_uploads( max_uploads ) {}
+
+    // `level_bytes` is finest first; `tail_level` and everything coarser is
+    // loaded by the first upload and never evicted.
+    [[nodiscard]] std::uint32_t add( std::vector<std::uint64_t> level_bytes,
+                                     const std::uint32_t        tail_level ) {
+        if ( tail_level >= level_bytes.size() ) {
+            throw std::runtime_error( "Texture tail past its last level." );
+        }
+        Texture texture{};
+        texture.level_bytes = std::move( level_bytes );
+        texture.tail_level = tail_level;
+        texture.resident_level = level_count( texture );
+        m_textures.push_back( std::move( texture ) );
+        return static_cast<std::uint32_t>( m_textures.size() - 1 );
+    }
+
+    // Marks the texture as used by `frame`, for refinement and eviction order.
+    void touch( const std::uint32_t id, const std::uint64_t frame ) {
+        auto & texture{ m_textures.at( id ) };
+        texture.last_used = std::max( texture.last_used, frame );
+    }
+
+    // Finest level currently resident, level_count() if none.
+    [[nodiscard]] std::uint32_t resident_level( const std::uint32_t id ) const {
+        return m_textures.at( id ).resident_level;
+    }
+    [[nodiscard]] std::uint32_t level_count( const std::uint32_t id ) const {
+        return level_count( m_textures.at( id ) );
+    }
+    // False until the first upload has landed; the fallback is bound until
+    // then.
+    [[nodiscard]] bool resident( const std::uint32_t id ) const {
+        const auto & texture{ m_textures.at( id ) };
+        return texture.resident_level < level_count( texture );
+    }
+    // Reserved by resident textures and planned uploads together.
+    [[nodiscard]] std::uint64_t committed_bytes() const noexcept {
+        return m_committed_bytes;
+    }
+    [[nodiscard]] const TextureResidencyStats & stats() const noexcept {
+        return m_stats;
+    }
+
+    // Plans uploads until `max_uploads` refinements are in flight or
+    // nothing more fits. Evictions making room come first and don't count
+    // against the limit.
+    [[nodiscard]] std::vector<TextureUploadPlan> schedule() {
+        std::vector<TextureUploadPlan> plans;
+        while ( m_refining < m_max_uploads ) {
+            // Most recently used first, and among textures used in the same
+            // frame the coarsest.
+            const Texture * best{ nullptr };
+            std::uint32_t   best_id{ 0 };
+            for ( std::uint32_t id{ 0 }; id < m_textures.size(); ++id ) {
+                const auto & texture{ m_textures[id] };
+                if ( texture.busy || texture.resident_level == 0 ) {
+                    continue;
+                }
+                if ( best == nullptr || texture.last_used > best->last_used
+                     || ( texture.last_used == best->last_used
+                          && texture.resident_level > best->resident_level ) ) {
+                    best = &texture;
+                    best_id = id;
+                }
+            }
+            if ( best == nullptr ) {
+                break;
+            }
+
+            const bool resident{ best->resident_level < level_count( *best ) };
+            const auto target{ resident ? best->resident_level - 1
+                                        : best->tail_level };
+            const auto growth{ chain_bytes( *best, target )
+                               - best->committed_bytes };
+            // Tails are always admitted; refinement has to fit the budget.
+            if ( resident && m_committed_bytes + growth > m_budget ) {
+                const auto needed{ m_committed_bytes + growth - m_budget };
+                if ( !evict( needed, best->last_used, plans ) ) {
+                    break;
+                }
+            }
+            plans.push_back( plan( best_id, target, false ) );
+            ++m_refining;
+        }
+        return plans;
+    }
+
+    // The planned upload has landed and replaces the resident levels.
+    void complete( const TextureUploadPlan & done ) {
+        auto & texture{ m_textures.at( done.texture ) };
+        texture.resident_level = done.first_level;
+        m_stats.resident_bytes = m_stats.resident_bytes - texture.bytes
+                                 + texture.committed_bytes;
+        texture.bytes = texture.committed_bytes;
+        m_stats.peak_resident_bytes =
+            std::max( m_stats.peak_resident_bytes, m_stats.resident_bytes );
+        if ( done.eviction ) {
+            ++m_stats.evictions;
+        }
+        else {
+            ++m_stats.uploads;
+            --m_refining;
+        }
+        texture.busy = false;
+    }
+
+    private:
+    struct Texture
+    {
+        std::vector<std::uint64_t> level_bytes;
+        std::uint32_t              tail_level{ 0 };
+        std::uint32_t              resident_level{ 0 };
+        std::uint64_t              bytes{ 0 };
+        // Bytes once the in-flight upload (if any) has completed.
+        std::uint64_t committed_bytes{ 0 };
+        std::uint64_t last_used{ 0 };
+        bool          busy{ false };
+    };
+
+    std::uint64_t         m_budget;
+    std::uint32_t         m_max_uploads;
+    std::uint32_t         m_refining{ 0 };
+    std::uint64_t         m_committed_bytes{ 0 };
+    TextureResidencyStats m_stats{};
+    std::vector<Texture>  m_textures;
+
+    [[nodiscard]] static std::uint32_t
+    level_count( const Texture & texture ) noexcept {
+        return static_cast<std::uint32_t>( texture.level_bytes.size() );
+    }
+
+    [[nodiscard]] static std::uint64_t
+    chain_bytes( const Texture & texture, const std::uint32_t first_level ) {
+        std::uint64_t bytes{ 0 };
+        for ( auto level{ first_level }; level < level_count( texture );
+              ++level ) {
+            bytes += texture.level_bytes[level];
+        }
+        return bytes;
+    }
+
+    // Reserves the budget for the upload and marks the texture busy.
+    [[nodiscard]] TextureUploadPlan plan( const std::uint32_t id,
+                                          const std::uint32_t first_level,
+                                          const bool          eviction ) {
+        auto &     texture{ m_textures[id] };
+        const auto new_bytes{ chain_bytes( texture, first_level ) };
+        m_committed_bytes =
+            m_committed_bytes - texture.committed_bytes + new_bytes;
+        texture.committed_bytes = new_bytes;
+        texture.busy = true;
+        return { id, first_level, eviction };
+    }
+
+    // Drops least recently used textures, used before `newer_than`, back to
+    // their tail until `needed` bytes are freed. Returns false if it can't.
+    [[nodiscard]] bool evict( const std::uint64_t              needed,
+                              const std::uint64_t              newer_than,
+                              std::vector<TextureUploadPlan> & plans ) {
+        std::vector<std::uint32_t> candidates;
+        for ( std::uint32_t id{ 0 }; id < m_textures.size(); ++id ) {
+            const auto & texture{ m_textures[id] };
+            if ( !texture.busy && texture.resident_level < texture.tail_level
+                 && texture.last_used < newer_than ) {
+                candidates.push_back( id );
+            }
+        }
+        std::sort( candidates.begin(), candidates.end(),
+                   [&]( const std::uint32_t a, const std::uint32_t b ) {
+                       return m_textures[a].last_used < m_textures[b].last_used;
+                   } );
+
+        const auto freeable = [this]( const std::uint32_t id ) {
+            const auto & texture{ m_textures[id] };
+            return texture.committed_bytes
+                   - chain_bytes( texture, texture.tail_level );
+        };
+
+        // Only start evicting if it will make enough room.
+        std::uint64_t available{ 0 };
+        std::size_t   count{ 0 };
+        while ( count < candidates.size() && available < needed ) {
+            available += freeable( candidates[count++] );
+        }
+        if ( available < needed ) {
+            return false;
+        }
+        for ( std::size_t i{ 0 }; i < count; ++i ) {
+            plans.push_back( plan( candidates[i],
+                                   m_textures[candidates[i]].tail_level,
+                                   true ) );
+        }
+        return true;
+    }
+};
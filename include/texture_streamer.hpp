@@ -0,0 +1,538 @@
+#pragma once
+
+#include "bc_decode.hpp"
+#include "ktx2.hpp"
+#include "submit_thread.hpp"
+#include "texture_residency.hpp"
+#include "thread_pool.hpp"
+#include "vk_dispatch.hpp"
+#include "vk_memory.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using TextureId = std::uint32_t;
+
+struct TextureStreamerConfig
+{
+    // Device memory all streamed textures may occupy together. Replaced
+    // images are only freed once the frames using them have completed, so
+    // the real footprint briefly exceeds this while textures change size.
+    VkDeviceSize budget{ 256ull << 20 };
+    // Levels no larger than this in either dimension form the tail, which is
+    // loaded by the first upload and never evicted.
+    std::uint32_t tail_size{ 64 };
+    // Refinement uploads in flight at once, each with its own staging buffer.
+    std::uint32_t max_uploads{ 2 };
+    // Threads paging levels in from the mapped files (and decoding BC).
+    std::size_t worker_count{ 1 };
+    // Whether the device was created with textureCompressionBC; without it
+    // BC1-BC3 are decoded to RGBA8 and other BC formats are rejected.
+    bool bc_enabled{ false };
+};
+
+// What view() currently refers to.
+struct TextureViewInfo
+{
+    VkFormat      format{ VK_FORMAT_UNDEFINED };
+    VkExtent2D    extent{};
+    std::uint32_t levels{ 0 };
+};
+
+struct TextureStreamerStats
+{
+    std::size_t   textures{ 0 };
+    std::size_t   decoded_textures{ 0 };
+    VkDeviceSize  resident_bytes{ 0 };
+    VkDeviceSize  peak_resident_bytes{ 0 };
+    std::uint64_t uploads{ 0 };
+    std::uint64_t evictions{ 0 };
+};
+
+// Streams mip chains of KTX2 textures into device memory, coarse first.
+//
+// Each texture starts out with only its tail mips and is refined one level at
+// a time. Among the textures used most recently the coarsest is refined next,
+// so everything on screen gets some detail before anything gets full detail.
+// Without sparse residency an image cannot grow, so every refinement uploads
+// a new image holding one more level (the coarser levels are re-read from the
+// page cache, at most a third of the new level's size) and retires the old
+// one through the frame deletion queue. When the budget is exhausted the
+// least recently used textures are dropped back to their tail. Those
+// decisions are made by TextureResidency, see texture_residency.hpp.
+//
+// Workers only fill staging memory; all Vulkan calls happen in update(), on
+// the thread that pushes the frames to `submit_thread`. Uploads are pushed
+// there too, each with its own fence, so they land on the queue the
+// textures are sampled on ahead of the frame that first samples them.
+// Recording goes through a copy of `dispatch`, so a CommandCapture later
+// installed in the caller's table never sees uploads. Everything the
+// streamer creates uses `allocator`.
+class TextureStreamer
+{
+    public:
+    TextureStreamer( const VkPhysicalDevice physical_device,
+                     const VkDevice device, const DeviceDispatch & dispatch,
+                     SubmitThread &                submit_thread,
+                     const std::uint32_t           queue_family,
+                     FrameDeletionQueue &          deletion_queue,
+                     const TextureStreamerConfig & config = {},
+                     const VkAllocationCallbacks * allocator = nullptr ) :
+        m_physical_device( physical_device ),
+        m_device( device ),
+        m_allocator( allocator ),
+        m_dispatch( dispatch ),
+        m_submit_thread( submit_thread ),
+        m_deletion_queue( deletion_queue ),
+        m_config( config ),
+        m_residency( config.budget, config.max_uploads ),
+        m_pool( std::max<std::size_t>( config.worker_count, 1 ) ) {
+        VkCommandPoolCreateInfo pool_info{};
+        pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+        pool_info.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+        pool_info.queueFamilyIndex = queue_family;
+        if ( vkCreateCommandPool( device, &pool_info, allocator,
+                                  m_command_pool.put( device, allocator ) )
+             != VK_SUCCESS ) {
+            throw std::runtime_error( "Failed to create command pool." );
+        }
+
+        create_fallback();
+    }
+
+    TextureStreamer( const TextureStreamer & ) = delete;
+    TextureStreamer & operator=( const TextureStreamer & ) = delete;
+
+    // A failed submit leaves its fence unsignalled forever, so fences are
+    // only waited for while the submit thread reports none.
+    ~TextureStreamer() {
+        m_pool.wait_idle();
+        for ( const auto & upload : m_uploads ) {
+            if ( upload->submitted ) {
+                m_submit_thread.wait_issued( upload->ticket );
+                if ( m_submit_thread.failed() ) {
+                    return;
+                }
+                const VkFence fence{ upload->fence };
+                m_dispatch.wait_for_fences( m_device, 1, &fence, VK_TRUE,
+                                            UINT64_MAX );
+            }
+        }
+    }
+
+    // Maps the file and queues its tail for upload. Throws if the format can
+    // neither be sampled by the device nor decoded on the CPU.
+    [[nodiscard]] TextureId add( const std::string & path ) {
+        Texture texture{};
+        texture.file = std::make_unique<Ktx2File>( path );
+        const auto & file{ *texture.file };
+
+        texture.format = file.format();
+        VkFormatProperties properties{};
+        vkGetPhysicalDeviceFormatProperties( m_physical_device, texture.format,
+                                             &properties );
+        const bool block_compressed{ file.format_info().block_width > 1 };
+        const bool sampleable{
+            ( properties.optimalTilingFeatures
+              & VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT )
+                != 0
+            && ( !block_compressed || m_config.bc_enabled ) };
+        if ( !sampleable ) {
+            if ( !can_decode_bc_to_rgba8( texture.format ) ) {
+                throw std::runtime_error(
+                    "Texture format not supported by the device: " + path );
+            }
+            texture.decode = true;
+            texture.format = bc_decode_target_format( texture.format );
+            ++m_stats.decoded_textures;
+        }
+
+        std::uint32_t              tail_level{ file.level_count() - 1 };
+        std::vector<std::uint64_t> level_bytes;
+        for ( std::uint32_t level{ 0 }; level < file.level_count(); ++level ) {
+            const auto & info{ file.level( level ) };
+            if ( std::max( info.width, info.height ) <= m_config.tail_size ) {
+                tail_level = std::min( tail_level, level );
+            }
+            level_bytes.push_back( texture_level_bytes( texture, level ) );
+        }
+
+        const auto id{ m_residency.add( std::move( level_bytes ),
+                                        tail_level ) };
+        m_textures.push_back( std::move( texture ) );
+        ++m_stats.textures;
+        return id;
+    }
+
+    // Marks the texture as used by `frame`, for eviction order.
+    void touch( const TextureId id, const std::uint64_t frame ) {
+        m_residency.touch( id, frame );
+    }
+
+    // The view to bind this frame: the resident mips, or a 1x1 white texture
+    // until the first upload has landed. Only changes inside update().
+    [[nodiscard]] VkImageView view( const TextureId id ) const {
+        return m_residency.resident( id ) ? m_textures.at( id ).view.get()
+                                          : m_fallback_view.get();
+    }
+
+    [[nodiscard]] TextureViewInfo view_info( const TextureId id ) const {
+        if ( !m_residency.resident( id ) ) {
+            return { VK_FORMAT_R8G8B8A8_UNORM, { 1, 1 }, 1 };
+        }
+        const auto & texture{ m_textures.at( id ) };
+        const auto   resident_level{ m_residency.resident_level( id ) };
+        const auto & base{ texture.file->level( resident_level ) };
+        return { texture.format,
+                 { base.width, base.height },
+                 texture.file->level_count() - resident_level };
+    }
+
+    // Finest level currently resident, level_count() if none.
+    [[nodiscard]] std::uint32_t resident_level( const TextureId id ) const {
+        return m_residency.resident_level( id );
+    }
+
+    // Call once per frame, after waiting for the frame's fence and before
+    // recording; anything replaced is retired as part of `frame`.
+    void update( const std::uint64_t frame ) {
+        complete_uploads( frame );
+        submit_staged();
+        for ( const auto & plan : m_residency.schedule() ) {
+            start_upload( plan );
+        }
+    }
+
+    [[nodiscard]] TextureStreamerStats stats() const noexcept {
+        const auto & residency{ m_residency.stats() };
+        auto         stats{ m_stats };
+        stats.resident_bytes = residency.resident_bytes;
+        stats.peak_resident_bytes = residency.peak_resident_bytes;
+        stats.uploads = residency.uploads;
+        stats.evictions = residency.evictions;
+        return stats;
+    }
+
+    private:
+    struct Texture
+    {
+        std::unique_ptr<Ktx2File> file;
+        // What the image is created with; RGBA8 when decoding.
+        VkFormat        format{ VK_FORMAT_UNDEFINED };
+        bool            decode{ false };
+        ImageAllocation image;
+        UniqueImageView view;
+    };
+
+    struct Upload
+    {
+        TextureUploadPlan              plan;
+        BufferAllocation               staging;
+        std::vector<VkBufferImageCopy> regions;
+        ImageAllocation                image;
+        UniqueImageView                view;
+        VkCommandBuffer                command_buffer{ VK_NULL_HANDLE };
+        UniqueFence                    fence;
+        bool                           submitted{ false };
+        std::uint64_t                  ticket{ 0 };
+        // Set by the worker once staging is filled.
+        std::atomic<bool>  staged{ false };
+        std::exception_ptr error;
+    };
+
+    VkPhysicalDevice              m_physical_device;
+    VkDevice                      m_device;
+    const VkAllocationCallbacks * m_allocator;
+    DeviceDispatch                m_dispatch;
+    SubmitThread &        m_submit_thread;
+    FrameDeletionQueue &  m_deletion_queue;
+    TextureStreamerConfig m_config;
+    // Only the counts of textures; the rest comes from m_residency.
+    TextureStreamerStats  m_stats{};
+    TextureResidency      m_residency;
+    UniqueCommandPool     m_command_pool;
+    ImageAllocation       m_fallback;
+    UniqueImageView       m_fallback_view;
+    std::vector<Texture>  m_textures;
+    std::vector<std::unique_ptr<Upload>> m_uploads;
+    // Last, so workers are joined before the uploads they fill go away.
+    ThreadPool m_pool;
+
+    [[nodiscard]] static VkDeviceSize
+    texture_level_bytes( const Texture & texture, const std::uint32_t level ) {
+        const auto & info{ texture.file->level( level ) };
+        if ( texture.decode ) {
+            return VkDeviceSize{ info.width } * info.height * 4;
+        }
+        return info.size;
+    }
+
+    // Staging offsets are kept aligned for every texel block size.
+    [[nodiscard]] static constexpr VkDeviceSize
+    align_staging( const VkDeviceSize offset ) noexcept {
+        return ( offset + 15 ) & ~VkDeviceSize{ 15 };
+    }
+
+    [[nodiscard]] VkCommandBuffer begin_commands() {
+        VkCommandBufferAllocateInfo alloc_info{};
+        alloc_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        alloc_info.commandPool = m_command_pool;
+        alloc_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        alloc_info.commandBufferCount = 1;
+        VkCommandBuffer command_buffer{ VK_NULL_HANDLE };
+        if ( vkAllocateCommandBuffers( m_device, &alloc_info, &command_buffer )
+             != VK_SUCCESS ) {
+            throw std::runtime_error( "Failed to allocate command buffer." );
+        }
+
+        VkCommandBufferBeginInfo begin_info{};
+        begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+        if ( m_dispatch.begin_command_buffer( command_buffer, &begin_info )
+             != VK_SUCCESS ) {
+            throw std::runtime_error( "Failed to begin command buffer." );
+        }
+        return command_buffer;
+    }
+
+    [[nodiscard]] UniqueFence create_fence() const {
+        VkFenceCreateInfo fence_info{};
+        fence_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+        UniqueFence fence;
+        if ( vkCreateFence( m_device, &fence_info, m_allocator,
+                            fence.put( m_device, m_allocator ) )
+             != VK_SUCCESS ) {
+            throw std::runtime_error( "Failed to create fence." );
+        }
+        return fence;
+    }
+
+    // Copies all regions into a freshly created image and leaves it ready
+    // for sampling by any later submission on the queue.
+    void
+    record_upload( const VkCommandBuffer command_buffer, const VkBuffer source,
+                   const VkImage image, const std::uint32_t levels,
+                   const std::vector<VkBufferImageCopy> & regions ) const {
+        VkImageMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        barrier.srcAccessMask = 0;
+        barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.image = image;
+        barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        barrier.subresourceRange.baseMipLevel = 0;
+        barrier.subresourceRange.levelCount = levels;
+        barrier.subresourceRange.baseArrayLayer = 0;
+        barrier.subresourceRange.layerCount = 1;
+        m_dispatch.cmd_pipeline_barrier(
+            command_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+            VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1,
+            &barrier );
+
+        m_dispatch.cmd_copy_buffer_to_image(
+            command_buffer, source, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+            static_cast<std::uint32_t>( regions.size() ), regions.data() );
+
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+        barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        m_dispatch.cmd_pipeline_barrier(
+            command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+            VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1,
+            &barrier );
+    }
+
+    void create_fallback() {
+        constexpr VkFormat format{ VK_FORMAT_R8G8B8A8_UNORM };
+        m_fallback = create_image(
+            m_physical_device, m_device, { 1, 1 }, format,
+            VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, 1,
+            m_allocator );
+        m_fallback_view = create_image_view( m_device, m_fallback.image, format,
+                                             VK_IMAGE_ASPECT_COLOR_BIT, 0, 1,
+                                             m_allocator );
+
+        auto staging{ create_buffer(
+            m_physical_device, m_device, 4, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT
+                | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+            0, m_allocator ) };
+        void * mapped{ nullptr };
+        if ( vkMapMemory( m_device, staging.memory, 0, VK_WHOLE_SIZE, 0,
+                          &mapped )
+             != VK_SUCCESS ) {
+            throw std::runtime_error( "Failed to map staging buffer." );
+        }
+        std::memset( mapped, 0xFF, 4 );
+        vkUnmapMemory( m_device, staging.memory );
+
+        VkBufferImageCopy region{};
+        region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        region.imageSubresource.layerCount = 1;
+        region.imageExtent = { 1, 1, 1 };
+
+        const auto command_buffer{ begin_commands() };
+        record_upload( command_buffer, staging.buffer, m_fallback.image, 1,
+                       { region } );
+        if ( m_dispatch.end_command_buffer( command_buffer ) != VK_SUCCESS ) {
+            throw std::runtime_error( "Failed to record command buffer." );
+        }
+
+        const auto fence{ create_fence() };
+        QueueSubmission submission{};
+        submission.command_buffers.push_back( command_buffer );
+        submission.fence = fence;
+        // Runs once at start-up, so waiting here costs one upload.
+        m_submit_thread.wait_issued(
+            m_submit_thread.submit( std::move( submission ) ) );
+        m_submit_thread.check();
+        const VkFence fence_handle{ fence };
+        m_dispatch.wait_for_fences( m_device, 1, &fence_handle, VK_TRUE,
+                                    UINT64_MAX );
+        vkFreeCommandBuffers( m_device, m_command_pool, 1, &command_buffer );
+    }
+
+    // Allocates staging and hands the copy from the mapped file to a
+    // worker; the budget was reserved when the upload was planned.
+    void start_upload( const TextureUploadPlan & plan ) {
+        const auto & texture{ m_textures[plan.texture] };
+        const auto   first_level{ plan.first_level };
+        auto         upload{ std::make_unique<Upload>() };
+        upload->plan = plan;
+
+        VkDeviceSize size{ 0 };
+        for ( auto level{ first_level }; level < texture.file->level_count();
+              ++level ) {
+            const auto & info{ texture.file->level( level ) };
+            VkBufferImageCopy region{};
+            region.bufferOffset = size;
+            region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+            region.imageSubresource.mipLevel = level - first_level;
+            region.imageSubresource.layerCount = 1;
+            region.imageExtent = { info.width, info.height, 1 };
+            upload->regions.push_back( region );
+            size = align_staging( size
+                                  + texture_level_bytes( texture, level ) );
+        }
+
+        upload->staging = create_buffer(
+            m_physical_device, m_device, size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT
+                | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+            0, m_allocator );
+        void * mapped{ nullptr };
+        if ( vkMapMemory( m_device, upload->staging.memory, 0, VK_WHOLE_SIZE, 0,
+                          &mapped )
+             != VK_SUCCESS ) {
+            throw std::runtime_error( "Failed to map staging buffer." );
+        }
+
+        // Touching the mapping is what pages the file in, so it stays off the
+        // render thread.
+        m_pool.submit( [file = texture.file.get(), decode = texture.decode,
+                        target = upload.get(),
+                        staging = static_cast<std::uint8_t *>( mapped )]() {
+            try {
+                for ( const auto & region : target->regions ) {
+                    const auto & level{ file->level(
+                        target->plan.first_level
+                        + region.imageSubresource.mipLevel ) };
+                    if ( decode ) {
+                        decode_bc_to_rgba8( file->format(), level.data,
+                                            level.width, level.height,
+                                            staging + region.bufferOffset );
+                    }
+                    else {
+                        std::memcpy( staging + region.bufferOffset, level.data,
+                                     level.size );
+                    }
+                }
+            }
+            catch ( ... ) {
+                target->error = std::current_exception();
+            }
+            target->staged.store( true, std::memory_order_release );
+        } );
+        m_uploads.push_back( std::move( upload ) );
+    }
+
+    void submit_staged() {
+        for ( auto & upload : m_uploads ) {
+            if ( upload->submitted
+                 || !upload->staged.load( std::memory_order_acquire ) ) {
+                continue;
+            }
+            if ( upload->error ) {
+                std::rethrow_exception( upload->error );
+            }
+
+            const auto & texture{ m_textures[upload->plan.texture] };
+            const auto & base{ texture.file->level(
+                upload->plan.first_level ) };
+            const auto   levels{ static_cast<std::uint32_t>(
+                upload->regions.size() ) };
+            upload->image = create_image( m_physical_device, m_device,
+                                          { base.width, base.height },
+                                          texture.format,
+                                          VK_IMAGE_USAGE_TRANSFER_DST_BIT
+                                              | VK_IMAGE_USAGE_SAMPLED_BIT,
+                                          levels, m_allocator );
+            upload->view = create_image_view( m_device, upload->image.image,
+                                              texture.format,
+                                              VK_IMAGE_ASPECT_COLOR_BIT, 0,
+                                              levels, m_allocator );
+
+            upload->command_buffer = begin_commands();
+            record_upload( upload->command_buffer, upload->staging.buffer,
+                           upload->image.image, levels, upload->regions );
+            if ( m_dispatch.end_command_buffer( upload->command_buffer )
+                 != VK_SUCCESS ) {
+                throw std::runtime_error( "Failed to record command buffer." );
+            }
+
+            upload->fence = create_fence();
+
+            // Failures come back through SubmitThread::check().
+            QueueSubmission submission{};
+            submission.command_buffers.push_back( upload->command_buffer );
+            submission.fence = upload->fence;
+            upload->ticket = m_submit_thread.submit( std::move( submission ) );
+            upload->submitted = true;
+        }
+    }
+
+    // Swaps in finished images. The old image may still be sampled by frames
+    // up to and including `frame`, so it goes through the deletion queue.
+    void complete_uploads( const std::uint64_t frame ) {
+        std::erase_if( m_uploads, [&]( std::unique_ptr<Upload> & upload ) {
+            if ( !upload->submitted
+                 || m_dispatch.get_fence_status( m_device, upload->fence )
+                        != VK_SUCCESS ) {
+                return false;
+            }
+
+            auto & texture{ m_textures[upload->plan.texture] };
+            m_deletion_queue.retire( frame, std::move( texture.view ) );
+            m_deletion_queue.retire( frame, std::move( texture.image.image ) );
+            m_deletion_queue.retire( frame, std::move( texture.image.memory ) );
+            texture.image = std::move( upload->image );
+            texture.view = std::move( upload->view );
+            m_residency.complete( upload->plan );
+
+            vkFreeCommandBuffers( m_device, m_command_pool, 1,
+                                  &upload->command_buffer );
+            return true;
+        } );
+    }
+};
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <stop_token>
+#include <thread>
+#include <vector>
+
+// Fixed-size pool of worker threads fed from a single FIFO queue.
+// Destruction drains the queue before joining the workers.
+class ThreadPool
+{
+    public:
+    explicit ThreadPool( const std::size_t thread_count =
+                             std::max( 1u, std::thread::hardware_concurrency() ) ) {
+        m_workers.reserve( thread_count );
+        for ( std::size_t i{ 0 }; i < thread_count; ++i ) {
+            m_workers.emplace_back(
+                [this]( std::stop_token stop ) { worker_loop( stop ); } );
+        }
+    }
+
+    ThreadPool( const ThreadPool & ) = delete;
+    ThreadPool & operator=( const ThreadPool & ) = delete;
+
+    ~ThreadPool() {
+        for ( auto & worker : m_workers ) { worker.request_stop(); }
+        m_task_available.notify_all();
+    }
+
+    void submit( std::function<void()> task ) {
+        {
+            std::lock_guard lock( m_mutex );
+            m_tasks.push_back( std::move( task ) );
+        }
+        m_task_available.notify_one();
+    }
+
+    // Blocks until the queue is empty and no task is running.
+    void wait_idle() {
+        std::unique_lock lock( m_mutex );
+        m_idle.wait( lock, [this]() { return m_tasks.empty() && m_active == 0; } );
+    }
+
+    [[nodiscard]] std::size_t size() const noexcept { return m_workers.size(); }
+
+    private:
+    std::mutex                        m_mutex;
+    std::condition_variable_any       m_task_available;
+    std::condition_variable           m_idle;
+    std::deque<std::function<void()>> m_tasks;
+    std::size_t                       m_active{ 0 };
+    // Last, so the workers are joined before anything they touch goes away.
+    std::vector<std::jthread> m_workers;
+
+    void worker_loop( std::stop_token stop ) {
+        while ( true ) {
+            std::function<void()> task;
+            {
+                std::unique_lock lock( m_mutex );
+                if ( !m_task_available.wait( lock, stop, [this]() {
+                         return !m_tasks.empty();
+                     } ) ) {
+                    return;
+                }
+                task = std::move( m_tasks.front() );
+                m_tasks.pop_front();
+                ++m_active;
+            }
+
+            try {
+                task();
+            }
+            catch ( const std::exception & err ) {
+                std::cerr << "ThreadPool task failed: " << err.what()
+                          << std::endl;
+            }
+
+            {
+                std::lock_guard lock( m_mutex );
+                --m_active;
+                if ( m_tasks.empty() && m_active == 0 ) {
+                    m_idle.notify_all();
+                }
+            }
+        }
+    }
+};
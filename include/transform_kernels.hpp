@@ -0,0 +1,318 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+#include <type_traits>
+
+// Batch kernels over structure-of-arrays transform data, see TransformStore.
+//
+// Every kernel is written once against a lane type: plain float for the
+// scalar path, and GCC vector extensions for SSE (4 lanes) and AVX2 (8
+// lanes). The wide variants are instantiated inside [[gnu::target]]
+// functions with [[gnu::flatten]], so the shared code is compiled for the
+// target it runs on and picked at run time, without -mavx2 for the whole
+// program. Helpers never pass lanes by value; that would change the ABI
+// between targets.
+
+enum class SimdLevel
+{
+    scalar,
+    sse,
+    avx2,
+};
+
+[[nodiscard]] inline std::string_view
+to_string( const SimdLevel level ) noexcept {
+    switch ( level ) {
+    case SimdLevel::scalar: return "scalar";
+    case SimdLevel::sse: return "sse";
+    case SimdLevel::avx2: return "avx2";
+    }
+    return "unknown";
+}
+
+// Widest level this CPU runs. SSE2 is part of x86-64, and elsewhere the
+// 4 lane path lowers to whatever the compiler has (NEON, or scalar code).
+[[nodiscard]] inline SimdLevel
+detect_simd_level() noexcept {
+#if defined( __x86_64__ ) || defined( __i386__ )
+    if ( __builtin_cpu_supports( "avx2" ) && __builtin_cpu_supports( "fma" ) ) {
+        return SimdLevel::avx2;
+    }
+#endif
+    return SimdLevel::sse;
+}
+
+// Six inward facing planes, (normal, distance) with unit normals, so that
+// dot( normal, p ) + distance >= 0 inside.
+struct Frustum
+{
+    std::array<glm::vec4, 6> planes{};
+
+    // Gribb/Hartmann extraction for a clip space with depth in [0, 1], as
+    // with GLM_FORCE_DEPTH_ZERO_TO_ONE.
+    [[nodiscard]] static Frustum
+    from_view_projection( const glm::mat4 & view_projection ) {
+        const auto row = [&]( const int r ) {
+            return glm::vec4( view_projection[0][r], view_projection[1][r],
+                              view_projection[2][r], view_projection[3][r] );
+        };
+        const glm::vec4 x{ row( 0 ) }, y{ row( 1 ) }, z{ row( 2 ) },
+            w{ row( 3 ) };
+        Frustum frustum{};
+        frustum.planes = { w + x, w - x, w + y, w - y, z, w - z };
+        for ( auto & plane : frustum.planes ) {
+            const float length{ std::sqrt( plane.x * plane.x
+                                           + plane.y * plane.y
+                                           + plane.z * plane.z ) };
+            plane = plane / length;
+        }
+        return frustum;
+    }
+};
+
+// Columns of a TransformStore. The world matrix is kept as the top three
+// rows of an affine 4x4, row major: world[r * 4 + c].
+struct TransformColumns
+{
+    std::array<const float *, 3> position{};
+    // Quaternion x, y, z, w.
+    std::array<const float *, 4> rotation{};
+    std::array<const float *, 3> scale{};
+    // Local space bounding sphere.
+    std::array<const float *, 3> center{};
+    const float *                radius{ nullptr };
+    // Dense index of the parent; only read when the range has parents.
+    const std::uint32_t *        parent{ nullptr };
+    std::array<float *, 12>      world{};
+    std::uint8_t *               visible{ nullptr };
+};
+
+namespace transform_detail
+{
+template <typename V>
+inline constexpr std::size_t LANES{ sizeof( V ) / sizeof( float ) };
+
+using Sse = float __attribute__( ( vector_size( 16 ) ) );
+using Avx = float __attribute__( ( vector_size( 32 ) ) );
+
+template <typename V>
+inline void
+load( V & out, const float * source ) noexcept {
+    std::memcpy( &out, source, sizeof( V ) );
+}
+
+template <typename V>
+inline void
+store( float * destination, const V & value ) noexcept {
+    std::memcpy( destination, &value, sizeof( V ) );
+}
+
+template <typename V>
+inline void
+broadcast( V & out, const float value ) noexcept {
+    if constexpr ( std::is_same_v<V, float> ) {
+        out = value;
+    }
+    else {
+        out = V{} + value;
+    }
+}
+
+// Parent rows are scattered, so lanes are filled one at a time; GCC turns
+// this into vgatherdps where it pays off.
+template <typename V>
+inline void
+gather( V & out, const float * base, const std::uint32_t * index ) noexcept {
+    if constexpr ( std::is_same_v<V, float> ) {
+        out = base[*index];
+    }
+    else {
+        for ( std::size_t lane{ 0 }; lane < LANES<V>; ++lane ) {
+            out[lane] = base[index[lane]];
+        }
+    }
+}
+
+template <typename V>
+inline void
+max_into( V & a, const V & b ) noexcept {
+    a = a > b ? a : b;
+}
+
+template <typename V, typename Mask>
+inline void
+store_mask( std::uint8_t * destination, const Mask & mask ) noexcept {
+    if constexpr ( std::is_same_v<V, float> ) {
+        *destination = mask ? 1 : 0;
+    }
+    else {
+        for ( std::size_t lane{ 0 }; lane < LANES<V>; ++lane ) {
+            destination[lane] = mask[lane] != 0 ? 1 : 0;
+        }
+    }
+}
+
+// Local TRS -> world matrix (times the parent's when `has_parent`), then a
+// sphere/frustum test. Handles whole lane groups from `begin` and returns
+// where it stopped; the caller finishes the tail with V = float.
+template <typename V>
+inline std::size_t
+transform_cull( const TransformColumns & columns, const std::size_t begin,
+                const std::size_t end, const bool has_parent,
+                const Frustum & frustum ) noexcept {
+    V one, two, zero;
+    broadcast( one, 1.0f );
+    broadcast( two, 2.0f );
+    broadcast( zero, 0.0f );
+
+    std::size_t i{ begin };
+    for ( ; i + LANES<V> <= end; i += LANES<V> ) {
+        V x, y, z, w, sx, sy, sz;
+        load( x, columns.rotation[0] + i );
+        load( y, columns.rotation[1] + i );
+        load( z, columns.rotation[2] + i );
+        load( w, columns.rotation[3] + i );
+        load( sx, columns.scale[0] + i );
+        load( sy, columns.scale[1] + i );
+        load( sz, columns.scale[2] + i );
+
+        const V xx{ x * x }, yy{ y * y }, zz{ z * z };
+        const V xy{ x * y }, xz{ x * z }, yz{ y * z };
+        const V wx{ w * x }, wy{ w * y }, wz{ w * z };
+
+        // Rotation matrix with the scale folded into its columns.
+        V local[12];
+        local[0] = ( one - two * ( yy + zz ) ) * sx;
+        local[1] = two * ( xy - wz ) * sy;
+        local[2] = two * ( xz + wy ) * sz;
+        local[4] = two * ( xy + wz ) * sx;
+        local[5] = ( one - two * ( xx + zz ) ) * sy;
+        local[6] = two * ( yz - wx ) * sz;
+        local[8] = two * ( xz - wy ) * sx;
+        local[9] = two * ( yz + wx ) * sy;
+        local[10] = ( one - two * ( xx + yy ) ) * sz;
+        load( local[3], columns.position[0] + i );
+        load( local[7], columns.position[1] + i );
+        load( local[11], columns.position[2] + i );
+
+        V world[12];
+        if ( has_parent ) {
+            V parent[12];
+            for ( std::size_t j{ 0 }; j < 12; ++j ) {
+                gather( parent[j], columns.world[j], columns.parent + i );
+            }
+            for ( std::size_t r{ 0 }; r < 3; ++r ) {
+                const V * p{ parent + r * 4 };
+                for ( std::size_t c{ 0 }; c < 4; ++c ) {
+                    world[r * 4 + c] = p[0] * local[c] + p[1] * local[4 + c]
+                                       + p[2] * local[8 + c];
+                }
+                world[r * 4 + 3] += p[3];
+            }
+        }
+        else {
+            for ( std::size_t j{ 0 }; j < 12; ++j ) {
+                world[j] = local[j];
+            }
+        }
+        for ( std::size_t j{ 0 }; j < 12; ++j ) {
+            store( columns.world[j] + i, world[j] );
+        }
+
+        // The radius grows with the largest axis scale of the world matrix.
+        V cx, cy, cz, radius;
+        load( cx, columns.center[0] + i );
+        load( cy, columns.center[1] + i );
+        load( cz, columns.center[2] + i );
+        load( radius, columns.radius + i );
+        V center[3];
+        for ( std::size_t r{ 0 }; r < 3; ++r ) {
+            center[r] = world[r * 4] * cx + world[r * 4 + 1] * cy
+                        + world[r * 4 + 2] * cz + world[r * 4 + 3];
+        }
+        V scale_squared{ world[0] * world[0] + world[4] * world[4]
+                         + world[8] * world[8] };
+        for ( std::size_t c{ 1 }; c < 3; ++c ) {
+            const V axis{ world[c] * world[c] + world[4 + c] * world[4 + c]
+                          + world[8 + c] * world[8 + c] };
+            max_into( scale_squared, axis );
+        }
+        const V radius_squared{ radius * radius * scale_squared };
+
+        // d >= -r, as d >= 0 || d * d <= r * r to stay clear of a sqrt.
+        auto inside{ zero == zero };
+        for ( const auto & plane : frustum.planes ) {
+            V nx, ny, nz, nd;
+            broadcast( nx, plane.x );
+            broadcast( ny, plane.y );
+            broadcast( nz, plane.z );
+            broadcast( nd, plane.w );
+            const V distance{ nx * center[0] + ny * center[1] + nz * center[2]
+                              + nd };
+            inside = inside
+                     & ( ( distance >= zero )
+                         | ( distance * distance <= radius_squared ) );
+        }
+        store_mask<V>( columns.visible + i, inside );
+    }
+    return i;
+}
+
+[[gnu::flatten]] inline void
+transform_cull_scalar( const TransformColumns & columns,
+                       const std::size_t begin, const std::size_t end,
+                       const bool has_parent, const Frustum & frustum ) {
+    transform_cull<float>( columns, begin, end, has_parent, frustum );
+}
+
+[[gnu::flatten]] inline void
+transform_cull_sse( const TransformColumns & columns, const std::size_t begin,
+                    const std::size_t end, const bool has_parent,
+                    const Frustum & frustum ) {
+    const auto tail{ transform_cull<Sse>( columns, begin, end, has_parent,
+                                          frustum ) };
+    transform_cull<float>( columns, tail, end, has_parent, frustum );
+}
+
+#if defined( __x86_64__ ) || defined( __i386__ )
+[[gnu::target( "avx2,fma" ), gnu::flatten]] inline void
+transform_cull_avx2( const TransformColumns & columns,
+                     const std::size_t begin, const std::size_t end,
+                     const bool has_parent, const Frustum & frustum ) {
+    const auto tail{ transform_cull<Avx>( columns, begin, end, has_parent,
+                                          frustum ) };
+    transform_cull<float>( columns, tail, end, has_parent, frustum );
+}
+#endif
+} // namespace transform_detail
+
+// Computes world matrices and visibility for entities [begin, end). With
+// `has_parent`, every parent's world matrix must already be final.
+inline void
+transform_and_cull( const SimdLevel level, const TransformColumns & columns,
+                    const std::size_t begin, const std::size_t end,
+                    const bool has_parent, const Frustum & frustum ) {
+    switch ( level ) {
+#if defined( __x86_64__ ) || defined( __i386__ )
+    case SimdLevel::avx2:
+        transform_detail::transform_cull_avx2( columns, begin, end,
+                                               has_parent, frustum );
+        return;
+#endif
+    case SimdLevel::sse:
+        transform_detail::transform_cull_sse( columns, begin, end, has_parent,
+                                              frustum );
+        return;
+    default:
+        transform_detail::transform_cull_scalar( columns, begin, end,
+                                                 has_parent, frustum );
+        return;
+    }
+}
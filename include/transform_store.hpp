@@ -0,0 +1,445 @@
+#pragma once
+
+#include "thread_pool.hpp"
+#include "transform_kernels.hpp"
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <latch>
+#include <limits>
+#include <span>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+// Handle to an entity in a TransformStore. Stays valid until the entity (or
+// one of its ancestors) is destroyed; stale handles are detected by
+// generation.
+struct TransformHandle
+{
+    static constexpr std::uint32_t NONE{
+        std::numeric_limits<std::uint32_t>::max()
+    };
+
+    std::uint32_t slot{ NONE };
+    std::uint32_t generation{ 0 };
+
+    [[nodiscard]] bool valid() const noexcept { return slot != NONE; }
+};
+
+struct LocalTransform
+{
+    glm::vec3 position{ 0.0f };
+    glm::quat rotation{ 1.0f, 0.0f, 0.0f, 0.0f };
+    glm::vec3 scale{ 1.0f };
+};
+
+struct BoundingSphere
+{
+    glm::vec3 center{ 0.0f };
+    float     radius{ 0.0f };
+};
+
+// One per visible entity in the instance buffer; matches a std430
+// `mat4 model` array element.
+struct InstanceData
+{
+    glm::mat4 model;
+};
+
+struct TransformUpdateStats
+{
+    std::size_t entities{ 0 };
+    std::size_t visible{ 0 };
+    // Instances written; less than `visible` if the buffer was too small.
+    std::size_t written{ 0 };
+    std::size_t levels{ 0 };
+    std::size_t chunks{ 0 };
+};
+
+// Dense structure-of-arrays store for entity transforms and bounds.
+//
+// Entities are kept sorted by hierarchy depth, so each depth is one
+// contiguous range whose parents all sit in earlier ranges. update() walks
+// the ranges in order and splits each into chunks across the thread pool:
+// every chunk computes world matrices (parent * local) and frustum
+// visibility with the widest SIMD kernel the CPU has, then the visible
+// ones are written, compacted, straight into the instance buffer. Adding a
+// root, or a child one level below the deepest, keeps the order; anything
+// else, and every destroy, re-sorts once on the next update().
+//
+// Not thread safe; update() must not be called from a pool worker.
+class TransformStore
+{
+    public:
+    static constexpr std::size_t CHUNK_SIZE{ 4096 };
+
+    explicit TransformStore( ThreadPool *    pool = nullptr,
+                             const SimdLevel simd = detect_simd_level() )
+        : m_pool( pool ), m_simd( simd ) {}
+
+    TransformStore( const TransformStore & ) = delete;
+    TransformStore & operator=( const TransformStore & ) = delete;
+
+    void reserve( const std::size_t count ) {
+        for_each_column(
+            [count]( auto & column ) { column.reserve( count ); } );
+        m_slots.reserve( count );
+    }
+
+    [[nodiscard]] TransformHandle
+    create( const LocalTransform & local, const BoundingSphere & bounds,
+            const TransformHandle parent = {} ) {
+        std::uint32_t parent_index{ TransformHandle::NONE };
+        std::uint32_t depth{ 0 };
+        if ( parent.valid() ) {
+            parent_index = dense_index( parent );
+            depth = m_depth[parent_index] + 1;
+        }
+
+        const auto index{ static_cast<std::uint32_t>( m_depth.size() ) };
+        for_each_column( []( auto & column ) { column.emplace_back(); } );
+        m_parent[index] = parent_index;
+        m_depth[index] = depth;
+        write_local( index, local );
+        for ( std::size_t i{ 0 }; i < 3; ++i ) {
+            m_center[i][index] = bounds.center[static_cast<int>( i )];
+        }
+        m_radius[index] = bounds.radius;
+
+        // Appending keeps the depth order as long as it doesn't go back up.
+        if ( index > 0 && depth < m_depth[index - 1] ) {
+            m_needs_sort = true;
+        }
+        else if ( !m_needs_sort && depth == m_levels.size() ) {
+            m_levels.push_back( index );
+        }
+
+        TransformHandle handle{};
+        if ( m_free_slots.empty() ) {
+            handle.slot = static_cast<std::uint32_t>( m_slots.size() );
+            m_slots.push_back( Slot{ index, 0 } );
+        }
+        else {
+            handle.slot = m_free_slots.back();
+            m_free_slots.pop_back();
+            m_slots[handle.slot].dense = index;
+        }
+        handle.generation = m_slots[handle.slot].generation;
+        m_slot_of[index] = handle.slot;
+        return handle;
+    }
+
+    // Destroys the entity at once and its descendants on the next update().
+    void destroy( const TransformHandle handle ) {
+        const auto index{ dense_index( handle ) };
+        m_dead[index] = 1;
+        ++m_slots[handle.slot].generation;
+        m_needs_sort = true;
+    }
+
+    [[nodiscard]] bool alive( const TransformHandle handle ) const noexcept {
+        return handle.valid() && handle.slot < m_slots.size()
+               && m_slots[handle.slot].generation == handle.generation
+               && m_slots[handle.slot].dense != TransformHandle::NONE
+               && m_dead[m_slots[handle.slot].dense] == 0;
+    }
+
+    void set_local( const TransformHandle handle,
+                    const LocalTransform & local ) {
+        write_local( dense_index( handle ), local );
+    }
+
+    // As of the last update().
+    [[nodiscard]] glm::mat4 world( const TransformHandle handle ) const {
+        const auto index{ dense_index( handle ) };
+        glm::mat4  matrix( 1.0f );
+        for ( int r{ 0 }; r < 3; ++r ) {
+            for ( int c{ 0 }; c < 4; ++c ) {
+                matrix[c][r] = m_world[static_cast<std::size_t>( r * 4 + c )]
+                                      [index];
+            }
+        }
+        return matrix;
+    }
+    // Whether the last update() wrote an instance for it.
+    [[nodiscard]] bool visible( const TransformHandle handle ) const {
+        return m_visible[dense_index( handle )] != 0;
+    }
+
+    [[nodiscard]] std::size_t size() const noexcept { return m_depth.size(); }
+
+    [[nodiscard]] SimdLevel simd_level() const noexcept { return m_simd; }
+    void set_simd_level( const SimdLevel simd ) noexcept { m_simd = simd; }
+
+    // Brings world matrices up to date, culls against `frustum` and writes
+    // the model matrix of every visible entity to the front of
+    // `instances`, typically the persistently mapped instance buffer of the
+    // frame being recorded. Only ever writes, never reads, so
+    // write-combined memory is fine.
+    TransformUpdateStats update( const Frustum &         frustum,
+                                 std::span<InstanceData> instances ) {
+        if ( m_needs_sort ) {
+            sort_by_depth();
+        }
+
+        TransformUpdateStats stats{};
+        stats.entities = size();
+        stats.levels = m_levels.size();
+
+        // Chunks never straddle a level, as the next level reads this one.
+        m_chunks.clear();
+        for ( std::size_t level{ 0 }; level < m_levels.size(); ++level ) {
+            const std::size_t end{ level + 1 < m_levels.size()
+                                       ? m_levels[level + 1]
+                                       : size() };
+            for ( std::size_t begin{ m_levels[level] }; begin < end;
+                  begin += CHUNK_SIZE ) {
+                m_chunks.push_back( Chunk{
+                    begin, std::min( begin + CHUNK_SIZE, end ), level, 0, 0 } );
+            }
+        }
+        stats.chunks = m_chunks.size();
+
+        const auto columns{ this->columns() };
+        std::size_t first{ 0 };
+        while ( first < m_chunks.size() ) {
+            std::size_t last{ first + 1 };
+            while ( last < m_chunks.size()
+                    && m_chunks[last].level == m_chunks[first].level ) {
+                ++last;
+            }
+            parallel_for( first, last, [&]( Chunk & chunk ) {
+                transform_and_cull( m_simd, columns, chunk.begin, chunk.end,
+                                    chunk.level > 0, frustum );
+                chunk.visible = static_cast<std::size_t>( std::count(
+                    m_visible.begin() + static_cast<std::ptrdiff_t>(
+                        chunk.begin ),
+                    m_visible.begin()
+                        + static_cast<std::ptrdiff_t>( chunk.end ),
+                    std::uint8_t{ 1 } ) );
+            } );
+            first = last;
+        }
+
+        for ( auto & chunk : m_chunks ) {
+            chunk.offset = stats.visible;
+            stats.visible += chunk.visible;
+        }
+        stats.written = std::min( stats.visible, instances.size() );
+        parallel_for( 0, m_chunks.size(), [&]( Chunk & chunk ) {
+            write_instances( chunk, instances );
+        } );
+        return stats;
+    }
+
+    private:
+    struct Slot
+    {
+        // TransformHandle::NONE while the slot is free.
+        std::uint32_t dense{ TransformHandle::NONE };
+        std::uint32_t generation{ 0 };
+    };
+
+    struct Chunk
+    {
+        std::size_t begin;
+        std::size_t end;
+        std::size_t level;
+        std::size_t visible;
+        std::size_t offset;
+    };
+
+    ThreadPool * m_pool;
+    SimdLevel    m_simd;
+
+    // Dense columns, one element per entity.
+    std::array<std::vector<float>, 3>  m_position;
+    std::array<std::vector<float>, 4>  m_rotation;
+    std::array<std::vector<float>, 3>  m_scale;
+    std::array<std::vector<float>, 3>  m_center;
+    std::vector<float>                 m_radius;
+    std::vector<std::uint32_t>         m_parent;
+    std::vector<std::uint32_t>         m_depth;
+    std::vector<std::uint32_t>         m_slot_of;
+    std::vector<std::uint8_t>          m_dead;
+    std::array<std::vector<float>, 12> m_world;
+    std::vector<std::uint8_t>          m_visible;
+
+    std::vector<Slot>          m_slots;
+    std::vector<std::uint32_t> m_free_slots;
+    // First dense index of each depth.
+    std::vector<std::size_t>   m_levels;
+    bool                       m_needs_sort{ false };
+    std::vector<Chunk>         m_chunks;
+
+    template <typename F>
+    void for_each_column( F && f ) {
+        for ( auto & column : m_position ) { f( column ); }
+        for ( auto & column : m_rotation ) { f( column ); }
+        for ( auto & column : m_scale ) { f( column ); }
+        for ( auto & column : m_center ) { f( column ); }
+        f( m_radius );
+        f( m_parent );
+        f( m_depth );
+        f( m_slot_of );
+        f( m_dead );
+        for ( auto & column : m_world ) { f( column ); }
+        f( m_visible );
+    }
+
+    [[nodiscard]] std::uint32_t
+    dense_index( const TransformHandle handle ) const {
+        if ( !alive( handle ) ) {
+            throw std::runtime_error( "Stale or invalid transform handle." );
+        }
+        return m_slots[handle.slot].dense;
+    }
+
+    void write_local( const std::size_t index, const LocalTransform & local ) {
+        for ( std::size_t i{ 0 }; i < 3; ++i ) {
+            m_position[i][index] = local.position[static_cast<int>( i )];
+            m_scale[i][index] = local.scale[static_cast<int>( i )];
+        }
+        m_rotation[0][index] = local.rotation.x;
+        m_rotation[1][index] = local.rotation.y;
+        m_rotation[2][index] = local.rotation.z;
+        m_rotation[3][index] = local.rotation.w;
+    }
+
+    [[nodiscard]] TransformColumns columns() {
+        TransformColumns columns{};
+        for ( std::size_t i{ 0 }; i < 3; ++i ) {
+            columns.position[i] = m_position[i].data();
+            columns.scale[i] = m_scale[i].data();
+            columns.center[i] = m_center[i].data();
+        }
+        for ( std::size_t i{ 0 }; i < 4; ++i ) {
+            columns.rotation[i] = m_rotation[i].data();
+        }
+        columns.radius = m_radius.data();
+        columns.parent = m_parent.data();
+        for ( std::size_t i{ 0 }; i < 12; ++i ) {
+            columns.world[i] = m_world[i].data();
+        }
+        columns.visible = m_visible.data();
+        return columns;
+    }
+
+    // Runs `f` on chunks [first, last), spread over the pool with the
+    // calling thread taking the first one.
+    template <typename F>
+    void parallel_for( const std::size_t first, const std::size_t last,
+                       F && f ) {
+        if ( first == last ) {
+            return;
+        }
+        if ( m_pool == nullptr || last - first == 1 ) {
+            for ( std::size_t i{ first }; i < last; ++i ) {
+                f( m_chunks[i] );
+            }
+            return;
+        }
+        std::latch done( static_cast<std::ptrdiff_t>( last - first - 1 ) );
+        for ( std::size_t i{ first + 1 }; i < last; ++i ) {
+            m_pool->submit( [this, &f, &done, i]() {
+                f( m_chunks[i] );
+                done.count_down();
+            } );
+        }
+        f( m_chunks[first] );
+        done.wait();
+    }
+
+    // Whole matrices in order, so write-combining buffers fill completely.
+    void write_instances( const Chunk &                 chunk,
+                          const std::span<InstanceData> instances ) const {
+        std::size_t out{ chunk.offset };
+        for ( std::size_t i{ chunk.begin };
+              i < chunk.end && out < instances.size(); ++i ) {
+            if ( m_visible[i] == 0 ) {
+                continue;
+            }
+            std::array<float, 16> matrix{};
+            for ( std::size_t c{ 0 }; c < 4; ++c ) {
+                for ( std::size_t r{ 0 }; r < 3; ++r ) {
+                    matrix[c * 4 + r] = m_world[r * 4 + c][i];
+                }
+            }
+            matrix[15] = 1.0f;
+            std::memcpy( static_cast<void *>( &instances[out] ), matrix.data(),
+                         sizeof( matrix ) );
+            ++out;
+        }
+    }
+
+    // Stable counting sort by depth that also drops destroyed entities and
+    // their descendants. Parents always come before their children in the
+    // dense order, so one forward pass finds every orphan.
+    void sort_by_depth() {
+        const std::size_t count{ size() };
+        std::uint32_t     max_depth{ 0 };
+        for ( std::size_t i{ 0 }; i < count; ++i ) {
+            if ( m_parent[i] != TransformHandle::NONE
+                 && m_dead[m_parent[i]] != 0 && m_dead[i] == 0 ) {
+                m_dead[i] = 1;
+                ++m_slots[m_slot_of[i]].generation;
+            }
+            if ( m_dead[i] == 0 ) {
+                max_depth = std::max( max_depth, m_depth[i] );
+            }
+        }
+
+        std::vector<std::size_t> offsets( max_depth + 2, 0 );
+        for ( std::size_t i{ 0 }; i < count; ++i ) {
+            if ( m_dead[i] == 0 ) {
+                ++offsets[m_depth[i] + 1];
+            }
+        }
+        for ( std::size_t d{ 1 }; d < offsets.size(); ++d ) {
+            offsets[d] += offsets[d - 1];
+        }
+        const std::size_t survivors{ offsets.back() };
+        m_levels.assign( offsets.begin(), offsets.end() - 1 );
+        if ( survivors == 0 ) {
+            m_levels.clear();
+        }
+
+        // new_index[old] for survivors, order[new] = old.
+        std::vector<std::uint32_t> new_index( count, TransformHandle::NONE );
+        std::vector<std::uint32_t> order( survivors );
+        for ( std::size_t i{ 0 }; i < count; ++i ) {
+            if ( m_dead[i] == 0 ) {
+                const auto to{ offsets[m_depth[i]]++ };
+                new_index[i] = static_cast<std::uint32_t>( to );
+                order[to] = static_cast<std::uint32_t>( i );
+            }
+            else {
+                m_slots[m_slot_of[i]].dense = TransformHandle::NONE;
+                m_free_slots.push_back( m_slot_of[i] );
+            }
+        }
+
+        for_each_column( [&order]( auto & column ) {
+            std::remove_reference_t<decltype( column )> sorted(
+                order.size() );
+            for ( std::size_t i{ 0 }; i < order.size(); ++i ) {
+                sorted[i] = column[order[i]];
+            }
+            column.swap( sorted );
+        } );
+        for ( std::size_t i{ 0 }; i < survivors; ++i ) {
+            if ( m_parent[i] != TransformHandle::NONE ) {
+                m_parent[i] = new_index[m_parent[i]];
+            }
+            m_slots[m_slot_of[i]].dense = static_cast<std::uint32_t>( i );
+        }
+        m_needs_sort = false;
+    }
+};
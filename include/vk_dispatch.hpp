@@ -0,0 +1,118 @@
+#pragma once
+
+#include "vk_handle.hpp"
+
+#include <stdexcept>
+#include <string>
+
+// Instance and device function tables, generated from the lists below and
+// filled once after creation.
+//
+// The loader's exported vk* functions are trampolines: each call looks up
+// the dispatch table hidden in the handle and jumps through it.
+// vkGetDeviceProcAddr hands back the driver's (or the first layer's) entry
+// point directly, so per-command work on the recording and submission paths
+// skips that hop. Everything else keeps calling the exports.
+//
+// Entries are X( member, vkName ). Adding a function is one line; the
+// member is the snake_case name without the vk prefix.
+
+// Core 1.0, so a null result means a broken driver.
+#define VK_INSTANCE_FUNCTIONS( X )                                            \
+    X( get_device_proc_addr, vkGetDeviceProcAddr )
+
+// Null unless the extension (or core version) is enabled.
+#define VK_INSTANCE_OPTIONAL_FUNCTIONS( X )                                   \
+    X( create_debug_utils_messenger_ext, vkCreateDebugUtilsMessengerEXT )    \
+    X( destroy_debug_utils_messenger_ext, vkDestroyDebugUtilsMessengerEXT )
+
+#define VK_DEVICE_FUNCTIONS( X )                                              \
+    X( queue_submit, vkQueueSubmit )                                         \
+    X( wait_for_fences, vkWaitForFences )                                    \
+    X( reset_fences, vkResetFences )                                         \
+    X( get_fence_status, vkGetFenceStatus )                                  \
+    X( update_descriptor_sets, vkUpdateDescriptorSets )                      \
+    X( reset_command_buffer, vkResetCommandBuffer )                          \
+    X( begin_command_buffer, vkBeginCommandBuffer )                          \
+    X( end_command_buffer, vkEndCommandBuffer )                              \
+    X( cmd_begin_render_pass, vkCmdBeginRenderPass )                         \
+    X( cmd_end_render_pass, vkCmdEndRenderPass )                             \
+    X( cmd_bind_pipeline, vkCmdBindPipeline )                                \
+    X( cmd_set_viewport, vkCmdSetViewport )                                  \
+    X( cmd_set_scissor, vkCmdSetScissor )                                    \
+    X( cmd_bind_vertex_buffers, vkCmdBindVertexBuffers )                     \
+    X( cmd_bind_index_buffer, vkCmdBindIndexBuffer )                         \
+    X( cmd_bind_descriptor_sets, vkCmdBindDescriptorSets )                   \
+    X( cmd_push_constants, vkCmdPushConstants )                              \
+    X( cmd_draw, vkCmdDraw )                                                 \
+    X( cmd_draw_indexed, vkCmdDrawIndexed )                                  \
+    X( cmd_pipeline_barrier, vkCmdPipelineBarrier )                          \
+    X( cmd_copy_buffer, vkCmdCopyBuffer )                                    \
+    X( cmd_copy_buffer_to_image, vkCmdCopyBufferToImage )                    \
+    X( cmd_copy_image_to_buffer, vkCmdCopyImageToBuffer )
+
+#define VK_DEVICE_OPTIONAL_FUNCTIONS( X )                                     \
+    X( acquire_next_image_khr, vkAcquireNextImageKHR )                       \
+    X( queue_present_khr, vkQueuePresentKHR )
+
+#define VK_DISPATCH_MEMBER( member, name ) PFN_##name member{ nullptr };
+
+namespace vk_dispatch_detail
+{
+template <typename Function, typename Loader, typename Handle>
+[[nodiscard]] Function
+load( const Loader loader, const Handle handle, const char * name,
+      const bool required ) {
+    const auto function{ reinterpret_cast<Function>( loader( handle, name ) ) };
+    if ( function == nullptr && required ) {
+        throw std::runtime_error( "Missing Vulkan entry point: "
+                                  + std::string{ name } );
+    }
+    return function;
+}
+} // namespace vk_dispatch_detail
+
+struct InstanceDispatch
+{
+    VkInstance instance{ VK_NULL_HANDLE };
+    VK_INSTANCE_FUNCTIONS( VK_DISPATCH_MEMBER )
+    VK_INSTANCE_OPTIONAL_FUNCTIONS( VK_DISPATCH_MEMBER )
+
+    [[nodiscard]] static InstanceDispatch load( const VkInstance instance ) {
+        InstanceDispatch dispatch{};
+        dispatch.instance = instance;
+        bool required{ true };
+#define VK_DISPATCH_LOAD( member, name )                                      \
+    dispatch.member = vk_dispatch_detail::load<PFN_##name>(                  \
+        vkGetInstanceProcAddr, instance, #name, required );
+        VK_INSTANCE_FUNCTIONS( VK_DISPATCH_LOAD )
+        required = false;
+        VK_INSTANCE_OPTIONAL_FUNCTIONS( VK_DISPATCH_LOAD )
+#undef VK_DISPATCH_LOAD
+        return dispatch;
+    }
+};
+
+struct DeviceDispatch
+{
+    VkDevice device{ VK_NULL_HANDLE };
+    VK_DEVICE_FUNCTIONS( VK_DISPATCH_MEMBER )
+    VK_DEVICE_OPTIONAL_FUNCTIONS( VK_DISPATCH_MEMBER )
+
+    [[nodiscard]] static DeviceDispatch
+    load( const InstanceDispatch & instance, const VkDevice device ) {
+        DeviceDispatch dispatch{};
+        dispatch.device = device;
+        bool required{ true };
+#define VK_DISPATCH_LOAD( member, name )                                      \
+    dispatch.member = vk_dispatch_detail::load<PFN_##name>(                  \
+        instance.get_device_proc_addr, device, #name, required );
+        VK_DEVICE_FUNCTIONS( VK_DISPATCH_LOAD )
+        required = false;
+        VK_DEVICE_OPTIONAL_FUNCTIONS( VK_DISPATCH_LOAD )
+#undef VK_DISPATCH_LOAD
+        return dispatch;
+    }
+};
+
+#undef VK_DISPATCH_MEMBER
@@ -0,0 +1,203 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include "GLFW/glfw3.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <type_traits>
+#include <utility>
+
+// Move-only owner for a single Vulkan handle.
+//
+// Root objects (VkInstance, VkDevice) are destroyed with
+// Destroy( handle, allocator ), everything else with
+// Destroy( parent, handle, allocator ), where Parent is the VkInstance or
+// VkDevice the handle was created from.
+template <typename Handle, auto Destroy, typename Parent = std::nullptr_t>
+class UniqueHandle
+{
+    public:
+    static constexpr bool is_root{ std::is_same_v<Parent, std::nullptr_t> };
+
+    UniqueHandle() noexcept = default;
+    explicit UniqueHandle( Handle                        handle,
+                           const VkAllocationCallbacks * allocator = nullptr )
+        noexcept
+    requires is_root
+        : m_handle( handle ), m_allocator( allocator ) {}
+    UniqueHandle( Parent parent, Handle handle,
+                  const VkAllocationCallbacks * allocator = nullptr ) noexcept
+    requires( !is_root )
+        : m_parent( parent ), m_handle( handle ), m_allocator( allocator ) {}
+
+    UniqueHandle( const UniqueHandle & ) = delete;
+    UniqueHandle & operator=( const UniqueHandle & ) = delete;
+
+    UniqueHandle( UniqueHandle && other ) noexcept :
+        m_parent( std::exchange( other.m_parent, Parent{} ) ),
+        m_handle( std::exchange( other.m_handle, VK_NULL_HANDLE ) ),
+        m_allocator( std::exchange( other.m_allocator, nullptr ) ) {}
+    UniqueHandle & operator=( UniqueHandle && other ) noexcept {
+        if ( this != &other ) {
+            reset();
+            m_parent = std::exchange( other.m_parent, Parent{} );
+            m_handle = std::exchange( other.m_handle, VK_NULL_HANDLE );
+            m_allocator = std::exchange( other.m_allocator, nullptr );
+        }
+        return *this;
+    }
+
+    ~UniqueHandle() { reset(); }
+
+    [[nodiscard]] Handle get() const noexcept { return m_handle; }
+    [[nodiscard]] Parent parent() const noexcept { return m_parent; }
+    [[nodiscard]] const VkAllocationCallbacks * allocator() const noexcept {
+        return m_allocator;
+    }
+    // Lets an owned handle be passed straight to vkCmd*/vkCreate* calls.
+    operator Handle() const noexcept { return m_handle; }
+    explicit operator bool() const noexcept {
+        return m_handle != VK_NULL_HANDLE;
+    }
+
+    // Destroys the current handle (if any) and returns the address to write a
+    // new one to, e.g. vkCreateFence( device, &info, nullptr, f.put( device ) )
+    [[nodiscard]] Handle *
+    put( const VkAllocationCallbacks * allocator = nullptr ) noexcept
+    requires is_root
+    {
+        reset();
+        m_allocator = allocator;
+        return &m_handle;
+    }
+    [[nodiscard]] Handle *
+    put( Parent parent, const VkAllocationCallbacks * allocator = nullptr ) noexcept
+    requires( !is_root )
+    {
+        reset();
+        m_parent = parent;
+        m_allocator = allocator;
+        return &m_handle;
+    }
+
+    // Gives up ownership without destroying the handle.
+    [[nodiscard]] Handle release() noexcept {
+        m_parent = Parent{};
+        m_allocator = nullptr;
+        return std::exchange( m_handle, VK_NULL_HANDLE );
+    }
+
+    void reset() noexcept {
+        if ( m_handle == VK_NULL_HANDLE ) {
+            return;
+        }
+        if constexpr ( is_root ) {
+            Destroy( m_handle, m_allocator );
+        }
+        else {
+            Destroy( m_parent, m_handle, m_allocator );
+        }
+        m_handle = VK_NULL_HANDLE;
+    }
+
+    // Hands ownership to a copyable callable which destroys the handle when
+    // invoked; used to park handles in a deletion queue.
+    [[nodiscard]] std::function<void()> into_deleter() && {
+        const auto parent{ m_parent };
+        const auto allocator{ m_allocator };
+        const auto handle{ release() };
+        if constexpr ( is_root ) {
+            return [handle, allocator]() { Destroy( handle, allocator ); };
+        }
+        else {
+            return [parent, handle, allocator]() {
+                Destroy( parent, handle, allocator );
+            };
+        }
+    }
+
+    private:
+    [[no_unique_address]] Parent  m_parent{};
+    Handle                        m_handle{ VK_NULL_HANDLE };
+    const VkAllocationCallbacks * m_allocator{ nullptr };
+};
+
+using UniqueInstance = UniqueHandle<VkInstance, vkDestroyInstance>;
+using UniqueDevice = UniqueHandle<VkDevice, vkDestroyDevice>;
+using UniqueSurface =
+    UniqueHandle<VkSurfaceKHR, vkDestroySurfaceKHR, VkInstance>;
+using UniqueSwapchain =
+    UniqueHandle<VkSwapchainKHR, vkDestroySwapchainKHR, VkDevice>;
+using UniqueImage = UniqueHandle<VkImage, vkDestroyImage, VkDevice>;
+using UniqueImageView = UniqueHandle<VkImageView, vkDestroyImageView, VkDevice>;
+using UniqueSampler = UniqueHandle<VkSampler, vkDestroySampler, VkDevice>;
+using UniqueBuffer = UniqueHandle<VkBuffer, vkDestroyBuffer, VkDevice>;
+using UniqueDeviceMemory =
+    UniqueHandle<VkDeviceMemory, vkFreeMemory, VkDevice>;
+using UniqueShaderModule =
+    UniqueHandle<VkShaderModule, vkDestroyShaderModule, VkDevice>;
+using UniqueRenderPass =
+    UniqueHandle<VkRenderPass, vkDestroyRenderPass, VkDevice>;
+using UniquePipelineLayout =
+    UniqueHandle<VkPipelineLayout, vkDestroyPipelineLayout, VkDevice>;
+using UniquePipeline = UniqueHandle<VkPipeline, vkDestroyPipeline, VkDevice>;
+using UniquePipelineCache =
+    UniqueHandle<VkPipelineCache, vkDestroyPipelineCache, VkDevice>;
+using UniqueDescriptorSetLayout =
+    UniqueHandle<VkDescriptorSetLayout, vkDestroyDescriptorSetLayout, VkDevice>;
+using UniqueDescriptorPool =
+    UniqueHandle<VkDescriptorPool, vkDestroyDescriptorPool, VkDevice>;
+using UniqueFramebuffer =
+    UniqueHandle<VkFramebuffer, vkDestroyFramebuffer, VkDevice>;
+using UniqueCommandPool =
+    UniqueHandle<VkCommandPool, vkDestroyCommandPool, VkDevice>;
+using UniqueSemaphore =
+    UniqueHandle<VkSemaphore, vkDestroySemaphore, VkDevice>;
+using UniqueFence = UniqueHandle<VkFence, vkDestroyFence, VkDevice>;
+using UniqueQueryPool =
+    UniqueHandle<VkQueryPool, vkDestroyQueryPool, VkDevice>;
+
+// Defers destruction of resources until the GPU can no longer be using them.
+//
+// Every frame is numbered when it is recorded. A resource retired while frame
+// N is current may still be referenced by N and the frames before it, so it
+// is only destroyed once collect() is told that frame N has completed, i.e.
+// after that frame's fence has signalled. Frames on one queue complete in
+// submission order, so the queue stays sorted by frame number.
+class FrameDeletionQueue
+{
+    public:
+    void retire( const std::uint64_t frame, std::function<void()> deleter ) {
+        m_pending.emplace_back( frame, std::move( deleter ) );
+    }
+    template <typename Handle, auto Destroy, typename Parent>
+    void retire( const std::uint64_t                        frame,
+                 UniqueHandle<Handle, Destroy, Parent> && handle ) {
+        if ( handle ) {
+            retire( frame, std::move( handle ).into_deleter() );
+        }
+    }
+
+    // Destroys everything retired during or before completed_frame.
+    void collect( const std::uint64_t completed_frame ) {
+        while ( !m_pending.empty()
+                && m_pending.front().first <= completed_frame ) {
+            m_pending.front().second();
+            m_pending.pop_front();
+        }
+    }
+
+    // Destroys everything; only valid once the device is idle.
+    void flush() {
+        for ( auto & [frame, deleter] : m_pending ) { deleter(); }
+        m_pending.clear();
+    }
+
+    [[nodiscard]] std::size_t size() const noexcept { return m_pending.size(); }
+
+    private:
+    std::deque<std::pair<std::uint64_t, std::function<void()>>> m_pending;
+};
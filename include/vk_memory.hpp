@@ -0,0 +1,189 @@
+#pragma once
+
+#include "vk_handle.hpp"
+
+#include <cstdint>
+#include <optional>
+#include <stdexcept>
+
+[[nodiscard]] inline std::optional<std::uint32_t>
+try_find_memory_type( const VkPhysicalDevice      physical_device,
+                      const std::uint32_t         type_filter,
+                      const VkMemoryPropertyFlags properties ) noexcept {
+    VkPhysicalDeviceMemoryProperties memory_properties;
+    vkGetPhysicalDeviceMemoryProperties( physical_device, &memory_properties );
+
+    for ( std::uint32_t i{ 0 }; i < memory_properties.memoryTypeCount; ++i ) {
+        if ( ( type_filter & ( 1u << i ) )
+             && ( memory_properties.memoryTypes[i].propertyFlags & properties )
+                    == properties ) {
+            return i;
+        }
+    }
+    return std::nullopt;
+}
+
+[[nodiscard]] inline std::uint32_t
+find_memory_type( const VkPhysicalDevice      physical_device,
+                  const std::uint32_t         type_filter,
+                  const VkMemoryPropertyFlags properties ) {
+    const auto index{ try_find_memory_type( physical_device, type_filter,
+                                            properties ) };
+    if ( !index.has_value() ) {
+        throw std::runtime_error( "Failed to find suitable memory type." );
+    }
+    return index.value();
+}
+
+struct BufferAllocation
+{
+    UniqueBuffer          buffer;
+    UniqueDeviceMemory    memory;
+    VkDeviceSize          size{ 0 };
+    VkMemoryPropertyFlags properties{ 0 };
+};
+
+// Creates a buffer with its own memory allocation. Memory types with all of
+// the `preferred` flags are tried first, falling back to `required` alone.
+// `allocator` is used for both the buffer and the memory, see
+// host_allocator.hpp.
+[[nodiscard]] inline BufferAllocation
+create_buffer( const VkPhysicalDevice        physical_device,
+               const VkDevice                device,
+               const VkDeviceSize            size,
+               const VkBufferUsageFlags      usage,
+               const VkMemoryPropertyFlags   required,
+               const VkMemoryPropertyFlags   preferred = 0,
+               const VkAllocationCallbacks * allocator = nullptr ) {
+    BufferAllocation allocation{};
+    allocation.size = size;
+
+    VkBufferCreateInfo buffer_info{};
+    buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    buffer_info.size = size;
+    buffer_info.usage = usage;
+    buffer_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+    if ( vkCreateBuffer( device, &buffer_info, allocator,
+                         allocation.buffer.put( device, allocator ) )
+         != VK_SUCCESS ) {
+        throw std::runtime_error( "Failed to create buffer." );
+    }
+
+    VkMemoryRequirements requirements;
+    vkGetBufferMemoryRequirements( device, allocation.buffer, &requirements );
+
+    auto memory_type{ try_find_memory_type( physical_device,
+                                            requirements.memoryTypeBits,
+                                            required | preferred ) };
+    allocation.properties = required | preferred;
+    if ( !memory_type.has_value() ) {
+        memory_type = find_memory_type( physical_device,
+                                        requirements.memoryTypeBits, required );
+        allocation.properties = required;
+    }
+
+    VkMemoryAllocateInfo alloc_info{};
+    alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    alloc_info.allocationSize = requirements.size;
+    alloc_info.memoryTypeIndex = memory_type.value();
+
+    if ( vkAllocateMemory( device, &alloc_info, allocator,
+                           allocation.memory.put( device, allocator ) )
+         != VK_SUCCESS ) {
+        throw std::runtime_error( "Failed to allocate buffer memory." );
+    }
+
+    vkBindBufferMemory( device, allocation.buffer, allocation.memory, 0 );
+
+    return allocation;
+}
+
+struct ImageAllocation
+{
+    UniqueImage        image;
+    UniqueDeviceMemory memory;
+};
+
+// Creates a 2D, single-layer, optimally tiled image in device-local memory.
+[[nodiscard]] inline ImageAllocation
+create_image( const VkPhysicalDevice        physical_device,
+              const VkDevice                device,
+              const VkExtent2D              extent,
+              const VkFormat                format,
+              const VkImageUsageFlags       usage,
+              const std::uint32_t           mip_levels = 1,
+              const VkAllocationCallbacks * allocator = nullptr ) {
+    ImageAllocation allocation{};
+
+    VkImageCreateInfo image_info{};
+    image_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    image_info.imageType = VK_IMAGE_TYPE_2D;
+    image_info.format = format;
+    image_info.extent = { extent.width, extent.height, 1 };
+    image_info.mipLevels = mip_levels;
+    image_info.arrayLayers = 1;
+    image_info.samples = VK_SAMPLE_COUNT_1_BIT;
+    image_info.tiling = VK_IMAGE_TILING_OPTIMAL;
+    image_info.usage = usage;
+    image_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    image_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+    if ( vkCreateImage( device, &image_info, allocator,
+                        allocation.image.put( device, allocator ) )
+         != VK_SUCCESS ) {
+        throw std::runtime_error( "Failed to create image." );
+    }
+
+    VkMemoryRequirements requirements;
+    vkGetImageMemoryRequirements( device, allocation.image, &requirements );
+
+    VkMemoryAllocateInfo alloc_info{};
+    alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    alloc_info.allocationSize = requirements.size;
+    alloc_info.memoryTypeIndex =
+        find_memory_type( physical_device, requirements.memoryTypeBits,
+                          VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT );
+
+    if ( vkAllocateMemory( device, &alloc_info, allocator,
+                           allocation.memory.put( device, allocator ) )
+         != VK_SUCCESS ) {
+        throw std::runtime_error( "Failed to allocate image memory." );
+    }
+
+    vkBindImageMemory( device, allocation.image, allocation.memory, 0 );
+
+    return allocation;
+}
+
+[[nodiscard]] inline UniqueImageView
+create_image_view( const VkDevice                device,
+                   const VkImage                 image,
+                   const VkFormat                format,
+                   const VkImageAspectFlags      aspect,
+                   const std::uint32_t           base_mip_level = 0,
+                   const std::uint32_t           mip_levels = 1,
+                   const VkAllocationCallbacks * allocator = nullptr ) {
+    VkImageViewCreateInfo create_info{};
+    create_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+    create_info.image = image;
+    create_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
+    create_info.format = format;
+    create_info.components.r = VK_COMPONENT_SWIZZLE_IDENTITY;
+    create_info.components.g = VK_COMPONENT_SWIZZLE_IDENTITY;
+    create_info.components.b = VK_COMPONENT_SWIZZLE_IDENTITY;
+    create_info.components.a = VK_COMPONENT_SWIZZLE_IDENTITY;
+    create_info.subresourceRange.aspectMask = aspect;
+    create_info.subresourceRange.baseMipLevel = base_mip_level;
+    create_info.subresourceRange.levelCount = mip_levels;
+    create_info.subresourceRange.baseArrayLayer = 0;
+    create_info.subresourceRange.layerCount = 1;
+
+    UniqueImageView view{};
+    if ( vkCreateImageView( device, &create_info, allocator,
+                            view.put( device, allocator ) )
+         != VK_SUCCESS ) {
+        throw std::runtime_error( "Failed to create image view." );
+    }
+    return view;
+}
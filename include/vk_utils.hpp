@@ -0,0 +1,52 @@
+#pragma once
+
+#include "vk_handle.hpp"
+
+#include <cstdint>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Helper functions
+
+inline std::vector<char>
+read_file( const std::string_view filename ) {
+    std::ifstream file( filename.data(), std::ios::ate | std::ios::binary );
+    if ( !file.is_open() ) {
+        throw std::runtime_error( "Couldn't open file: "
+                                  + std::string{ filename } );
+    }
+
+    // Get filesize + buffer for file
+    const size_t      file_size = file.tellg();
+    std::vector<char> file_buffer( file_size );
+
+    // Start of file
+    file.seekg( 0 );
+    // Read contents
+    file.read( file_buffer.data(), file_size );
+
+    file.close();
+
+    return file_buffer;
+}
+
+inline UniqueShaderModule
+create_shader_module( const VkDevice device, const std::vector<char> & code,
+                      const VkAllocationCallbacks * allocator = nullptr ) {
+    VkShaderModuleCreateInfo create_info{};
+    create_info.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+    create_info.codeSize = code.size();
+    create_info.pCode = reinterpret_cast<const uint32_t *>( code.data() );
+
+    UniqueShaderModule shader_module{};
+    if ( vkCreateShaderModule( device, &create_info, allocator,
+                               shader_module.put( device, allocator ) )
+         != VK_SUCCESS ) {
+        throw std::runtime_error( "Failed to create shader module." );
+    }
+
+    return shader_module;
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <vector>
+
+// One job deque per worker. Workers take from the front of their own deque
+// and, once it runs dry, steal from the back of the others, so jobs handed
+// out in contiguous blocks keep their order locally while the tail of a slow
+// worker's block is picked up by whoever finishes first.
+//
+// Deques are guarded by their own mutex rather than being lock-free; jobs
+// here are whole frames, so contention on a pop is noise next to the work.
+template <typename Job>
+class WorkStealingScheduler
+{
+    public:
+    struct Taken
+    {
+        Job  job;
+        bool stolen{ false };
+    };
+
+    explicit WorkStealingScheduler( const std::size_t worker_count ) {
+        m_queues.reserve( worker_count );
+        for ( std::size_t i{ 0 }; i < worker_count; ++i ) {
+            m_queues.push_back( std::make_unique<Queue>() );
+        }
+    }
+
+    WorkStealingScheduler( const WorkStealingScheduler & ) = delete;
+    WorkStealingScheduler & operator=( const WorkStealingScheduler & ) = delete;
+
+    [[nodiscard]] std::size_t worker_count() const noexcept {
+        return m_queues.size();
+    }
+
+    void push( const std::size_t worker, Job job ) {
+        auto &          queue{ *m_queues.at( worker ) };
+        std::lock_guard lock( queue.mutex );
+        queue.jobs.push_back( std::move( job ) );
+    }
+
+    // Own work first, then one job stolen from the next non-empty deque.
+    // Nothing is ever pushed while workers run, so an empty result means
+    // every deque is drained and the worker can stop.
+    [[nodiscard]] std::optional<Taken> take( const std::size_t worker ) {
+        if ( auto job{ pop_front( *m_queues.at( worker ) ) } ) {
+            return Taken{ std::move( *job ), false };
+        }
+        for ( std::size_t offset{ 1 }; offset < m_queues.size(); ++offset ) {
+            auto & victim{ *m_queues[( worker + offset ) % m_queues.size()] };
+            if ( auto job{ pop_back( victim ) } ) {
+                return Taken{ std::move( *job ), true };
+            }
+        }
+        return std::nullopt;
+    }
+
+    private:
+    struct Queue
+    {
+        std::mutex      mutex;
+        std::deque<Job> jobs;
+    };
+
+    // Behind pointers so the mutexes never move.
+    std::vector<std::unique_ptr<Queue>> m_queues;
+
+    [[nodiscard]] static std::optional<Job> pop_front( Queue & queue ) {
+        std::lock_guard lock( queue.mutex );
+        if ( queue.jobs.empty() ) {
+            return std::nullopt;
+        }
+        Job job{ std::move( queue.jobs.front() ) };
+        queue.jobs.pop_front();
+        return job;
+    }
+    [[nodiscard]] static std::optional<Job> pop_back( Queue & queue ) {
+        std::lock_guard lock( queue.mutex );
+        if ( queue.jobs.empty() ) {
+            return std::nullopt;
+        }
+        Job job{ std::move( queue.jobs.back() ) };
+        queue.jobs.pop_back();
+        return job;
+    }
+};
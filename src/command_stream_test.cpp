@@ -0,0 +1,366 @@
+#include "command_stream.hpp"
+#include "vk_utils.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <variant>
+#include <vector>
+
+// Round trip of save_command_stream/load_command_stream, no GPU needed: a
+// stream with every record type is written and read back, then broken
+// copies of it have to be rejected by the loader.
+//
+//   command_stream_test [--output <path>] [--triangle <path>]
+//
+// --triangle also writes a one-triangle frame drawn with
+// shaders/triangle_*.spv, which the vk_replay test replays.
+
+namespace
+{
+
+struct TestOptions
+{
+    std::string output{
+        ( std::filesystem::temp_directory_path() / "command_stream_test.vcmd" )
+            .string() };
+    std::string triangle_path;
+};
+
+TestOptions
+parse_options( const int argc, char ** argv ) {
+    TestOptions options{};
+    for ( int i{ 1 }; i < argc; ++i ) {
+        const std::string_view arg{ argv[i] };
+        const auto             next = [&]() -> std::string {
+            if ( i + 1 >= argc ) {
+                throw std::runtime_error( "Missing value for "
+                                          + std::string{ arg } );
+            }
+            return argv[++i];
+        };
+
+        if ( arg == "--output" ) {
+            options.output = next();
+        }
+        else if ( arg == "--triangle" ) {
+            options.triangle_path = next();
+        }
+        else {
+            throw std::runtime_error( "Unknown option: " + std::string{ arg } );
+        }
+    }
+    return options;
+}
+
+// One of everything, with values that differ from the defaults.
+[[nodiscard]] CommandStream
+sample_stream() {
+    CommandStream stream{};
+    stream.color_format = VK_FORMAT_B8G8R8A8_SRGB;
+    stream.depth_format = VK_FORMAT_D32_SFLOAT;
+    stream.targets.push_back( { 640, 480 } );
+    stream.targets.push_back( { 320, 200 } );
+    // Only replay looks inside the SPIR-V.
+    stream.shaders.push_back( { 0x03, 0x02, 0x23, 0x07 } );
+    stream.shaders.push_back( { 0x03, 0x02, 0x23, 0x07, 0x00, 0x00, 0x01,
+                                0x00 } );
+
+    auto & vertices{ stream.buffers.emplace_back() };
+    vertices.usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT;
+    for ( std::uint32_t i{ 0 }; i < 96; ++i ) {
+        vertices.contents.push_back( static_cast<std::uint8_t>( i * 7 ) );
+    }
+    auto & indices{ stream.buffers.emplace_back() };
+    indices.usage = VK_BUFFER_USAGE_INDEX_BUFFER_BIT;
+    indices.contents.assign( 12, 0xab );
+
+    stream.textures.push_back(
+        { static_cast<std::uint32_t>( VK_FORMAT_B8G8R8A8_UNORM ), 256, 128,
+          9 } );
+    stream.pipelines.push_back(
+        { 0, 1, 128, VK_FRONT_FACE_COUNTER_CLOCKWISE,
+          STREAM_PIPELINE_MESH_VERTICES | STREAM_PIPELINE_DEPTH_TEST
+              | STREAM_PIPELINE_TEXTURED } );
+    stream.pipelines.push_back( { 0, 1, 0, VK_FRONT_FACE_CLOCKWISE, 0 } );
+
+    StreamImageBarrier to_attachment{};
+    to_attachment.target = 1;
+    to_attachment.old_layout = VK_IMAGE_LAYOUT_UNDEFINED;
+    to_attachment.new_layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+    to_attachment.src_stages = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+    to_attachment.dst_stages = VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT;
+    to_attachment.dst_access = VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT;
+    stream.commands.emplace_back( to_attachment );
+    stream.commands.emplace_back( StreamMemoryBarrier{
+        VK_PIPELINE_STAGE_2_ALL_TRANSFER_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT,
+        VK_PIPELINE_STAGE_2_ALL_GRAPHICS_BIT, VK_ACCESS_2_SHADER_READ_BIT } );
+    stream.commands.emplace_back( StreamBarrierFlush{} );
+
+    StreamBeginRenderPass begin{};
+    begin.target = 1;
+    begin.clear_color[0] = 0.25f;
+    begin.clear_color[3] = 1.0f;
+    begin.clear_depth = 0.5f;
+    begin.clear_stencil = 3;
+    stream.commands.emplace_back( begin );
+    stream.commands.emplace_back( StreamBindPipeline{ 0 } );
+    stream.commands.emplace_back(
+        StreamSetViewport{ 1.0f, 2.0f, 318.0f, 196.0f, 0.0f, 1.0f } );
+    stream.commands.emplace_back( StreamSetScissor{ 4, 5, 300, 190 } );
+    stream.commands.emplace_back( StreamBindVertexBuffer{ 0, 0, 32 } );
+    stream.commands.emplace_back(
+        StreamBindIndexBuffer{ 1, VK_INDEX_TYPE_UINT16, 4 } );
+    stream.commands.emplace_back( StreamBindTexture{ 0, 0 } );
+
+    StreamPushConstants push{};
+    push.pipeline = 0;
+    push.stages = VK_SHADER_STAGE_VERTEX_BIT;
+    push.offset = 64;
+    push.size = 64;
+    for ( std::uint32_t i{ 0 }; i < push.size; ++i ) {
+        push.data[i] = static_cast<std::uint8_t>( 255 - i );
+    }
+    stream.commands.emplace_back( push );
+    stream.commands.emplace_back( StreamDrawIndexed{ 6, 2, 0, -1, 1 } );
+    stream.commands.emplace_back( StreamBindPipeline{ 1 } );
+    stream.commands.emplace_back( StreamDraw{ 3, 1, 0, 0 } );
+    stream.commands.emplace_back( StreamEndRenderPass{} );
+
+    StreamImageBarrier to_present{ to_attachment };
+    to_present.old_layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+    to_present.new_layout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+    stream.commands.emplace_back( to_present );
+    stream.commands.emplace_back( StreamBarrierFlush{} );
+    return stream;
+}
+
+// The records are written byte for byte and have no padding.
+template <typename Record>
+[[nodiscard]] bool
+same_record( const Record & a, const Record & b ) {
+    return std::memcmp( &a, &b, sizeof( Record ) ) == 0;
+}
+
+template <typename Record>
+[[nodiscard]] bool
+same_records( const std::vector<Record> & a, const std::vector<Record> & b ) {
+    if ( a.size() != b.size() ) {
+        return false;
+    }
+    for ( std::size_t i{ 0 }; i < a.size(); ++i ) {
+        if ( !same_record( a[i], b[i] ) ) {
+            return false;
+        }
+    }
+    return true;
+}
+
+[[nodiscard]] bool
+same_commands( const std::vector<StreamCommand> & a,
+               const std::vector<StreamCommand> & b ) {
+    if ( a.size() != b.size() ) {
+        return false;
+    }
+    for ( std::size_t i{ 0 }; i < a.size(); ++i ) {
+        if ( a[i].index() != b[i].index() ) {
+            return false;
+        }
+        const bool same{ std::visit(
+            [&]( const auto & record ) {
+                using Record = std::decay_t<decltype( record )>;
+                return same_record( record, std::get<Record>( b[i] ) );
+            },
+            a[i] ) };
+        if ( !same ) {
+            return false;
+        }
+    }
+    return true;
+}
+
+template <typename Record>
+[[nodiscard]] Record &
+first_command( CommandStream & stream ) {
+    for ( auto & command : stream.commands ) {
+        if ( auto * record{ std::get_if<Record>( &command ) } ) {
+            return *record;
+        }
+    }
+    throw std::runtime_error( "Sample stream lacks a command." );
+}
+
+// A single triangle into a 256x256 target, for vk_replay.
+[[nodiscard]] CommandStream
+triangle_stream() {
+    CommandStream stream{};
+    stream.color_format = VK_FORMAT_B8G8R8A8_UNORM;
+    stream.depth_format = VK_FORMAT_D32_SFLOAT;
+    stream.targets.push_back( { 256, 256 } );
+    stream.shaders.push_back( read_file( "shaders/triangle_vert.spv" ) );
+    stream.shaders.push_back( read_file( "shaders/triangle_frag.spv" ) );
+    stream.pipelines.push_back( { 0, 1, 0, VK_FRONT_FACE_CLOCKWISE, 0 } );
+
+    StreamBeginRenderPass begin{};
+    begin.clear_color[3] = 1.0f;
+    stream.commands.emplace_back( begin );
+    stream.commands.emplace_back( StreamBindPipeline{ 0 } );
+    stream.commands.emplace_back(
+        StreamSetViewport{ 0.0f, 0.0f, 256.0f, 256.0f, 0.0f, 1.0f } );
+    stream.commands.emplace_back( StreamSetScissor{ 0, 0, 256, 256 } );
+    stream.commands.emplace_back( StreamDraw{ 3, 1, 0, 0 } );
+    stream.commands.emplace_back( StreamEndRenderPass{} );
+    return stream;
+}
+
+[[nodiscard]] int
+run_test( const TestOptions & options ) {
+    int        failures{ 0 };
+    const auto check = [&]( const bool ok, const std::string & what ) {
+        if ( !ok ) {
+            std::cerr << "FAIL: " << what << std::endl;
+            ++failures;
+        }
+    };
+
+    const CommandStream stream{ sample_stream() };
+    const auto          bytes{ save_command_stream( options.output, stream ) };
+    check( bytes == std::filesystem::file_size( options.output ),
+           "bytes written" );
+
+    const CommandStream loaded{ load_command_stream( options.output ) };
+    check( loaded.color_format == stream.color_format
+               && loaded.depth_format == stream.depth_format,
+           "formats" );
+    check( same_records( loaded.targets, stream.targets ), "targets" );
+    check( loaded.shaders == stream.shaders, "shaders" );
+    check( loaded.buffers.size() == stream.buffers.size(), "buffer count" );
+    for ( std::size_t i{ 0 };
+          i < std::min( loaded.buffers.size(), stream.buffers.size() ); ++i ) {
+        check( loaded.buffers[i].usage == stream.buffers[i].usage
+                   && loaded.buffers[i].contents == stream.buffers[i].contents,
+               "buffer " + std::to_string( i ) );
+    }
+    check( same_records( loaded.textures, stream.textures ), "textures" );
+    check( same_records( loaded.pipelines, stream.pipelines ), "pipelines" );
+    check( same_commands( loaded.commands, stream.commands ), "commands" );
+    check( loaded.draw_count() == 2, "draw count" );
+
+    // Each of these has to make load_command_stream throw.
+    const auto rejects = [&]( const std::string &                    what,
+                              const std::function<void( CommandStream & )> &
+                                  corrupt ) {
+        CommandStream broken{ stream };
+        corrupt( broken );
+        save_command_stream( options.output, broken );
+        bool thrown{ false };
+        try {
+            static_cast<void>( load_command_stream( options.output ) );
+        }
+        catch ( const std::runtime_error & ) {
+            thrown = true;
+        }
+        check( thrown, "rejects " + what );
+    };
+    rejects( "a texture without levels", []( CommandStream & broken ) {
+        broken.textures[0].levels = 0;
+    } );
+    rejects( "more levels than the mip chain", []( CommandStream & broken ) {
+        broken.textures[0].levels = 10;
+    } );
+    rejects( "an unknown texture format", []( CommandStream & broken ) {
+        broken.textures[0].format = VK_FORMAT_D32_SFLOAT;
+    } );
+    rejects( "a missing shader", []( CommandStream & broken ) {
+        broken.pipelines[1].fragment_shader = 2;
+    } );
+    rejects( "an unknown front face", []( CommandStream & broken ) {
+        broken.pipelines[0].front_face = 2;
+    } );
+    rejects( "too many push constants", []( CommandStream & broken ) {
+        broken.pipelines[0].push_constant_size = 256;
+    } );
+    rejects( "a missing target", []( CommandStream & broken ) {
+        first_command<StreamBeginRenderPass>( broken ).target = 2;
+    } );
+    rejects( "a missing pipeline", []( CommandStream & broken ) {
+        first_command<StreamBindPipeline>( broken ).pipeline = 2;
+    } );
+    rejects( "a missing buffer", []( CommandStream & broken ) {
+        first_command<StreamBindVertexBuffer>( broken ).buffer = 2;
+    } );
+    rejects( "a missing texture", []( CommandStream & broken ) {
+        first_command<StreamBindTexture>( broken ).texture = 1;
+    } );
+    rejects( "an unknown index type", []( CommandStream & broken ) {
+        first_command<StreamBindIndexBuffer>( broken ).index_type = 7;
+    } );
+    rejects( "an unknown old layout", []( CommandStream & broken ) {
+        first_command<StreamImageBarrier>( broken ).old_layout =
+            0x7fffffff;
+    } );
+    rejects( "an unknown new layout", []( CommandStream & broken ) {
+        first_command<StreamImageBarrier>( broken ).new_layout = 1234;
+    } );
+    rejects( "push constants out of range", []( CommandStream & broken ) {
+        first_command<StreamPushConstants>( broken ).offset = 96;
+    } );
+
+    // Damage to the file itself.
+    save_command_stream( options.output, stream );
+    const auto reload_fails = [&]( const std::string & what ) {
+        bool thrown{ false };
+        try {
+            static_cast<void>( load_command_stream( options.output ) );
+        }
+        catch ( const std::runtime_error & ) {
+            thrown = true;
+        }
+        check( thrown, "rejects " + what );
+    };
+    std::filesystem::resize_file( options.output, bytes - 1 );
+    reload_fails( "a truncated file" );
+    {
+        std::ofstream file( options.output,
+                            std::ios::binary | std::ios::in | std::ios::out );
+        file.write( "VCMX", 4 );
+    }
+    reload_fails( "a bad magic" );
+    std::filesystem::remove( options.output );
+
+    if ( !options.triangle_path.empty() ) {
+        save_command_stream( options.triangle_path, triangle_stream() );
+        check( load_command_stream( options.triangle_path ).draw_count() == 1,
+               "triangle capture" );
+    }
+
+    if ( failures != 0 ) {
+        std::cerr << failures << " checks failed" << std::endl;
+        return EXIT_FAILURE;
+    }
+    std::cout << "Command stream test passed (" << bytes << " bytes, "
+              << stream.commands.size() << " commands)" << std::endl;
+    return EXIT_SUCCESS;
+}
+
+} // namespace
+
+int
+main( int argc, char ** argv ) {
+    try {
+        return run_test( parse_options( argc, argv ) );
+    }
+    catch ( const std::exception & err ) {
+        std::cerr << err.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+}
@@ -1,16 +1,39 @@
 #define GLFW_INCLUDE_VULKAN
 #include "GLFW/glfw3.h"
+#include "async_executor.hpp"
+#include "command_capture.hpp"
+#include "frame_capture.hpp"
+#include "host_allocator.hpp"
+#include "init_graph.hpp"
+#include "mesh_loader.hpp"
+#include "metrics_exporter.hpp"
+#include "pipeline.hpp"
+#include "sampler_cache.hpp"
+#include "submit_thread.hpp"
+#include "synchronization.hpp"
+#include "texture_streamer.hpp"
+#include "vk_dispatch.hpp"
+#include "vk_handle.hpp"
+#include "vk_utils.hpp"
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
 
 #include <algorithm>
+#include <chrono>
 #include <cstdint>
 #include <cstdlib>
 #include <cstring>
 #include <format>
 #include <fstream>
 #include <functional>
+#include <future>
 #include <iostream>
 #include <limits>
 #include <map>
+#include <memory>
 #include <optional>
 #include <set>
 #include <stdexcept>
@@ -20,81 +43,34 @@
 
 #define NDEBUG
 
-// Helper functions
-
-static std::vector<char>
-read_file( const std::string_view filename ) {
-    std::ifstream file( filename.data(), std::ios::ate | std::ios::binary );
-    if ( !file.is_open() ) {
-        throw std::runtime_error( "Couldn't open file: "
-                                  + std::string{ filename } );
-    }
-
-    // Get filesize + buffer for file
-    const size_t      file_size = file.tellg();
-    std::vector<char> file_buffer( file_size );
-
-    // Start of file
-    file.seekg( 0 );
-    // Read contents
-    file.read( file_buffer.data(), file_size );
-
-    file.close();
-
-    return file_buffer;
-}
-
-VkShaderModule
-create_shader_module( const VkDevice device, const std::vector<char> & code ) {
-    VkShaderModuleCreateInfo create_info{};
-    create_info.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-    create_info.codeSize = code.size();
-    create_info.pCode = reinterpret_cast<const uint32_t *>( code.data() );
-
-    VkShaderModule shader_module{};
-    if ( vkCreateShaderModule( device, &create_info, nullptr, &shader_module )
-         != VK_SUCCESS ) {
-        throw std::runtime_error( "Failed to create shader module." );
-    }
-
-    return shader_module;
-}
-
-// External debug functions
-
-VkResult
-create_debug_utils_messenger_EXT(
-    VkInstance                                 instance,
-    const VkDebugUtilsMessengerCreateInfoEXT * p_create_info,
-    const VkAllocationCallbacks *              p_allocator,
-    VkDebugUtilsMessengerEXT *                 p_debug_messenger ) {
-    const auto func = reinterpret_cast<PFN_vkCreateDebugUtilsMessengerEXT>(
-        vkGetInstanceProcAddr( instance, "vkCreateDebugUtilsMessengerEXT" ) );
-
-    if ( func != nullptr ) {
-        return func( instance, p_create_info, p_allocator, p_debug_messenger );
-    }
-    else {
-        return VK_ERROR_EXTENSION_NOT_PRESENT;
-    }
-}
+constexpr std::uint32_t MAX_FRAMES_IN_FLIGHT{ 2 };
+// Images are acquired a frame ahead, so one more acquire semaphore than
+// frames in flight, see draw_frame().
+constexpr std::uint32_t ACQUIRE_SEMAPHORE_COUNT{ MAX_FRAMES_IN_FLIGHT + 1 };
+// About the widest the init graph gets, see HelloTriangleApp::init().
+constexpr std::size_t INIT_THREAD_COUNT{ 4 };
 
+// The messenger keeps a pointer to the app's instance table, which outlives
+// it; the extension functions were looked up once in create_instance().
 void
-destroy_debug_utils_messenger_EXT( VkInstance               instance,
-                                   VkDebugUtilsMessengerEXT debug_messenger,
-                                   const VkAllocationCallbacks * p_allocator ) {
-    const auto func = reinterpret_cast<PFN_vkDestroyDebugUtilsMessengerEXT>(
-        vkGetInstanceProcAddr( instance, "vkDestroyDebugUtilsMessengerEXT" ) );
-
-    if ( func != nullptr ) {
-        return func( instance, debug_messenger, p_allocator );
+destroy_debug_utils_messenger( const InstanceDispatch *      dispatch,
+                               VkDebugUtilsMessengerEXT      debug_messenger,
+                               const VkAllocationCallbacks * p_allocator ) {
+    if ( dispatch->destroy_debug_utils_messenger_ext != nullptr ) {
+        dispatch->destroy_debug_utils_messenger_ext(
+            dispatch->instance, debug_messenger, p_allocator );
     }
 }
 
+using UniqueDebugMessenger =
+    UniqueHandle<VkDebugUtilsMessengerEXT, destroy_debug_utils_messenger,
+                 const InstanceDispatch *>;
+
 void
 populate_debug_messenger_create_info(
     VkDebugUtilsMessengerCreateInfoEXT & create_info,
-    PFN_vkDebugUtilsMessengerCallbackEXT debug_callback ) {
+    PFN_vkDebugUtilsMessengerCallbackEXT debug_callback,
+    void *                               user_data = nullptr ) {
     create_info = VkDebugUtilsMessengerCreateInfoEXT{};
     create_info.sType = VK_STRUCTURE_TYPE_DEBUG_UTILS_MESSENGER_CREATE_INFO_EXT;
     create_info.messageSeverity =
@@ -105,7 +81,7 @@ populate_debug_messenger_create_info(
                               | VK_DEBUG_UTILS_MESSAGE_TYPE_VALIDATION_BIT_EXT
                               | VK_DEBUG_UTILS_MESSAGE_TYPE_PERFORMANCE_BIT_EXT;
     create_info.pfnUserCallback = debug_callback;
-    create_info.pUserData = nullptr; // optional
+    create_info.pUserData = user_data; // optional
 }
 
 // Helper structs & related functions
@@ -138,7 +114,7 @@ struct SwapChainSupportDetails
 };
 
 struct SwapChainSupportDetails
-query_swapchain_support( VkPhysicalDevice & device, VkSurfaceKHR & surface )
+query_swapchain_support( VkPhysicalDevice device, VkSurfaceKHR surface )
 {
     SwapChainSupportDetails details;
 
@@ -169,103 +145,684 @@ query_swapchain_support( VkPhysicalDevice & device, VkSurfaceKHR & surface )
     return details;
 }
 
+// Command line options
+
+struct AppOptions
+{
+    std::optional<FrameCaptureConfig> capture;
+    // .vcmd file (see command_stream.hpp) for vk_replay, holding the
+    // commands of frame capture_stream_frame.
+    std::optional<std::string> capture_stream;
+    std::uint64_t              capture_stream_frame{ 0 };
+    // Stop after this many frames, e.g. for batch capture runs.
+    std::optional<std::uint64_t> frame_limit;
+    // .vmesh file (see mesh_convert) drawn instead of the built-in triangle.
+    std::optional<std::string> mesh;
+    // KTX2 texture streamed in and mapped onto the mesh.
+    std::optional<std::string> texture;
+    // Device memory budget for streamed textures, in MiB.
+    std::optional<std::uint64_t> texture_budget_mib;
+    // Windows rendered by the one device, each with its own swapchain.
+    std::uint32_t window_count{ 1 };
+    // Prometheus endpoint on 127.0.0.1, 0 for any free port.
+    std::optional<std::uint16_t> metrics_port;
+    // File rewritten with the same text every metrics_interval_ms.
+    std::optional<std::string> metrics_file;
+    std::uint32_t              metrics_interval_ms{ 5000 };
+    // Start-up steps one after the other, to compare time to first frame.
+    bool serial_init{ false };
+};
+
+[[nodiscard]] AppOptions
+parse_options( const int argc, char ** argv ) {
+    AppOptions options{};
+
+    for ( int i{ 1 }; i < argc; ++i ) {
+        const std::string_view arg{ argv[i] };
+        const auto             next_value = [&]() -> std::string_view {
+            if ( i + 1 >= argc ) {
+                throw std::runtime_error( "Missing value for "
+                                          + std::string{ arg } );
+            }
+            return argv[++i];
+        };
+
+        if ( arg == "--capture" ) {
+            if ( !options.capture ) {
+                options.capture.emplace();
+            }
+            options.capture->directory = next_value();
+        }
+        else if ( arg == "--capture-format" ) {
+            if ( !options.capture ) {
+                options.capture.emplace();
+            }
+            options.capture->format = parse_image_file_format( next_value() );
+        }
+        else if ( arg == "--capture-threads" ) {
+            if ( !options.capture ) {
+                options.capture.emplace();
+            }
+            options.capture->worker_count =
+                static_cast<std::uint32_t>( std::stoul( std::string{
+                    next_value() } ) );
+        }
+        else if ( arg == "--capture-stream" ) {
+            options.capture_stream = next_value();
+        }
+        else if ( arg == "--capture-stream-frame" ) {
+            options.capture_stream_frame =
+                std::stoull( std::string{ next_value() } );
+        }
+        else if ( arg == "--frames" ) {
+            options.frame_limit = std::stoull( std::string{ next_value() } );
+        }
+        else if ( arg == "--mesh" ) {
+            options.mesh = next_value();
+        }
+        else if ( arg == "--texture" ) {
+            options.texture = next_value();
+        }
+        else if ( arg == "--texture-budget" ) {
+            options.texture_budget_mib =
+                std::stoull( std::string{ next_value() } );
+        }
+        else if ( arg == "--windows" ) {
+            options.window_count = static_cast<std::uint32_t>(
+                std::stoul( std::string{ next_value() } ) );
+            if ( options.window_count == 0 ) {
+                throw std::runtime_error( "--windows must be at least 1." );
+            }
+        }
+        else if ( arg == "--metrics-port" ) {
+            options.metrics_port = static_cast<std::uint16_t>(
+                std::stoul( std::string{ next_value() } ) );
+        }
+        else if ( arg == "--metrics-file" ) {
+            options.metrics_file = next_value();
+        }
+        else if ( arg == "--metrics-interval" ) {
+            options.metrics_interval_ms = static_cast<std::uint32_t>(
+                std::stoul( std::string{ next_value() } ) );
+            if ( options.metrics_interval_ms == 0 ) {
+                throw std::runtime_error(
+                    "--metrics-interval must be at least 1 ms." );
+            }
+        }
+        else if ( arg == "--serial-init" ) {
+            options.serial_init = true;
+        }
+        else {
+            throw std::runtime_error( "Unknown option: " + std::string{ arg } );
+        }
+    }
+
+    return options;
+}
+
+// Everything recorded on the render thread, registered once up front so
+// recording is a handful of relaxed atomics.
+struct AppMetrics
+{
+    explicit AppMetrics( MetricsRegistry & registry )
+        : frames( registry.counter( "vk_frames_total", "Frames submitted." ) ),
+          frame_cpu( registry.histogram(
+              "vk_frame_cpu_seconds", "CPU time spent in draw_frame.",
+              1e-9 ) ),
+          frame_wait( registry.histogram(
+              "vk_frame_wait_seconds",
+              "Time draw_frame blocked on the GPU for a frame in flight.",
+              1e-9 ) ),
+          acquire( registry.histogram( "vk_acquire_seconds",
+                                       "vkAcquireNextImageKHR latency.",
+                                       1e-9 ) ),
+          submit( registry.histogram( "vk_queue_submit_seconds",
+                                      "vkQueueSubmit latency.", 1e-9 ) ),
+          present( registry.histogram( "vk_queue_present_seconds",
+                                       "vkQueuePresentKHR latency.",
+                                       1e-9 ) ),
+          pipeline_compile( registry.histogram(
+              "vk_pipeline_compile_seconds",
+              "Graphics pipeline builds, shader modules included.", 1e-9 ) ),
+          validation_warnings( registry.counter(
+              "vk_validation_messages_total",
+              "Messages from the validation layers.",
+              { { "severity", "warning" } } ) ),
+          validation_errors( registry.counter(
+              "vk_validation_messages_total",
+              "Messages from the validation layers.",
+              { { "severity", "error" } } ) ) {}
+
+    MetricCounter &   frames;
+    MetricHistogram & frame_cpu;
+    MetricHistogram & frame_wait;
+    MetricHistogram & acquire;
+    MetricHistogram & submit;
+    MetricHistogram & present;
+    MetricHistogram & pipeline_compile;
+    MetricCounter &   validation_warnings;
+    MetricCounter &   validation_errors;
+};
+
+// Written by the submit thread.
+struct SurfaceStats
+{
+    std::uint64_t frames{ 0 };
+    std::uint64_t present_suboptimal{ 0 };
+    // Suboptimal acquires.
+    std::uint64_t suboptimal{ 0 };
+    // Time the submit thread spent blocked in vkAcquireNextImageKHR.
+    double acquire_seconds{ 0.0 };
+    double max_acquire_seconds{ 0.0 };
+};
+
+// Everything tied to one window. The device, render pass, pipelines and
+// command buffers are shared; each window has its own swapchain, sized to
+// its own framebuffer.
+struct WindowSurface
+{
+    GLFWwindow *                   window{ nullptr };
+    UniqueSurface                  surface;
+    UniqueSwapchain                swapchain;
+    std::vector<VkImage>           images;
+    std::vector<UniqueImageView>   image_views;
+    VkExtent2D                     extent{};
+    ImageAllocation                depth_image;
+    UniqueImageView                depth_image_view;
+    std::vector<UniqueFramebuffer> framebuffers;
+    // ACQUIRE_SEMAPHORE_COUNT of them, used in turn.
+    std::vector<UniqueSemaphore> image_available_semaphores;
+    // Per swapchain image, see create_sync_objects().
+    std::vector<UniqueSemaphore> render_finished_semaphores;
+    // Whether there are images beyond minImageCount, which acquiring with
+    // one image already held needs.
+    bool acquire_ahead{ false };
+    // Written by the submit thread once the frame's acquire has returned.
+    std::uint32_t acquired_index{ 0 };
+    // Image acquired for the frame being recorded.
+    std::uint32_t image_index{ 0 };
+    SurfaceStats  stats;
+};
+
+// Vertex stage push constants for mesh rendering, see mesh_vert.vert.
+struct MeshPushConstants
+{
+    glm::mat4 mvp;
+    glm::mat4 model;
+};
+
+// SPIR-V a pipeline is built from.
+struct ShaderPaths
+{
+    std::string vertex;
+    std::string fragment;
+};
+
+// A pipeline with the layout it was built against.
+struct BuiltPipeline
+{
+    UniquePipelineLayout layout;
+    UniquePipeline       pipeline;
+};
+
 // HelloTriangleApp class
 
 class HelloTriangleApp
 {
     public:
     HelloTriangleApp( const uint32_t width = 800, const uint32_t height = 600,
-                      const bool enable_validation_layers = false ) :
+                      const bool enable_validation_layers = false,
+                      AppOptions options = {} ) :
         m_width( width ),
         m_height( height ),
         m_physical_device( VK_NULL_HANDLE ),
-        m_enable_validation_layers( enable_validation_layers ) {}
+        m_enable_validation_layers( enable_validation_layers ),
+        m_options( std::move( options ) ) {}
     void run() {
-        init_window();
-        init_vulkan();
+        m_run_start = std::chrono::steady_clock::now();
+        init();
         main_loop();
         cleanup();
     }
 
     private:
     uint32_t                        m_width, m_height;
-    GLFWwindow *                    m_window;
-    VkInstance                      m_instance;
-    VkDebugUtilsMessengerEXT        m_debug_messenger;
+    // Time to first frame is measured from here.
+    std::chrono::steady_clock::time_point m_run_start;
+    double                          m_init_seconds{ 0.0 };
+    // Outlives the exporters and everything recording into it.
+    MetricsRegistry                 m_metrics;
+    AppMetrics                      m_app_metrics{ m_metrics };
+    // Ahead of every Vulkan object, which must all be gone before it is.
+    HostAllocator                   m_host_allocator;
+    UniqueInstance                  m_instance;
+    InstanceDispatch                m_instance_dispatch;
+    std::uint32_t                   m_instance_api_version{};
+    UniqueDebugMessenger            m_debug_messenger;
     VkPhysicalDevice                m_physical_device;
-    VkDevice                        m_device;
+    UniqueDevice                    m_device;
+    // Recording and submission go through this, not the loader exports.
+    DeviceDispatch                  m_dispatch;
+    NegotiatedDeviceFeatures        m_device_features;
+    SynchronizationFunctions        m_sync_functions;
     VkQueue                         m_graphics_queue;
-    VkSurfaceKHR                    m_surface;
     VkQueue                         m_present_queue;
-    VkSwapchainKHR                  m_swapchain;
-    std::vector<VkImage>            m_swapchain_images;
-    std::vector<VkImageView>        m_swapchain_image_views;
-    VkFormat                        m_swapchain_image_format;
-    VkExtent2D                      m_swapchain_extent;
-    VkRenderPass                    m_render_pass;
-    VkPipelineLayout                m_pipeline_layout;
-    VkPipeline                      m_graphics_pipeline;
-    std::vector<VkFramebuffer>      m_swapchain_framebuffers;
+    // Sole user of both queues, uploads included, see draw_frame().
+    std::unique_ptr<SubmitThread>   m_submit_thread;
+    // Ticket of the last frame's present.
+    std::uint64_t                   m_present_ticket{ 0 };
+    // Ticket of the acquire for the next frame to be recorded.
+    std::uint64_t                   m_acquire_ticket{ 0 };
+    std::vector<WindowSurface>      m_surfaces;
+    // Shared by all swapchains so one render pass and pipeline serve them;
+    // VK_FORMAT_UNDEFINED until the first swapchain picks it.
+    VkFormat                        m_swapchain_image_format{};
+    VkFormat                        m_depth_format;
+    UniqueRenderPass                m_render_pass;
+    UniquePipelineLayout            m_pipeline_layout;
+    UniquePipeline                  m_graphics_pipeline;
+    UniqueCommandPool               m_command_pool;
+    std::vector<VkCommandBuffer>    m_command_buffers;
+    // Frame pacing: one timeline semaphore where the device has them,
+    // otherwise a fence per frame in flight.
+    std::optional<FrameTimeline>    m_frame_timeline;
+    std::vector<UniqueFence>        m_in_flight_fences;
+    std::uint32_t                   m_current_frame{ 0 };
+    std::uint64_t                   m_frame_number{ 0 };
+    FrameDeletionQueue              m_deletion_queue;
+    std::unique_ptr<FrameCapture>   m_capture;
+    std::unique_ptr<CommandCapture> m_stream_capture;
+    std::optional<Mesh>             m_mesh;
+    // In flight between load_mesh() and finish_mesh_load().
+    std::future<Mesh>               m_pending_mesh;
+    MeshLoadStats                   m_mesh_stats{};
+    // Hot reload result, picked up by the main loop once ready.
+    std::future<BuiltPipeline>      m_pending_pipeline;
+    std::unique_ptr<TextureStreamer> m_texture_streamer;
+    std::unique_ptr<SamplerCache>   m_sampler_cache;
+    TextureId                       m_texture{ 0 };
+    UniqueDescriptorSetLayout       m_texture_set_layout;
+    UniqueDescriptorPool            m_descriptor_pool;
+    std::vector<VkDescriptorSet>    m_texture_sets;
+    bool                            m_texture_compression_bc{ false };
     bool                            m_enable_validation_layers;
+    AppOptions                      m_options;
+    bool                            m_memory_budget{ false };
+    std::unique_ptr<MetricsServer>     m_metrics_server;
+    std::unique_ptr<MetricsFileWriter> m_metrics_writer;
     const std::vector<const char *> m_validation_layers{
         "VK_LAYER_KHRONOS_validation"
     };
     const std::vector<const char *> m_device_extensions{
         VK_KHR_SWAPCHAIN_EXTENSION_NAME
     };
+    // File reads, mesh uploads and pipeline builds off the main thread.
+    // Last, so its pools drain and join before any member a running task
+    // uses, the device and allocator included, is destroyed.
+    AsyncExecutor                   m_executor;
 
-    void init_window() {
+    void init_glfw() {
         glfwInit();
         // GLFW originally designed to use an OpenGL context,
         // this tells it not to.
         glfwWindowHint( GLFW_CLIENT_API, GLFW_NO_API );
         // Handling resizing takes care, so disable for now.
         glfwWindowHint( GLFW_RESIZABLE, GLFW_FALSE );
-
-        // Create the window.
-        m_window =
-            glfwCreateWindow( m_width, m_height, "Vulkan", nullptr, nullptr );
     }
-    void init_vulkan() {
+    void create_windows() {
+        m_surfaces.resize( m_options.window_count );
+        for ( std::size_t i{ 0 }; i < m_surfaces.size(); ++i ) {
+            const std::string title{ m_surfaces.size() == 1
+                                         ? std::string{ "Vulkan" }
+                                         : "Vulkan [" + std::to_string( i )
+                                               + "]" };
+            m_surfaces[i].window = glfwCreateWindow(
+                m_width, m_height, title.c_str(), nullptr, nullptr );
+            if ( m_surfaces[i].window == nullptr ) {
+                throw std::runtime_error( "Failed to create window." );
+            }
+        }
+    }
+    // Start-up as a dependency graph, so windows, instance and device
+    // set-up, shader reads and pipeline compilation overlap where they can.
+    // GLFW only allows window calls on the main thread; everything else goes
+    // to a pool that lives just as long as this.
+    void init() {
+        std::vector<char>                    vert_shader_code;
+        std::vector<char>                    frag_shader_code;
+        std::multimap<int, VkPhysicalDevice> device_candidates;
+
+        constexpr auto main_thread{ InitGraph::Affinity::main_thread };
+        InitGraph      graph;
+        const auto     glfw{ graph.add(
+            "glfw", [this]() { init_glfw(); }, {}, main_thread ) };
+        const auto windows{ graph.add(
+            "windows", [this]() { create_windows(); }, { glfw },
+            main_thread ) };
+        // GLFW is only needed for the surface extension names.
+        const auto instance{ graph.add(
+            "instance", [this]() { create_instance(); }, { glfw } ) };
+        // Ahead of anything else on the instance, so validation sees it.
+        const auto messenger{ graph.add(
+            "debug_messenger", [this]() { setup_debug_messenger(); },
+            { instance } ) };
+        const auto surfaces{ graph.add(
+            "surfaces", [this]() { create_surfaces(); },
+            { messenger, windows } ) };
+        const auto shaders{ graph.add( "read_shaders", [&]() {
+            const auto paths{ shader_paths() };
+            vert_shader_code = read_file( paths.vertex );
+            frag_shader_code = read_file( paths.fragment );
+        } ) };
+        // Everything about the devices that doesn't need a surface.
+        const auto rank{ graph.add(
+            "rank_devices",
+            [&]() { device_candidates = rank_physical_devices(); },
+            { messenger } ) };
+        const auto pick{ graph.add(
+            "pick_device",
+            [&]() { pick_physical_device( device_candidates ); },
+            { rank, surfaces } ) };
+        const auto device{ graph.add(
+            "device", [this]() { create_logical_device(); }, { pick } ) };
+        const auto texture{ graph.add(
+            "texture", [this]() { load_texture(); }, { device } ) };
+        // Streams in while the rest is set up.
+        const auto mesh{ graph.add( "mesh", [this]() { load_mesh(); },
+                                    { device } ) };
+        // choose_swap_extent() asks GLFW for the framebuffer size.
+        const auto swap_chains{ graph.add(
+            "swap_chains", [this]() { create_swap_chains(); }, { device },
+            main_thread ) };
+        const auto image_views{ graph.add(
+            "image_views", [this]() { create_image_views(); },
+            { swap_chains } ) };
+        const auto depth{ graph.add(
+            "depth_resources", [this]() { create_depth_resources(); },
+            { swap_chains } ) };
+        const auto render_pass{ graph.add(
+            "render_pass", [this]() { create_render_pass(); },
+            { swap_chains, depth } ) };
+        // Ahead of the mesh and pipeline, which register with it.
+        const auto stream_capture{ graph.add(
+            "stream_capture", [this]() { create_stream_capture(); },
+            { swap_chains, depth } ) };
+        // Doesn't wait for the mesh, only the options decide the layout.
+        graph.add(
+            "graphics_pipeline",
+            [&]() {
+                create_graphics_pipeline( vert_shader_code, frag_shader_code );
+            },
+            { render_pass, shaders, texture, stream_capture } );
+        graph.add( "finish_mesh_load", [this]() { finish_mesh_load(); },
+                   { mesh, stream_capture } );
+        graph.add( "framebuffers", [this]() { create_framebuffers(); },
+                   { render_pass, image_views, depth, stream_capture } );
+        const auto command_pool{ graph.add(
+            "command_pool", [this]() { create_command_pool(); },
+            { device } ) };
+        graph.add( "command_buffers", [this]() { create_command_buffers(); },
+                   { command_pool } );
+        graph.add( "sync_objects", [this]() { create_sync_objects(); },
+                   { swap_chains } );
+        graph.add( "frame_capture", [this]() { create_frame_capture(); },
+                   { swap_chains } );
+        graph.add( "metrics_export", [this]() { start_metrics_export(); },
+                   { device } );
+
         try {
-            create_instance();
-            setup_debug_messenger();
-            create_surface();
-            pick_physical_device();
-            create_logical_device();
-            create_swap_chain();
-            create_image_views();
-            create_render_pass();
-            create_graphics_pipeline();
-            create_framebuffers();
+            if ( m_options.serial_init ) {
+                graph.run_serial();
+            }
+            else {
+                ThreadPool pool( INIT_THREAD_COUNT );
+                graph.run( pool );
+            }
         }
         catch ( const std::exception & err ) {
             std::cerr << err.what() << std::endl;
-            return;
+            // The upload still uses the device; let it land first.
+            if ( m_pending_mesh.valid() ) {
+                m_pending_mesh.wait();
+            }
+            throw;
         }
+        m_init_seconds = graph.wall_seconds();
+        report_init_stats( graph );
     }
     void main_loop() {
-        while ( !glfwWindowShouldClose( m_window ) ) { glfwPollEvents(); }
+        bool reload_held{ false };
+        // Closing any window ends the run.
+        const auto any_closed = [this]() {
+            return std::any_of( m_surfaces.begin(), m_surfaces.end(),
+                                []( const WindowSurface & surface ) {
+                                    return glfwWindowShouldClose(
+                                        surface.window );
+                                } );
+        };
+        const auto start{ std::chrono::steady_clock::now() };
+        while ( !any_closed()
+                && ( !m_options.frame_limit
+                     || m_frame_number < m_options.frame_limit.value() ) ) {
+            glfwPollEvents();
+
+            // R swaps in a freshly built pipeline without idling the device.
+            const bool reload_pressed{ std::any_of(
+                m_surfaces.begin(), m_surfaces.end(),
+                []( const WindowSurface & surface ) {
+                    return glfwGetKey( surface.window, GLFW_KEY_R )
+                           == GLFW_PRESS;
+                } ) };
+            if ( reload_pressed && !reload_held
+                 && !m_pending_pipeline.valid() ) {
+                reload_graphics_pipeline();
+            }
+            reload_held = reload_pressed;
+            install_reloaded_pipeline();
+
+            draw_frame();
+            if ( m_frame_number == 1 ) {
+                report_first_frame();
+            }
+        }
+
+        if ( m_pending_pipeline.valid() ) {
+            m_pending_pipeline.wait();
+            install_reloaded_pipeline();
+        }
+        release_acquired_images();
+        // vkDeviceWaitIdle needs the queues to itself.
+        m_submit_thread->wait_idle();
+        m_submit_thread->check();
+        vkDeviceWaitIdle( m_device );
+        report_surface_stats( std::chrono::duration<double>(
+                                  std::chrono::steady_clock::now() - start )
+                                  .count() );
+
+        if ( m_capture && m_frame_number > 0 ) {
+            m_capture->frame_completed( m_frame_number - 1 );
+            report_capture_stats( m_capture->finish() );
+        }
+        if ( m_stream_capture
+             && m_stream_capture->frame() >= m_frame_number ) {
+            std::cerr << "Frame " << m_stream_capture->frame()
+                      << " was never drawn, nothing written to "
+                      << m_stream_capture->path() << std::endl;
+        }
+        if ( m_texture_streamer ) {
+            report_texture_stats( m_texture_streamer->stats() );
+        }
+        report_submit_stats( m_submit_thread->stats() );
+        report_host_memory_stats( m_host_allocator.stats() );
+    }
+    void report_init_stats( const InitGraph & graph ) const {
+        std::cout << "Init: " << graph.size() << " steps, "
+                  << graph.work_seconds() * 1000.0 << " ms of work in "
+                  << graph.wall_seconds() * 1000.0 << " ms ("
+                  << ( m_options.serial_init
+                           ? std::string{ "serial" }
+                           : std::to_string( INIT_THREAD_COUNT )
+                                 + " threads" )
+                  << ")" << std::endl;
+        if ( m_options.serial_init ) {
+            return;
+        }
+        std::cout << "Init critical path:";
+        for ( const auto id : graph.critical_path() ) {
+            std::cout << " " << graph.name( id ) << " "
+                      << ( graph.end_seconds( id ) - graph.start_seconds( id ) )
+                             * 1000.0
+                      << " ms";
+        }
+        std::cout << std::endl;
+    }
+    // Up to the first present leaving the submit thread, which is waited for
+    // this once.
+    void report_first_frame() {
+        m_submit_thread->wait_issued( m_present_ticket );
+        const std::chrono::duration<double, std::milli> elapsed{
+            std::chrono::steady_clock::now() - m_run_start };
+        std::cout << "Time to first frame: " << elapsed.count() << " ms (init "
+                  << m_init_seconds * 1000.0 << " ms)" << std::endl;
+    }
+    void report_submit_stats( const SubmitStats & stats ) const {
+        std::cout << "Submit thread: " << stats.submissions
+                  << " submissions in " << stats.submit_calls
+                  << " vkQueueSubmit calls (up to " << stats.max_coalesced
+                  << " per call), " << stats.presents << " presents, "
+                  << stats.acquires << " acquires, "
+                  << stats.issue_waits << " waits for it ("
+                  << stats.issue_wait_seconds * 1000.0 << " ms)" << std::endl;
+    }
+    void report_capture_stats( const FrameCaptureStats & stats ) const {
+        constexpr double mib{ 1024.0 * 1024.0 };
+        std::cout << "Captured " << stats.frames << " frames ("
+                  << static_cast<double>( stats.bytes ) / mib << " MiB) in "
+                  << stats.seconds << " s: " << stats.frames_per_second()
+                  << " frames/s, " << stats.bytes_per_second() / mib
+                  << " MiB/s" << std::endl;
+    }
+    void
+    report_stream_capture_stats( const CommandCaptureStats & stats ) const {
+        std::cout << "Captured frame " << m_stream_capture->frame() << " to "
+                  << m_stream_capture->path() << ": " << stats.commands
+                  << " commands, " << stats.draws << " draws, "
+                  << stats.pipelines << " pipelines, " << stats.buffers
+                  << " buffers, " << stats.file_bytes / 1024 << " KiB"
+                  << std::endl;
+    }
+    void report_surface_stats( const double seconds ) const {
+        for ( std::size_t i{ 0 }; i < m_surfaces.size(); ++i ) {
+            const auto & stats{ m_surfaces[i].stats };
+            const double frames{ static_cast<double>(
+                std::max<std::uint64_t>( stats.frames, 1 ) ) };
+            std::cout << "Surface " << i << " (" << m_surfaces[i].extent.width
+                      << "x" << m_surfaces[i].extent.height
+                      << "): " << stats.frames << " frames, "
+                      << ( seconds > 0.0
+                               ? static_cast<double>( stats.frames ) / seconds
+                               : 0.0 )
+                      << " frames/s, acquire avg "
+                      << stats.acquire_seconds * 1000.0 / frames
+                      << " ms max " << stats.max_acquire_seconds * 1000.0
+                      << " ms, "
+                      << stats.suboptimal + stats.present_suboptimal
+                      << " suboptimal"
+                      << std::endl;
+        }
+    }
+    // Current bytes are what is still alive with the device idle; peaks cover
+    // the whole run.
+    void report_host_memory_stats( const HostMemoryStats & stats ) const {
+        constexpr double kib{ 1024.0 };
+        const auto       print = []( const std::string_view  name,
+                               const HostMemoryUsage & usage ) {
+            std::cout << "  " << name << ": "
+                      << static_cast<double>( usage.bytes ) / kib
+                      << " KiB live in " << usage.live << ", peak "
+                      << static_cast<double>( usage.peak_bytes ) / kib
+                      << " KiB, " << usage.allocations << " allocations"
+                      << std::endl;
+        };
+
+        std::cout << "Host memory: " << stats.arena_allocations
+                  << " arena, " << stats.pool_allocations << " pool, "
+                  << stats.heap_allocations << " heap allocations"
+                  << std::endl;
+        print( "total", stats.total );
+        for ( std::size_t i{ 0 }; i < HOST_MEMORY_SCOPE_COUNT; ++i ) {
+            if ( stats.scopes[i].allocations != 0 ) {
+                print( to_string( static_cast<VkSystemAllocationScope>( i ) ),
+                       stats.scopes[i] );
+            }
+        }
+        for ( std::size_t i{ 0 }; i < HOST_MEMORY_SUBSYSTEM_COUNT; ++i ) {
+            if ( stats.subsystems[i].allocations != 0 ) {
+                print( to_string( static_cast<HostMemorySubsystem>( i ) ),
+                       stats.subsystems[i] );
+            }
+        }
+        for ( std::size_t i{ 0 }; i < HOST_MEMORY_SCOPE_COUNT; ++i ) {
+            if ( stats.internal[i].allocations != 0 ) {
+                print( std::string{ "internal " }
+                           + std::string{ to_string(
+                               static_cast<VkSystemAllocationScope>( i ) ) },
+                       stats.internal[i] );
+            }
+        }
+    }
+    void report_texture_stats( const TextureStreamerStats & stats ) const {
+        constexpr double mib{ 1024.0 * 1024.0 };
+        std::cout << "Textures: " << stats.textures << " ("
+                  << stats.decoded_textures << " decoded on the CPU), "
+                  << stats.uploads << " uploads, " << stats.evictions
+                  << " evictions, "
+                  << static_cast<double>( stats.resident_bytes ) / mib
+                  << " MiB resident, peak "
+                  << static_cast<double>( stats.peak_resident_bytes ) / mib
+                  << " MiB" << std::endl;
     }
     void cleanup() {
-        for ( auto framebuffer : m_swapchain_framebuffers ) {
-            vkDestroyFramebuffer( m_device, framebuffer, nullptr );
+        // Collectors read the device and allocator, so exporting stops
+        // first. The file gets one last write on the way out.
+        m_metrics_server.reset();
+        m_metrics_writer.reset();
+
+        // Device is idle at this point, so anything still queued can go.
+        m_deletion_queue.flush();
+
+        m_capture.reset();
+        m_frame_timeline.reset();
+        m_in_flight_fences.clear();
+        m_command_pool.reset();
+        for ( auto & surface : m_surfaces ) {
+            surface.render_finished_semaphores.clear();
+            surface.image_available_semaphores.clear();
+            surface.framebuffers.clear();
         }
-        vkDestroyPipeline( m_device, m_graphics_pipeline, nullptr );
-        vkDestroyPipelineLayout( m_device, m_pipeline_layout, nullptr );
-        vkDestroyRenderPass( m_device, m_render_pass, nullptr );
-        for ( auto image_view : m_swapchain_image_views ) {
-            vkDestroyImageView( m_device, image_view, nullptr );
+        m_graphics_pipeline.reset();
+        m_pipeline_layout.reset();
+        m_render_pass.reset();
+        for ( auto & surface : m_surfaces ) {
+            surface.depth_image_view.reset();
+            surface.depth_image = {};
+            surface.image_views.clear();
+            surface.swapchain.reset();
         }
-        vkDestroySwapchainKHR( m_device, m_swapchain, nullptr );
-        vkDestroyDevice( m_device, nullptr );
-        if ( m_enable_validation_layers ) {
-            destroy_debug_utils_messenger_EXT( m_instance, m_debug_messenger,
-                                               nullptr );
+        m_descriptor_pool.reset();
+        m_texture_set_layout.reset();
+        m_sampler_cache.reset();
+        m_texture_streamer.reset();
+        m_mesh.reset();
+        m_submit_thread.reset();
+        m_device.reset();
+        m_debug_messenger.reset();
+        for ( auto & surface : m_surfaces ) {
+            surface.surface.reset();
+            glfwDestroyWindow( surface.window );
         }
-        vkDestroySurfaceKHR( m_instance, m_surface, nullptr );
-        vkDestroyInstance( m_instance, nullptr );
-        glfwDestroyWindow( m_window );
+        m_surfaces.clear();
+        m_instance.reset();
         glfwTerminate();
     }
     void setup_debug_messenger() {
@@ -274,10 +831,16 @@ class HelloTriangleApp
         }
 
         VkDebugUtilsMessengerCreateInfoEXT create_info;
-        populate_debug_messenger_create_info( create_info, debug_callback );
-
-        if ( create_debug_utils_messenger_EXT( m_instance, &create_info,
-                                               nullptr, &m_debug_messenger ) ) {
+        populate_debug_messenger_create_info( create_info, debug_callback,
+                                              &m_app_metrics );
+
+        const auto * allocator{ m_host_allocator.callbacks(
+            HostMemorySubsystem::instance ) };
+        if ( m_instance_dispatch.create_debug_utils_messenger_ext == nullptr
+             || m_instance_dispatch.create_debug_utils_messenger_ext(
+                    m_instance, &create_info, allocator,
+                    m_debug_messenger.put( &m_instance_dispatch, allocator ) )
+                    != VK_SUCCESS ) {
             throw std::runtime_error( "Debug messenger setup failed." );
         }
     }
@@ -339,7 +902,9 @@ class HelloTriangleApp
         app_info.applicationVersion = VK_MAKE_VERSION( 1, 0, 0 );
         app_info.pEngineName = "No Engine";
         app_info.engineVersion = VK_MAKE_VERSION( 1, 0, 0 );
-        app_info.apiVersion = VK_MAKE_VERSION( 1, 0, 0 );
+        // As new as the loader allows; the device caps it further.
+        m_instance_api_version = negotiate_instance_api_version();
+        app_info.apiVersion = m_instance_api_version;
 
         // Mandatory, tells Vulkan driver about global extensions & validation
         // layers
@@ -362,8 +927,8 @@ class HelloTriangleApp
                 static_cast<uint32_t>( m_validation_layers.size() );
             create_info.ppEnabledLayerNames = m_validation_layers.data();
 
-            populate_debug_messenger_create_info( debug_create_info,
-                                                  debug_callback );
+            populate_debug_messenger_create_info(
+                debug_create_info, debug_callback, &m_app_metrics );
             create_info.pNext =
                 reinterpret_cast<VkDebugUtilsMessengerCreateInfoEXT *>(
                     &debug_create_info );
@@ -374,15 +939,18 @@ class HelloTriangleApp
         }
 
         // Create the Vulkan instance
-        VkResult result =
-            vkCreateInstance( &create_info, nullptr, &m_instance );
+        const auto * allocator{ m_host_allocator.callbacks(
+            HostMemorySubsystem::instance ) };
+        VkResult result = vkCreateInstance( &create_info, allocator,
+                                            m_instance.put( allocator ) );
         if ( result != VK_SUCCESS ) {
             throw std::runtime_error(
                 "Failed to create Vulkan instance, error code: "
                 + std::to_string( result ) );
         }
+        m_instance_dispatch = InstanceDispatch::load( m_instance );
     }
-    void create_logical_device() noexcept {
+    void create_logical_device() {
         QueueFamilyIndices indices{ find_queue_families( m_physical_device ) };
 
         std::vector<VkDeviceQueueCreateInfo> queue_create_infos;
@@ -401,19 +969,42 @@ class HelloTriangleApp
             queue_create_infos.push_back( queue_create_info );
         }
 
-        // For use later with more advanced Vulkan features
-        VkPhysicalDeviceFeatures device_features{};
+        // BC textures are sampled directly where possible, otherwise the
+        // texture streamer decodes them. Without timeline semaphores or
+        // synchronization2 the frame loop falls back to fences and legacy
+        // barriers.
+        DeviceFeatureRequest request{};
+        request.core.textureCompressionBC = VK_TRUE;
+        request.timeline_semaphore = true;
+        request.synchronization2 = true;
+        m_device_features = negotiate_device_features(
+            m_physical_device, m_instance_api_version, request );
+        m_texture_compression_bc =
+            m_device_features.core.textureCompressionBC == VK_TRUE;
+
+        std::vector<const char *> extensions{ m_device_extensions };
+        extensions.insert( extensions.end(),
+                           m_device_features.extensions.begin(),
+                           m_device_features.extensions.end() );
+
+        // Budget queries go through vkGetPhysicalDeviceMemoryProperties2.
+        m_memory_budget =
+            m_device_features.api_version >= VK_API_VERSION_1_1
+            && has_device_extension( m_physical_device,
+                                     VK_EXT_MEMORY_BUDGET_EXTENSION_NAME );
+        if ( m_memory_budget ) {
+            extensions.push_back( VK_EXT_MEMORY_BUDGET_EXTENSION_NAME );
+        }
 
         VkDeviceCreateInfo create_info{};
         create_info.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
         create_info.queueCreateInfoCount =
             static_cast<uint32_t>( queue_create_infos.size() );
         create_info.pQueueCreateInfos = queue_create_infos.data();
-        create_info.queueCreateInfoCount = 1;
-        create_info.pEnabledFeatures = &device_features;
+        m_device_features.apply( create_info );
         create_info.enabledExtensionCount =
-            static_cast<uint32_t>( m_device_extensions.size() );
-        create_info.ppEnabledExtensionNames = m_device_extensions.data();
+            static_cast<uint32_t>( extensions.size() );
+        create_info.ppEnabledExtensionNames = extensions.data();
 
         if ( m_enable_validation_layers ) {
             create_info.enabledLayerCount =
@@ -424,31 +1015,51 @@ class HelloTriangleApp
             create_info.enabledLayerCount = 0;
         }
 
-        if ( vkCreateDevice( m_physical_device, &create_info, nullptr,
-                             &m_device )
+        const auto * allocator{ m_host_allocator.callbacks(
+            HostMemorySubsystem::device ) };
+        if ( vkCreateDevice( m_physical_device, &create_info, allocator,
+                             m_device.put( allocator ) )
              != VK_SUCCESS ) {
-            std::cerr << "Failed to create logical device." << std::endl;
-            exit( -1 );
-            // throw std::runtime_error( "Failed to create logical device." );
+            throw std::runtime_error( "Failed to create logical device." );
         }
 
+        m_dispatch = DeviceDispatch::load( m_instance_dispatch, m_device );
         vkGetDeviceQueue( m_device, indices.graphics_family(), 0,
                           &m_graphics_queue );
         vkGetDeviceQueue( m_device, indices.present_family(), 0,
                           &m_present_queue );
+        m_submit_thread = std::make_unique<SubmitThread>(
+            m_dispatch, m_graphics_queue, m_present_queue,
+            &m_app_metrics.submit, &m_app_metrics.present );
+
+        m_sync_functions =
+            SynchronizationFunctions::load( m_device, m_device_features );
+        std::cout << "Vulkan "
+                  << to_version_string( m_device_features.api_version )
+                  << ", timeline semaphores "
+                  << ( m_sync_functions.has_timeline_semaphore() ? "on"
+                                                                 : "off" )
+                  << ", synchronization2 "
+                  << ( m_sync_functions.has_synchronization2() ? "on" : "off" )
+                  << std::endl;
     }
-    void create_surface() {
-        if ( glfwCreateWindowSurface( m_instance, m_window, nullptr,
-                                      &m_surface )
-             != VK_SUCCESS ) {
-            throw std::runtime_error( "Failed to create window surface." );
+    void create_surfaces() {
+        const auto * allocator{ m_host_allocator.callbacks(
+            HostMemorySubsystem::swapchain ) };
+        for ( auto & surface : m_surfaces ) {
+            if ( glfwCreateWindowSurface(
+                     m_instance, surface.window, allocator,
+                     surface.surface.put( m_instance, allocator ) )
+                 != VK_SUCCESS ) {
+                throw std::runtime_error( "Failed to create window surface." );
+            }
         }
     }
     [[nodiscard]] static VKAPI_ATTR VkBool32 VKAPI_CALL debug_callback(
         VkDebugUtilsMessageSeverityFlagBitsEXT           message_severity,
         [[maybe_unused]] VkDebugUtilsMessageTypeFlagsEXT message_type,
         const VkDebugUtilsMessengerCallbackDataEXT *     p_callback_data,
-        [[maybe_unused]] void * p_user_data ) noexcept {
+        void * p_user_data ) noexcept {
         const time_t current_time{ time( NULL ) };
         const auto   time_str{ asctime( gmtime( &current_time ) ) };
 
@@ -456,6 +1067,18 @@ class HelloTriangleApp
         logfile << time_str << ": Validation layer - "
                 << p_callback_data->pMessage << std::endl;
 
+        if ( p_user_data != nullptr ) {
+            auto & metrics{ *static_cast<AppMetrics *>( p_user_data ) };
+            if ( message_severity
+                 >= VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT ) {
+                metrics.validation_errors.add();
+            }
+            else if ( message_severity
+                      >= VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT ) {
+                metrics.validation_warnings.add();
+            }
+        }
+
         if ( message_severity
              >= VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT ) {
             std::cerr << time_str << ": Validation layer - "
@@ -465,7 +1088,7 @@ class HelloTriangleApp
         return VK_FALSE;
     }
     [[nodiscard]] const auto
-    check_device_extension_support( VkPhysicalDevice device ) const noexcept {
+    check_device_extension_support( VkPhysicalDevice device ) const {
         uint32_t extension_count;
         vkEnumerateDeviceExtensionProperties( device, nullptr, &extension_count,
                                               nullptr );
@@ -484,26 +1107,27 @@ class HelloTriangleApp
 
         return required_extensions.empty();
     }
+    // What needs the surfaces, see rate_device_suitability() for the rest.
     [[nodiscard]] auto is_device_suitable( VkPhysicalDevice device ) {
-        QueueFamilyIndices indices{ find_queue_families( device ) };
+        QueueFamilyIndices indices{ query_queue_families( device ) };
 
-        const bool extensions_supported{ check_device_extension_support(
-            device ) };
-
-        bool swap_chain_adequate{ false };
-        if ( extensions_supported ) {
+        bool swap_chain_adequate{ true };
+        for ( const auto & surface : m_surfaces ) {
+            if ( !swap_chain_adequate ) {
+                break;
+            }
             const auto swapchain_support{ query_swapchain_support(
-                device, m_surface ) };
+                device, surface.surface ) };
             swap_chain_adequate = !swapchain_support.formats.empty()
                                   && !swapchain_support.present_modes.empty();
         }
 
-        return indices.is_complete() && extensions_supported
-               && swap_chain_adequate;
+        return indices.is_complete() && swap_chain_adequate;
     }
+    // Runs before the surfaces exist, so only what doesn't need them.
     [[nodiscard]] int
-    rate_device_suitability( const VkPhysicalDevice device ) noexcept {
-        if ( !is_device_suitable( device ) ) {
+    rate_device_suitability( const VkPhysicalDevice device ) {
+        if ( !check_device_extension_support( device ) ) {
             return 0;
         }
 
@@ -530,7 +1154,7 @@ class HelloTriangleApp
 
         return score;
     }
-    void pick_physical_device() {
+    [[nodiscard]] std::multimap<int, VkPhysicalDevice> rank_physical_devices() {
         uint32_t device_count{ 0 };
         vkEnumeratePhysicalDevices( m_instance, &device_count, nullptr );
 
@@ -542,27 +1166,36 @@ class HelloTriangleApp
         std::vector<VkPhysicalDevice> devices( device_count );
         vkEnumeratePhysicalDevices( m_instance, &device_count, devices.data() );
 
-        // Ordered map to
+        // Ordered by score, best last.
         std::multimap<int, VkPhysicalDevice> device_candidates;
         for ( const auto & device : devices ) {
             const int score = rate_device_suitability( device );
             device_candidates.insert( std::make_pair( score, device ) );
         }
-
-        // Check if the best candidate is suitable at all
+        return device_candidates;
+    }
+    // Best rated device that can present to every window.
+    void pick_physical_device(
+        const std::multimap<int, VkPhysicalDevice> & device_candidates ) {
 #ifndef __APPLE__
-        if ( device_candidates.rbegin()->first > 0 ) {
+        constexpr int min_score{ 1 };
 #else
-        if ( device_candidates.rbegin()->first >= 0 ) {
+        constexpr int min_score{ 0 };
 #endif
-            m_physical_device = device_candidates.rbegin()->second;
-        }
-        else {
-            throw std::runtime_error( "Failed to find suitable GPU." );
+        for ( auto candidate{ device_candidates.rbegin() };
+              candidate != device_candidates.rend()
+              && candidate->first >= min_score;
+              ++candidate ) {
+            if ( is_device_suitable( candidate->second ) ) {
+                m_physical_device = candidate->second;
+                return;
+            }
         }
+        throw std::runtime_error( "Failed to find suitable GPU." );
     }
+    // Whatever the device has, possibly incomplete.
     [[nodiscard]] struct QueueFamilyIndices
-    find_queue_families( VkPhysicalDevice device ) {
+    query_queue_families( VkPhysicalDevice device ) {
         QueueFamilyIndices indices;
         uint32_t           queue_family_count{ 0 };
         vkGetPhysicalDeviceQueueFamilyProperties( device, &queue_family_count,
@@ -578,9 +1211,15 @@ class HelloTriangleApp
                 indices.graphics_family( i );
             }
 
-            VkBool32 present_support{ false };
-            vkGetPhysicalDeviceSurfaceSupportKHR( device, i, m_surface,
-                                                  &present_support );
+            // A single present call needs one queue that reaches every
+            // window.
+            bool present_support{ true };
+            for ( const auto & surface : m_surfaces ) {
+                VkBool32 supported{ VK_FALSE };
+                vkGetPhysicalDeviceSurfaceSupportKHR(
+                    device, i, surface.surface, &supported );
+                present_support = present_support && supported == VK_TRUE;
+            }
 
             if ( present_support ) {
                 indices.present_family( i );
@@ -593,15 +1232,30 @@ class HelloTriangleApp
             i++;
         }
 
+        return indices;
+    }
+    [[nodiscard]] struct QueueFamilyIndices
+    find_queue_families( VkPhysicalDevice device ) {
+        const QueueFamilyIndices indices{ query_queue_families( device ) };
         if ( !indices.is_complete() ) {
             throw std::runtime_error(
                 "Unable to find queues for all requirements." );
         }
-
         return indices;
     }
     [[nodiscard]] VkSurfaceFormatKHR choose_swap_surface_format(
         const std::vector<VkSurfaceFormatKHR> & available_formats ) {
+        // Later windows have to match the first, the render pass and
+        // pipelines are shared.
+        if ( m_swapchain_image_format != VK_FORMAT_UNDEFINED ) {
+            for ( const auto & available_format : available_formats ) {
+                if ( available_format.format == m_swapchain_image_format ) {
+                    return available_format;
+                }
+            }
+            throw std::runtime_error(
+                "Windows don't share a common swapchain format." );
+        }
         for ( const auto & available_format : available_formats ) {
             if ( available_format.format == VK_FORMAT_B8G8R8A8_SRGB
                  && available_format.colorSpace
@@ -614,6 +1268,14 @@ class HelloTriangleApp
     }
     [[nodiscard]] VkPresentModeKHR choose_swap_present_mode(
         const std::vector<VkPresentModeKHR> & available_present_modes ) {
+        // Captured frames should be produced as fast as the GPU allows.
+        if ( m_options.capture ) {
+            for ( const auto & present_mode : available_present_modes ) {
+                if ( present_mode == VK_PRESENT_MODE_IMMEDIATE_KHR ) {
+                    return present_mode;
+                }
+            }
+        }
         for ( const auto & present_mode : available_present_modes ) {
             if ( present_mode == VK_PRESENT_MODE_MAILBOX_KHR ) {
                 return present_mode;
@@ -622,14 +1284,15 @@ class HelloTriangleApp
         return VK_PRESENT_MODE_FIFO_KHR;
     }
     [[nodiscard]] VkExtent2D
-    choose_swap_extent( const VkSurfaceCapabilitiesKHR & capabilities ) {
+    choose_swap_extent( const VkSurfaceCapabilitiesKHR & capabilities,
+                        GLFWwindow *                     window ) {
         if ( capabilities.currentExtent.width
              != std::numeric_limits<std::uint32_t>::max() ) {
             return capabilities.currentExtent;
         }
         else {
             int width, height;
-            glfwGetFramebufferSize( m_window, &width, &height );
+            glfwGetFramebufferSize( window, &width, &height );
 
             VkExtent2D actual_extent{
                 std::clamp( static_cast<std::uint32_t>( width ),
@@ -643,18 +1306,23 @@ class HelloTriangleApp
             return actual_extent;
         }
     }
-    void create_swap_chain() {
+    void create_swap_chains() {
+        for ( auto & surface : m_surfaces ) {
+            create_swap_chain( surface );
+        }
+    }
+    void create_swap_chain( WindowSurface & surface ) {
         SwapChainSupportDetails swap_chain_support =
-            query_swapchain_support( m_physical_device, m_surface );
+            query_swapchain_support( m_physical_device, surface.surface );
 
         VkSurfaceFormatKHR surface_format =
             choose_swap_surface_format( swap_chain_support.formats );
         m_swapchain_image_format = surface_format.format;
         VkPresentModeKHR present_mode =
             choose_swap_present_mode( swap_chain_support.present_modes );
-        VkExtent2D extent =
-            choose_swap_extent( swap_chain_support.capabilities );
-        m_swapchain_extent = extent;
+        VkExtent2D extent = choose_swap_extent( swap_chain_support.capabilities,
+                                                surface.window );
+        surface.extent = extent;
 
         std::uint32_t image_count{ std::clamp(
             swap_chain_support.capabilities.minImageCount + 5,
@@ -663,13 +1331,21 @@ class HelloTriangleApp
 
         VkSwapchainCreateInfoKHR create_info{};
         create_info.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR;
-        create_info.surface = m_surface;
+        create_info.surface = surface.surface;
         create_info.minImageCount = image_count;
         create_info.imageFormat = surface_format.format;
         create_info.imageColorSpace = surface_format.colorSpace;
         create_info.imageExtent = extent;
         create_info.imageArrayLayers = 1;
         create_info.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+        if ( m_options.capture ) {
+            if ( !( swap_chain_support.capabilities.supportedUsageFlags
+                    & VK_IMAGE_USAGE_TRANSFER_SRC_BIT ) ) {
+                throw std::runtime_error(
+                    "Swapchain images can't be read back for capture." );
+            }
+            create_info.imageUsage |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+        }
 
         QueueFamilyIndices indices = find_queue_families( m_physical_device );
         std::uint32_t      queue_family_indices[] = { indices.graphics_family(),
@@ -695,24 +1371,38 @@ class HelloTriangleApp
 
         create_info.oldSwapchain = VK_NULL_HANDLE;
 
-        if ( vkCreateSwapchainKHR( m_device, &create_info, nullptr,
-                                   &m_swapchain )
+        const auto * allocator{ m_host_allocator.callbacks(
+            HostMemorySubsystem::swapchain ) };
+        if ( vkCreateSwapchainKHR( m_device, &create_info, allocator,
+                                   surface.swapchain.put( m_device,
+                                                          allocator ) )
              != VK_SUCCESS ) {
             throw std::runtime_error( "Failed to create swapchain." );
         }
 
-        vkGetSwapchainImagesKHR( m_device, m_swapchain, &image_count, nullptr );
-        m_swapchain_images.resize( image_count );
-        vkGetSwapchainImagesKHR( m_device, m_swapchain, &image_count,
-                                 m_swapchain_images.data() );
+        vkGetSwapchainImagesKHR( m_device, surface.swapchain, &image_count,
+                                 nullptr );
+        surface.images.resize( image_count );
+        vkGetSwapchainImagesKHR( m_device, surface.swapchain, &image_count,
+                                 surface.images.data() );
+        surface.acquire_ahead =
+            image_count > swap_chain_support.capabilities.minImageCount;
     }
     void create_image_views() {
-        m_swapchain_image_views.resize( m_swapchain_images.size() );
+        for ( auto & surface : m_surfaces ) {
+            create_image_views( surface );
+        }
+    }
+    void create_image_views( WindowSurface & surface ) {
+        const auto * allocator{ m_host_allocator.callbacks(
+            HostMemorySubsystem::swapchain ) };
+        surface.image_views.clear();
+        surface.image_views.resize( surface.images.size() );
 
-        for ( size_t i{ 0 }; i < m_swapchain_images.size(); ++i ) {
+        for ( size_t i{ 0 }; i < surface.images.size(); ++i ) {
             VkImageViewCreateInfo create_info{};
             create_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
-            create_info.image = m_swapchain_images[i];
+            create_info.image = surface.images[i];
 
             // Specifies how the image data is interpreted
             create_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
@@ -732,185 +1422,350 @@ class HelloTriangleApp
             create_info.subresourceRange.baseArrayLayer = 0;
             create_info.subresourceRange.layerCount = 1;
 
-            if ( vkCreateImageView( m_device, &create_info, nullptr,
-                                    &m_swapchain_image_views[i] )
+            if ( vkCreateImageView( m_device, &create_info, allocator,
+                                    surface.image_views[i].put( m_device,
+                                                                allocator ) )
                  != VK_SUCCESS ) {
                 throw std::runtime_error( "Failed to create image view." );
             }
         }
     }
-    void create_graphics_pipeline() {
-        // Setting up shader modules
-        const auto vert_shader_code{ read_file( "shaders/triangle_vert.spv" ) };
-        const auto frag_shader_code{ read_file( "shaders/triangle_frag.spv" ) };
-
-        const auto vert_shader_mod =
-            create_shader_module( m_device, vert_shader_code );
-        const auto frag_shader_mod =
-            create_shader_module( m_device, frag_shader_code );
-
-        VkPipelineShaderStageCreateInfo vert_shader_create_info{};
-        vert_shader_create_info.sType =
-            VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-        vert_shader_create_info.stage = VK_SHADER_STAGE_VERTEX_BIT;
-        vert_shader_create_info.module = vert_shader_mod;
-        vert_shader_create_info.pName = "main";
-
-        VkPipelineShaderStageCreateInfo frag_shader_create_info{};
-        frag_shader_create_info.sType =
-            VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-        frag_shader_create_info.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
-        frag_shader_create_info.module = frag_shader_mod;
-        frag_shader_create_info.pName = "main";
-
-        VkPipelineShaderStageCreateInfo shader_stages[] = {
-            vert_shader_create_info, frag_shader_create_info
-        };
+    [[nodiscard]] VkFormat find_depth_format() const {
+        for ( const auto format :
+              { VK_FORMAT_D32_SFLOAT, VK_FORMAT_D32_SFLOAT_S8_UINT,
+                VK_FORMAT_D24_UNORM_S8_UINT } ) {
+            VkFormatProperties properties;
+            vkGetPhysicalDeviceFormatProperties( m_physical_device, format,
+                                                 &properties );
+            if ( properties.optimalTilingFeatures
+                 & VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT ) {
+                return format;
+            }
+        }
+        throw std::runtime_error( "Failed to find a supported depth format." );
+    }
+    void create_depth_resources() {
+        // One depth buffer per window is enough, the render pass dependency
+        // keeps frames in flight from touching it at the same time.
+        m_depth_format = find_depth_format();
+        const auto * allocator{ m_host_allocator.callbacks(
+            HostMemorySubsystem::swapchain ) };
+        for ( auto & surface : m_surfaces ) {
+            surface.depth_image = create_image(
+                m_physical_device, m_device, surface.extent, m_depth_format,
+                VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, 1, allocator );
+            surface.depth_image_view = create_image_view(
+                m_device, surface.depth_image.image, m_depth_format,
+                VK_IMAGE_ASPECT_DEPTH_BIT, 0, 1, allocator );
+        }
+    }
+    void load_mesh() {
+        if ( !m_options.mesh ) {
+            return;
+        }
+        const QueueFamilyIndices indices{ find_queue_families(
+            m_physical_device ) };
+
+        // The upload runs on a worker and goes out through the submit
+        // thread, like everything else on the graphics queue.
+        MeshUploadTarget target{};
+        target.physical_device = m_physical_device;
+        target.device = m_device;
+        target.dispatch = m_dispatch;
+        target.submit_thread = m_submit_thread.get();
+        target.queue_family = indices.graphics_family();
+        target.allocator =
+            m_host_allocator.callbacks( HostMemorySubsystem::resources );
+        m_pending_mesh = m_executor.spawn( load_mesh_async(
+            m_executor, target, m_options.mesh.value(), &m_mesh_stats ) );
+    }
+    void finish_mesh_load() {
+        if ( !m_pending_mesh.valid() ) {
+            return;
+        }
+        m_mesh = m_pending_mesh.get();
+        if ( m_stream_capture ) {
+            capture_mesh_buffers();
+        }
 
-        // Fixed functions
+        const auto & stats{ m_mesh_stats };
+        std::cout << "Loaded " << m_options.mesh.value() << ": "
+                  << m_mesh->vertex_count << " vertices, "
+                  << m_mesh->index_count / 3 << " triangles, "
+                  << stats.bytes / 1024 << " KiB in " << stats.seconds * 1000.0
+                  << " ms (" << ( stats.direct ? "direct" : "staged" ) << ")"
+                  << std::endl;
+    }
+    // The upload went straight to the GPU, so the contents are read again
+    // from the file.
+    void capture_mesh_buffers() {
+        const auto &     path{ m_options.mesh.value() };
+        const MappedFile file( path );
+        const auto &     header{ validate_mesh_file( file.data(), file.size(),
+                                                     path ) };
+        m_stream_capture->add_buffer(
+            m_mesh->vertex_buffer.buffer, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+            file.data() + header.vertex_offset,
+            std::size_t{ header.vertex_count } * header.vertex_stride );
+        m_stream_capture->add_buffer(
+            m_mesh->index_buffer.buffer, VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
+            file.data() + header.index_offset,
+            std::size_t{ header.index_count } * header.index_size );
+    }
+    void load_texture() {
+        if ( !m_options.texture ) {
+            return;
+        }
+        if ( !m_options.mesh ) {
+            throw std::runtime_error( "--texture needs a --mesh to map onto." );
+        }
+        const QueueFamilyIndices indices{ find_queue_families(
+            m_physical_device ) };
 
-        std::vector<VkDynamicState> dynamic_states{ VK_DYNAMIC_STATE_VIEWPORT,
-                                                    VK_DYNAMIC_STATE_SCISSOR };
+        TextureStreamerConfig config{};
+        config.bc_enabled = m_texture_compression_bc;
+        if ( m_options.texture_budget_mib ) {
+            config.budget = m_options.texture_budget_mib.value() << 20;
+        }
+        const auto * allocator{ m_host_allocator.callbacks(
+            HostMemorySubsystem::resources ) };
+        m_texture_streamer = std::make_unique<TextureStreamer>(
+            m_physical_device, m_device, m_dispatch, *m_submit_thread,
+            indices.graphics_family(), m_deletion_queue, config, allocator );
+        m_texture = m_texture_streamer->add( m_options.texture.value() );
+        m_sampler_cache =
+            std::make_unique<SamplerCache>( m_device, 1.0f, allocator );
+
+        VkDescriptorSetLayoutBinding binding{};
+        binding.binding = 0;
+        binding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        binding.descriptorCount = 1;
+        binding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+
+        VkDescriptorSetLayoutCreateInfo layout_info{};
+        layout_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+        layout_info.bindingCount = 1;
+        layout_info.pBindings = &binding;
+        if ( vkCreateDescriptorSetLayout(
+                 m_device, &layout_info, allocator,
+                 m_texture_set_layout.put( m_device, allocator ) )
+             != VK_SUCCESS ) {
+            throw std::runtime_error(
+                "Failed to create descriptor set layout." );
+        }
 
-        VkPipelineDynamicStateCreateInfo dynamic_state_info{};
-        dynamic_state_info.sType =
-            VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
-        dynamic_state_info.dynamicStateCount =
-            static_cast<uint32_t>( dynamic_states.size() );
-        dynamic_state_info.pDynamicStates = dynamic_states.data();
+        // One set per frame in flight, as the resident view changes while
+        // earlier frames are still sampling the old one.
+        VkDescriptorPoolSize pool_size{};
+        pool_size.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        pool_size.descriptorCount = MAX_FRAMES_IN_FLIGHT;
+
+        VkDescriptorPoolCreateInfo pool_info{};
+        pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+        pool_info.maxSets = MAX_FRAMES_IN_FLIGHT;
+        pool_info.poolSizeCount = 1;
+        pool_info.pPoolSizes = &pool_size;
+        if ( vkCreateDescriptorPool( m_device, &pool_info, allocator,
+                                     m_descriptor_pool.put( m_device,
+                                                            allocator ) )
+             != VK_SUCCESS ) {
+            throw std::runtime_error( "Failed to create descriptor pool." );
+        }
 
-        VkPipelineVertexInputStateCreateInfo vertex_input_info{};
-        vertex_input_info.sType =
-            VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-        vertex_input_info.vertexBindingDescriptionCount = 0;
-        vertex_input_info.pVertexBindingDescriptions = nullptr;
-        vertex_input_info.vertexAttributeDescriptionCount = 0;
-        vertex_input_info.pVertexAttributeDescriptions = nullptr;
+        const std::vector<VkDescriptorSetLayout> set_layouts(
+            MAX_FRAMES_IN_FLIGHT, m_texture_set_layout );
+        VkDescriptorSetAllocateInfo alloc_info{};
+        alloc_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        alloc_info.descriptorPool = m_descriptor_pool;
+        alloc_info.descriptorSetCount = MAX_FRAMES_IN_FLIGHT;
+        alloc_info.pSetLayouts = set_layouts.data();
+        m_texture_sets.resize( MAX_FRAMES_IN_FLIGHT );
+        if ( vkAllocateDescriptorSets( m_device, &alloc_info,
+                                       m_texture_sets.data() )
+             != VK_SUCCESS ) {
+            throw std::runtime_error( "Failed to allocate descriptor sets." );
+        }
+    }
+    // The current frame's set is free again once its fence has signalled, so
+    // it is pointed at whatever mips are resident now.
+    void update_texture_set() {
+        const VkDescriptorSet set{ m_texture_sets[m_current_frame] };
+
+        VkDescriptorImageInfo image_info{};
+        image_info.sampler = m_sampler_cache->get( SamplerDesc{} );
+        image_info.imageView = m_texture_streamer->view( m_texture );
+        image_info.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        if ( m_stream_capture ) {
+            const auto info{ m_texture_streamer->view_info( m_texture ) };
+            m_stream_capture->add_texture( image_info.imageView, info.format,
+                                           info.extent, info.levels );
+        }
 
-        VkPipelineInputAssemblyStateCreateInfo input_assembly{};
-        input_assembly.sType =
-            VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
-        input_assembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
-        input_assembly.primitiveRestartEnable = VK_FALSE;
+        VkWriteDescriptorSet write{};
+        write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        write.dstSet = set;
+        write.dstBinding = 0;
+        write.descriptorCount = 1;
+        write.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        write.pImageInfo = &image_info;
+        m_dispatch.update_descriptor_sets( m_device, 1, &write, 0, nullptr );
+    }
+    void bind_texture( VkCommandBuffer command_buffer ) {
+        const VkDescriptorSet set{ m_texture_sets[m_current_frame] };
+        m_dispatch.cmd_bind_descriptor_sets(
+            command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipeline_layout,
+            0, 1, &set, 0, nullptr );
+    }
+    // Each window looks at the mesh from its own side.
+    [[nodiscard]] MeshPushConstants
+    mesh_push_constants( const VkExtent2D extent,
+                         const std::size_t surface_index ) const {
+        const glm::vec3 lo{ m_mesh->bounds_min[0], m_mesh->bounds_min[1],
+                            m_mesh->bounds_min[2] };
+        const glm::vec3 hi{ m_mesh->bounds_max[0], m_mesh->bounds_max[1],
+                            m_mesh->bounds_max[2] };
+        const glm::vec3 center{ ( lo + hi ) * 0.5f };
+        const float     radius{ std::max( glm::length( hi - lo ) * 0.5f, 1e-3f ) };
+
+        // Slow turntable around the mesh centre.
+        const float angle{
+            static_cast<float>( glfwGetTime() ) * glm::radians( 30.0f )
+            + glm::radians( 360.0f ) * static_cast<float>( surface_index )
+                  / static_cast<float>( m_surfaces.size() ) };
+        const glm::mat4 model{
+            glm::rotate( glm::mat4( 1.0f ), angle, glm::vec3( 0.0f, 1.0f, 0.0f ) )
+            * glm::translate( glm::mat4( 1.0f ), -center ) };
+        const glm::mat4 view{ glm::lookAt(
+            glm::vec3( 0.0f, radius * 0.5f, radius * 2.5f ), glm::vec3( 0.0f ),
+            glm::vec3( 0.0f, 1.0f, 0.0f ) ) };
+        glm::mat4 projection{ glm::perspective(
+            glm::radians( 45.0f ),
+            static_cast<float>( extent.width )
+                / static_cast<float>( extent.height ),
+            radius * 0.1f, radius * 10.0f ) };
+        // GLM follows OpenGL's clip space, where y points up.
+        projection[1][1] *= -1.0f;
+
+        return { projection * view * model, model };
+    }
+    // Going by the options, as the first pipeline is built while the mesh
+    // and texture are still loading.
+    [[nodiscard]] ShaderPaths shader_paths() const {
+        return { m_options.mesh ? "shaders/mesh_vert.spv"
+                                : "shaders/triangle_vert.spv",
+                 m_options.texture ? "shaders/mesh_textured_frag.spv"
+                                   : "shaders/triangle_frag.spv" };
+    }
+    // Both shaders are read concurrently on the I/O pool, and everything
+    // after that runs on a worker, so a hot reload never stalls a frame.
+    [[nodiscard]] Task<BuiltPipeline> build_pipeline_async() {
+        const auto                           paths{ shader_paths() };
+        std::vector<Task<std::vector<char>>> reads;
+        reads.push_back( m_executor.read_file( paths.vertex ) );
+        reads.push_back( m_executor.read_file( paths.fragment ) );
+        const auto code{ co_await when_all( std::move( reads ) ) };
+        co_return build_pipeline( code[0], code[1] );
+    }
+    [[nodiscard]] BuiltPipeline
+    build_pipeline( const std::vector<char> & vert_shader_code,
+                    const std::vector<char> & frag_shader_code ) {
+        const ScopedMetricTimer timer( m_app_metrics.pipeline_compile );
+        const bool              textured{ m_texture_streamer != nullptr };
+        // m_mesh may not have landed yet, see init().
+        const bool mesh{ m_options.mesh.has_value() };
 
-        VkViewport viewport{};
-        viewport.x = 0.0f;
-        viewport.y = 0.0f;
-        viewport.width = static_cast<float>( m_swapchain_extent.width );
-        viewport.height = static_cast<float>( m_swapchain_extent.height );
-        viewport.minDepth = 0.0f;
-        viewport.maxDepth = 1.0f;
+        // Setting up shader modules
+        const auto * allocator{ m_host_allocator.callbacks(
+            HostMemorySubsystem::pipeline ) };
+        const auto vert_shader_mod =
+            create_shader_module( m_device, vert_shader_code, allocator );
+        const auto frag_shader_mod =
+            create_shader_module( m_device, frag_shader_code, allocator );
 
-        VkRect2D scissor{};
-        scissor.offset = { 0, 0 };
-        scissor.extent = m_swapchain_extent;
-
-        VkPipelineViewportStateCreateInfo viewport_state{};
-        viewport_state.sType =
-            VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
-        viewport_state.viewportCount = 1;
-        viewport_state.scissorCount = 1;
-
-        VkPipelineRasterizationStateCreateInfo rasterizer{};
-        rasterizer.sType =
-            VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
-        rasterizer.depthClampEnable = VK_FALSE;
-        rasterizer.rasterizerDiscardEnable = VK_FALSE;
-        rasterizer.polygonMode = VK_POLYGON_MODE_FILL;
-        rasterizer.lineWidth = 1.0f;
-        rasterizer.cullMode = VK_CULL_MODE_BACK_BIT;
-        rasterizer.frontFace = VK_FRONT_FACE_CLOCKWISE;
-        rasterizer.depthBiasEnable = VK_FALSE;
-        rasterizer.depthBiasConstantFactor = 0.0f;
-        rasterizer.depthBiasClamp = 0.0f;
-        rasterizer.depthBiasSlopeFactor = 0.0f;
-
-        // Multisampling (Disabled for now)
-        VkPipelineMultisampleStateCreateInfo multisampling{};
-        multisampling.sType =
-            VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
-        multisampling.sampleShadingEnable = VK_FALSE;
-        multisampling.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
-        multisampling.minSampleShading = 1.0f;
-        multisampling.pSampleMask = nullptr;
-        multisampling.alphaToCoverageEnable = VK_FALSE;
-        multisampling.alphaToOneEnable = VK_FALSE;
-
-        // Color blending
-        VkPipelineColorBlendAttachmentState color_blend_attachment{};
-        color_blend_attachment.colorWriteMask =
-            VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT
-            | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
-        color_blend_attachment.blendEnable = VK_FALSE;
-        color_blend_attachment.srcColorBlendFactor =
-            VK_BLEND_FACTOR_ONE; // Optional
-        color_blend_attachment.dstColorBlendFactor =
-            VK_BLEND_FACTOR_ZERO;                              // Optional
-        color_blend_attachment.colorBlendOp = VK_BLEND_OP_ADD; // Optional
-        color_blend_attachment.srcAlphaBlendFactor =
-            VK_BLEND_FACTOR_ONE; // Optional
-        color_blend_attachment.dstAlphaBlendFactor =
-            VK_BLEND_FACTOR_ZERO;                              // Optional
-        color_blend_attachment.alphaBlendOp = VK_BLEND_OP_ADD; // Optional
-
-        VkPipelineColorBlendStateCreateInfo color_blend{};
-        color_blend.sType =
-            VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
-        color_blend.logicOpEnable = VK_FALSE;
-        color_blend.logicOp = VK_LOGIC_OP_COPY;
-        color_blend.attachmentCount = 1;
-        color_blend.pAttachments = &color_blend_attachment;
-        color_blend.blendConstants[0] = 0.0f;
-        color_blend.blendConstants[1] = 0.0f;
-        color_blend.blendConstants[2] = 0.0f;
-        color_blend.blendConstants[3] = 0.0f;
-
-        // Pipeline layout
-
-        VkPipelineLayoutCreateInfo pipeline_layout_info{};
-        pipeline_layout_info.sType =
-            VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-        pipeline_layout_info.setLayoutCount = 0;
-        pipeline_layout_info.pSetLayouts = nullptr;
-        pipeline_layout_info.pushConstantRangeCount = 0;
-        pipeline_layout_info.pPushConstantRanges = nullptr;
-
-        if ( vkCreatePipelineLayout( m_device, &pipeline_layout_info, nullptr,
-                                     &m_pipeline_layout )
-             != VK_SUCCESS ) {
-            throw std::runtime_error( "Failed to create pipeline layout." );
-        }
-
-        // vkDestroyShaderModule( m_device, vert_shader_mod, nullptr );
-        // vkDestroyShaderModule( m_device, frag_shader_mod, nullptr );
-
-        VkGraphicsPipelineCreateInfo pipeline_info{};
-        pipeline_info.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
-        pipeline_info.stageCount = 2;
-        pipeline_info.pStages = shader_stages;
-        pipeline_info.pVertexInputState = &vertex_input_info;
-        pipeline_info.pInputAssemblyState = &input_assembly;
-        pipeline_info.pViewportState = &viewport_state;
-        pipeline_info.pRasterizationState = &rasterizer;
-        pipeline_info.pMultisampleState = &multisampling;
-        pipeline_info.pDepthStencilState = nullptr;
-        pipeline_info.pColorBlendState = &color_blend;
-        pipeline_info.pDynamicState = &dynamic_state_info;
-        pipeline_info.layout = m_pipeline_layout;
-        pipeline_info.renderPass = m_render_pass;
-        pipeline_info.subpass = 0;
-        pipeline_info.basePipelineHandle = VK_NULL_HANDLE;
-        pipeline_info.basePipelineIndex = -1;
-
-        if ( vkCreateGraphicsPipelines( m_device, VK_NULL_HANDLE, 1,
-                                        &pipeline_info, nullptr,
-                                        &m_graphics_pipeline )
-             != VK_SUCCESS ) {
-            throw std::runtime_error( "Failed to create graphics pipeline." );
+        const VkDescriptorSetLayout texture_set_layout{ m_texture_set_layout };
+        std::span<const VkDescriptorSetLayout> set_layouts{};
+        if ( textured ) {
+            set_layouts = { &texture_set_layout, 1 };
+        }
+        BuiltPipeline built{};
+        built.layout = create_pipeline_layout(
+            m_device, mesh ? sizeof( MeshPushConstants ) : 0, set_layouts,
+            allocator );
+
+        GraphicsPipelineDesc pipeline_desc{};
+        pipeline_desc.vertex_shader = vert_shader_mod;
+        pipeline_desc.fragment_shader = frag_shader_mod;
+        pipeline_desc.layout = built.layout;
+        pipeline_desc.render_pass = m_render_pass;
+        pipeline_desc.depth_test = true;
+        pipeline_desc.allocator = allocator;
+
+        // Meshes come from PackedVertex buffers, with the usual
+        // counter-clockwise winding once the projection has flipped y.
+        const auto vertex_binding{ mesh_vertex_binding() };
+        const auto vertex_attributes{ mesh_vertex_attributes() };
+        if ( mesh ) {
+            pipeline_desc.vertex_bindings = { &vertex_binding, 1 };
+            pipeline_desc.vertex_attributes = vertex_attributes;
+            pipeline_desc.front_face = VK_FRONT_FACE_COUNTER_CLOCKWISE;
         }
 
-        vkDestroyShaderModule( m_device, vert_shader_mod, nullptr );
-        vkDestroyShaderModule( m_device, frag_shader_mod, nullptr );
+        // Shader modules are released on scope exit, including on failure.
+        built.pipeline = build_graphics_pipeline( m_device, pipeline_desc );
+
+        if ( m_stream_capture ) {
+            StreamPipeline stream_desc{};
+            stream_desc.push_constant_size =
+                mesh ? sizeof( MeshPushConstants ) : 0;
+            stream_desc.front_face = pipeline_desc.front_face;
+            stream_desc.flags = STREAM_PIPELINE_DEPTH_TEST;
+            if ( mesh ) {
+                stream_desc.flags |= STREAM_PIPELINE_MESH_VERTICES;
+            }
+            if ( textured ) {
+                stream_desc.flags |= STREAM_PIPELINE_TEXTURED;
+            }
+            m_stream_capture->add_pipeline( built.pipeline, built.layout,
+                                            stream_desc, vert_shader_code,
+                                            frag_shader_code );
+        }
+        return built;
+    }
+    void
+    create_graphics_pipeline( const std::vector<char> & vert_shader_code,
+                              const std::vector<char> & frag_shader_code ) {
+        auto built{ build_pipeline( vert_shader_code, frag_shader_code ) };
+        m_pipeline_layout = std::move( built.layout );
+        m_graphics_pipeline = std::move( built.pipeline );
+    }
+    // Starts the rebuild; install_reloaded_pipeline() swaps it in.
+    void reload_graphics_pipeline() {
+        m_pending_pipeline = m_executor.spawn( build_pipeline_async() );
+    }
+    void install_reloaded_pipeline() {
+        if ( !m_pending_pipeline.valid()
+             || m_pending_pipeline.wait_for( std::chrono::seconds( 0 ) )
+                    != std::future_status::ready ) {
+            return;
+        }
+        BuiltPipeline built{};
+        try {
+            built = m_pending_pipeline.get();
+        }
+        catch ( const std::exception & err ) {
+            // A broken shader keeps the old pipeline running.
+            std::cerr << "Pipeline reload failed: " << err.what()
+                      << std::endl;
+            return;
+        }
+        // Frames still in flight may reference the current pipeline, so it is
+        // parked until the frame about to be recorded has retired.
+        m_deletion_queue.retire( m_frame_number,
+                                 std::move( m_graphics_pipeline ) );
+        m_deletion_queue.retire( m_frame_number,
+                                 std::move( m_pipeline_layout ) );
+        m_pipeline_layout = std::move( built.layout );
+        m_graphics_pipeline = std::move( built.pipeline );
     }
     void create_render_pass() {
         VkAttachmentDescription color_attachment{};
@@ -921,58 +1776,637 @@ class HelloTriangleApp
         color_attachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
         color_attachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
         color_attachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-        color_attachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+        // When capturing, the image is read back before being presented.
+        color_attachment.finalLayout =
+            m_options.capture ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL
+                              : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+
+        VkAttachmentDescription depth_attachment{};
+        depth_attachment.format = m_depth_format;
+        depth_attachment.samples = VK_SAMPLE_COUNT_1_BIT;
+        depth_attachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+        depth_attachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+        depth_attachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+        depth_attachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+        depth_attachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        depth_attachment.finalLayout =
+            VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+        const VkAttachmentDescription attachments[] = { color_attachment,
+                                                        depth_attachment };
 
         VkAttachmentReference color_attachment_ref{};
         color_attachment_ref.attachment = 0;
         color_attachment_ref.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
 
+        VkAttachmentReference depth_attachment_ref{};
+        depth_attachment_ref.attachment = 1;
+        depth_attachment_ref.layout =
+            VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
         VkSubpassDescription subpass{};
         subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
         subpass.colorAttachmentCount = 1;
         subpass.pColorAttachments = &color_attachment_ref;
+        subpass.pDepthStencilAttachment = &depth_attachment_ref;
+
+        // The swapchain image is only available once the acquire semaphore
+        // has been waited on at the colour attachment output stage. The depth
+        // buffer is shared by all frames, so the previous frame's depth
+        // writes must also be done before it is cleared.
+        VkSubpassDependency dependencies[2]{};
+        dependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
+        dependencies[0].dstSubpass = 0;
+        dependencies[0].srcStageMask =
+            VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT
+            | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+        dependencies[0].srcAccessMask =
+            VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+        dependencies[0].dstStageMask =
+            VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT
+            | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+        dependencies[0].dstAccessMask =
+            VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT
+            | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+
+        // Readback copies the attachment straight after the pass.
+        dependencies[1].srcSubpass = 0;
+        dependencies[1].dstSubpass = VK_SUBPASS_EXTERNAL;
+        dependencies[1].srcStageMask =
+            VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+        dependencies[1].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+        dependencies[1].dstStageMask = VK_PIPELINE_STAGE_TRANSFER_BIT;
+        dependencies[1].dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
 
         VkRenderPassCreateInfo render_pass_info{};
         render_pass_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
-        render_pass_info.attachmentCount = 1;
-        render_pass_info.pAttachments = &color_attachment;
+        render_pass_info.attachmentCount = 2;
+        render_pass_info.pAttachments = attachments;
         render_pass_info.subpassCount = 1;
         render_pass_info.pSubpasses = &subpass;
+        render_pass_info.dependencyCount = m_options.capture ? 2 : 1;
+        render_pass_info.pDependencies = dependencies;
 
-        if ( vkCreateRenderPass( m_device, &render_pass_info, nullptr,
-                                 &m_render_pass )
+        const auto * allocator{ m_host_allocator.callbacks(
+            HostMemorySubsystem::swapchain ) };
+        if ( vkCreateRenderPass( m_device, &render_pass_info, allocator,
+                                 m_render_pass.put( m_device, allocator ) )
              != VK_SUCCESS ) {
             throw std::runtime_error( "Failed to create render pass." );
         }
     }
     void create_framebuffers() {
-        m_swapchain_framebuffers.resize( m_swapchain_image_views.size() );
+        for ( auto & surface : m_surfaces ) {
+            create_framebuffers( surface );
+            if ( m_stream_capture ) {
+                const std::vector<VkFramebuffer> framebuffers(
+                    surface.framebuffers.begin(), surface.framebuffers.end() );
+                m_stream_capture->add_target( surface.extent, framebuffers,
+                                              surface.images );
+            }
+        }
+    }
+    void create_framebuffers( WindowSurface & surface ) {
+        const auto * allocator{ m_host_allocator.callbacks(
+            HostMemorySubsystem::swapchain ) };
+        surface.framebuffers.clear();
+        surface.framebuffers.resize( surface.image_views.size() );
 
-        for ( size_t i{ 0 }; i < m_swapchain_image_views.size(); ++i ) {
-            VkImageView attachments[] = { m_swapchain_image_views[i] };
+        for ( size_t i{ 0 }; i < surface.image_views.size(); ++i ) {
+            VkImageView attachments[] = { surface.image_views[i],
+                                          surface.depth_image_view };
 
             VkFramebufferCreateInfo framebuffer_info{};
             framebuffer_info.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
             framebuffer_info.renderPass = m_render_pass;
-            framebuffer_info.attachmentCount = 1;
+            framebuffer_info.attachmentCount = 2;
             framebuffer_info.pAttachments = attachments;
-            framebuffer_info.width = m_swapchain_extent.width;
-            framebuffer_info.height = m_swapchain_extent.height;
+            framebuffer_info.width = surface.extent.width;
+            framebuffer_info.height = surface.extent.height;
             framebuffer_info.layers = 1;
 
-            if ( vkCreateFramebuffer( m_device, &framebuffer_info, nullptr,
-                                      &m_swapchain_framebuffers[i] )
+            if ( vkCreateFramebuffer( m_device, &framebuffer_info, allocator,
+                                      surface.framebuffers[i].put(
+                                          m_device, allocator ) )
                  != VK_SUCCESS ) {
                 throw std::runtime_error( "Failed to create framebuffer." );
             }
         }
     }
+    void create_command_pool() {
+        QueueFamilyIndices indices{ find_queue_families( m_physical_device ) };
+
+        VkCommandPoolCreateInfo pool_info{};
+        pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+        pool_info.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+        pool_info.queueFamilyIndex = indices.graphics_family();
+
+        // Command buffers allocate from the pool's allocator while recording.
+        const auto * allocator{ m_host_allocator.callbacks(
+            HostMemorySubsystem::commands ) };
+        if ( vkCreateCommandPool( m_device, &pool_info, allocator,
+                                  m_command_pool.put( m_device, allocator ) )
+             != VK_SUCCESS ) {
+            throw std::runtime_error( "Failed to create command pool." );
+        }
+    }
+    void create_command_buffers() {
+        m_command_buffers.resize( MAX_FRAMES_IN_FLIGHT );
+
+        VkCommandBufferAllocateInfo alloc_info{};
+        alloc_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        alloc_info.commandPool = m_command_pool;
+        alloc_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        alloc_info.commandBufferCount =
+            static_cast<std::uint32_t>( m_command_buffers.size() );
+
+        // Freed along with the pool.
+        if ( vkAllocateCommandBuffers( m_device, &alloc_info,
+                                       m_command_buffers.data() )
+             != VK_SUCCESS ) {
+            throw std::runtime_error( "Failed to allocate command buffers." );
+        }
+    }
+    void create_sync_objects() {
+        const auto * allocator{ m_host_allocator.callbacks(
+            HostMemorySubsystem::sync ) };
+
+        VkSemaphoreCreateInfo semaphore_info{};
+        semaphore_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+
+        if ( m_sync_functions.has_timeline_semaphore() ) {
+            m_frame_timeline.emplace( m_device, m_sync_functions, allocator );
+        }
+        else {
+            // Start signalled so the first wait on each frame returns at
+            // once.
+            VkFenceCreateInfo fence_info{};
+            fence_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+            fence_info.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+
+            m_in_flight_fences.resize( MAX_FRAMES_IN_FLIGHT );
+            for ( auto & fence : m_in_flight_fences ) {
+                if ( vkCreateFence( m_device, &fence_info, allocator,
+                                    fence.put( m_device, allocator ) )
+                     != VK_SUCCESS ) {
+                    throw std::runtime_error(
+                        "Failed to create frame synchronisation objects." );
+                }
+            }
+        }
+
+        const auto create_semaphores = [&]( std::vector<UniqueSemaphore> &
+                                                semaphores,
+                                            const std::size_t count ) {
+            semaphores.resize( count );
+            for ( auto & semaphore : semaphores ) {
+                if ( vkCreateSemaphore( m_device, &semaphore_info, allocator,
+                                        semaphore.put( m_device, allocator ) )
+                     != VK_SUCCESS ) {
+                    throw std::runtime_error(
+                        "Failed to create frame synchronisation objects." );
+                }
+            }
+        };
+        for ( auto & surface : m_surfaces ) {
+            create_semaphores( surface.image_available_semaphores,
+                               ACQUIRE_SEMAPHORE_COUNT );
+            // Presentation waits on these, and an image can be re-acquired
+            // before the frame slot that rendered it comes round again, so
+            // they are kept per swapchain image rather than per frame in
+            // flight.
+            create_semaphores( surface.render_finished_semaphores,
+                               surface.images.size() );
+        }
+    }
+    void create_stream_capture() {
+        if ( !m_options.capture_stream ) {
+            return;
+        }
+        m_stream_capture = std::make_unique<CommandCapture>(
+            m_options.capture_stream.value(),
+            m_options.capture_stream_frame );
+        m_stream_capture->set_formats( m_swapchain_image_format,
+                                       m_depth_format );
+    }
+    void create_frame_capture() {
+        if ( !m_options.capture ) {
+            return;
+        }
+        m_capture = std::make_unique<FrameCapture>(
+            m_physical_device, m_device, m_dispatch, m_surfaces.front().extent,
+            m_swapchain_image_format, MAX_FRAMES_IN_FLIGHT,
+            m_options.capture.value(),
+            m_host_allocator.callbacks( HostMemorySubsystem::resources ) );
+    }
+    // Sampled metrics are pulled in by collectors on the exporting threads,
+    // so the render thread pays nothing for them.
+    void start_metrics_export() {
+        if ( !m_options.metrics_port && !m_options.metrics_file ) {
+            return;
+        }
+        register_device_memory_metrics();
+        register_host_memory_metrics();
+
+        if ( m_options.metrics_port ) {
+            m_metrics_server = std::make_unique<MetricsServer>(
+                m_metrics, m_options.metrics_port.value() );
+            std::cout << "Metrics on http://127.0.0.1:"
+                      << m_metrics_server->port() << "/metrics" << std::endl;
+        }
+        if ( m_options.metrics_file ) {
+            m_metrics_writer = std::make_unique<MetricsFileWriter>(
+                m_metrics, m_options.metrics_file.value(),
+                std::chrono::milliseconds{ m_options.metrics_interval_ms } );
+        }
+    }
+    void register_device_memory_metrics() {
+        VkPhysicalDeviceMemoryProperties properties{};
+        vkGetPhysicalDeviceMemoryProperties( m_physical_device, &properties );
+
+        struct HeapGauges
+        {
+            MetricGauge * budget;
+            MetricGauge * usage;
+        };
+        std::vector<HeapGauges> heaps;
+        for ( std::uint32_t i{ 0 }; i < properties.memoryHeapCount; ++i ) {
+            const MetricLabels labels{ { "heap", std::to_string( i ) } };
+            m_metrics
+                .gauge( "vk_device_memory_heap_size_bytes",
+                        "Size of each device memory heap.", labels )
+                .set( static_cast<double>( properties.memoryHeaps[i].size ) );
+            if ( m_memory_budget ) {
+                heaps.push_back(
+                    { &m_metrics.gauge( "vk_device_memory_budget_bytes",
+                                        "Heap budget from "
+                                        "VK_EXT_memory_budget.",
+                                        labels ),
+                      &m_metrics.gauge( "vk_device_memory_usage_bytes",
+                                        "Heap usage from VK_EXT_memory_budget, "
+                                        "all processes.",
+                                        labels ) } );
+            }
+        }
+        if ( !m_memory_budget ) {
+            return;
+        }
+
+        m_metrics.add_collector(
+            [physical_device = m_physical_device, heaps]() {
+                VkPhysicalDeviceMemoryBudgetPropertiesEXT budget{};
+                budget.sType =
+                    VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT;
+                VkPhysicalDeviceMemoryProperties2 properties{};
+                properties.sType =
+                    VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2;
+                properties.pNext = &budget;
+                vkGetPhysicalDeviceMemoryProperties2( physical_device,
+                                                      &properties );
+                for ( std::size_t i{ 0 }; i < heaps.size(); ++i ) {
+                    heaps[i].budget->set(
+                        static_cast<double>( budget.heapBudget[i] ) );
+                    heaps[i].usage->set(
+                        static_cast<double>( budget.heapUsage[i] ) );
+                }
+            } );
+    }
+    void register_host_memory_metrics() {
+        struct SubsystemMetrics
+        {
+            MetricGauge *   bytes;
+            MetricGauge *   live;
+            MetricCounter * allocations;
+        };
+        std::vector<SubsystemMetrics> subsystems;
+        for ( std::size_t i{ 0 }; i < HOST_MEMORY_SUBSYSTEM_COUNT; ++i ) {
+            const MetricLabels labels{
+                { "subsystem",
+                  std::string{ to_string(
+                      static_cast<HostMemorySubsystem>( i ) ) } }
+            };
+            subsystems.push_back(
+                { &m_metrics.gauge( "vk_host_memory_bytes",
+                                    "Driver host memory held through the "
+                                    "allocation callbacks.",
+                                    labels ),
+                  &m_metrics.gauge( "vk_host_memory_live_allocations",
+                                    "Driver host allocations not yet freed.",
+                                    labels ),
+                  &m_metrics.counter( "vk_host_allocations_total",
+                                      "Driver host allocations made.",
+                                      labels ) } );
+        }
+
+        m_metrics.add_collector( [this, subsystems]() {
+            const auto stats{ m_host_allocator.stats() };
+            for ( std::size_t i{ 0 }; i < subsystems.size(); ++i ) {
+                const auto & usage{ stats.subsystems[i] };
+                subsystems[i].bytes->set( static_cast<double>( usage.bytes ) );
+                subsystems[i].live->set( static_cast<double>( usage.live ) );
+                subsystems[i].allocations->set( usage.allocations );
+            }
+        } );
+    }
+    // One command buffer renders every window, each in its own pass over
+    // the image acquired for it.
+    void record_command_buffer( VkCommandBuffer command_buffer ) {
+        VkCommandBufferBeginInfo begin_info{};
+        begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+        if ( m_dispatch.begin_command_buffer( command_buffer, &begin_info )
+             != VK_SUCCESS ) {
+            throw std::runtime_error( "Failed to begin command buffer." );
+        }
+
+        if ( m_mesh && m_texture_streamer ) {
+            update_texture_set();
+        }
+        // The present transitions of every window go out as one barrier
+        // once all passes are recorded.
+        BarrierBatch present_barriers( m_sync_functions );
+        for ( std::size_t i{ 0 }; i < m_surfaces.size(); ++i ) {
+            record_surface( command_buffer, i, present_barriers );
+        }
+        present_barriers.flush( command_buffer );
+
+        if ( m_dispatch.end_command_buffer( command_buffer ) != VK_SUCCESS ) {
+            throw std::runtime_error( "Failed to record command buffer." );
+        }
+    }
+    void record_surface( VkCommandBuffer   command_buffer,
+                         const std::size_t surface_index,
+                         BarrierBatch &    present_barriers ) {
+        const WindowSurface & surface{ m_surfaces[surface_index] };
+
+        VkClearValue clear_values[2]{};
+        clear_values[0].color = { { 0.0f, 0.0f, 0.0f, 1.0f } };
+        clear_values[1].depthStencil = { 1.0f, 0 };
+
+        VkRenderPassBeginInfo render_pass_info{};
+        render_pass_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+        render_pass_info.renderPass = m_render_pass;
+        render_pass_info.framebuffer =
+            surface.framebuffers[surface.image_index];
+        render_pass_info.renderArea.offset = { 0, 0 };
+        render_pass_info.renderArea.extent = surface.extent;
+        render_pass_info.clearValueCount = 2;
+        render_pass_info.pClearValues = clear_values;
+
+        m_dispatch.cmd_begin_render_pass( command_buffer, &render_pass_info,
+                                          VK_SUBPASS_CONTENTS_INLINE );
+
+        m_dispatch.cmd_bind_pipeline( command_buffer,
+                                      VK_PIPELINE_BIND_POINT_GRAPHICS,
+                                      m_graphics_pipeline );
+
+        VkViewport viewport{};
+        viewport.x = 0.0f;
+        viewport.y = 0.0f;
+        viewport.width = static_cast<float>( surface.extent.width );
+        viewport.height = static_cast<float>( surface.extent.height );
+        viewport.minDepth = 0.0f;
+        viewport.maxDepth = 1.0f;
+        m_dispatch.cmd_set_viewport( command_buffer, 0, 1, &viewport );
+
+        VkRect2D scissor{};
+        scissor.offset = { 0, 0 };
+        scissor.extent = surface.extent;
+        m_dispatch.cmd_set_scissor( command_buffer, 0, 1, &scissor );
+
+        if ( m_mesh ) {
+            const VkBuffer     vertex_buffers[] = { m_mesh->vertex_buffer.buffer };
+            const VkDeviceSize offsets[] = { 0 };
+            m_dispatch.cmd_bind_vertex_buffers( command_buffer, 0, 1,
+                                                vertex_buffers, offsets );
+            m_dispatch.cmd_bind_index_buffer( command_buffer,
+                                              m_mesh->index_buffer.buffer, 0,
+                                              m_mesh->index_type );
+            if ( m_texture_streamer ) {
+                bind_texture( command_buffer );
+            }
+
+            const auto push_constants{ mesh_push_constants( surface.extent,
+                                                            surface_index ) };
+            m_dispatch.cmd_push_constants(
+                command_buffer, m_pipeline_layout, VK_SHADER_STAGE_VERTEX_BIT,
+                0, sizeof( push_constants ), &push_constants );
+
+            m_dispatch.cmd_draw_indexed( command_buffer, m_mesh->index_count,
+                                         1, 0, 0, 0 );
+        }
+        else {
+            m_dispatch.cmd_draw( command_buffer, 3, 1, 0, 0 );
+        }
+
+        m_dispatch.cmd_end_render_pass( command_buffer );
+
+        // With capture on the shared render pass leaves every image in
+        // TRANSFER_SRC, but only the first window is written out.
+        if ( m_capture ) {
+            const auto image{ surface.images[surface.image_index] };
+            if ( surface_index == 0 ) {
+                m_capture->record_copy( command_buffer, image, m_frame_number );
+            }
+            present_barriers.image_barrier(
+                image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
+                VK_PIPELINE_STAGE_2_TRANSFER_BIT, VK_ACCESS_2_TRANSFER_READ_BIT,
+                VK_PIPELINE_STAGE_2_NONE, VK_ACCESS_2_NONE );
+        }
+    }
+    // Pushes the acquires for `frame`. Its semaphores were last waited on
+    // ACQUIRE_SEMAPHORE_COUNT frames before, by a frame draw_frame() has
+    // already seen complete.
+    [[nodiscard]] std::uint64_t acquire_images( const std::uint64_t frame ) {
+        SwapchainAcquisition acquisition{};
+        acquisition.device = m_device;
+        for ( const auto & surface : m_surfaces ) {
+            acquisition.swapchains.push_back( surface.swapchain );
+            acquisition.semaphores.push_back(
+                surface.image_available_semaphores
+                    [frame % ACQUIRE_SEMAPHORE_COUNT] );
+        }
+        acquisition.on_acquired = [this]( const std::vector<AcquiredImage> &
+                                              images ) {
+            for ( std::size_t i{ 0 }; i < m_surfaces.size(); ++i ) {
+                auto &       surface{ m_surfaces[i] };
+                const auto & image{ images[i] };
+                surface.acquired_index = image.image_index;
+                m_app_metrics.acquire.record( image.nanoseconds );
+                const double seconds{ static_cast<double>( image.nanoseconds )
+                                      * 1e-9 };
+                surface.stats.acquire_seconds += seconds;
+                surface.stats.max_acquire_seconds =
+                    std::max( surface.stats.max_acquire_seconds, seconds );
+                if ( image.result == VK_SUBOPTIMAL_KHR ) {
+                    ++surface.stats.suboptimal;
+                }
+            }
+        };
+        return m_submit_thread->acquire( std::move( acquisition ) );
+    }
+    // The images acquired for a frame that is never drawn: an empty
+    // submission waits on their semaphores so none is left pending.
+    void release_acquired_images() {
+        if ( m_frame_number == 0 ) {
+            return;
+        }
+        m_submit_thread->wait_issued( m_acquire_ticket );
+        if ( m_submit_thread->failed() ) {
+            return;
+        }
+        QueueSubmission release{};
+        for ( const auto & surface : m_surfaces ) {
+            release.wait_semaphores.push_back(
+                surface.image_available_semaphores
+                    [m_frame_number % ACQUIRE_SEMAPHORE_COUNT] );
+            release.wait_stages.push_back( VK_PIPELINE_STAGE_ALL_COMMANDS_BIT );
+        }
+        m_submit_thread->submit( std::move( release ) );
+    }
+    void draw_frame() {
+        const ScopedMetricTimer frame_timer( m_app_metrics.frame_cpu );
+        m_submit_thread->check();
+
+        // Wait for the frame submitted MAX_FRAMES_IN_FLIGHT frames ago,
+        // after which anything retired up to then is no longer referenced
+        // by the GPU.
+        VkFence in_flight_fence{ VK_NULL_HANDLE };
+        {
+            const ScopedMetricTimer wait_timer( m_app_metrics.frame_wait );
+            if ( m_frame_timeline ) {
+                if ( m_frame_number >= MAX_FRAMES_IN_FLIGHT ) {
+                    m_frame_timeline->wait( m_frame_number
+                                            - MAX_FRAMES_IN_FLIGHT );
+                }
+            }
+            else {
+                in_flight_fence = m_in_flight_fences[m_current_frame];
+                m_dispatch.wait_for_fences(
+                    m_device, 1, &in_flight_fence, VK_TRUE,
+                    std::numeric_limits<std::uint64_t>::max() );
+            }
+        }
+
+        if ( m_frame_number >= MAX_FRAMES_IN_FLIGHT ) {
+            m_deletion_queue.collect( m_frame_number - MAX_FRAMES_IN_FLIGHT );
+            if ( m_capture ) {
+                m_capture->frame_completed( m_frame_number
+                                            - MAX_FRAMES_IN_FLIGHT );
+            }
+        }
+
+        if ( m_texture_streamer ) {
+            m_texture_streamer->touch( m_texture, m_frame_number );
+            m_texture_streamer->update( m_frame_number );
+        }
+
+        // The images were acquired on the submit thread, see
+        // acquire_images(); this only waits if that acquire hasn't returned.
+        if ( m_frame_number == 0 ) {
+            m_acquire_ticket = acquire_images( m_frame_number );
+        }
+        m_submit_thread->wait_issued( m_acquire_ticket );
+        m_submit_thread->check();
+
+        const auto        semaphore{ m_frame_number % ACQUIRE_SEMAPHORE_COUNT };
+        QueueSubmission   submission{};
+        QueuePresentation presentation{};
+        for ( auto & surface : m_surfaces ) {
+            surface.image_index = surface.acquired_index;
+            submission.wait_semaphores.push_back(
+                surface.image_available_semaphores[semaphore] );
+            submission.wait_stages.push_back(
+                VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT );
+            submission.signal_semaphores.push_back(
+                surface.render_finished_semaphores[surface.image_index] );
+            presentation.swapchains.push_back( surface.swapchain );
+            presentation.image_indices.push_back( surface.image_index );
+        }
+        presentation.wait_semaphores = submission.signal_semaphores;
+
+        // Only reset once work is certain to be submitted with it.
+        if ( in_flight_fence != VK_NULL_HANDLE ) {
+            m_dispatch.reset_fences( m_device, 1, &in_flight_fence );
+        }
+
+        const auto command_buffer{ m_command_buffers[m_current_frame] };
+        m_dispatch.reset_command_buffer( command_buffer, 0 );
+        const bool capture_stream{ m_stream_capture
+                                   && m_stream_capture->frame()
+                                          == m_frame_number };
+        std::optional<CommandCapture::Recording> stream_recording;
+        if ( capture_stream ) {
+            stream_recording.emplace(
+                m_stream_capture->begin( m_dispatch, m_sync_functions ) );
+        }
+        record_command_buffer( command_buffer );
+        if ( stream_recording ) {
+            report_stream_capture_stats(
+                m_stream_capture->finish( std::move( *stream_recording ) ) );
+        }
+
+        submission.command_buffers.push_back( command_buffer );
+        submission.fence = in_flight_fence;
+        // Presentation only takes binary semaphores, so the timeline rides
+        // along after the per-window ones. Values for binary semaphores are
+        // ignored but the arrays have to line up.
+        if ( m_frame_timeline ) {
+            submission.wait_values.assign( submission.wait_semaphores.size(),
+                                           0 );
+            submission.signal_values.assign(
+                submission.signal_semaphores.size(), 0 );
+            submission.signal_semaphores.push_back(
+                m_frame_timeline->semaphore() );
+            submission.signal_values.push_back(
+                FrameTimeline::signal_value( m_frame_number ) );
+        }
+        m_submit_thread->submit( std::move( submission ) );
+        m_app_metrics.frames.add();
+
+        // Every window goes out in one call, which lets the presentation
+        // engine flip them together and costs one queue operation per frame.
+        // The counts are only written here, on the submit thread.
+        presentation.on_presented = [this]( const std::vector<VkResult> &
+                                                results ) {
+            for ( std::size_t i{ 0 }; i < m_surfaces.size(); ++i ) {
+                auto & stats{ m_surfaces[i].stats };
+                ++stats.frames;
+                if ( results[i] == VK_SUBOPTIMAL_KHR ) {
+                    ++stats.present_suboptimal;
+                }
+            }
+        };
+        // The next frame's images are acquired ahead of this present, so its
+        // recording never waits for the present to leave the driver (FIFO
+        // blocks in vkQueuePresentKHR until the refresh). That holds this
+        // frame's image during the acquire, which needs a spare one; without
+        // it the acquire goes after the present.
+        const bool acquire_ahead{ std::all_of(
+            m_surfaces.begin(), m_surfaces.end(),
+            []( const WindowSurface & surface ) {
+                return surface.acquire_ahead;
+            } ) };
+        if ( acquire_ahead ) {
+            m_acquire_ticket = acquire_images( m_frame_number + 1 );
+        }
+        m_present_ticket =
+            m_submit_thread->present( std::move( presentation ) );
+        if ( !acquire_ahead ) {
+            m_acquire_ticket = acquire_images( m_frame_number + 1 );
+        }
+
+        m_current_frame = ( m_current_frame + 1 ) % MAX_FRAMES_IN_FLIGHT;
+        ++m_frame_number;
+    }
 };
 
 int
-main() {
-    HelloTriangleApp app( 800, 600, true );
+main( int argc, char ** argv ) {
     try {
+        HelloTriangleApp app( 800, 600, true, parse_options( argc, argv ) );
         app.run();
     }
     catch ( const std::exception & err ) {
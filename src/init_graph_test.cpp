@@ -0,0 +1,243 @@
+#include "init_graph.hpp"
+#include "thread_pool.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+// Checks InitGraph's scheduling with steps that only record what happened:
+// dependencies finish before their dependents start, main thread steps run
+// on the caller, independent steps overlap, and a throwing step stops
+// everything after it.
+//
+//   init_graph_test [--runs <n>] [--threads <n>]
+//
+// Built with ThreadSanitizer, see CMakeLists.txt.
+
+namespace
+{
+
+struct TestOptions
+{
+    std::uint32_t runs{ 200 };
+    std::uint32_t threads{ 4 };
+};
+
+TestOptions
+parse_options( const int argc, char ** argv ) {
+    TestOptions options{};
+    for ( int i{ 1 }; i < argc; ++i ) {
+        const std::string_view arg{ argv[i] };
+        const auto             next = [&]() -> std::string {
+            if ( i + 1 >= argc ) {
+                throw std::runtime_error( "Missing value for "
+                                          + std::string{ arg } );
+            }
+            return argv[++i];
+        };
+
+        if ( arg == "--runs" ) {
+            options.runs = static_cast<std::uint32_t>( std::stoul( next() ) );
+        }
+        else if ( arg == "--threads" ) {
+            options.threads =
+                static_cast<std::uint32_t>( std::stoul( next() ) );
+        }
+        else {
+            throw std::runtime_error( "Unknown option: " + std::string{ arg } );
+        }
+    }
+    if ( options.runs == 0 || options.threads < 2 ) {
+        throw std::runtime_error(
+            "--runs must be at least 1, --threads at least 2." );
+    }
+    return options;
+}
+
+// Spins until `count` steps have arrived, false if they don't within a
+// second, i.e. the steps weren't running at the same time.
+[[nodiscard]] bool
+meet( std::atomic<std::uint32_t> & arrived, const std::uint32_t count ) {
+    arrived.fetch_add( 1 );
+    const auto deadline{ std::chrono::steady_clock::now()
+                         + std::chrono::seconds( 1 ) };
+    while ( arrived.load() < count ) {
+        if ( std::chrono::steady_clock::now() > deadline ) {
+            return false;
+        }
+        std::this_thread::yield();
+    }
+    return true;
+}
+
+[[nodiscard]] int
+run_test( const TestOptions & options ) {
+    int        failures{ 0 };
+    const auto check = [&]( const bool ok, const std::string & what ) {
+        if ( !ok ) {
+            std::cerr << "FAIL: " << what << std::endl;
+            ++failures;
+        }
+    };
+
+    ThreadPool     pool( options.threads );
+    const auto     main_thread{ std::this_thread::get_id() };
+    constexpr auto main_affinity{ InitGraph::Affinity::main_thread };
+    constexpr int  NOT_RUN{ -1 };
+
+    // A diamond with a main thread step on one side, run many times to give
+    // the scheduling a chance to go wrong. Steps count up `sequence` when
+    // they start and when they finish.
+    std::uint32_t bad_order{ 0 };
+    std::uint32_t off_main{ 0 };
+    for ( std::uint32_t run{ 0 }; run < options.runs; ++run ) {
+        std::atomic<int> sequence{ 0 };
+        struct Span
+        {
+            int start{ NOT_RUN };
+            int end{ NOT_RUN };
+        };
+        Span       a{}, b{}, c{}, d{};
+        bool       b_on_main{ false };
+        const auto step = [&]( Span & span ) {
+            return [&]() {
+                span.start = sequence++;
+                span.end = sequence++;
+            };
+        };
+
+        InitGraph  graph;
+        const auto step_a{ graph.add( "a", step( a ) ) };
+        const auto step_b{ graph.add(
+            "b",
+            [&]() {
+                step( b )();
+                b_on_main = std::this_thread::get_id() == main_thread;
+            },
+            { step_a }, main_affinity ) };
+        const auto step_c{ graph.add( "c", step( c ), { step_a } ) };
+        graph.add( "d", step( d ), { step_b, step_c } );
+        graph.run( pool );
+
+        bad_order += a.end == NOT_RUN || a.end > b.start || a.end > c.start
+                     || b.end > d.start || c.end > d.start;
+        off_main += !b_on_main;
+    }
+    check( bad_order == 0, "dependencies finish before dependents start ("
+                               + std::to_string( bad_order ) + " runs)" );
+    check( off_main == 0, "main thread steps run on the caller ("
+                              + std::to_string( off_main ) + " runs)" );
+
+    // Independent steps, including a main thread one, all running at once.
+    {
+        std::atomic<std::uint32_t> arrived{ 0 };
+        std::atomic<std::uint32_t> met{ 0 };
+        const std::uint32_t        count{ options.threads };
+        InitGraph                  graph;
+        for ( std::uint32_t i{ 0 }; i < count; ++i ) {
+            graph.add(
+                "wide" + std::to_string( i ),
+                [&]() { met += meet( arrived, count ); }, {},
+                i == 0 ? main_affinity : InitGraph::Affinity::any );
+        }
+        graph.run( pool );
+        check( met.load() == count, "independent steps overlap" );
+    }
+
+    // The slow side of a diamond is the critical path.
+    {
+        InitGraph  graph;
+        const auto start{ graph.add( "start", []() {} ) };
+        const auto slow{ graph.add(
+            "slow",
+            []() {
+                std::this_thread::sleep_for( std::chrono::milliseconds( 50 ) );
+            },
+            { start } ) };
+        const auto fast{ graph.add( "fast", []() {}, { start } ) };
+        const auto end{ graph.add( "end", []() {}, { slow, fast } ) };
+        graph.run( pool );
+        check( graph.critical_path()
+                   == std::vector<InitGraph::NodeId>{ start, slow, end },
+               "critical path through the slow step" );
+        check( graph.wall_seconds() >= 0.05
+                   && graph.work_seconds() >= graph.end_seconds( slow )
+                                                  - graph.start_seconds( slow ),
+               "timings" );
+    }
+
+    // A throwing step: its dependents are skipped and run() rethrows.
+    {
+        std::atomic<bool> dependent_ran{ false };
+        InitGraph         graph;
+        const auto        broken{ graph.add(
+            "broken", []() { throw std::runtime_error( "broken step" ); } ) };
+        graph.add( "dependent", [&]() { dependent_ran = true; }, { broken } );
+        graph.add( "main", []() {}, {}, main_affinity );
+        std::string error;
+        try {
+            graph.run( pool );
+        }
+        catch ( const std::runtime_error & err ) {
+            error = err.what();
+        }
+        check( error == "broken step", "run() rethrows the step's error" );
+        check( !dependent_ran.load(), "dependents of a failed step skipped" );
+    }
+
+    // run_serial() keeps to the order the steps were added in.
+    {
+        std::vector<std::uint32_t> order;
+        InitGraph                  graph;
+        const auto                 first{ graph.add(
+            "first", [&]() { order.push_back( 0 ); } ) };
+        graph.add( "second", [&]() { order.push_back( 1 ); }, {},
+                   main_affinity );
+        graph.add( "third", [&]() { order.push_back( 2 ); }, { first } );
+        graph.run_serial();
+        check( order == std::vector<std::uint32_t>{ 0, 1, 2 },
+               "run_serial() in insertion order" );
+    }
+
+    // Dependencies have to be added first.
+    {
+        InitGraph graph;
+        graph.add( "only", []() {} );
+        bool thrown{ false };
+        try {
+            graph.add( "forward", []() {}, { 1 } );
+        }
+        catch ( const std::runtime_error & ) {
+            thrown = true;
+        }
+        check( thrown, "add() rejects a dependency on a later step" );
+    }
+
+    if ( failures != 0 ) {
+        std::cerr << failures << " checks failed" << std::endl;
+        return EXIT_FAILURE;
+    }
+    std::cout << "Init graph test passed (" << options.runs << " runs on "
+              << options.threads << " threads)" << std::endl;
+    return EXIT_SUCCESS;
+}
+
+} // namespace
+
+int
+main( int argc, char ** argv ) {
+    try {
+        return run_test( parse_options( argc, argv ) );
+    }
+    catch ( const std::exception & err ) {
+        std::cerr << err.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+}
@@ -0,0 +1,913 @@
+#include "json.hpp"
+#include "mesh_format.hpp"
+#include "mesh_optimizer.hpp"
+#include "vk_utils.hpp"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cctype>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <numeric>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// Offline converter from OBJ / glTF 2.0 (.gltf, .glb) to the .vmesh format
+// read by load_mesh().
+//
+//   mesh_convert <input> <output.vmesh> [--cache-size N] [--no-optimize]
+//   mesh_convert --self-test
+//
+// Vertices are deduplicated, triangles reordered for the post-transform cache
+// and for overdraw, vertices reordered for fetch locality, and attributes
+// quantised. 16-bit indices are used whenever the vertex count allows.
+
+namespace
+{
+
+struct MeshVertex
+{
+    float position[3];
+    float normal[3];
+    float uv[2];
+
+    [[nodiscard]] bool operator==( const MeshVertex & other ) const noexcept {
+        return std::memcmp( this, &other, sizeof( MeshVertex ) ) == 0;
+    }
+};
+
+struct MeshVertexHash
+{
+    [[nodiscard]] std::size_t operator()( const MeshVertex & v ) const noexcept {
+        // FNV-1a over the raw bytes; equal vertices are bitwise equal.
+        const auto * bytes{ reinterpret_cast<const std::uint8_t *>( &v ) };
+        std::size_t  hash{ 14695981039346656037ull };
+        for ( std::size_t i{ 0 }; i < sizeof( MeshVertex ); ++i ) {
+            hash = ( hash ^ bytes[i] ) * 1099511628211ull;
+        }
+        return hash;
+    }
+};
+
+struct SourceMesh
+{
+    std::vector<MeshVertex>    vertices;
+    std::vector<std::uint32_t> indices;
+    bool                       has_normals{ false };
+};
+
+// Indexed mesh builder that merges identical vertices.
+class MeshBuilder
+{
+    public:
+    void add( const MeshVertex & vertex ) {
+        const auto [it, inserted]{ m_lookup.try_emplace(
+            vertex, static_cast<std::uint32_t>( m_mesh.vertices.size() ) ) };
+        if ( inserted ) {
+            m_mesh.vertices.push_back( vertex );
+        }
+        m_mesh.indices.push_back( it->second );
+    }
+
+    [[nodiscard]] SourceMesh finish( const bool has_normals ) && {
+        m_mesh.has_normals = has_normals;
+        return std::move( m_mesh );
+    }
+
+    private:
+    SourceMesh                                                    m_mesh;
+    std::unordered_map<MeshVertex, std::uint32_t, MeshVertexHash> m_lookup;
+};
+
+// Wavefront OBJ
+
+// Resolves a 1-based (or negative, relative) OBJ index.
+[[nodiscard]] std::size_t
+resolve_obj_index( const long index, const std::size_t count ) {
+    const long resolved{ index < 0 ? static_cast<long>( count ) + index
+                                   : index - 1 };
+    if ( resolved < 0 || static_cast<std::size_t>( resolved ) >= count ) {
+        throw std::runtime_error( "OBJ face index out of range." );
+    }
+    return static_cast<std::size_t>( resolved );
+}
+
+[[nodiscard]] SourceMesh
+load_obj( const std::string & path ) {
+    const auto  file{ read_file( path ) };
+    std::string_view text{ file.data(), file.size() };
+
+    std::vector<std::array<float, 3>> positions;
+    std::vector<std::array<float, 3>> normals;
+    std::vector<std::array<float, 2>> uvs;
+    MeshBuilder                       builder;
+    bool                              has_normals{ true };
+    bool                              any_face{ false };
+
+    std::vector<MeshVertex> polygon;
+    while ( !text.empty() ) {
+        const auto       eol{ text.find( '\n' ) };
+        std::string_view line{ text.substr( 0, eol ) };
+        text.remove_prefix( eol == std::string_view::npos ? text.size()
+                                                          : eol + 1 );
+
+        std::istringstream stream{ std::string{ line } };
+        std::string        keyword;
+        stream >> keyword;
+
+        if ( keyword == "v" ) {
+            auto & p{ positions.emplace_back() };
+            stream >> p[0] >> p[1] >> p[2];
+        }
+        else if ( keyword == "vn" ) {
+            auto & n{ normals.emplace_back() };
+            stream >> n[0] >> n[1] >> n[2];
+        }
+        else if ( keyword == "vt" ) {
+            auto & t{ uvs.emplace_back() };
+            stream >> t[0] >> t[1];
+            // OBJ has v pointing up, Vulkan samples with v pointing down.
+            t[1] = 1.0f - t[1];
+        }
+        else if ( keyword == "f" ) {
+            polygon.clear();
+            std::string corner;
+            while ( stream >> corner ) {
+                MeshVertex vertex{};
+                long       refs[3]{ 0, 0, 0 };
+                std::size_t field{ 0 }, start{ 0 };
+                // v, v/vt, v//vn or v/vt/vn
+                for ( std::size_t i{ 0 }; i <= corner.size() && field < 3; ++i ) {
+                    if ( i == corner.size() || corner[i] == '/' ) {
+                        if ( i > start ) {
+                            refs[field] = std::stol( corner.substr( start,
+                                                                    i - start ) );
+                        }
+                        ++field;
+                        start = i + 1;
+                    }
+                }
+
+                const auto & p{ positions[resolve_obj_index( refs[0],
+                                                             positions.size() )] };
+                std::copy( p.begin(), p.end(), vertex.position );
+                if ( refs[1] != 0 ) {
+                    const auto & t{ uvs[resolve_obj_index( refs[1], uvs.size() )] };
+                    std::copy( t.begin(), t.end(), vertex.uv );
+                }
+                if ( refs[2] != 0 ) {
+                    const auto & n{
+                        normals[resolve_obj_index( refs[2], normals.size() )] };
+                    std::copy( n.begin(), n.end(), vertex.normal );
+                }
+                else {
+                    has_normals = false;
+                }
+                polygon.push_back( vertex );
+            }
+
+            // Fan triangulation, fine for the convex faces exporters write.
+            for ( std::size_t i{ 1 }; i + 1 < polygon.size(); ++i ) {
+                builder.add( polygon[0] );
+                builder.add( polygon[i] );
+                builder.add( polygon[i + 1] );
+                any_face = true;
+            }
+        }
+    }
+
+    if ( !any_face ) {
+        throw std::runtime_error( "OBJ file has no faces: " + path );
+    }
+    return std::move( builder ).finish( has_normals );
+}
+
+// glTF 2.0
+
+constexpr std::uint32_t GLTF_FLOAT{ 5126 };
+constexpr std::uint32_t GLTF_UNSIGNED_BYTE{ 5121 };
+constexpr std::uint32_t GLTF_UNSIGNED_SHORT{ 5123 };
+constexpr std::uint32_t GLTF_UNSIGNED_INT{ 5125 };
+constexpr std::uint32_t GLTF_TRIANGLES{ 4 };
+
+[[nodiscard]] std::vector<std::uint8_t>
+decode_base64( const std::string_view text ) {
+    const auto value = []( const char c ) -> int {
+        if ( c >= 'A' && c <= 'Z' ) return c - 'A';
+        if ( c >= 'a' && c <= 'z' ) return c - 'a' + 26;
+        if ( c >= '0' && c <= '9' ) return c - '0' + 52;
+        if ( c == '+' ) return 62;
+        if ( c == '/' ) return 63;
+        return -1;
+    };
+
+    std::vector<std::uint8_t> out;
+    out.reserve( text.size() * 3 / 4 );
+    std::uint32_t buffer{ 0 };
+    int           bits{ 0 };
+    for ( const char c : text ) {
+        const int v{ value( c ) };
+        if ( v < 0 ) {
+            continue; // Padding and whitespace.
+        }
+        buffer = ( buffer << 6 ) | static_cast<std::uint32_t>( v );
+        bits += 6;
+        if ( bits >= 8 ) {
+            bits -= 8;
+            out.push_back( static_cast<std::uint8_t>( buffer >> bits ) );
+        }
+    }
+    return out;
+}
+
+class GltfDocument
+{
+    public:
+    explicit GltfDocument( const std::string & path ) {
+        const auto file{ read_file( path ) };
+        const auto base_dir{ std::filesystem::path( path ).parent_path() };
+
+        std::vector<std::uint8_t> glb_chunk;
+        std::string_view          json_text{ file.data(), file.size() };
+
+        // Binary container: 12 byte header, JSON chunk, optional BIN chunk.
+        if ( file.size() >= 12 && std::memcmp( file.data(), "glTF", 4 ) == 0 ) {
+            std::size_t offset{ 12 };
+            while ( offset + 8 <= file.size() ) {
+                std::uint32_t length, type;
+                std::memcpy( &length, file.data() + offset, 4 );
+                std::memcpy( &type, file.data() + offset + 4, 4 );
+                offset += 8;
+                if ( offset + length > file.size() ) {
+                    throw std::runtime_error( "Truncated GLB chunk." );
+                }
+                if ( type == 0x4E4F534Au ) { // "JSON"
+                    json_text = { file.data() + offset, length };
+                }
+                else if ( type == 0x004E4942u ) { // "BIN\0"
+                    glb_chunk.assign( file.data() + offset,
+                                      file.data() + offset + length );
+                }
+                offset += length;
+            }
+        }
+
+        m_json = JsonValue::parse( json_text );
+
+        if ( const auto * buffers = m_json.find( "buffers" ) ) {
+            for ( const auto & buffer : buffers->as_array() ) {
+                const auto * uri{ buffer.find( "uri" ) };
+                if ( uri == nullptr ) {
+                    m_buffers.push_back( std::move( glb_chunk ) );
+                    continue;
+                }
+                const auto & uri_text{ uri->as_string() };
+                if ( uri_text.starts_with( "data:" ) ) {
+                    const auto comma{ uri_text.find( ',' ) };
+                    m_buffers.push_back( decode_base64(
+                        std::string_view{ uri_text }.substr( comma + 1 ) ) );
+                }
+                else {
+                    const auto data{ read_file(
+                        ( base_dir / uri_text ).string() ) };
+                    m_buffers.emplace_back( data.begin(), data.end() );
+                }
+            }
+        }
+    }
+
+    [[nodiscard]] const JsonValue & json() const noexcept { return m_json; }
+
+    // Reads accessor `index` as `components` floats (or integers converted to
+    // float) per element.
+    [[nodiscard]] std::vector<float>
+    read_floats( const std::size_t index, const std::size_t components ) const {
+        std::vector<float> out;
+        read_accessor( index, [&]( const std::uint8_t * element,
+                                   const std::uint32_t  component_type,
+                                   const std::size_t    count ) {
+            if ( component_type != GLTF_FLOAT || count != components ) {
+                throw std::runtime_error(
+                    "Unsupported glTF vertex attribute format." );
+            }
+            for ( std::size_t c{ 0 }; c < components; ++c ) {
+                float value;
+                std::memcpy( &value, element + c * 4, 4 );
+                out.push_back( value );
+            }
+        } );
+        return out;
+    }
+
+    [[nodiscard]] std::vector<std::uint32_t>
+    read_indices( const std::size_t index ) const {
+        std::vector<std::uint32_t> out;
+        read_accessor( index, [&]( const std::uint8_t * element,
+                                   const std::uint32_t  component_type,
+                                   std::size_t ) {
+            switch ( component_type ) {
+            case GLTF_UNSIGNED_BYTE: out.push_back( element[0] ); break;
+            case GLTF_UNSIGNED_SHORT: {
+                std::uint16_t v;
+                std::memcpy( &v, element, 2 );
+                out.push_back( v );
+                break;
+            }
+            case GLTF_UNSIGNED_INT: {
+                std::uint32_t v;
+                std::memcpy( &v, element, 4 );
+                out.push_back( v );
+                break;
+            }
+            default: throw std::runtime_error( "Unsupported glTF index type." );
+            }
+        } );
+        return out;
+    }
+
+    private:
+    JsonValue                              m_json;
+    std::vector<std::vector<std::uint8_t>> m_buffers;
+
+    [[nodiscard]] static std::size_t
+    component_count( const std::string & type ) {
+        if ( type == "SCALAR" ) return 1;
+        if ( type == "VEC2" ) return 2;
+        if ( type == "VEC3" ) return 3;
+        if ( type == "VEC4" ) return 4;
+        throw std::runtime_error( "Unsupported glTF accessor type: " + type );
+    }
+
+    [[nodiscard]] static std::size_t
+    component_size( const std::uint32_t component_type ) {
+        switch ( component_type ) {
+        case GLTF_UNSIGNED_BYTE: return 1;
+        case GLTF_UNSIGNED_SHORT: return 2;
+        case GLTF_UNSIGNED_INT:
+        case GLTF_FLOAT: return 4;
+        default: throw std::runtime_error( "Unsupported glTF component type." );
+        }
+    }
+
+    template <typename Visit>
+    void read_accessor( const std::size_t index, Visit && visit ) const {
+        const auto & accessor{ m_json["accessors"][index] };
+        const auto   count{ static_cast<std::size_t>(
+            accessor["count"].as_number() ) };
+        const auto   component_type{ static_cast<std::uint32_t>(
+            accessor["componentType"].as_number() ) };
+        const auto   components{ component_count(
+            accessor["type"].as_string() ) };
+        const auto   element_size{ components
+                                 * component_size( component_type ) };
+
+        if ( accessor.find( "bufferView" ) == nullptr ) {
+            throw std::runtime_error( "Sparse glTF accessors aren't supported." );
+        }
+        const auto & view{ m_json["bufferViews"][static_cast<std::size_t>(
+            accessor["bufferView"].as_number() )] };
+        const auto & buffer{ m_buffers.at( static_cast<std::size_t>(
+            view["buffer"].as_number() ) ) };
+        const auto   offset{ static_cast<std::size_t>(
+            view.number_or( "byteOffset", 0 )
+            + accessor.number_or( "byteOffset", 0 ) ) };
+        const auto   stride{ static_cast<std::size_t>( view.number_or(
+            "byteStride", static_cast<double>( element_size ) ) ) };
+
+        if ( count != 0
+             && offset + stride * ( count - 1 ) + element_size > buffer.size() ) {
+            throw std::runtime_error( "glTF accessor exceeds its buffer." );
+        }
+        for ( std::size_t i{ 0 }; i < count; ++i ) {
+            visit( buffer.data() + offset + stride * i, component_type,
+                   components );
+        }
+    }
+};
+
+// Merges every triangle primitive of every mesh. Node transforms are not
+// applied; scenes are expected to be exported with meshes in world space.
+[[nodiscard]] SourceMesh
+load_gltf( const std::string & path ) {
+    const GltfDocument document( path );
+    const auto &       meshes{ document.json()["meshes"].as_array() };
+
+    MeshBuilder builder;
+    bool        has_normals{ true };
+    bool        any_primitive{ false };
+
+    for ( const auto & mesh : meshes ) {
+        for ( const auto & primitive : mesh["primitives"].as_array() ) {
+            if ( primitive.number_or( "mode", GLTF_TRIANGLES )
+                 != GLTF_TRIANGLES ) {
+                continue;
+            }
+            const auto & attributes{ primitive["attributes"] };
+            const auto   accessor_of = [&]( const std::string_view name ) {
+                const auto * a{ attributes.find( name ) };
+                return a != nullptr
+                           ? static_cast<std::int64_t>( a->as_number() )
+                           : std::int64_t{ -1 };
+            };
+
+            const auto positions{ document.read_floats(
+                static_cast<std::size_t>( attributes["POSITION"].as_number() ),
+                3 ) };
+            const auto vertex_count{ positions.size() / 3 };
+
+            std::vector<float> normals, uvs;
+            if ( const auto a{ accessor_of( "NORMAL" ) }; a >= 0 ) {
+                normals = document.read_floats( static_cast<std::size_t>( a ), 3 );
+            }
+            else {
+                has_normals = false;
+            }
+            if ( const auto a{ accessor_of( "TEXCOORD_0" ) }; a >= 0 ) {
+                uvs = document.read_floats( static_cast<std::size_t>( a ), 2 );
+            }
+
+            std::vector<std::uint32_t> indices;
+            if ( const auto * a = primitive.find( "indices" ) ) {
+                indices = document.read_indices(
+                    static_cast<std::size_t>( a->as_number() ) );
+            }
+            else {
+                indices.resize( vertex_count );
+                std::iota( indices.begin(), indices.end(), 0u );
+            }
+
+            for ( const auto index : indices ) {
+                if ( index >= vertex_count ) {
+                    throw std::runtime_error( "glTF index out of range." );
+                }
+                MeshVertex vertex{};
+                std::copy_n( &positions[index * 3], 3, vertex.position );
+                if ( !normals.empty() ) {
+                    std::copy_n( &normals[index * 3], 3, vertex.normal );
+                }
+                if ( !uvs.empty() ) {
+                    std::copy_n( &uvs[index * 2], 2, vertex.uv );
+                }
+                builder.add( vertex );
+            }
+            any_primitive = true;
+        }
+    }
+
+    if ( !any_primitive ) {
+        throw std::runtime_error( "glTF file has no triangle primitives: "
+                                  + path );
+    }
+    return std::move( builder ).finish( has_normals );
+}
+
+// Area weighted vertex normals, for sources without them.
+void
+generate_normals( SourceMesh & mesh ) {
+    for ( auto & v : mesh.vertices ) {
+        std::fill_n( v.normal, 3, 0.0f );
+    }
+    for ( std::size_t i{ 0 }; i + 2 < mesh.indices.size(); i += 3 ) {
+        auto &      a{ mesh.vertices[mesh.indices[i]] };
+        auto &      b{ mesh.vertices[mesh.indices[i + 1]] };
+        auto &      c{ mesh.vertices[mesh.indices[i + 2]] };
+        const float e1[3]{ b.position[0] - a.position[0],
+                           b.position[1] - a.position[1],
+                           b.position[2] - a.position[2] };
+        const float e2[3]{ c.position[0] - a.position[0],
+                           c.position[1] - a.position[1],
+                           c.position[2] - a.position[2] };
+        const float n[3]{ e1[1] * e2[2] - e1[2] * e2[1],
+                          e1[2] * e2[0] - e1[0] * e2[2],
+                          e1[0] * e2[1] - e1[1] * e2[0] };
+        for ( auto * v : { &a, &b, &c } ) {
+            for ( int k{ 0 }; k < 3; ++k ) {
+                v->normal[k] += n[k];
+            }
+        }
+    }
+    for ( auto & v : mesh.vertices ) {
+        const float length{ std::sqrt( v.normal[0] * v.normal[0]
+                                       + v.normal[1] * v.normal[1]
+                                       + v.normal[2] * v.normal[2] ) };
+        if ( length > 0.0f ) {
+            for ( auto & n : v.normal ) {
+                n /= length;
+            }
+        }
+    }
+}
+
+// Triangle order for the vertex cache and overdraw, then vertex order for
+// fetch locality.
+void
+optimize_mesh( SourceMesh & mesh, const std::size_t cache_size ) {
+    const auto vertex_count{ mesh.vertices.size() };
+    const auto clustered{ optimize_vertex_cache( mesh.indices, vertex_count,
+                                                 cache_size ) };
+    mesh.indices = optimize_overdraw( clustered, mesh.vertices[0].position,
+                                      sizeof( MeshVertex ), vertex_count,
+                                      cache_size );
+
+    const auto order{ optimize_vertex_fetch( mesh.indices, vertex_count ) };
+    std::vector<MeshVertex> reordered;
+    reordered.reserve( order.size() );
+    for ( const auto old_index : order ) {
+        reordered.push_back( mesh.vertices[old_index] );
+    }
+    mesh.vertices = std::move( reordered );
+}
+
+void
+write_vmesh( const std::string & path, const SourceMesh & mesh ) {
+    MeshFileHeader header{};
+    header.vertex_count = static_cast<std::uint32_t>( mesh.vertices.size() );
+    header.vertex_stride = sizeof( PackedVertex );
+    header.index_count = static_cast<std::uint32_t>( mesh.indices.size() );
+    header.index_size =
+        mesh.vertices.size() <= std::numeric_limits<std::uint16_t>::max() ? 2
+                                                                          : 4;
+    header.vertex_offset = align_mesh_section( sizeof( MeshFileHeader ) );
+    header.index_offset = align_mesh_section(
+        header.vertex_offset
+        + std::uint64_t{ header.vertex_count } * sizeof( PackedVertex ) );
+
+    std::fill_n( header.bounds_min, 3, std::numeric_limits<float>::max() );
+    std::fill_n( header.bounds_max, 3, std::numeric_limits<float>::lowest() );
+
+    std::vector<PackedVertex> packed( mesh.vertices.size() );
+    for ( std::size_t i{ 0 }; i < mesh.vertices.size(); ++i ) {
+        const auto & v{ mesh.vertices[i] };
+        auto &       p{ packed[i] };
+        for ( int k{ 0 }; k < 3; ++k ) {
+            p.position[k] = v.position[k];
+            header.bounds_min[k] = std::min( header.bounds_min[k], v.position[k] );
+            header.bounds_max[k] = std::max( header.bounds_max[k], v.position[k] );
+        }
+        encode_octahedral_normal( v.normal, p.normal );
+        p.uv[0] = float_to_half( v.uv[0] );
+        p.uv[1] = float_to_half( v.uv[1] );
+    }
+
+    std::ofstream file( path, std::ios::binary | std::ios::trunc );
+    if ( !file.is_open() ) {
+        throw std::runtime_error( "Couldn't open file: " + path );
+    }
+
+    const auto pad_to = [&]( const std::uint64_t offset ) {
+        static constexpr char zeros[MESH_SECTION_ALIGNMENT]{};
+        const auto            position{ static_cast<std::uint64_t>( file.tellp() ) };
+        file.write( zeros, static_cast<std::streamsize>( offset - position ) );
+    };
+
+    file.write( reinterpret_cast<const char *>( &header ), sizeof( header ) );
+    pad_to( header.vertex_offset );
+    file.write( reinterpret_cast<const char *>( packed.data() ),
+                static_cast<std::streamsize>( packed.size()
+                                              * sizeof( PackedVertex ) ) );
+    pad_to( header.index_offset );
+    if ( header.index_size == 2 ) {
+        std::vector<std::uint16_t> narrow( mesh.indices.begin(),
+                                           mesh.indices.end() );
+        file.write( reinterpret_cast<const char *>( narrow.data() ),
+                    static_cast<std::streamsize>( narrow.size() * 2 ) );
+    }
+    else {
+        file.write( reinterpret_cast<const char *>( mesh.indices.data() ),
+                    static_cast<std::streamsize>( mesh.indices.size() * 4 ) );
+    }
+
+    if ( !file ) {
+        throw std::runtime_error( "Failed to write file: " + path );
+    }
+}
+
+// Self test, run by ctest: a UV sphere goes through the same optimisation
+// and packing as a converted file, and is checked against the source.
+
+// Rows in the usual top to bottom order, which is what exporters produce.
+[[nodiscard]] SourceMesh
+make_uv_sphere( const std::uint32_t rings, const std::uint32_t segments ) {
+    constexpr float pi{ 3.14159265358979f };
+    const auto      vertex = [&]( const std::uint32_t ring,
+                             const std::uint32_t segment ) {
+        const float theta{ pi * static_cast<float>( ring )
+                           / static_cast<float>( rings ) };
+        const float phi{ 2.0f * pi * static_cast<float>( segment )
+                         / static_cast<float>( segments ) };
+        MeshVertex v{};
+        v.position[0] = std::sin( theta ) * std::cos( phi );
+        v.position[1] = std::cos( theta );
+        v.position[2] = std::sin( theta ) * std::sin( phi );
+        std::copy_n( v.position, 3, v.normal );
+        v.uv[0] =
+            static_cast<float>( segment ) / static_cast<float>( segments );
+        v.uv[1] = static_cast<float>( ring ) / static_cast<float>( rings );
+        return v;
+    };
+
+    MeshBuilder builder;
+    for ( std::uint32_t ring{ 0 }; ring < rings; ++ring ) {
+        for ( std::uint32_t segment{ 0 }; segment < segments; ++segment ) {
+            // The triangle touching the pole twice has no area.
+            if ( ring != rings - 1 ) {
+                builder.add( vertex( ring, segment ) );
+                builder.add( vertex( ring + 1, segment ) );
+                builder.add( vertex( ring + 1, segment + 1 ) );
+            }
+            if ( ring != 0 ) {
+                builder.add( vertex( ring, segment ) );
+                builder.add( vertex( ring + 1, segment + 1 ) );
+                builder.add( vertex( ring, segment + 1 ) );
+            }
+        }
+    }
+    return std::move( builder ).finish( true );
+}
+
+[[nodiscard]] float
+half_to_float( const std::uint16_t half ) noexcept {
+    const int   exponent{ ( half >> 10 ) & 0x1F };
+    const int   mantissa{ half & 0x3FF };
+    const float magnitude{ exponent == 0
+                               ? std::ldexp( static_cast<float>( mantissa ),
+                                             -24 )
+                               : std::ldexp( static_cast<float>(
+                                                 mantissa + 0x400 ),
+                                             exponent - 25 ) };
+    return ( half & 0x8000u ) != 0 ? -magnitude : magnitude;
+}
+
+// Equivalent to decode_octahedral() in mesh_vert.vert.
+void
+decode_octahedral_normal( const std::int16_t in[2], float out[3] ) noexcept {
+    float x{ std::max( static_cast<float>( in[0] ) / 32767.0f, -1.0f ) };
+    float y{ std::max( static_cast<float>( in[1] ) / 32767.0f, -1.0f ) };
+    const float z{ 1.0f - std::abs( x ) - std::abs( y ) };
+    if ( z < 0.0f ) {
+        const float ox{ x };
+        x = ( 1.0f - std::abs( y ) ) * ( ox >= 0.0f ? 1.0f : -1.0f );
+        y = ( 1.0f - std::abs( ox ) ) * ( y >= 0.0f ? 1.0f : -1.0f );
+    }
+    const float length{ std::sqrt( x * x + y * y + z * z ) };
+    out[0] = x / length;
+    out[1] = y / length;
+    out[2] = z / length;
+}
+
+// Triangles as source vertex indices, rotated so the smallest comes first
+// (winding kept) and sorted, so two index buffers can be compared.
+[[nodiscard]] std::vector<std::array<std::uint32_t, 3>>
+canonical_triangles( const std::vector<std::uint32_t> & indices,
+                     const std::vector<std::uint32_t> & to_source ) {
+    std::vector<std::array<std::uint32_t, 3>> triangles;
+    triangles.reserve( indices.size() / 3 );
+    for ( std::size_t i{ 0 }; i + 2 < indices.size(); i += 3 ) {
+        std::array<std::uint32_t, 3> t{ to_source[indices[i]],
+                                        to_source[indices[i + 1]],
+                                        to_source[indices[i + 2]] };
+        std::rotate( t.begin(), std::min_element( t.begin(), t.end() ),
+                     t.end() );
+        triangles.push_back( t );
+    }
+    std::sort( triangles.begin(), triangles.end() );
+    return triangles;
+}
+
+[[nodiscard]] int
+run_self_test() {
+    constexpr std::size_t cache_size{ 16 };
+    // The bounds the 64x64 sphere has to stay within; it packs to about
+    // 57% and reaches an ACMR of about 0.65.
+    constexpr double max_acmr{ 0.75 };
+    constexpr double max_size_ratio{ 0.6 };
+    // Octahedral snorm16 and half precision UVs in [0, 1].
+    constexpr float max_normal_error{ 1e-3f };
+    constexpr float max_uv_error{ 5e-4f };
+
+    int        failures{ 0 };
+    const auto check = [&]( const bool ok, const std::string & what ) {
+        if ( !ok ) {
+            std::cerr << "FAIL: " << what << std::endl;
+            ++failures;
+        }
+    };
+
+    const SourceMesh source{ make_uv_sphere( 64, 64 ) };
+    SourceMesh       mesh{ source };
+    const auto       acmr_before{ compute_acmr(
+        mesh.indices, mesh.vertices.size(), cache_size ) };
+    optimize_mesh( mesh, cache_size );
+    const auto acmr_after{ compute_acmr( mesh.indices, mesh.vertices.size(),
+                                         cache_size ) };
+
+    const auto path{ ( std::filesystem::temp_directory_path()
+                       / "mesh_convert_self_test.vmesh" )
+                         .string() };
+    write_vmesh( path, mesh );
+    const auto file{ read_file( path ) };
+    std::filesystem::remove( path );
+
+    MeshFileHeader header{};
+    std::memcpy( &header, file.data(), sizeof( header ) );
+    const auto float_bytes{ source.vertices.size() * sizeof( MeshVertex )
+                            + source.indices.size() * 4 };
+    const double size_ratio{ static_cast<double>( file.size() )
+                             / static_cast<double>( float_bytes ) };
+
+    std::cout << "UV sphere: " << source.vertices.size() << " vertices, "
+              << source.indices.size() / 3 << " triangles\n"
+              << "  ACMR (cache " << cache_size << "): " << acmr_before
+              << " -> " << acmr_after << "\n  size: " << 100.0 * size_ratio
+              << "% of float32 vertices + 32-bit indices" << std::endl;
+
+    check( acmr_after < acmr_before, "optimisation didn't lower the ACMR" );
+    check( acmr_after <= max_acmr,
+           "ACMR " + std::to_string( acmr_after ) + " above "
+               + std::to_string( max_acmr ) );
+    check( size_ratio <= max_size_ratio,
+           "packed size " + std::to_string( size_ratio ) + " of float32" );
+    check( header.vertex_count == source.vertices.size()
+               && header.index_count == source.indices.size(),
+           "header counts" );
+    check( header.vertex_stride == sizeof( PackedVertex ), "vertex stride" );
+    check( header.index_size == 2, "16-bit indices not used" );
+    if ( failures != 0 ) {
+        return EXIT_FAILURE;
+    }
+
+    // Every packed vertex decodes back to the vertex at the same place in
+    // the optimised mesh, which in turn is one of the source vertices.
+    std::unordered_map<MeshVertex, std::uint32_t, MeshVertexHash> source_index;
+    for ( std::uint32_t i{ 0 }; i < source.vertices.size(); ++i ) {
+        source_index.emplace( source.vertices[i], i );
+    }
+    std::vector<std::uint32_t> to_source( mesh.vertices.size() );
+    float                      normal_error{ 0.0f };
+    float                      uv_error{ 0.0f };
+    for ( std::size_t i{ 0 }; i < mesh.vertices.size(); ++i ) {
+        const auto & v{ mesh.vertices[i] };
+        const auto   found{ source_index.find( v ) };
+        check( found != source_index.end(),
+               "vertex " + std::to_string( i ) + " not in the source" );
+        if ( found == source_index.end() ) {
+            return EXIT_FAILURE;
+        }
+        to_source[i] = found->second;
+
+        PackedVertex packed{};
+        std::memcpy( &packed,
+                     file.data() + header.vertex_offset
+                         + i * sizeof( PackedVertex ),
+                     sizeof( packed ) );
+        check( std::memcmp( packed.position, v.position,
+                            sizeof( v.position ) )
+                   == 0,
+               "position of vertex " + std::to_string( i ) );
+        float normal[3];
+        decode_octahedral_normal( packed.normal, normal );
+        for ( int k{ 0 }; k < 3; ++k ) {
+            normal_error =
+                std::max( normal_error, std::abs( normal[k] - v.normal[k] ) );
+        }
+        for ( int k{ 0 }; k < 2; ++k ) {
+            uv_error = std::max( uv_error, std::abs( half_to_float(
+                                                         packed.uv[k] )
+                                                     - v.uv[k] ) );
+        }
+    }
+    check( normal_error <= max_normal_error,
+           "normal error " + std::to_string( normal_error ) );
+    check( uv_error <= max_uv_error, "UV error " + std::to_string( uv_error ) );
+
+    // Reordering may rotate and move triangles, never change them.
+    std::vector<std::uint32_t> written( header.index_count );
+    for ( std::size_t i{ 0 }; i < written.size(); ++i ) {
+        std::uint16_t index{ 0 };
+        std::memcpy( &index, file.data() + header.index_offset + i * 2, 2 );
+        written[i] = index;
+    }
+    std::vector<std::uint32_t> identity( source.vertices.size() );
+    std::iota( identity.begin(), identity.end(), 0u );
+    check( canonical_triangles( written, to_source )
+               == canonical_triangles( source.indices, identity ),
+           "triangles differ from the source" );
+
+    std::cout << "  max error: normal " << normal_error << ", UV " << uv_error
+              << std::endl;
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+} // namespace
+
+int
+main( int argc, char ** argv ) {
+    if ( argc == 2 && std::string_view{ argv[1] } == "--self-test" ) {
+        try {
+            return run_self_test();
+        }
+        catch ( const std::exception & err ) {
+            std::cerr << "ERROR: " << err.what() << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+    if ( argc < 3 ) {
+        std::cerr << "Usage: " << argv[0]
+                  << " <input.obj|.gltf|.glb> <output.vmesh>"
+                     " [--cache-size N] [--no-optimize]"
+                  << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    const std::string input{ argv[1] };
+    const std::string output{ argv[2] };
+    std::size_t       cache_size{ 16 };
+    bool              optimize{ true };
+
+    try {
+        for ( int i{ 3 }; i < argc; ++i ) {
+            const std::string_view arg{ argv[i] };
+            if ( arg == "--cache-size" && i + 1 < argc ) {
+                cache_size = std::stoul( argv[++i] );
+            }
+            else if ( arg == "--no-optimize" ) {
+                optimize = false;
+            }
+            else {
+                throw std::runtime_error( "Unknown option: "
+                                          + std::string{ arg } );
+            }
+        }
+
+        const auto start{ std::chrono::steady_clock::now() };
+
+        auto extension{ std::filesystem::path( input ).extension().string() };
+        std::transform( extension.begin(), extension.end(), extension.begin(),
+                        []( const unsigned char c ) {
+                            return static_cast<char>( std::tolower( c ) );
+                        } );
+
+        SourceMesh mesh{};
+        if ( extension == ".obj" ) {
+            mesh = load_obj( input );
+        }
+        else if ( extension == ".gltf" || extension == ".glb" ) {
+            mesh = load_gltf( input );
+        }
+        else {
+            throw std::runtime_error( "Unsupported input format: " + extension );
+        }
+
+        if ( !mesh.has_normals ) {
+            generate_normals( mesh );
+        }
+
+        const auto vertex_count{ mesh.vertices.size() };
+        const auto acmr_before{ compute_acmr( mesh.indices, vertex_count,
+                                              cache_size ) };
+
+        if ( optimize ) {
+            optimize_mesh( mesh, cache_size );
+        }
+
+        write_vmesh( output, mesh );
+
+        const auto   seconds{ std::chrono::duration<double>(
+                                std::chrono::steady_clock::now() - start )
+                                .count() };
+        const auto   float_bytes{ mesh.vertices.size() * sizeof( MeshVertex )
+                                + mesh.indices.size() * 4 };
+        const auto   packed_bytes{ std::filesystem::file_size( output ) };
+        std::cout << input << " -> " << output << ": "
+                  << mesh.vertices.size() << " vertices, "
+                  << mesh.indices.size() / 3 << " triangles, "
+                  << ( mesh.vertices.size() <= 0xFFFF ? 16 : 32 )
+                  << "-bit indices\n"
+                  << "  ACMR (cache " << cache_size << "): " << acmr_before
+                  << " -> "
+                  << compute_acmr( mesh.indices, mesh.vertices.size(),
+                                   cache_size )
+                  << "\n  size: " << packed_bytes << " bytes ("
+                  << 100.0 * static_cast<double>( packed_bytes )
+                         / static_cast<double>( float_bytes )
+                  << "% of float32 vertices + 32-bit indices), " << seconds
+                  << " s" << std::endl;
+    }
+    catch ( const std::exception & err ) {
+        std::cerr << "ERROR: " << err.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,13 @@
+#version 450
+
+layout( set = 0, binding = 0 ) uniform sampler2D albedo;
+
+layout( location = 0 ) out vec4 out_color;
+layout( location = 1 ) in vec2 frag_uv;
+layout( location = 2 ) in float frag_light;
+
+void
+main() {
+    vec4 texel = texture( albedo, frag_uv );
+    out_color = vec4( texel.rgb * frag_light, texel.a );
+}
@@ -0,0 +1,43 @@
+#version 450
+
+layout( push_constant ) uniform PushConstants {
+    mat4 mvp;
+    mat4 model;
+}
+push;
+
+layout( location = 0 ) in vec3 in_position;
+// Octahedral encoded, already unpacked from snorm16 to [-1, 1].
+layout( location = 1 ) in vec2 in_normal;
+layout( location = 2 ) in vec2 in_uv;
+
+layout( location = 0 ) out vec3 frag_color;
+// Only read by mesh_textured_frag.frag.
+layout( location = 1 ) out vec2 frag_uv;
+layout( location = 2 ) out float frag_light;
+
+vec3
+decode_octahedral( vec2 e ) {
+    vec3  n = vec3( e, 1.0 - abs( e.x ) - abs( e.y ) );
+    float t = max( -n.z, 0.0 );
+    n.x += n.x >= 0.0 ? -t : t;
+    n.y += n.y >= 0.0 ? -t : t;
+    return normalize( n );
+}
+
+void
+main() {
+    gl_Position = push.mvp * vec4( in_position, 1.0 );
+
+    const vec3 light_dir = normalize( vec3( 0.4, 0.8, 0.6 ) );
+    vec3 normal = normalize( mat3( push.model ) * decode_octahedral( in_normal ) );
+    float diffuse = max( dot( normal, light_dir ), 0.0 );
+
+    // Faint UV checker so texture coordinates are visibly exercised.
+    float checker = mod( floor( in_uv.x * 8.0 ) + floor( in_uv.y * 8.0 ), 2.0 );
+
+    vec3 base = normal * 0.5 + 0.5;
+    frag_light = 0.2 + 0.8 * diffuse;
+    frag_color = base * frag_light * ( 0.85 + 0.15 * checker );
+    frag_uv = in_uv;
+}
@@ -0,0 +1,400 @@
+#include "submit_thread.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+// Stress test for SubmitThread and its MpscQueue against a fake device: no
+// GPU, the dispatch table points at the functions below. Producers push
+// submissions (some fenced), acquires and presents through a deliberately
+// small queue and check the ticket guarantees; the fakes check that only
+// the submit thread calls into the "queue" or the swapchain, never two calls
+// at once, and that a fence only ever comes with the last submission of a
+// call.
+//
+//   submit_thread_test [--producers <n>] [--items <n>]
+//
+// Built with ThreadSanitizer, see CMakeLists.txt.
+
+namespace
+{
+
+// Submissions carry a fake command buffer handle naming the producer, the
+// item and whether it has a fence.
+constexpr std::uint32_t  MAX_PRODUCERS{ 16 };
+constexpr std::uint32_t  MAX_ITEMS{ 1u << 20 };
+constexpr std::uintptr_t FENCED_BIT{ 1 };
+
+struct TestOptions
+{
+    std::uint32_t producers{ 4 };
+    std::uint32_t items{ 2000 };
+};
+
+TestOptions
+parse_options( const int argc, char ** argv ) {
+    TestOptions options{};
+    for ( int i{ 1 }; i < argc; ++i ) {
+        const std::string_view arg{ argv[i] };
+        const auto             next = [&]() -> std::string {
+            if ( i + 1 >= argc ) {
+                throw std::runtime_error( "Missing value for "
+                                          + std::string{ arg } );
+            }
+            return argv[++i];
+        };
+
+        if ( arg == "--producers" ) {
+            options.producers =
+                static_cast<std::uint32_t>( std::stoul( next() ) );
+        }
+        else if ( arg == "--items" ) {
+            options.items = static_cast<std::uint32_t>( std::stoul( next() ) );
+        }
+        else {
+            throw std::runtime_error( "Unknown option: " + std::string{ arg } );
+        }
+    }
+    if ( options.producers == 0 || options.producers > MAX_PRODUCERS
+         || options.items == 0 || options.items > MAX_ITEMS ) {
+        throw std::runtime_error( "--producers must be 1-"
+                                  + std::to_string( MAX_PRODUCERS )
+                                  + ", --items 1-"
+                                  + std::to_string( MAX_ITEMS ) + "." );
+    }
+    return options;
+}
+
+[[nodiscard]] VkCommandBuffer
+encode( const std::uint32_t producer, const std::uint32_t item,
+        const bool fenced ) {
+    return reinterpret_cast<VkCommandBuffer>(
+        ( ( std::uintptr_t{ producer } * MAX_ITEMS + item + 1 ) << 1 )
+        | ( fenced ? FENCED_BIT : 0 ) );
+}
+
+struct Decoded
+{
+    std::uint32_t producer;
+    std::uint32_t item;
+    bool          fenced;
+};
+
+[[nodiscard]] Decoded
+decode( const VkCommandBuffer command_buffer ) {
+    const auto bits{ reinterpret_cast<std::uintptr_t>( command_buffer ) };
+    const auto index{ ( bits >> 1 ) - 1 };
+    return { static_cast<std::uint32_t>( index / MAX_ITEMS ),
+             static_cast<std::uint32_t>( index % MAX_ITEMS ),
+             ( bits & FENCED_BIT ) != 0 };
+}
+
+// State shared with the fakes, which can't capture.
+struct FakeQueue
+{
+    std::atomic<int>             in_call{ 0 };
+    std::atomic<std::thread::id> caller{};
+    std::atomic<std::uint64_t>   errors{ 0 };
+    std::atomic<VkResult>        submit_result{ VK_SUCCESS };
+    std::atomic<VkResult>        acquire_result{ VK_SUCCESS };
+    // Only touched inside calls, which the checks above keep to one thread.
+    std::vector<std::uint32_t>   next_item;
+    std::uint64_t                submissions{ 0 };
+    std::uint32_t                next_image{ 0 };
+    // Per producer and item, set once its submit call has returned.
+    std::vector<std::atomic<bool>> issued;
+    std::uint32_t                  items{ 0 };
+
+    [[nodiscard]] std::atomic<bool> & issued_flag( const std::uint32_t producer,
+                                                   const std::uint32_t item ) {
+        return issued[std::size_t{ producer } * items + item];
+    }
+};
+
+FakeQueue g_queue;
+
+void
+enter_call() {
+    if ( g_queue.in_call.fetch_add( 1, std::memory_order_acq_rel ) != 0 ) {
+        g_queue.errors.fetch_add( 1 );
+        std::cerr << "FAIL: overlapping queue calls" << std::endl;
+    }
+    std::thread::id expected{};
+    const auto      self{ std::this_thread::get_id() };
+    if ( !g_queue.caller.compare_exchange_strong( expected, self )
+         && expected != self ) {
+        g_queue.errors.fetch_add( 1 );
+        std::cerr << "FAIL: queue called from a second thread" << std::endl;
+    }
+}
+
+void
+leave_call() {
+    g_queue.in_call.fetch_sub( 1, std::memory_order_acq_rel );
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL
+fake_queue_submit( VkQueue, const std::uint32_t count,
+                   const VkSubmitInfo * infos, const VkFence fence ) {
+    enter_call();
+    for ( std::uint32_t i{ 0 }; i < count; ++i ) {
+        const auto submission{ decode( infos[i].pCommandBuffers[0] ) };
+        if ( submission.fenced && i + 1 != count ) {
+            g_queue.errors.fetch_add( 1 );
+            std::cerr << "FAIL: fenced submission coalesced with later ones"
+                      << std::endl;
+        }
+        if ( submission.fenced
+             != ( i + 1 == count && fence != VK_NULL_HANDLE ) ) {
+            g_queue.errors.fetch_add( 1 );
+            std::cerr << "FAIL: fence on the wrong submission" << std::endl;
+        }
+        auto & next{ g_queue.next_item[submission.producer] };
+        if ( submission.item != next ) {
+            g_queue.errors.fetch_add( 1 );
+            std::cerr << "FAIL: producer " << submission.producer << " item "
+                      << submission.item << " out of order, expected "
+                      << next << std::endl;
+        }
+        next = submission.item + 1;
+        ++g_queue.submissions;
+    }
+    // Long enough for producers to pile up behind it.
+    std::this_thread::sleep_for( std::chrono::microseconds( 20 ) );
+    const VkResult result{ g_queue.submit_result.load() };
+    for ( std::uint32_t i{ 0 }; i < count; ++i ) {
+        const auto submission{ decode( infos[i].pCommandBuffers[0] ) };
+        g_queue.issued_flag( submission.producer, submission.item )
+            .store( true, std::memory_order_relaxed );
+    }
+    leave_call();
+    return result;
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL
+fake_queue_present( VkQueue, const VkPresentInfoKHR * present_info ) {
+    enter_call();
+    for ( std::uint32_t i{ 0 }; i < present_info->swapchainCount; ++i ) {
+        present_info->pResults[i] = VK_SUBOPTIMAL_KHR;
+    }
+    leave_call();
+    return VK_SUCCESS;
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL
+fake_acquire_next_image( VkDevice, VkSwapchainKHR, std::uint64_t, VkSemaphore,
+                         VkFence, std::uint32_t * image_index ) {
+    enter_call();
+    *image_index = g_queue.next_image++ % 3;
+    leave_call();
+    return g_queue.acquire_result.load();
+}
+
+[[nodiscard]] int
+run_test( const TestOptions & options ) {
+    int        failures{ 0 };
+    const auto check = [&]( const bool ok, const std::string & what ) {
+        if ( !ok ) {
+            std::cerr << "FAIL: " << what << std::endl;
+            ++failures;
+        }
+    };
+
+    g_queue.next_item.assign( options.producers, 0 );
+    g_queue.items = options.items;
+    g_queue.issued = std::vector<std::atomic<bool>>(
+        std::size_t{ options.producers } * options.items );
+
+    DeviceDispatch dispatch{};
+    dispatch.queue_submit = fake_queue_submit;
+    dispatch.queue_present_khr = fake_queue_present;
+    dispatch.acquire_next_image_khr = fake_acquire_next_image;
+
+    // Every 7th submission is fenced, every 50th followed by an acquire and
+    // a present.
+    constexpr std::uint32_t fence_every{ 7 };
+    constexpr std::uint32_t present_every{ 50 };
+    const std::uint64_t        presents{
+        std::uint64_t{ options.producers }
+        * ( ( options.items + present_every - 1 ) / present_every ) };
+    std::atomic<std::uint64_t> presented{ 0 };
+    std::atomic<std::uint64_t> acquired{ 0 };
+    std::atomic<std::uint64_t> ticket_errors{ 0 };
+    SubmitStats                stats{};
+    {
+        // Small, so producers regularly find it full.
+        SubmitThread submit_thread( dispatch, VK_NULL_HANDLE, VK_NULL_HANDLE,
+                                    nullptr, nullptr, 8 );
+        {
+            std::vector<std::jthread> producers;
+            for ( std::uint32_t producer{ 0 }; producer < options.producers;
+                  ++producer ) {
+                producers.emplace_back( [&, producer]() {
+                    for ( std::uint32_t item{ 0 }; item < options.items;
+                          ++item ) {
+                        const bool      fenced{ item % fence_every == 0 };
+                        QueueSubmission submission{};
+                        submission.command_buffers.push_back(
+                            encode( producer, item, fenced ) );
+                        if ( fenced ) {
+                            submission.fence =
+                                reinterpret_cast<VkFence>( std::uintptr_t{
+                                    1 } );
+                        }
+                        const auto ticket{ submit_thread.submit(
+                            std::move( submission ) ) };
+                        if ( item % present_every != 0 ) {
+                            continue;
+                        }
+
+                        // The image index is written before the ticket is
+                        // issued, so it can be read without a lock.
+                        std::uint32_t        image_index{ 3 };
+                        SwapchainAcquisition acquisition{};
+                        acquisition.swapchains.push_back(
+                            reinterpret_cast<VkSwapchainKHR>(
+                                std::uintptr_t{ 1 } ) );
+                        acquisition.semaphores.push_back( VK_NULL_HANDLE );
+                        acquisition.on_acquired =
+                            [&]( const std::vector<AcquiredImage> & images ) {
+                                image_index = images.at( 0 ).image_index;
+                            };
+                        submit_thread.wait_issued( submit_thread.acquire(
+                            std::move( acquisition ) ) );
+                        if ( image_index < 3 ) {
+                            acquired.fetch_add( 1 );
+                        }
+
+                        QueuePresentation presentation{};
+                        presentation.swapchains.push_back(
+                            reinterpret_cast<VkSwapchainKHR>(
+                                std::uintptr_t{ 1 } ) );
+                        presentation.image_indices.push_back( 0 );
+                        presentation.on_presented =
+                            [&]( const std::vector<VkResult> & results ) {
+                                if ( results.size() == 1
+                                     && results[0] == VK_SUBOPTIMAL_KHR ) {
+                                    presented.fetch_add( 1 );
+                                }
+                            };
+                        const auto present_ticket{ submit_thread.present(
+                            std::move( presentation ) ) };
+                        // Everything pushed before the present has gone
+                        // out once it has.
+                        submit_thread.wait_issued( present_ticket );
+                        if ( present_ticket <= ticket
+                             || !g_queue.issued_flag( producer, item )
+                                     .load( std::memory_order_relaxed ) ) {
+                            ticket_errors.fetch_add( 1 );
+                        }
+                    }
+                } );
+            }
+        }
+        submit_thread.wait_idle();
+        check( !submit_thread.failed(), "no failures reported" );
+        stats = submit_thread.stats();
+    }
+
+    const std::uint64_t submissions{ std::uint64_t{ options.producers }
+                                     * options.items };
+    check( g_queue.errors.load() == 0, "fake queue checks" );
+    check( ticket_errors.load() == 0,
+           "submissions issued before a later present's ticket" );
+    check( g_queue.submissions == submissions, "every submission issued" );
+    for ( std::uint32_t producer{ 0 }; producer < options.producers;
+          ++producer ) {
+        check( g_queue.next_item[producer] == options.items,
+               "producer " + std::to_string( producer ) + " complete" );
+    }
+    check( stats.submissions == submissions, "submission count" );
+    check( stats.presents == presents, "present count" );
+    check( presented.load() == presents, "on_presented with the results" );
+    check( stats.acquires == presents && acquired.load() == presents,
+           "on_acquired with the image index before the ticket" );
+    check( stats.submit_calls < submissions, "submissions coalesced" );
+    check( stats.max_coalesced <= 8, "calls no larger than the queue" );
+
+    std::cout << submissions << " submissions in " << stats.submit_calls
+              << " calls (up to " << stats.max_coalesced << " per call), "
+              << stats.presents << " presents, " << stats.acquires
+              << " acquires, " << stats.issue_waits
+              << " waits for the submit thread" << std::endl;
+
+    // A failed submit is kept and rethrown on the producer side.
+    g_queue.submit_result = VK_ERROR_DEVICE_LOST;
+    g_queue.next_item.assign( options.producers, 0 );
+    g_queue.caller = std::thread::id{};
+    {
+        SubmitThread    submit_thread( dispatch, VK_NULL_HANDLE,
+                                       VK_NULL_HANDLE );
+        QueueSubmission submission{};
+        submission.command_buffers.push_back( encode( 0, 0, false ) );
+        submit_thread.wait_issued(
+            submit_thread.submit( std::move( submission ) ) );
+        check( submit_thread.failed(), "failed() after a failed submit" );
+        bool thrown{ false };
+        try {
+            submit_thread.check();
+        }
+        catch ( const std::runtime_error & ) {
+            thrown = true;
+        }
+        check( thrown, "check() throws after a failed submit" );
+    }
+
+    // So is a failed acquire, without calling on_acquired.
+    g_queue.acquire_result = VK_ERROR_OUT_OF_DATE_KHR;
+    g_queue.caller = std::thread::id{};
+    {
+        SubmitThread         submit_thread( dispatch, VK_NULL_HANDLE,
+                                            VK_NULL_HANDLE );
+        bool                 called{ false };
+        SwapchainAcquisition acquisition{};
+        acquisition.swapchains.push_back(
+            reinterpret_cast<VkSwapchainKHR>( std::uintptr_t{ 1 } ) );
+        acquisition.semaphores.push_back( VK_NULL_HANDLE );
+        acquisition.on_acquired = [&]( const std::vector<AcquiredImage> & ) {
+            called = true;
+        };
+        submit_thread.wait_issued(
+            submit_thread.acquire( std::move( acquisition ) ) );
+        check( submit_thread.failed() && !called,
+               "failed() and no on_acquired after a failed acquire" );
+        bool thrown{ false };
+        try {
+            submit_thread.check();
+        }
+        catch ( const std::runtime_error & ) {
+            thrown = true;
+        }
+        check( thrown, "check() throws after a failed acquire" );
+    }
+
+    if ( failures != 0 ) {
+        std::cerr << failures << " checks failed" << std::endl;
+        return EXIT_FAILURE;
+    }
+    std::cout << "Submit thread test passed" << std::endl;
+    return EXIT_SUCCESS;
+}
+
+} // namespace
+
+int
+main( int argc, char ** argv ) {
+    try {
+        return run_test( parse_options( argc, argv ) );
+    }
+    catch ( const std::exception & err ) {
+        std::cerr << err.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+}
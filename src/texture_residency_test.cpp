@@ -0,0 +1,301 @@
+#include "texture_residency.hpp"
+
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Checks the mip residency decisions TextureStreamer acts on, no GPU needed:
+// the fallback until a tail lands, coarse first refinement of the most
+// recently used textures, least recently used eviction under the budget, and
+// the budget holding over a long random run.
+//
+//   texture_residency_test [--frames <n>] [--seed <n>]
+
+namespace
+{
+
+struct TestOptions
+{
+    std::uint32_t frames{ 2000 };
+    std::uint32_t seed{ 1 };
+};
+
+TestOptions
+parse_options( const int argc, char ** argv ) {
+    TestOptions options{};
+    for ( int i{ 1 }; i < argc; ++i ) {
+        const std::string_view arg{ argv[i] };
+        const auto             next = [&]() -> std::string {
+            if ( i + 1 >= argc ) {
+                throw std::runtime_error( "Missing value for "
+                                          + std::string{ arg } );
+            }
+            return argv[++i];
+        };
+
+        if ( arg == "--frames" ) {
+            options.frames =
+                static_cast<std::uint32_t>( std::stoul( next() ) );
+        }
+        else if ( arg == "--seed" ) {
+            options.seed = static_cast<std::uint32_t>( std::stoul( next() ) );
+        }
+        else {
+            throw std::runtime_error( "Unknown option: " + std::string{ arg } );
+        }
+    }
+    return options;
+}
+
+// A 64x64 texture with 1 byte texels: 4096, 1024, ... bytes, finest first.
+[[nodiscard]] std::vector<std::uint64_t>
+chain() {
+    std::vector<std::uint64_t> bytes;
+    for ( std::uint64_t size{ 64 }; size != 0; size /= 2 ) {
+        bytes.push_back( size * size );
+    }
+    return bytes;
+}
+constexpr std::uint32_t TAIL_LEVEL{ 3 };
+// Levels 3 to 6: 64 + 16 + 4 + 1.
+constexpr std::uint64_t TAIL_BYTES{ 85 };
+constexpr std::uint64_t FULL_BYTES{ 5461 };
+
+// Completes everything planned right away, like uploads landing by the
+// next frame.
+std::vector<TextureUploadPlan>
+step( TextureResidency & residency ) {
+    const auto plans{ residency.schedule() };
+    for ( const auto & plan : plans ) {
+        residency.complete( plan );
+    }
+    return plans;
+}
+
+[[nodiscard]] int
+run_test( const TestOptions & options ) {
+    int        failures{ 0 };
+    const auto check = [&]( const bool ok, const std::string & what ) {
+        if ( !ok ) {
+            std::cerr << "FAIL: " << what << std::endl;
+            ++failures;
+        }
+    };
+
+    // The fallback is bound until the tail has landed, then the tail.
+    {
+        TextureResidency residency( 1ull << 20, 2 );
+        const auto       id{ residency.add( chain(), TAIL_LEVEL ) };
+        check( !residency.resident( id )
+                   && residency.resident_level( id ) == 7,
+               "nothing resident after add()" );
+        const auto plans{ residency.schedule() };
+        check( plans.size() == 1 && plans[0].first_level == TAIL_LEVEL
+                   && !plans[0].eviction,
+               "the tail is the first upload" );
+        check( !residency.resident( id ), "fallback while the tail uploads" );
+        check( residency.committed_bytes() == TAIL_BYTES,
+               "the tail is reserved when planned" );
+        check( residency.stats().resident_bytes == 0,
+               "the tail counts as resident only once it lands" );
+        residency.complete( plans[0] );
+        check( residency.resident( id )
+                   && residency.resident_level( id ) == TAIL_LEVEL,
+               "the tail is resident once it lands" );
+    }
+
+    // One level at a time, and never more than max_uploads at once.
+    {
+        TextureResidency residency( 1ull << 20, 1 );
+        const auto       id{ residency.add( chain(), TAIL_LEVEL ) };
+        std::vector<std::uint32_t> levels;
+        for ( int frame{ 0 }; frame < 10; ++frame ) {
+            const auto plans{ residency.schedule() };
+            check( plans.size() <= 1, "at most max_uploads refinements" );
+            check( residency.schedule().empty(),
+                   "nothing more while an upload is in flight" );
+            for ( const auto & plan : plans ) {
+                levels.push_back( plan.first_level );
+                residency.complete( plan );
+            }
+        }
+        check( levels == std::vector<std::uint32_t>{ TAIL_LEVEL, 2, 1, 0 },
+               "refined one level at a time down to level 0" );
+        check( residency.resident_level( id ) == 0
+                   && residency.stats().resident_bytes == FULL_BYTES
+                   && residency.stats().uploads == 4,
+               "the full chain resident" );
+    }
+
+    // Most recently used first, and among those the coarsest.
+    {
+        TextureResidency residency( 1ull << 20, 1 );
+        const auto       old_id{ residency.add( chain(), TAIL_LEVEL ) };
+        const auto       fine_id{ residency.add( chain(), TAIL_LEVEL ) };
+        const auto       coarse_id{ residency.add( chain(), TAIL_LEVEL ) };
+        for ( const auto id : { old_id, fine_id, coarse_id } ) {
+            residency.touch( id, 1 );
+            static_cast<void>( step( residency ) );
+        }
+        // Every tail resident; refine one of the two recent ones once.
+        residency.touch( fine_id, 2 );
+        static_cast<void>( step( residency ) );
+        check( residency.resident_level( fine_id ) == TAIL_LEVEL - 1,
+               "the only recent texture is refined" );
+        residency.touch( coarse_id, 2 );
+        const auto plans{ step( residency ) };
+        check( plans.size() == 1 && plans[0].texture == coarse_id,
+               "the coarser of two equally recent textures goes first" );
+        check( residency.resident_level( old_id ) == TAIL_LEVEL,
+               "older textures wait" );
+    }
+
+    // Over budget, the least recently used textures drop to their tail;
+    // textures used in the same frame are never evicted for each other.
+    {
+        TextureResidency residency( 2 * FULL_BYTES + TAIL_BYTES, 1 );
+        const auto       a{ residency.add( chain(), TAIL_LEVEL ) };
+        const auto       b{ residency.add( chain(), TAIL_LEVEL ) };
+        const auto       c{ residency.add( chain(), TAIL_LEVEL ) };
+        std::uint64_t    frame{ 1 };
+        for ( ; frame < 20; ++frame ) {
+            residency.touch( a, frame );
+            residency.touch( b, frame );
+            residency.touch( c, frame );
+            static_cast<void>( step( residency ) );
+        }
+        check( residency.committed_bytes() <= 2 * FULL_BYTES + TAIL_BYTES,
+               "refinement stops at the budget" );
+        check( residency.stats().evictions == 0,
+               "nothing evicted for a texture used in the same frame" );
+
+        // Now only c is used; a is the least recently used.
+        residency.touch( b, frame++ );
+        residency.touch( c, frame++ );
+        std::vector<TextureUploadPlan> plans;
+        for ( int i{ 0 }; i < 10; ++i ) {
+            const auto more{ step( residency ) };
+            plans.insert( plans.end(), more.begin(), more.end() );
+        }
+        std::uint32_t evicted_a{ 0 };
+        std::uint32_t evicted_other{ 0 };
+        for ( const auto & plan : plans ) {
+            if ( plan.eviction ) {
+                ( plan.texture == a ? evicted_a : evicted_other ) += 1;
+                check( plan.first_level == TAIL_LEVEL,
+                       "eviction drops to the tail" );
+            }
+        }
+        check( evicted_a == 1 && evicted_other == 0,
+               "the least recently used texture is evicted" );
+        check( residency.resident_level( a ) == TAIL_LEVEL
+                   && residency.resident( a ),
+               "an evicted texture keeps its tail" );
+        check( residency.resident_level( c ) == 0,
+               "the recently used texture is fully refined" );
+        check( residency.committed_bytes() <= 2 * FULL_BYTES + TAIL_BYTES
+                   && residency.stats().resident_bytes
+                          == residency.committed_bytes(),
+               "within budget after eviction" );
+    }
+
+    // Tails are admitted past the budget, refinement isn't.
+    {
+        TextureResidency residency( 100, 4 );
+        const auto       a{ residency.add( chain(), TAIL_LEVEL ) };
+        const auto       b{ residency.add( chain(), TAIL_LEVEL ) };
+        for ( int frame{ 0 }; frame < 10; ++frame ) {
+            static_cast<void>( step( residency ) );
+        }
+        check( residency.resident_level( a ) == TAIL_LEVEL
+                   && residency.resident_level( b ) == TAIL_LEVEL
+                   && residency.committed_bytes() == 2 * TAIL_BYTES,
+               "tails over budget, no refinement" );
+    }
+
+    // A tail past the last level is rejected.
+    {
+        TextureResidency residency( 100, 1 );
+        bool             thrown{ false };
+        try {
+            static_cast<void>( residency.add( chain(), 7 ) );
+        }
+        catch ( const std::runtime_error & ) {
+            thrown = true;
+        }
+        check( thrown, "add() rejects a tail past the last level" );
+    }
+
+    // Random use and late uploads: the budget holds (tails aside), and a
+    // texture is never evicted or refined twice at once.
+    {
+        constexpr std::uint32_t    TEXTURES{ 16 };
+        constexpr std::uint64_t    BUDGET{ 4 * FULL_BYTES };
+        TextureResidency           residency( BUDGET, 3 );
+        std::mt19937               random( options.seed );
+        std::vector<std::uint32_t> ids;
+        for ( std::uint32_t i{ 0 }; i < TEXTURES; ++i ) {
+            ids.push_back( residency.add( chain(), TAIL_LEVEL ) );
+        }
+        std::vector<TextureUploadPlan> in_flight;
+        std::uint32_t                  over_budget{ 0 };
+        std::uint32_t                  doubled{ 0 };
+        for ( std::uint64_t frame{ 1 }; frame <= options.frames; ++frame ) {
+            // A few textures on screen, mostly the same ones.
+            for ( int i{ 0 }; i < 3; ++i ) {
+                const auto pick{ random() % ( random() % 4 == 0 ? TEXTURES
+                                                                : 5 ) };
+                residency.touch( ids[pick], frame );
+            }
+            // Uploads land in any order, some frames later.
+            std::erase_if( in_flight, [&]( const TextureUploadPlan & plan ) {
+                if ( random() % 3 != 0 ) {
+                    return false;
+                }
+                residency.complete( plan );
+                return true;
+            } );
+            for ( const auto & plan : residency.schedule() ) {
+                for ( const auto & other : in_flight ) {
+                    doubled += other.texture == plan.texture;
+                }
+                in_flight.push_back( plan );
+            }
+            over_budget += residency.committed_bytes()
+                           > BUDGET + TEXTURES * TAIL_BYTES;
+        }
+        check( over_budget == 0, "budget holds over a random run ("
+                                     + std::to_string( over_budget )
+                                     + " frames over)" );
+        check( doubled == 0, "one upload per texture at a time" );
+        check( residency.stats().uploads != 0
+                   && residency.stats().evictions != 0,
+               "the random run refines and evicts" );
+    }
+
+    if ( failures != 0 ) {
+        std::cerr << failures << " checks failed" << std::endl;
+        return EXIT_FAILURE;
+    }
+    std::cout << "Texture residency test passed (" << options.frames
+              << " random frames)" << std::endl;
+    return EXIT_SUCCESS;
+}
+
+} // namespace
+
+int
+main( int argc, char ** argv ) {
+    try {
+        return run_test( parse_options( argc, argv ) );
+    }
+    catch ( const std::exception & err ) {
+        std::cerr << err.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+}
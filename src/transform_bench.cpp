@@ -0,0 +1,472 @@
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include "json.hpp"
+#include "thread_pool.hpp"
+#include "transform_store.hpp"
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+// CPU benchmark for TransformStore: hierarchy propagation, world matrices
+// and frustum culling into an instance buffer, per SIMD level and across
+// threads, against the obvious array-of-structs glm loop.
+//
+//   transform_bench [--entities <n>] [--depth <n>] [--iterations <n>]
+//                   [--threads <n>] [--json <out>]
+
+namespace
+{
+
+using steady_clock = std::chrono::steady_clock;
+
+struct TransformBenchOptions
+{
+    std::size_t entities{ 1'000'000 };
+    std::size_t depth{ 4 };
+    std::size_t iterations{ 20 };
+    std::size_t threads{ std::max( 1u, std::thread::hardware_concurrency() ) };
+    std::string json_path;
+};
+
+TransformBenchOptions
+parse_options( const int argc, char ** argv ) {
+    TransformBenchOptions options{};
+    for ( int i{ 1 }; i < argc; ++i ) {
+        const std::string_view arg{ argv[i] };
+        const auto             next = [&]() -> std::string {
+            if ( i + 1 >= argc ) {
+                throw std::runtime_error( "Missing value for "
+                                          + std::string{ arg } );
+            }
+            return argv[++i];
+        };
+
+        if ( arg == "--entities" ) {
+            options.entities = std::stoull( next() );
+        }
+        else if ( arg == "--depth" ) {
+            options.depth = std::stoull( next() );
+        }
+        else if ( arg == "--iterations" ) {
+            options.iterations = std::stoull( next() );
+        }
+        else if ( arg == "--threads" ) {
+            options.threads = std::stoull( next() );
+        }
+        else if ( arg == "--json" ) {
+            options.json_path = next();
+        }
+        else {
+            throw std::runtime_error( "Unknown option: " + std::string{ arg } );
+        }
+    }
+    if ( options.entities == 0 || options.depth == 0
+         || options.iterations == 0 || options.threads == 0 ) {
+        throw std::runtime_error(
+            "--entities, --depth, --iterations and --threads must be at "
+            "least 1." );
+    }
+    return options;
+}
+
+struct SceneObject
+{
+    LocalTransform local;
+    BoundingSphere bounds;
+    // Index of an earlier object, or TransformHandle::NONE.
+    std::uint32_t  parent;
+};
+
+// Roots scattered through a 200 unit cube, then levels twice the size of
+// the one above with children close to a random parent.
+[[nodiscard]] std::vector<SceneObject>
+make_scene( const TransformBenchOptions & options ) {
+    std::mt19937                          random( 1234 );
+    std::uniform_real_distribution<float> unit( -1.0f, 1.0f );
+    const auto                            rotation = [&]() {
+        const glm::vec3 axis{ unit( random ), unit( random ),
+                              unit( random ) + 2.0f };
+        return glm::angleAxis( unit( random ) * 3.14159f,
+                               glm::normalize( axis ) );
+    };
+
+    const double total_weight{ std::pow( 2.0, options.depth ) - 1.0 };
+    std::vector<SceneObject> objects;
+    objects.reserve( options.entities );
+    std::size_t level_begin{ 0 };
+    for ( std::size_t level{ 0 }; level < options.depth; ++level ) {
+        const std::size_t level_size{
+            level + 1 == options.depth
+                ? options.entities - objects.size()
+                : static_cast<std::size_t>(
+                      static_cast<double>( options.entities )
+                      * std::pow( 2.0, level ) / total_weight ) };
+        const std::size_t parents_begin{ level_begin };
+        level_begin = objects.size();
+        for ( std::size_t i{ 0 }; i < level_size; ++i ) {
+            SceneObject object{};
+            object.local.rotation = rotation();
+            object.local.scale = glm::vec3( 0.8f + 0.2f * unit( random ) );
+            object.bounds.center = glm::vec3( unit( random ), unit( random ),
+                                              unit( random ) )
+                                   * 0.25f;
+            object.bounds.radius = 1.0f;
+            if ( level == 0 || level_begin == parents_begin ) {
+                object.parent = TransformHandle::NONE;
+                object.local.position = glm::vec3( unit( random ),
+                                                   unit( random ),
+                                                   unit( random ) )
+                                        * 100.0f;
+            }
+            else {
+                std::uniform_int_distribution<std::size_t> pick(
+                    parents_begin, level_begin - 1 );
+                object.parent = static_cast<std::uint32_t>( pick( random ) );
+                object.local.position = glm::vec3( unit( random ),
+                                                   unit( random ),
+                                                   unit( random ) )
+                                        * 5.0f;
+            }
+            objects.push_back( object );
+        }
+    }
+    return objects;
+}
+
+// What the code would look like without the store: one struct per object,
+// glm matrix products, one object at a time.
+struct AosObject
+{
+    glm::vec3     position;
+    glm::quat     rotation;
+    glm::vec3     scale;
+    std::uint32_t parent;
+    glm::vec3     center;
+    float         radius;
+    glm::mat4     world;
+};
+
+std::size_t
+naive_update( std::vector<AosObject> & objects, const Frustum & frustum,
+              std::vector<InstanceData> & instances ) {
+    std::size_t visible{ 0 };
+    for ( auto & object : objects ) {
+        const glm::mat4 local{
+            glm::translate( glm::mat4( 1.0f ), object.position )
+            * glm::mat4_cast( object.rotation )
+            * glm::scale( glm::mat4( 1.0f ), object.scale ) };
+        object.world = object.parent == TransformHandle::NONE
+                           ? local
+                           : objects[object.parent].world * local;
+
+        const glm::vec3 center{ object.world
+                                * glm::vec4( object.center, 1.0f ) };
+        const float     scale{ std::sqrt( std::max(
+            { glm::dot( glm::vec3( object.world[0] ),
+                        glm::vec3( object.world[0] ) ),
+              glm::dot( glm::vec3( object.world[1] ),
+                        glm::vec3( object.world[1] ) ),
+              glm::dot( glm::vec3( object.world[2] ),
+                        glm::vec3( object.world[2] ) ) } ) ) };
+        bool inside{ true };
+        for ( const auto & plane : frustum.planes ) {
+            if ( glm::dot( glm::vec3( plane ), center ) + plane.w
+                 < -object.radius * scale ) {
+                inside = false;
+                break;
+            }
+        }
+        if ( inside ) {
+            instances[visible++].model = object.world;
+        }
+    }
+    return visible;
+}
+
+struct BenchResult
+{
+    std::string name;
+    double      median_ms{ 0.0 };
+    std::size_t visible{ 0 };
+};
+
+// Median over `iterations` runs after one untimed warm up.
+[[nodiscard]] BenchResult
+measure( std::string name, const std::size_t iterations,
+         const std::function<std::size_t()> & run ) {
+    BenchResult result{};
+    result.name = std::move( name );
+    result.visible = run();
+    std::vector<double> samples;
+    samples.reserve( iterations );
+    for ( std::size_t i{ 0 }; i < iterations; ++i ) {
+        const auto start{ steady_clock::now() };
+        result.visible = run();
+        samples.push_back( std::chrono::duration<double, std::milli>(
+                               steady_clock::now() - start )
+                               .count() );
+    }
+    std::sort( samples.begin(), samples.end() );
+    result.median_ms = samples[samples.size() / 2];
+    return result;
+}
+
+// What one path ended up with, per object in scene order.
+struct Snapshot
+{
+    std::vector<glm::mat4>    world;
+    std::vector<std::uint8_t> visible;
+};
+
+constexpr std::uint8_t GRAZING{ 2 };
+
+[[nodiscard]] Snapshot
+snapshot( const TransformStore &               store,
+          const std::vector<TransformHandle> & handles ) {
+    Snapshot result{};
+    result.world.reserve( handles.size() );
+    result.visible.reserve( handles.size() );
+    for ( const auto handle : handles ) {
+        result.world.push_back( store.world( handle ) );
+        result.visible.push_back( store.visible( handle ) ? 1 : 0 );
+    }
+    return result;
+}
+
+// The reference, from naive_update()'s matrices. Rounding differs between
+// the paths (FMA, glm's own order), so a sphere within rounding of a plane
+// is marked GRAZING and may land either side; every other object has to
+// agree exactly.
+[[nodiscard]] Snapshot
+snapshot( const std::vector<AosObject> & objects, const Frustum & frustum ) {
+    Snapshot result{};
+    result.world.reserve( objects.size() );
+    result.visible.reserve( objects.size() );
+    for ( const auto & object : objects ) {
+        const glm::vec3 center{ object.world
+                                * glm::vec4( object.center, 1.0f ) };
+        const float     scale{ std::sqrt( std::max(
+            { glm::dot( glm::vec3( object.world[0] ),
+                        glm::vec3( object.world[0] ) ),
+              glm::dot( glm::vec3( object.world[1] ),
+                        glm::vec3( object.world[1] ) ),
+              glm::dot( glm::vec3( object.world[2] ),
+                        glm::vec3( object.world[2] ) ) } ) ) };
+        std::uint8_t visible{ 1 };
+        for ( const auto & plane : frustum.planes ) {
+            const float distance{ glm::dot( glm::vec3( plane ), center )
+                                  + plane.w + object.radius * scale };
+            const float rounding{ 1e-4f
+                                  * ( glm::length( center )
+                                      + std::abs( plane.w )
+                                      + object.radius * scale ) };
+            if ( distance < -rounding ) {
+                visible = 0;
+                break;
+            }
+            if ( distance <= rounding ) {
+                visible = GRAZING;
+            }
+        }
+        result.world.push_back( object.world );
+        result.visible.push_back( visible );
+    }
+    return result;
+}
+
+// World matrices within rounding of the reference's and the same objects
+// visible, reporting the first few that are not.
+[[nodiscard]] bool
+matches_reference( const std::string & name, const Snapshot & result,
+                   const Snapshot & reference ) {
+    std::size_t world_errors{ 0 };
+    std::size_t visible_errors{ 0 };
+    for ( std::size_t i{ 0 }; i < reference.world.size(); ++i ) {
+        bool world_matches{ true };
+        for ( int c{ 0 }; c < 4; ++c ) {
+            for ( int r{ 0 }; r < 4; ++r ) {
+                const float expected{ reference.world[i][c][r] };
+                const float error{ result.world[i][c][r] - expected };
+                const float rounding{ 1e-4f * ( 1.0f + std::abs( expected ) ) };
+                world_matches = world_matches && std::abs( error ) <= rounding;
+            }
+        }
+        if ( !world_matches && world_errors++ < 4 ) {
+            std::cerr << name << ": world matrix of object " << i
+                      << " differs from aos_glm's\n";
+        }
+        if ( reference.visible[i] != GRAZING
+             && result.visible[i] != reference.visible[i]
+             && visible_errors++ < 4 ) {
+            std::cerr << name << ": object " << i << " is "
+                      << ( result.visible[i] != 0 ? "visible" : "culled" )
+                      << ", aos_glm has it "
+                      << ( reference.visible[i] != 0 ? "visible" : "culled" )
+                      << '\n';
+        }
+    }
+    if ( world_errors > 0 || visible_errors > 0 ) {
+        std::cerr << name << " disagrees with aos_glm: " << world_errors
+                  << " world matrices, " << visible_errors << " visibilities"
+                  << std::endl;
+        return false;
+    }
+    return true;
+}
+
+} // namespace
+
+int
+main( int argc, char ** argv ) {
+    try {
+        const auto options{ parse_options( argc, argv ) };
+        const auto scene{ make_scene( options ) };
+
+        // From inside the cube looking down -z, so roughly a quarter of it
+        // is in view and culling has real work on both sides.
+        glm::mat4 projection{ glm::perspective( glm::radians( 60.0f ),
+                                                16.0f / 9.0f, 0.1f, 500.0f ) };
+        projection[1][1] *= -1.0f;
+        const glm::mat4 view{ glm::lookAt( glm::vec3( 0.0f, 0.0f, 40.0f ),
+                                           glm::vec3( 0.0f ),
+                                           glm::vec3( 0.0f, 1.0f, 0.0f ) ) };
+        const auto frustum{ Frustum::from_view_projection( projection
+                                                           * view ) };
+
+        std::vector<InstanceData> instances( scene.size() );
+
+        std::vector<AosObject> aos;
+        aos.reserve( scene.size() );
+        for ( const auto & object : scene ) {
+            aos.push_back( AosObject{
+                object.local.position, object.local.rotation,
+                object.local.scale, object.parent, object.bounds.center,
+                object.bounds.radius, glm::mat4( 1.0f ) } );
+        }
+
+        ThreadPool     pool( options.threads );
+        TransformStore store;
+        store.reserve( scene.size() );
+        std::vector<TransformHandle> handles;
+        handles.reserve( scene.size() );
+        for ( const auto & object : scene ) {
+            handles.push_back( store.create(
+                object.local, object.bounds,
+                object.parent == TransformHandle::NONE
+                    ? TransformHandle{}
+                    : handles[object.parent] ) );
+        }
+        TransformStore threaded( &pool );
+        threaded.reserve( scene.size() );
+        std::vector<TransformHandle> threaded_handles;
+        threaded_handles.reserve( scene.size() );
+        for ( const auto & object : scene ) {
+            threaded_handles.push_back( threaded.create(
+                object.local, object.bounds,
+                object.parent == TransformHandle::NONE
+                    ? TransformHandle{}
+                    : threaded_handles[object.parent] ) );
+        }
+
+        std::cout << scene.size() << " entities in " << options.depth
+                  << " levels, " << options.iterations << " iterations, "
+                  << to_string( detect_simd_level() ) << " available\n";
+
+        std::vector<BenchResult> results;
+        results.push_back( measure( "aos_glm", options.iterations, [&]() {
+            return naive_update( aos, frustum, instances );
+        } ) );
+        const auto reference{ snapshot( aos, frustum ) };
+        const auto grazing{ static_cast<std::size_t>( std::count(
+            reference.visible.begin(), reference.visible.end(), GRAZING ) ) };
+        std::cout << grazing << " grazing a frustum plane, not compared\n";
+        bool mismatch{ false };
+
+        std::vector<SimdLevel> levels{ SimdLevel::scalar, SimdLevel::sse };
+        if ( detect_simd_level() == SimdLevel::avx2 ) {
+            levels.push_back( SimdLevel::avx2 );
+        }
+        for ( const auto level : levels ) {
+            store.set_simd_level( level );
+            results.push_back( measure(
+                "soa_" + std::string{ to_string( level ) },
+                options.iterations, [&]() {
+                    return store.update( frustum, instances ).visible;
+                } ) );
+            mismatch |= !matches_reference(
+                results.back().name, snapshot( store, handles ), reference );
+        }
+        results.push_back( measure(
+            "soa_" + std::string{ to_string( threaded.simd_level() ) } + "_x"
+                + std::to_string( pool.size() ),
+            options.iterations,
+            [&]() { return threaded.update( frustum, instances ).visible; } ) );
+        mismatch |= !matches_reference( results.back().name,
+                                        snapshot( threaded, threaded_handles ),
+                                        reference );
+
+        JsonValue::Array runs;
+        const double     baseline_ms{ results.front().median_ms };
+        for ( const auto & result : results ) {
+            const double speedup{ result.median_ms > 0.0
+                                      ? baseline_ms / result.median_ms
+                                      : 0.0 };
+            const double entities_per_second{
+                result.median_ms > 0.0
+                    ? static_cast<double>( scene.size() ) * 1000.0
+                          / result.median_ms
+                    : 0.0 };
+            std::cout << "  " << result.name << ": " << result.median_ms
+                      << " ms, " << entities_per_second / 1e6
+                      << " M entities/s, " << speedup << "x, "
+                      << result.visible << " visible\n";
+            runs.emplace_back( JsonValue::Object{
+                { "name", result.name },
+                { "median_ms", result.median_ms },
+                { "entities_per_second", entities_per_second },
+                { "speedup", speedup },
+                { "visible", static_cast<double>( result.visible ) },
+            } );
+        }
+
+        if ( !options.json_path.empty() ) {
+            std::ofstream file( options.json_path, std::ios::trunc );
+            if ( !file.is_open() ) {
+                throw std::runtime_error( "Couldn't open file: "
+                                          + options.json_path );
+            }
+            JsonValue{
+                JsonValue::Object{
+                    { "entities", static_cast<double>( scene.size() ) },
+                    { "depth", static_cast<double>( options.depth ) },
+                    { "threads", static_cast<double>( pool.size() ) },
+                    { "runs", JsonValue{ std::move( runs ) } } } }
+                .write( file );
+            file << '\n';
+        }
+        if ( mismatch ) {
+            return EXIT_FAILURE;
+        }
+    }
+    catch ( const std::exception & err ) {
+        std::cerr << err.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
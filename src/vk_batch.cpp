@@ -0,0 +1,231 @@
+#include "batch_renderer.hpp"
+#include "host_allocator.hpp"
+#include "json.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Scaling benchmark for the sharded batch renderer. Renders the same job
+// list on 1, 2, 4, ... shards up to every shard available and reports
+// throughput and speedup over a single shard.
+//
+//   vk_batch [--jobs <n>] [--draws <n>] [--devices-per-gpu <n>]
+//            [--max-queues <n>] [--json <out>]
+//
+// On a CPU-only host, --devices-per-gpu N creates N lavapipe devices so
+// there is something to scale across. Exits non-zero if any run completes
+// a different number of jobs or draws than asked for.
+
+namespace
+{
+
+// CTest treats this as "skipped" rather than failed.
+constexpr int EXIT_SKIPPED{ 77 };
+
+struct BatchOptions
+{
+    std::uint64_t       jobs{ 256 };
+    std::uint32_t       draws_per_job{ 200 };
+    BatchRendererConfig renderer{};
+    std::string         json_path;
+};
+
+BatchOptions
+parse_options( const int argc, char ** argv ) {
+    BatchOptions options{};
+    for ( int i{ 1 }; i < argc; ++i ) {
+        const std::string_view arg{ argv[i] };
+        const auto             next = [&]() -> std::string {
+            if ( i + 1 >= argc ) {
+                throw std::runtime_error( "Missing value for "
+                                          + std::string{ arg } );
+            }
+            return argv[++i];
+        };
+
+        if ( arg == "--jobs" ) {
+            options.jobs = std::stoull( next() );
+        }
+        else if ( arg == "--draws" ) {
+            options.draws_per_job =
+                static_cast<std::uint32_t>( std::stoul( next() ) );
+        }
+        else if ( arg == "--devices-per-gpu" ) {
+            options.renderer.devices_per_gpu =
+                static_cast<std::uint32_t>( std::stoul( next() ) );
+        }
+        else if ( arg == "--max-queues" ) {
+            options.renderer.max_queues_per_device =
+                static_cast<std::uint32_t>( std::stoul( next() ) );
+        }
+        else if ( arg == "--json" ) {
+            options.json_path = next();
+        }
+        else {
+            throw std::runtime_error( "Unknown option: " + std::string{ arg } );
+        }
+    }
+    if ( options.jobs == 0 ) {
+        throw std::runtime_error( "--jobs must be at least 1." );
+    }
+    return options;
+}
+
+// 1, 2, 4, ... and always the full count.
+[[nodiscard]] std::vector<std::size_t>
+shard_steps( const std::size_t total ) {
+    std::vector<std::size_t> steps;
+    for ( std::size_t count{ 1 }; count < total; count *= 2 ) {
+        steps.push_back( count );
+    }
+    steps.push_back( total );
+    return steps;
+}
+
+[[nodiscard]] JsonValue
+to_json( const BatchRunStats & stats, const double speedup ) {
+    JsonValue::Array shards;
+    for ( const auto & shard : stats.shards ) {
+        shards.emplace_back( JsonValue::Object{
+            { "device", static_cast<double>( shard.device_index ) },
+            { "queue", static_cast<double>( shard.queue_index ) },
+            { "jobs", static_cast<double>( shard.jobs ) },
+            { "stolen", static_cast<double>( shard.stolen ) },
+            { "seconds", shard.seconds },
+        } );
+    }
+    return JsonValue{ JsonValue::Object{
+        { "shards", static_cast<double>( stats.shards.size() ) },
+        { "seconds", stats.seconds },
+        { "jobs_per_second", stats.jobs_per_second() },
+        { "speedup", speedup },
+        { "per_shard", JsonValue{ std::move( shards ) } },
+    } };
+}
+
+} // namespace
+
+int
+main( int argc, char ** argv ) {
+    BatchOptions options{};
+    try {
+        options = parse_options( argc, argv );
+    }
+    catch ( const std::exception & err ) {
+        std::cerr << err.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    // Declared first, it has to outlive everything allocated through it.
+    HostAllocator  host_allocator;
+    UniqueInstance instance{};
+    try {
+        instance = create_headless_instance(
+            "vk_batch",
+            host_allocator.callbacks( HostMemorySubsystem::instance ) );
+        static_cast<void>( pick_headless_device( instance ) );
+    }
+    catch ( const std::exception & err ) {
+        std::cerr << "Skipping, no usable Vulkan device: " << err.what()
+                  << std::endl;
+        return EXIT_SKIPPED;
+    }
+
+    try {
+        BatchRenderer renderer(
+            instance, options.renderer,
+            host_allocator.callbacks( HostMemorySubsystem::device ) );
+        std::cout << "Devices: " << renderer.device_count()
+                  << ", shards: " << renderer.shard_count() << '\n';
+
+        const std::uint32_t        draws{ options.draws_per_job };
+        std::atomic<std::uint64_t> recorded_draws{ 0 };
+        const BatchRecordFn        record = [draws, &recorded_draws](
+                                         const BatchShard & shard,
+                                         VkCommandBuffer    command_buffer,
+                                         std::uint64_t ) {
+            const auto & dispatch{ shard.dispatch() };
+            shard.target().begin( command_buffer,
+                                  { { { 0.0f, 0.0f, 0.0f, 1.0f } } } );
+            dispatch.cmd_bind_pipeline( command_buffer,
+                                        VK_PIPELINE_BIND_POINT_GRAPHICS,
+                                        shard.pipeline() );
+            for ( std::uint32_t i{ 0 }; i < draws; ++i ) {
+                dispatch.cmd_draw( command_buffer, 3, 1, 0, 0 );
+            }
+            dispatch.cmd_end_render_pass( command_buffer );
+            recorded_draws.fetch_add( draws, std::memory_order_relaxed );
+        };
+
+        // Untimed pass on every shard so first-use costs (driver thread
+        // start up, shader JIT) stay out of the single shard number.
+        static_cast<void>(
+            renderer.run( renderer.shard_count(), record ) );
+
+        JsonValue::Array runs;
+        double           single_shard_rate{ 0.0 };
+        bool             complete{ true };
+        for ( const auto count : shard_steps( renderer.shard_count() ) ) {
+            recorded_draws = 0;
+            const auto stats{ renderer.run( options.jobs, record, count ) };
+            if ( count == 1 ) {
+                single_shard_rate = stats.jobs_per_second();
+            }
+            const double speedup{ single_shard_rate > 0.0
+                                      ? stats.jobs_per_second()
+                                            / single_shard_rate
+                                      : 0.0 };
+
+            std::uint64_t stolen{ 0 };
+            std::uint64_t jobs{ 0 };
+            for ( const auto & shard : stats.shards ) {
+                stolen += shard.stolen;
+                jobs += shard.jobs;
+            }
+            if ( jobs != options.jobs
+                 || recorded_draws.load() != options.jobs * draws ) {
+                std::cerr << count << " shard(s) completed " << jobs
+                          << " jobs and " << recorded_draws.load()
+                          << " draws, expected " << options.jobs << " and "
+                          << options.jobs * draws << std::endl;
+                complete = false;
+            }
+            std::cout << "  " << count << " shard(s): "
+                      << stats.jobs_per_second() << " jobs/s, " << speedup
+                      << "x (" << speedup / static_cast<double>( count ) * 100.0
+                      << "% efficiency), " << stolen << " stolen\n";
+            runs.push_back( to_json( stats, speedup ) );
+        }
+
+        if ( !options.json_path.empty() ) {
+            std::ofstream file( options.json_path, std::ios::trunc );
+            if ( !file.is_open() ) {
+                throw std::runtime_error( "Couldn't open file: "
+                                          + options.json_path );
+            }
+            JsonValue{ JsonValue::Object{
+                           { "jobs", static_cast<double>( options.jobs ) },
+                           { "draws_per_job", static_cast<double>( draws ) },
+                           { "runs", JsonValue{ std::move( runs ) } } } }
+                .write( file );
+            file << '\n';
+        }
+        if ( !complete ) {
+            return EXIT_FAILURE;
+        }
+    }
+    catch ( const std::exception & err ) {
+        std::cerr << err.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,634 @@
+#include "headless_context.hpp"
+#include "host_allocator.hpp"
+#include "json.hpp"
+#include "offscreen_target.hpp"
+#include "pipeline.hpp"
+#include "vk_dispatch.hpp"
+#include "vk_utils.hpp"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <numeric>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Microbenchmarks for the Vulkan setup and render paths. Runs headless so it
+// works on CI machines with only a software ICD (lavapipe).
+//
+//   vk_bench [--json <out>] [--baseline <file>] [--update-baseline]
+//            [--scale <factor>]
+//
+// With --baseline, every benchmark's median is compared against the stored
+// median times its threshold (the file's default unless the entry sets its
+// own) and the process exits non-zero on regression. Entries without a
+// median are reported but not checked.
+
+namespace
+{
+
+// CTest treats this as "skipped" rather than failed.
+constexpr int EXIT_SKIPPED{ 77 };
+constexpr int EXIT_REGRESSION{ 1 };
+
+constexpr double     DEFAULT_THRESHOLD{ 1.5 };
+constexpr VkExtent2D FRAME_EXTENT{ 256, 256 };
+constexpr uint32_t   DRAWS_PER_RECORDING{ 1000 };
+constexpr uint32_t   FRAMES_IN_FLIGHT{ 2 };
+
+using steady_clock = std::chrono::steady_clock;
+
+struct BenchOptions
+{
+    std::string json_path;
+    std::string baseline_path;
+    bool        update_baseline{ false };
+    double      scale{ 1.0 };
+};
+
+BenchOptions
+parse_options( const int argc, char ** argv ) {
+    BenchOptions options{};
+    for ( int i{ 1 }; i < argc; ++i ) {
+        const std::string_view arg{ argv[i] };
+        const auto             next = [&]() -> std::string {
+            if ( i + 1 >= argc ) {
+                throw std::runtime_error( "Missing value for "
+                                          + std::string{ arg } );
+            }
+            return argv[++i];
+        };
+
+        if ( arg == "--json" ) {
+            options.json_path = next();
+        }
+        else if ( arg == "--baseline" ) {
+            options.baseline_path = next();
+        }
+        else if ( arg == "--update-baseline" ) {
+            options.update_baseline = true;
+        }
+        else if ( arg == "--scale" ) {
+            options.scale = std::stod( next() );
+        }
+        else {
+            throw std::runtime_error( "Unknown option: " + std::string{ arg } );
+        }
+    }
+    if ( options.update_baseline && options.baseline_path.empty() ) {
+        throw std::runtime_error( "--update-baseline requires --baseline." );
+    }
+    return options;
+}
+
+struct BenchResult
+{
+    std::string         name;
+    std::vector<double> samples_ns;
+    // Extra values reported alongside the timings, e.g. frames per second.
+    JsonValue::Object extra;
+
+    [[nodiscard]] double median() const {
+        auto sorted{ samples_ns };
+        std::sort( sorted.begin(), sorted.end() );
+        const auto mid{ sorted.size() / 2 };
+        return sorted.size() % 2 != 0
+                   ? sorted[mid]
+                   : 0.5 * ( sorted[mid - 1] + sorted[mid] );
+    }
+    [[nodiscard]] double mean() const {
+        return std::accumulate( samples_ns.begin(), samples_ns.end(), 0.0 )
+               / static_cast<double>( samples_ns.size() );
+    }
+    [[nodiscard]] double min() const {
+        return *std::min_element( samples_ns.begin(), samples_ns.end() );
+    }
+    [[nodiscard]] double max() const {
+        return *std::max_element( samples_ns.begin(), samples_ns.end() );
+    }
+
+    [[nodiscard]] JsonValue to_json() const {
+        JsonValue::Object object{
+            { "iterations", static_cast<double>( samples_ns.size() ) },
+            { "median_ns", median() },
+            { "mean_ns", mean() },
+            { "min_ns", min() },
+            { "max_ns", max() },
+        };
+        object.insert( object.end(), extra.begin(), extra.end() );
+        return JsonValue{ std::move( object ) };
+    }
+};
+
+[[nodiscard]] double
+elapsed_ns( const steady_clock::time_point start ) {
+    return std::chrono::duration<double, std::nano>( steady_clock::now()
+                                                     - start )
+        .count();
+}
+
+// Times `iterations` calls of `body` after `warmup` untimed calls.
+BenchResult
+run_bench( std::string name, const uint32_t iterations,
+           const std::function<void()> & body, const uint32_t warmup = 1 ) {
+    for ( uint32_t i{ 0 }; i < warmup; ++i ) {
+        body();
+    }
+
+    BenchResult result{};
+    result.name = std::move( name );
+    result.samples_ns.reserve( iterations );
+    for ( uint32_t i{ 0 }; i < iterations; ++i ) {
+        const auto start{ steady_clock::now() };
+        body();
+        result.samples_ns.push_back( elapsed_ns( start ) );
+    }
+    return result;
+}
+
+[[nodiscard]] uint32_t
+scaled( const uint32_t iterations, const double scale ) {
+    return std::max( 1u, static_cast<uint32_t>( iterations * scale ) );
+}
+
+[[nodiscard]] UniqueCommandPool
+create_command_pool( const VkDevice device, const uint32_t queue_family,
+                     const VkAllocationCallbacks * allocator = nullptr ) {
+    VkCommandPoolCreateInfo pool_info{};
+    pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    pool_info.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+    pool_info.queueFamilyIndex = queue_family;
+
+    UniqueCommandPool command_pool{};
+    if ( vkCreateCommandPool( device, &pool_info, allocator,
+                              command_pool.put( device, allocator ) )
+         != VK_SUCCESS ) {
+        throw std::runtime_error( "Failed to create command pool." );
+    }
+    return command_pool;
+}
+
+[[nodiscard]] UniqueFence
+create_signalled_fence( const VkDevice device ) {
+    VkFenceCreateInfo fence_info{};
+    fence_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+    fence_info.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+
+    UniqueFence fence{};
+    if ( vkCreateFence( device, &fence_info, nullptr, fence.put( device ) )
+         != VK_SUCCESS ) {
+        throw std::runtime_error( "Failed to create fence." );
+    }
+    return fence;
+}
+
+[[nodiscard]] UniquePipelineCache
+create_pipeline_cache( const VkDevice device ) {
+    VkPipelineCacheCreateInfo cache_info{};
+    cache_info.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+
+    UniquePipelineCache cache{};
+    if ( vkCreatePipelineCache( device, &cache_info, nullptr,
+                                cache.put( device ) )
+         != VK_SUCCESS ) {
+        throw std::runtime_error( "Failed to create pipeline cache." );
+    }
+    return cache;
+}
+
+void
+record_draws( const VkCommandBuffer command_buffer,
+              const OffscreenTarget & target, const VkPipeline pipeline,
+              const uint32_t draw_count ) {
+    VkCommandBufferBeginInfo begin_info{};
+    begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+    if ( vkBeginCommandBuffer( command_buffer, &begin_info ) != VK_SUCCESS ) {
+        throw std::runtime_error( "Failed to begin recording command buffer." );
+    }
+
+    target.begin( command_buffer, { { { 0.0f, 0.0f, 0.0f, 1.0f } } } );
+    vkCmdBindPipeline( command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
+                       pipeline );
+    for ( uint32_t i{ 0 }; i < draw_count; ++i ) {
+        vkCmdDraw( command_buffer, 3, 1, 0, 0 );
+    }
+    vkCmdEndRenderPass( command_buffer );
+
+    if ( vkEndCommandBuffer( command_buffer ) != VK_SUCCESS ) {
+        throw std::runtime_error( "Failed to record command buffer." );
+    }
+}
+
+// `call_count` calls of `call( command_buffer )` inside one render pass,
+// with the pipeline already bound. The call is the only thing that varies
+// between the loader and dispatch table variants.
+template <typename Call>
+void
+record_calls( const VkCommandBuffer command_buffer,
+              const OffscreenTarget & target, const VkPipeline pipeline,
+              const uint32_t call_count, const Call & call ) {
+    VkCommandBufferBeginInfo begin_info{};
+    begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+    if ( vkBeginCommandBuffer( command_buffer, &begin_info ) != VK_SUCCESS ) {
+        throw std::runtime_error( "Failed to begin recording command buffer." );
+    }
+
+    target.begin( command_buffer, { { { 0.0f, 0.0f, 0.0f, 1.0f } } } );
+    vkCmdBindPipeline( command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
+                       pipeline );
+    for ( uint32_t i{ 0 }; i < call_count; ++i ) {
+        call( command_buffer );
+    }
+    vkCmdEndRenderPass( command_buffer );
+
+    if ( vkEndCommandBuffer( command_buffer ) != VK_SUCCESS ) {
+        throw std::runtime_error( "Failed to record command buffer." );
+    }
+}
+
+std::vector<BenchResult>
+run_all( const BenchOptions & options, std::string & device_name ) {
+    std::vector<BenchResult> results;
+    const double             scale{ options.scale };
+
+    results.push_back( run_bench( "instance_create", scaled( 20, scale ), []() {
+        auto instance{ create_headless_instance( "vk_bench" ) };
+    } ) );
+
+    auto context{ HeadlessContext::create( "vk_bench" ) };
+    const VkDevice device{ context.device };
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties( context.physical_device, &properties );
+    device_name = properties.deviceName;
+
+    results.push_back( run_bench(
+        "device_select", scaled( 200, scale ), [&]() {
+            const auto physical_device{ pick_headless_device( context.instance ) };
+            static_cast<void>( physical_device );
+        } ) );
+
+    results.push_back(
+        run_bench( "device_create", scaled( 20, scale ), [&]() {
+            auto logical_device{ create_headless_device(
+                context.physical_device, context.queue_family ) };
+        } ) );
+
+    const auto vert_code{ read_file( "shaders/triangle_vert.spv" ) };
+    const auto frag_code{ read_file( "shaders/triangle_frag.spv" ) };
+
+    results.push_back(
+        run_bench( "shader_module_create", scaled( 200, scale ), [&]() {
+            auto vert{ create_shader_module( device, vert_code ) };
+            auto frag{ create_shader_module( device, frag_code ) };
+        } ) );
+
+    const auto            vert{ create_shader_module( device, vert_code ) };
+    const auto            frag{ create_shader_module( device, frag_code ) };
+    const auto            layout{ create_pipeline_layout( device ) };
+    const OffscreenTarget target( context.physical_device, device,
+                                  FRAME_EXTENT );
+
+    GraphicsPipelineDesc desc{};
+    desc.vertex_shader = vert;
+    desc.fragment_shader = frag;
+    desc.layout = layout;
+    desc.render_pass = target.render_pass();
+
+    // Cold: a fresh, empty cache per build, so the driver compiles every time.
+    results.push_back(
+        run_bench( "pipeline_create_cold", scaled( 20, scale ), [&]() {
+            auto cache{ create_pipeline_cache( device ) };
+            desc.cache = cache;
+            auto pipeline{ build_graphics_pipeline( device, desc ) };
+        } ) );
+
+    // Cold again, with the driver's host allocations going through
+    // HostAllocator's arena and size-class pools instead of malloc.
+    HostAllocator host_allocator;
+    results.push_back( run_bench(
+        "pipeline_create_cold_host_alloc", scaled( 20, scale ), [&]() {
+            auto cache{ create_pipeline_cache( device ) };
+            auto allocator_desc{ desc };
+            allocator_desc.cache = cache;
+            allocator_desc.allocator =
+                host_allocator.callbacks( HostMemorySubsystem::pipeline );
+            auto pipeline{ build_graphics_pipeline( device, allocator_desc ) };
+        } ) );
+
+    // Warm: the warmup build populates a shared cache that later builds hit.
+    const auto warm_cache{ create_pipeline_cache( device ) };
+    desc.cache = warm_cache;
+    results.push_back(
+        run_bench( "pipeline_create_warm", scaled( 20, scale ), [&]() {
+            auto pipeline{ build_graphics_pipeline( device, desc ) };
+        } ) );
+
+    const auto pipeline{ build_graphics_pipeline( device, desc ) };
+    const auto command_pool{ create_command_pool( device,
+                                                  context.queue_family ) };
+
+    std::array<VkCommandBuffer, FRAMES_IN_FLIGHT> command_buffers{};
+    VkCommandBufferAllocateInfo                   alloc_info{};
+    alloc_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    alloc_info.commandPool = command_pool;
+    alloc_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    alloc_info.commandBufferCount = FRAMES_IN_FLIGHT;
+    if ( vkAllocateCommandBuffers( device, &alloc_info, command_buffers.data() )
+         != VK_SUCCESS ) {
+        throw std::runtime_error( "Failed to allocate command buffers." );
+    }
+
+    auto record{ run_bench( "command_record", scaled( 200, scale ), [&]() {
+        vkResetCommandBuffer( command_buffers[0], 0 );
+        record_draws( command_buffers[0], target, pipeline,
+                      DRAWS_PER_RECORDING );
+    } ) };
+    record.extra.emplace_back( "draws",
+                               static_cast<double>( DRAWS_PER_RECORDING ) );
+    results.push_back( std::move( record ) );
+
+    // Command buffers allocate through their pool's callbacks while
+    // recording.
+    const auto host_command_pool{ create_command_pool(
+        device, context.queue_family,
+        host_allocator.callbacks( HostMemorySubsystem::commands ) ) };
+    VkCommandBuffer host_command_buffer{ VK_NULL_HANDLE };
+    alloc_info.commandPool = host_command_pool;
+    alloc_info.commandBufferCount = 1;
+    if ( vkAllocateCommandBuffers( device, &alloc_info, &host_command_buffer )
+         != VK_SUCCESS ) {
+        throw std::runtime_error( "Failed to allocate command buffers." );
+    }
+
+    auto record_host_alloc{ run_bench(
+        "command_record_host_alloc", scaled( 200, scale ), [&]() {
+            vkResetCommandBuffer( host_command_buffer, 0 );
+            record_draws( host_command_buffer, target, pipeline,
+                          DRAWS_PER_RECORDING );
+        } ) };
+    record_host_alloc.extra.emplace_back(
+        "draws", static_cast<double>( DRAWS_PER_RECORDING ) );
+    results.push_back( std::move( record_host_alloc ) );
+
+    // Per-call cost of the loader's exported trampolines against entry
+    // points from vkGetDeviceProcAddr, as used by the window app.
+    const auto instance_dispatch{ InstanceDispatch::load( context.instance ) };
+    const auto dispatch{ DeviceDispatch::load( instance_dispatch, device ) };
+    const auto call_bench = [&]( std::string name, const auto & call ) {
+        auto result{ run_bench( std::move( name ), scaled( 200, scale ), [&]() {
+            vkResetCommandBuffer( command_buffers[0], 0 );
+            record_calls( command_buffers[0], target, pipeline,
+                          DRAWS_PER_RECORDING, call );
+        } ) };
+        result.extra.emplace_back( "calls",
+                                   static_cast<double>( DRAWS_PER_RECORDING ) );
+        result.extra.emplace_back( "ns_per_call",
+                                   result.median() / DRAWS_PER_RECORDING );
+        return result;
+    };
+    const auto compare_calls = [&]( const std::string & command,
+                                    const auto &        loader_call,
+                                    const auto &        dispatch_call ) {
+        auto loader{ call_bench( command + "_loader", loader_call ) };
+        auto direct{ call_bench( command + "_dispatch", dispatch_call ) };
+        direct.extra.emplace_back( "speedup",
+                                   loader.median() / direct.median() );
+        results.push_back( std::move( loader ) );
+        results.push_back( std::move( direct ) );
+    };
+    compare_calls(
+        "cmd_draw",
+        []( const VkCommandBuffer command_buffer ) {
+            vkCmdDraw( command_buffer, 3, 1, 0, 0 );
+        },
+        [&]( const VkCommandBuffer command_buffer ) {
+            dispatch.cmd_draw( command_buffer, 3, 1, 0, 0 );
+        } );
+    compare_calls(
+        "cmd_bind_pipeline",
+        [&]( const VkCommandBuffer command_buffer ) {
+            vkCmdBindPipeline( command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
+                               pipeline );
+        },
+        [&]( const VkCommandBuffer command_buffer ) {
+            dispatch.cmd_bind_pipeline(
+                command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline );
+        } );
+
+    // End to end: wait for the slot's fence, re-record, submit. Same shape as
+    // the window app's draw_frame, minus acquire/present.
+    std::array<UniqueFence, FRAMES_IN_FLIGHT> fences{};
+    for ( auto & fence : fences ) {
+        fence = create_signalled_fence( device );
+    }
+
+    uint32_t   current_frame{ 0 };
+    const auto frame_body = [&]() {
+        const VkFence fence{ fences[current_frame] };
+        vkWaitForFences( device, 1, &fence, VK_TRUE, UINT64_MAX );
+        vkResetFences( device, 1, &fence );
+
+        const auto command_buffer{ command_buffers[current_frame] };
+        vkResetCommandBuffer( command_buffer, 0 );
+        record_draws( command_buffer, target, pipeline, 1 );
+
+        VkSubmitInfo submit_info{};
+        submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        submit_info.commandBufferCount = 1;
+        submit_info.pCommandBuffers = &command_buffer;
+        if ( vkQueueSubmit( context.queue, 1, &submit_info, fence )
+             != VK_SUCCESS ) {
+            throw std::runtime_error( "Failed to submit draw command buffer." );
+        }
+        current_frame = ( current_frame + 1 ) % FRAMES_IN_FLIGHT;
+    };
+
+    const auto frames_start{ steady_clock::now() };
+    auto       frames{ run_bench( "frame", scaled( 500, scale ), frame_body,
+                                  FRAMES_IN_FLIGHT ) };
+    vkDeviceWaitIdle( device );
+    const double total_seconds{ elapsed_ns( frames_start ) * 1e-9 };
+    frames.extra.emplace_back(
+        "fps",
+        static_cast<double>( frames.samples_ns.size() + FRAMES_IN_FLIGHT )
+            / total_seconds );
+    results.push_back( std::move( frames ) );
+
+    return results;
+}
+
+[[nodiscard]] JsonValue
+load_json( const std::string & path ) {
+    std::ifstream file( path );
+    if ( !file.is_open() ) {
+        throw std::runtime_error( "Couldn't open file: " + path );
+    }
+    std::stringstream buffer;
+    buffer << file.rdbuf();
+    return JsonValue::parse( buffer.str() );
+}
+
+void
+save_json( const std::string & path, const JsonValue & value ) {
+    std::ofstream file( path, std::ios::trunc );
+    if ( !file.is_open() ) {
+        throw std::runtime_error( "Couldn't open file: " + path );
+    }
+    value.write( file );
+    file << '\n';
+}
+
+// Returns the number of benchmarks slower than baseline * threshold.
+int
+compare_to_baseline( const std::vector<BenchResult> & results,
+                     const JsonValue &                baseline ) {
+    const double default_threshold{ baseline.number_or( "threshold",
+                                                        DEFAULT_THRESHOLD ) };
+    const auto * entries{ baseline.find( "benchmarks" ) };
+
+    int regressions{ 0 };
+    for ( const auto & result : results ) {
+        const auto * entry{ entries != nullptr ? entries->find( result.name )
+                                               : nullptr };
+        const auto * median{ entry != nullptr ? entry->find( "median_ns" )
+                                              : nullptr };
+        if ( median == nullptr ) {
+            std::cout << "  " << result.name << ": no baseline\n";
+            continue;
+        }
+
+        const double reference{ median->as_number() };
+        const double threshold{ entry->number_or( "threshold",
+                                                  default_threshold ) };
+        const double ratio{ result.median() / reference };
+        const bool   regressed{ ratio > threshold };
+        regressions += regressed ? 1 : 0;
+
+        std::cout << "  " << result.name << ": " << ratio
+                  << "x baseline (limit " << threshold << "x)"
+                  << ( regressed ? "  REGRESSION" : "" ) << '\n';
+    }
+    return regressions;
+}
+
+void
+update_baseline( const std::string &              path,
+                 const std::vector<BenchResult> & results,
+                 const std::string &              device_name ) {
+    JsonValue baseline{ JsonValue::Object{} };
+    double    threshold{ DEFAULT_THRESHOLD };
+    try {
+        baseline = load_json( path );
+        threshold = baseline.number_or( "threshold", DEFAULT_THRESHOLD );
+    }
+    catch ( const std::exception & ) {
+        baseline = JsonValue{ JsonValue::Object{} };
+    }
+
+    // Per-benchmark thresholds are kept, only the medians are replaced.
+    const auto *      old_entries{ baseline.find( "benchmarks" ) };
+    JsonValue::Object entries;
+    for ( const auto & result : results ) {
+        JsonValue entry{ JsonValue::Object{
+            { "median_ns", result.median() } } };
+        const auto * old_entry{ old_entries != nullptr
+                                    ? old_entries->find( result.name )
+                                    : nullptr };
+        if ( const auto * old_threshold{
+                 old_entry != nullptr ? old_entry->find( "threshold" )
+                                      : nullptr } ) {
+            entry.set( "threshold", *old_threshold );
+        }
+        entries.emplace_back( result.name, std::move( entry ) );
+    }
+    // Replaces any note about hand-set ceilings, these are measured.
+    baseline.set( "note", "Medians measured on " + device_name
+                              + " with vk_bench --update-baseline." );
+    baseline.set( "threshold", threshold );
+    baseline.set( "benchmarks", JsonValue{ std::move( entries ) } );
+    save_json( path, baseline );
+    std::cout << "Baseline written to " << path << '\n';
+}
+
+} // namespace
+
+int
+main( int argc, char ** argv ) {
+    BenchOptions options{};
+    try {
+        options = parse_options( argc, argv );
+    }
+    catch ( const std::exception & err ) {
+        std::cerr << err.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    // No instance or device means there is nothing to measure, not a failure.
+    try {
+        auto probe{ HeadlessContext::create( "vk_bench" ) };
+    }
+    catch ( const std::exception & err ) {
+        std::cerr << "Skipping, no usable Vulkan device: " << err.what()
+                  << std::endl;
+        return EXIT_SKIPPED;
+    }
+
+    try {
+        std::string device_name;
+        const auto  results{ run_all( options, device_name ) };
+
+        std::cout << "Device: " << device_name << '\n';
+        for ( const auto & result : results ) {
+            std::cout << "  " << result.name << ": median "
+                      << result.median() / 1000.0 << " us, min "
+                      << result.min() / 1000.0 << " us, max "
+                      << result.max() / 1000.0 << " us\n";
+        }
+
+        if ( !options.json_path.empty() ) {
+            JsonValue::Object benchmarks;
+            for ( const auto & result : results ) {
+                benchmarks.emplace_back( result.name, result.to_json() );
+            }
+            save_json( options.json_path,
+                       JsonValue{ JsonValue::Object{
+                           { "device", device_name },
+                           { "benchmarks",
+                             JsonValue{ std::move( benchmarks ) } } } } );
+        }
+
+        if ( options.update_baseline ) {
+            update_baseline( options.baseline_path, results, device_name );
+        }
+        else if ( !options.baseline_path.empty() ) {
+            std::cout << "Comparing against " << options.baseline_path << '\n';
+            const int regressions{ compare_to_baseline(
+                results, load_json( options.baseline_path ) ) };
+            if ( regressions != 0 ) {
+                std::cerr << regressions
+                          << " benchmark(s) regressed past the baseline."
+                          << std::endl;
+                return EXIT_REGRESSION;
+            }
+        }
+    }
+    catch ( const std::exception & err ) {
+        std::cerr << err.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
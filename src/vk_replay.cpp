@@ -0,0 +1,935 @@
+#include "command_stream.hpp"
+#include "headless_context.hpp"
+#include "json.hpp"
+#include "mesh_format.hpp"
+#include "pipeline.hpp"
+#include "sampler_cache.hpp"
+#include "synchronization.hpp"
+#include "vk_memory.hpp"
+#include "vk_utils.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <numeric>
+#include <stdexcept>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Replays a frame captured with `hello_triangle --capture-stream` without a
+// window and reports per-frame timings.
+//
+//   vk_replay <capture.vcmd> [--iterations <n>] [--warmup <n>] [--json <out>]
+//
+// Every iteration records the captured commands into a command buffer (CPU
+// time), submits it and waits for its fence (frame time). Timestamps around
+// the commands give the GPU time where the queue supports them.
+//
+// Swapchain images become offscreen colour + depth targets, so layouts the
+// capture moved to PRESENT_SRC end up in TRANSFER_SRC instead. Textures have
+// their captured shape but undefined contents.
+
+namespace
+{
+
+using steady_clock = std::chrono::steady_clock;
+
+// CTest treats this as "skipped" rather than failed.
+constexpr int EXIT_SKIPPED{ 77 };
+
+struct ReplayOptions
+{
+    std::string   capture_path;
+    std::uint32_t iterations{ 100 };
+    std::uint32_t warmup{ 5 };
+    std::string   json_path;
+};
+
+ReplayOptions
+parse_options( const int argc, char ** argv ) {
+    ReplayOptions options{};
+    for ( int i{ 1 }; i < argc; ++i ) {
+        const std::string_view arg{ argv[i] };
+        const auto             next = [&]() -> std::string {
+            if ( i + 1 >= argc ) {
+                throw std::runtime_error( "Missing value for "
+                                          + std::string{ arg } );
+            }
+            return argv[++i];
+        };
+
+        if ( arg == "--iterations" ) {
+            options.iterations =
+                static_cast<std::uint32_t>( std::stoul( next() ) );
+        }
+        else if ( arg == "--warmup" ) {
+            options.warmup = static_cast<std::uint32_t>( std::stoul( next() ) );
+        }
+        else if ( arg == "--json" ) {
+            options.json_path = next();
+        }
+        else if ( options.capture_path.empty() && !arg.starts_with( "--" ) ) {
+            options.capture_path = arg;
+        }
+        else {
+            throw std::runtime_error( "Unknown option: " + std::string{ arg } );
+        }
+    }
+    if ( options.capture_path.empty() ) {
+        throw std::runtime_error(
+            "Usage: vk_replay <capture.vcmd> [--iterations <n>] "
+            "[--warmup <n>] [--json <out>]" );
+    }
+    if ( options.iterations == 0 ) {
+        throw std::runtime_error( "--iterations must be at least 1." );
+    }
+    return options;
+}
+
+struct TimingSeries
+{
+    std::string         name;
+    std::vector<double> samples_ns;
+
+    [[nodiscard]] double median() const {
+        auto sorted{ samples_ns };
+        std::sort( sorted.begin(), sorted.end() );
+        const auto mid{ sorted.size() / 2 };
+        return sorted.size() % 2 != 0
+                   ? sorted[mid]
+                   : 0.5 * ( sorted[mid - 1] + sorted[mid] );
+    }
+    [[nodiscard]] double mean() const {
+        return std::accumulate( samples_ns.begin(), samples_ns.end(), 0.0 )
+               / static_cast<double>( samples_ns.size() );
+    }
+    [[nodiscard]] double min() const {
+        return *std::min_element( samples_ns.begin(), samples_ns.end() );
+    }
+    [[nodiscard]] double max() const {
+        return *std::max_element( samples_ns.begin(), samples_ns.end() );
+    }
+
+    [[nodiscard]] JsonValue to_json() const {
+        return JsonValue{ JsonValue::Object{
+            { "median_ns", median() },
+            { "mean_ns", mean() },
+            { "min_ns", min() },
+            { "max_ns", max() },
+        } };
+    }
+};
+
+[[nodiscard]] double
+elapsed_ns( const steady_clock::time_point start ) {
+    return std::chrono::duration<double, std::nano>( steady_clock::now()
+                                                     - start )
+        .count();
+}
+
+[[nodiscard]] UniqueCommandPool
+create_command_pool( const VkDevice device, const uint32_t queue_family,
+                     const VkAllocationCallbacks * allocator ) {
+    VkCommandPoolCreateInfo pool_info{};
+    pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    pool_info.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+    pool_info.queueFamilyIndex = queue_family;
+
+    UniqueCommandPool command_pool{};
+    if ( vkCreateCommandPool( device, &pool_info, allocator,
+                              command_pool.put( device, allocator ) )
+         != VK_SUCCESS ) {
+        throw std::runtime_error( "Failed to create command pool." );
+    }
+    return command_pool;
+}
+
+[[nodiscard]] UniqueFence
+create_fence( const VkDevice                device,
+              const VkAllocationCallbacks * allocator ) {
+    VkFenceCreateInfo fence_info{};
+    fence_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+
+    UniqueFence fence{};
+    if ( vkCreateFence( device, &fence_info, allocator,
+                        fence.put( device, allocator ) )
+         != VK_SUCCESS ) {
+        throw std::runtime_error( "Failed to create fence." );
+    }
+    return fence;
+}
+
+void
+submit_and_wait( const VkDevice device, const VkQueue queue,
+                 const VkCommandBuffer command_buffer, const VkFence fence ) {
+    VkSubmitInfo submit_info{};
+    submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submit_info.commandBufferCount = 1;
+    submit_info.pCommandBuffers = &command_buffer;
+    if ( vkQueueSubmit( queue, 1, &submit_info, fence ) != VK_SUCCESS ) {
+        throw std::runtime_error( "Failed to submit command buffer." );
+    }
+    if ( vkWaitForFences( device, 1, &fence, VK_TRUE,
+                          std::numeric_limits<std::uint64_t>::max() )
+             != VK_SUCCESS
+         || vkResetFences( device, 1, &fence ) != VK_SUCCESS ) {
+        throw std::runtime_error( "Failed to wait for fence." );
+    }
+}
+
+void
+require_format( const VkPhysicalDevice physical_device, const VkFormat format,
+                const VkFormatFeatureFlags features, const char * what ) {
+    VkFormatProperties properties;
+    vkGetPhysicalDeviceFormatProperties( physical_device, format,
+                                         &properties );
+    if ( ( properties.optimalTilingFeatures & features ) != features ) {
+        throw std::runtime_error( std::string{ "Captured " } + what
+                                  + " format not supported by this device." );
+    }
+}
+
+// The captured layout for a target, with the window-only ones swapped for
+// what an offscreen image can use.
+[[nodiscard]] VkImageLayout
+offscreen_layout( const std::uint32_t layout ) {
+    const auto captured{ static_cast<VkImageLayout>( layout ) };
+    return captured == VK_IMAGE_LAYOUT_PRESENT_SRC_KHR
+               ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL
+               : captured;
+}
+
+// Everything the capture refers to, recreated on a headless device.
+class ReplayScene
+{
+    public:
+    ReplayScene( const HeadlessContext & context, const CommandStream & stream )
+        : m_context( context ), m_stream( stream ),
+          m_sampler_cache( context.device, 1.0f, context.allocator ) {
+        require_format( context.physical_device, stream.color_format,
+                        VK_FORMAT_FEATURE_COLOR_ATTACHMENT_BIT, "colour" );
+        require_format( context.physical_device, stream.depth_format,
+                        VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT,
+                        "depth" );
+        m_command_pool = create_command_pool(
+            context.device, context.queue_family, context.allocator );
+        m_fence = create_fence( context.device, context.allocator );
+
+        create_render_pass();
+        create_targets();
+        create_set_layout();
+        create_pipelines();
+        upload_resources();
+    }
+
+    [[nodiscard]] VkCommandPool command_pool() const noexcept {
+        return m_command_pool;
+    }
+    [[nodiscard]] VkFence fence() const noexcept { return m_fence; }
+
+    // Records the whole capture into `command_buffer`, which must be in the
+    // recording state.
+    void record( const VkCommandBuffer command_buffer ) const {
+        Recorder recorder{ *this, command_buffer,
+                           BarrierBatch( SynchronizationFunctions{} ) };
+        for ( const auto & command : m_stream.commands ) {
+            std::visit( recorder, command );
+        }
+        recorder.barriers.flush( command_buffer );
+    }
+
+    private:
+    struct Target
+    {
+        ImageAllocation   color;
+        ImageAllocation   depth;
+        UniqueImageView   color_view;
+        UniqueImageView   depth_view;
+        UniqueFramebuffer framebuffer;
+        VkExtent2D        extent{};
+    };
+
+    struct Pipeline
+    {
+        UniquePipelineLayout layout;
+        UniquePipeline       pipeline;
+    };
+
+    struct Texture
+    {
+        ImageAllocation image;
+        UniqueImageView view;
+        VkDescriptorSet set{ VK_NULL_HANDLE };
+    };
+
+    // One call per command type; see StreamCommand.
+    struct Recorder
+    {
+        const ReplayScene &   scene;
+        const VkCommandBuffer command_buffer;
+        BarrierBatch          barriers;
+
+        void operator()( const StreamBeginRenderPass & command ) {
+            const auto & target{ scene.m_targets[command.target] };
+
+            VkClearValue clear_values[2]{};
+            std::copy_n( command.clear_color, 4,
+                         clear_values[0].color.float32 );
+            clear_values[1].depthStencil = { command.clear_depth,
+                                             command.clear_stencil };
+
+            VkRenderPassBeginInfo render_pass_info{};
+            render_pass_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+            render_pass_info.renderPass = scene.m_render_pass;
+            render_pass_info.framebuffer = target.framebuffer;
+            render_pass_info.renderArea.offset = { 0, 0 };
+            render_pass_info.renderArea.extent = target.extent;
+            render_pass_info.clearValueCount = 2;
+            render_pass_info.pClearValues = clear_values;
+            vkCmdBeginRenderPass( command_buffer, &render_pass_info,
+                                  VK_SUBPASS_CONTENTS_INLINE );
+        }
+        void operator()( const StreamEndRenderPass & ) {
+            vkCmdEndRenderPass( command_buffer );
+        }
+        void operator()( const StreamBindPipeline & command ) {
+            vkCmdBindPipeline( command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
+                               scene.m_pipelines[command.pipeline].pipeline );
+        }
+        void operator()( const StreamSetViewport & command ) {
+            const VkViewport viewport{ command.x,         command.y,
+                                       command.width,     command.height,
+                                       command.min_depth, command.max_depth };
+            vkCmdSetViewport( command_buffer, 0, 1, &viewport );
+        }
+        void operator()( const StreamSetScissor & command ) {
+            const VkRect2D scissor{ { command.x, command.y },
+                                    { command.width, command.height } };
+            vkCmdSetScissor( command_buffer, 0, 1, &scissor );
+        }
+        void operator()( const StreamBindVertexBuffer & command ) {
+            const VkBuffer buffer{ scene.m_buffers[command.buffer].buffer };
+            const VkDeviceSize offset{ command.offset };
+            vkCmdBindVertexBuffers( command_buffer, command.binding, 1, &buffer,
+                                    &offset );
+        }
+        void operator()( const StreamBindIndexBuffer & command ) {
+            vkCmdBindIndexBuffer(
+                command_buffer, scene.m_buffers[command.buffer].buffer,
+                command.offset,
+                static_cast<VkIndexType>( command.index_type ) );
+        }
+        void operator()( const StreamBindTexture & command ) {
+            const VkDescriptorSet set{ scene.m_textures[command.texture].set };
+            vkCmdBindDescriptorSets(
+                command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
+                scene.m_pipelines[command.pipeline].layout, 0, 1, &set, 0,
+                nullptr );
+        }
+        void operator()( const StreamPushConstants & command ) {
+            vkCmdPushConstants( command_buffer,
+                                scene.m_pipelines[command.pipeline].layout,
+                                command.stages, command.offset, command.size,
+                                command.data );
+        }
+        void operator()( const StreamDraw & command ) {
+            vkCmdDraw( command_buffer, command.vertex_count,
+                       command.instance_count, command.first_vertex,
+                       command.first_instance );
+        }
+        void operator()( const StreamDrawIndexed & command ) {
+            vkCmdDrawIndexed( command_buffer, command.index_count,
+                              command.instance_count, command.first_index,
+                              command.vertex_offset, command.first_instance );
+        }
+        void operator()( const StreamImageBarrier & command ) {
+            barriers.image_barrier(
+                scene.m_targets[command.target].color.image,
+                offscreen_layout( command.old_layout ),
+                offscreen_layout( command.new_layout ), command.src_stages,
+                command.src_access, command.dst_stages, command.dst_access );
+        }
+        void operator()( const StreamMemoryBarrier & command ) {
+            barriers.memory_barrier( command.src_stages, command.src_access,
+                                     command.dst_stages, command.dst_access );
+        }
+        void operator()( const StreamBarrierFlush & ) {
+            barriers.flush( command_buffer );
+        }
+    };
+
+    const HeadlessContext &         m_context;
+    const CommandStream &           m_stream;
+    SamplerCache                    m_sampler_cache;
+    UniqueCommandPool               m_command_pool;
+    UniqueFence                     m_fence;
+    UniqueRenderPass                m_render_pass;
+    std::vector<Target>             m_targets;
+    UniqueDescriptorSetLayout       m_set_layout;
+    UniqueDescriptorPool            m_descriptor_pool;
+    std::vector<Pipeline>           m_pipelines;
+    std::vector<BufferAllocation>   m_buffers;
+    std::vector<Texture>            m_textures;
+
+    // Same attachments as the app's pass, but the colour image ends in
+    // TRANSFER_SRC as there is nothing to present.
+    void create_render_pass() {
+        const VkDevice device{ m_context.device };
+        const auto *   allocator{ m_context.allocator };
+
+        VkAttachmentDescription attachments[2]{};
+        attachments[0].format = m_stream.color_format;
+        attachments[0].samples = VK_SAMPLE_COUNT_1_BIT;
+        attachments[0].loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+        attachments[0].storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+        attachments[0].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+        attachments[0].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+        attachments[0].initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        attachments[0].finalLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+
+        attachments[1].format = m_stream.depth_format;
+        attachments[1].samples = VK_SAMPLE_COUNT_1_BIT;
+        attachments[1].loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+        attachments[1].storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+        attachments[1].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+        attachments[1].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+        attachments[1].initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        attachments[1].finalLayout =
+            VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+        VkAttachmentReference color_attachment_ref{};
+        color_attachment_ref.attachment = 0;
+        color_attachment_ref.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
+        VkAttachmentReference depth_attachment_ref{};
+        depth_attachment_ref.attachment = 1;
+        depth_attachment_ref.layout =
+            VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+        VkSubpassDescription subpass{};
+        subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+        subpass.colorAttachmentCount = 1;
+        subpass.pColorAttachments = &color_attachment_ref;
+        subpass.pDepthStencilAttachment = &depth_attachment_ref;
+
+        // Iterations reuse the attachments back to back.
+        VkSubpassDependency dependencies[2]{};
+        dependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
+        dependencies[0].dstSubpass = 0;
+        dependencies[0].srcStageMask =
+            VK_PIPELINE_STAGE_TRANSFER_BIT
+            | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+        dependencies[0].srcAccessMask =
+            VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+        dependencies[0].dstStageMask =
+            VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT
+            | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+        dependencies[0].dstAccessMask =
+            VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT
+            | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+
+        dependencies[1].srcSubpass = 0;
+        dependencies[1].dstSubpass = VK_SUBPASS_EXTERNAL;
+        dependencies[1].srcStageMask =
+            VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+        dependencies[1].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+        dependencies[1].dstStageMask = VK_PIPELINE_STAGE_TRANSFER_BIT;
+        dependencies[1].dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+
+        VkRenderPassCreateInfo render_pass_info{};
+        render_pass_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+        render_pass_info.attachmentCount = 2;
+        render_pass_info.pAttachments = attachments;
+        render_pass_info.subpassCount = 1;
+        render_pass_info.pSubpasses = &subpass;
+        render_pass_info.dependencyCount = 2;
+        render_pass_info.pDependencies = dependencies;
+
+        if ( vkCreateRenderPass( device, &render_pass_info, allocator,
+                                 m_render_pass.put( device, allocator ) )
+             != VK_SUCCESS ) {
+            throw std::runtime_error( "Failed to create render pass." );
+        }
+    }
+
+    void create_targets() {
+        const VkDevice device{ m_context.device };
+        const auto *   allocator{ m_context.allocator };
+        for ( const auto & captured : m_stream.targets ) {
+            auto & target{ m_targets.emplace_back() };
+            target.extent = { captured.width, captured.height };
+            target.color = create_image(
+                m_context.physical_device, device, target.extent,
+                m_stream.color_format,
+                VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT
+                    | VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+                1, allocator );
+            target.color_view =
+                create_image_view( device, target.color.image,
+                                   m_stream.color_format,
+                                   VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, allocator );
+            target.depth = create_image(
+                m_context.physical_device, device, target.extent,
+                m_stream.depth_format,
+                VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, 1, allocator );
+            target.depth_view =
+                create_image_view( device, target.depth.image,
+                                   m_stream.depth_format,
+                                   VK_IMAGE_ASPECT_DEPTH_BIT, 0, 1, allocator );
+
+            const VkImageView attachments[] = { target.color_view,
+                                                target.depth_view };
+
+            VkFramebufferCreateInfo framebuffer_info{};
+            framebuffer_info.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+            framebuffer_info.renderPass = m_render_pass;
+            framebuffer_info.attachmentCount = 2;
+            framebuffer_info.pAttachments = attachments;
+            framebuffer_info.width = target.extent.width;
+            framebuffer_info.height = target.extent.height;
+            framebuffer_info.layers = 1;
+
+            if ( vkCreateFramebuffer(
+                     device, &framebuffer_info, allocator,
+                     target.framebuffer.put( device, allocator ) )
+                 != VK_SUCCESS ) {
+                throw std::runtime_error( "Failed to create framebuffer." );
+            }
+        }
+    }
+
+    // The app's texture set: one combined image sampler for the fragment
+    // stage. One set per texture, all written up front.
+    void create_set_layout() {
+        const VkDevice device{ m_context.device };
+        const auto *   allocator{ m_context.allocator };
+
+        VkDescriptorSetLayoutBinding binding{};
+        binding.binding = 0;
+        binding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        binding.descriptorCount = 1;
+        binding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+
+        VkDescriptorSetLayoutCreateInfo layout_info{};
+        layout_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+        layout_info.bindingCount = 1;
+        layout_info.pBindings = &binding;
+        if ( vkCreateDescriptorSetLayout(
+                 device, &layout_info, allocator,
+                 m_set_layout.put( device, allocator ) )
+             != VK_SUCCESS ) {
+            throw std::runtime_error(
+                "Failed to create descriptor set layout." );
+        }
+        if ( m_stream.textures.empty() ) {
+            return;
+        }
+
+        const auto set_count{ static_cast<std::uint32_t>(
+            m_stream.textures.size() ) };
+        VkDescriptorPoolSize pool_size{};
+        pool_size.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        pool_size.descriptorCount = set_count;
+
+        VkDescriptorPoolCreateInfo pool_info{};
+        pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+        pool_info.maxSets = set_count;
+        pool_info.poolSizeCount = 1;
+        pool_info.pPoolSizes = &pool_size;
+        if ( vkCreateDescriptorPool(
+                 device, &pool_info, allocator,
+                 m_descriptor_pool.put( device, allocator ) )
+             != VK_SUCCESS ) {
+            throw std::runtime_error( "Failed to create descriptor pool." );
+        }
+    }
+
+    void create_pipelines() {
+        const VkDevice device{ m_context.device };
+        const auto *   allocator{ m_context.allocator };
+
+        std::vector<UniqueShaderModule> shaders;
+        for ( const auto & code : m_stream.shaders ) {
+            shaders.push_back(
+                create_shader_module( device, code, allocator ) );
+        }
+
+        const VkDescriptorSetLayout set_layout{ m_set_layout };
+        const auto vertex_binding{ mesh_vertex_binding() };
+        const auto vertex_attributes{ mesh_vertex_attributes() };
+        for ( const auto & captured : m_stream.pipelines ) {
+            std::span<const VkDescriptorSetLayout> set_layouts{};
+            if ( ( captured.flags & STREAM_PIPELINE_TEXTURED ) != 0 ) {
+                set_layouts = { &set_layout, 1 };
+            }
+            auto & pipeline{ m_pipelines.emplace_back() };
+            pipeline.layout = create_pipeline_layout(
+                device, captured.push_constant_size, set_layouts, allocator );
+
+            GraphicsPipelineDesc desc{};
+            desc.vertex_shader = shaders[captured.vertex_shader];
+            desc.fragment_shader = shaders[captured.fragment_shader];
+            desc.layout = pipeline.layout;
+            desc.render_pass = m_render_pass;
+            desc.allocator = allocator;
+            desc.front_face = static_cast<VkFrontFace>( captured.front_face );
+            desc.depth_test =
+                ( captured.flags & STREAM_PIPELINE_DEPTH_TEST ) != 0;
+            if ( ( captured.flags & STREAM_PIPELINE_MESH_VERTICES ) != 0 ) {
+                desc.vertex_bindings = { &vertex_binding, 1 };
+                desc.vertex_attributes = vertex_attributes;
+            }
+            pipeline.pipeline = build_graphics_pipeline( device, desc );
+        }
+    }
+
+    // Buffers go through one staging buffer each and textures are moved
+    // straight to SHADER_READ_ONLY, all in a single submission.
+    void upload_resources() {
+        const VkDevice device{ m_context.device };
+        const auto *   allocator{ m_context.allocator };
+
+        VkCommandBufferAllocateInfo alloc_info{};
+        alloc_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        alloc_info.commandPool = m_command_pool;
+        alloc_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        alloc_info.commandBufferCount = 1;
+        VkCommandBuffer command_buffer{ VK_NULL_HANDLE };
+        if ( vkAllocateCommandBuffers( device, &alloc_info, &command_buffer )
+             != VK_SUCCESS ) {
+            throw std::runtime_error(
+                "Failed to allocate command buffers." );
+        }
+
+        VkCommandBufferBeginInfo begin_info{};
+        begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+        if ( vkBeginCommandBuffer( command_buffer, &begin_info )
+             != VK_SUCCESS ) {
+            throw std::runtime_error( "Failed to begin command buffer." );
+        }
+
+        BarrierBatch barriers( SynchronizationFunctions{} );
+        std::vector<BufferAllocation> staging;
+        for ( const auto & captured : m_stream.buffers ) {
+            const auto size{ static_cast<VkDeviceSize>(
+                captured.contents.size() ) };
+            if ( size == 0 ) {
+                throw std::runtime_error( "Captured buffer is empty." );
+            }
+            auto & source{ staging.emplace_back( create_buffer(
+                m_context.physical_device, device, size,
+                VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT
+                    | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                0, allocator ) ) };
+            void * mapped{ nullptr };
+            if ( vkMapMemory( device, source.memory, 0, size, 0, &mapped )
+                 != VK_SUCCESS ) {
+                throw std::runtime_error( "Failed to map staging buffer." );
+            }
+            std::memcpy( mapped, captured.contents.data(), size );
+            vkUnmapMemory( device, source.memory );
+
+            auto & buffer{ m_buffers.emplace_back( create_buffer(
+                m_context.physical_device, device, size,
+                captured.usage | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 0, allocator ) ) };
+            const VkBufferCopy region{ 0, 0, size };
+            vkCmdCopyBuffer( command_buffer, source.buffer, buffer.buffer, 1,
+                             &region );
+        }
+        barriers.memory_barrier(
+            VK_PIPELINE_STAGE_2_TRANSFER_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT,
+            VK_PIPELINE_STAGE_2_VERTEX_INPUT_BIT,
+            VK_ACCESS_2_VERTEX_ATTRIBUTE_READ_BIT
+                | VK_ACCESS_2_INDEX_READ_BIT );
+
+        const VkSampler sampler{ m_sampler_cache.get( SamplerDesc{} ) };
+        for ( const auto & captured : m_stream.textures ) {
+            const auto format{ static_cast<VkFormat>( captured.format ) };
+            require_format( m_context.physical_device, format,
+                            VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT, "texture" );
+            auto & texture{ m_textures.emplace_back() };
+            texture.image = create_image(
+                m_context.physical_device, device,
+                { captured.width, captured.height }, format,
+                VK_IMAGE_USAGE_SAMPLED_BIT, captured.levels, allocator );
+            texture.view = create_image_view( device, texture.image.image,
+                                              format,
+                                              VK_IMAGE_ASPECT_COLOR_BIT, 0,
+                                              captured.levels, allocator );
+            barriers.image_barrier(
+                texture.image.image, VK_IMAGE_LAYOUT_UNDEFINED,
+                VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                VK_PIPELINE_STAGE_2_NONE, VK_ACCESS_2_NONE,
+                VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT,
+                VK_ACCESS_2_SHADER_SAMPLED_READ_BIT,
+                { VK_IMAGE_ASPECT_COLOR_BIT, 0, captured.levels, 0, 1 } );
+            write_texture_set( texture, sampler );
+        }
+        barriers.flush( command_buffer );
+
+        if ( vkEndCommandBuffer( command_buffer ) != VK_SUCCESS ) {
+            throw std::runtime_error( "Failed to record command buffer." );
+        }
+        submit_and_wait( device, m_context.queue, command_buffer, m_fence );
+        vkFreeCommandBuffers( device, m_command_pool, 1, &command_buffer );
+    }
+
+    void write_texture_set( Texture & texture, const VkSampler sampler ) {
+        const VkDevice              device{ m_context.device };
+        const VkDescriptorSetLayout set_layout{ m_set_layout };
+
+        VkDescriptorSetAllocateInfo alloc_info{};
+        alloc_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        alloc_info.descriptorPool = m_descriptor_pool;
+        alloc_info.descriptorSetCount = 1;
+        alloc_info.pSetLayouts = &set_layout;
+        if ( vkAllocateDescriptorSets( device, &alloc_info, &texture.set )
+             != VK_SUCCESS ) {
+            throw std::runtime_error( "Failed to allocate descriptor sets." );
+        }
+
+        VkDescriptorImageInfo image_info{};
+        image_info.sampler = sampler;
+        image_info.imageView = texture.view;
+        image_info.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+        VkWriteDescriptorSet write{};
+        write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        write.dstSet = texture.set;
+        write.dstBinding = 0;
+        write.descriptorCount = 1;
+        write.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        write.pImageInfo = &image_info;
+        vkUpdateDescriptorSets( device, 1, &write, 0, nullptr );
+    }
+};
+
+// Start and end of the replayed commands, read back after every iteration.
+class GpuTimer
+{
+    public:
+    explicit GpuTimer( const HeadlessContext & context )
+        : m_device( context.device ), m_allocator( context.allocator ) {
+        std::uint32_t family_count{ 0 };
+        vkGetPhysicalDeviceQueueFamilyProperties( context.physical_device,
+                                                  &family_count, nullptr );
+        std::vector<VkQueueFamilyProperties> families( family_count );
+        vkGetPhysicalDeviceQueueFamilyProperties(
+            context.physical_device, &family_count, families.data() );
+        const auto valid_bits{
+            families[context.queue_family].timestampValidBits };
+        if ( valid_bits == 0 ) {
+            return;
+        }
+        m_mask = valid_bits >= 64 ? ~std::uint64_t{ 0 }
+                                  : ( std::uint64_t{ 1 } << valid_bits ) - 1;
+
+        VkPhysicalDeviceProperties properties;
+        vkGetPhysicalDeviceProperties( context.physical_device, &properties );
+        m_period_ns = properties.limits.timestampPeriod;
+
+        VkQueryPoolCreateInfo pool_info{};
+        pool_info.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+        pool_info.queryType = VK_QUERY_TYPE_TIMESTAMP;
+        pool_info.queryCount = 2;
+        if ( vkCreateQueryPool( m_device, &pool_info, m_allocator,
+                                m_pool.put( m_device, m_allocator ) )
+             != VK_SUCCESS ) {
+            throw std::runtime_error( "Failed to create query pool." );
+        }
+    }
+
+    [[nodiscard]] bool available() const noexcept {
+        return m_pool.get() != VK_NULL_HANDLE;
+    }
+
+    void begin( const VkCommandBuffer command_buffer ) const {
+        if ( available() ) {
+            vkCmdResetQueryPool( command_buffer, m_pool, 0, 2 );
+            vkCmdWriteTimestamp( command_buffer,
+                                 VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, m_pool, 0 );
+        }
+    }
+    void end( const VkCommandBuffer command_buffer ) const {
+        if ( available() ) {
+            vkCmdWriteTimestamp( command_buffer,
+                                 VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, m_pool,
+                                 1 );
+        }
+    }
+
+    // Nanoseconds between begin() and end() of the last completed submit.
+    [[nodiscard]] double elapsed_ns() const {
+        std::uint64_t ticks[2]{};
+        if ( vkGetQueryPoolResults( m_device, m_pool, 0, 2, sizeof( ticks ),
+                                    ticks, sizeof( ticks[0] ),
+                                    VK_QUERY_RESULT_64_BIT
+                                        | VK_QUERY_RESULT_WAIT_BIT )
+             != VK_SUCCESS ) {
+            throw std::runtime_error( "Failed to read timestamps." );
+        }
+        const std::uint64_t elapsed{ ( ticks[1] - ticks[0] ) & m_mask };
+        return static_cast<double>( elapsed ) * m_period_ns;
+    }
+
+    private:
+    VkDevice                      m_device;
+    const VkAllocationCallbacks * m_allocator;
+    UniqueQueryPool               m_pool;
+    std::uint64_t                 m_mask{ 0 };
+    double                        m_period_ns{ 0.0 };
+};
+
+void
+report( const TimingSeries & series ) {
+    std::cout << "  " << series.name << ": median "
+              << series.median() / 1000.0 << " us, mean "
+              << series.mean() / 1000.0 << " us, min "
+              << series.min() / 1000.0 << " us, max "
+              << series.max() / 1000.0 << " us\n";
+}
+
+void
+replay( const ReplayOptions & options, const CommandStream & stream,
+        const HeadlessContext & context ) {
+    const VkDevice device{ context.device };
+
+    const auto        setup_start{ steady_clock::now() };
+    const ReplayScene scene( context, stream );
+    const GpuTimer    gpu_timer( context );
+    std::cout << "Setup: " << elapsed_ns( setup_start ) / 1e6 << " ms ("
+              << stream.pipelines.size() << " pipelines, "
+              << stream.buffers.size() << " buffers, "
+              << stream.textures.size() << " textures)\n";
+
+    VkCommandBufferAllocateInfo alloc_info{};
+    alloc_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    alloc_info.commandPool = scene.command_pool();
+    alloc_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    alloc_info.commandBufferCount = 1;
+    VkCommandBuffer command_buffer{ VK_NULL_HANDLE };
+    if ( vkAllocateCommandBuffers( device, &alloc_info, &command_buffer )
+         != VK_SUCCESS ) {
+        throw std::runtime_error( "Failed to allocate command buffers." );
+    }
+
+    TimingSeries cpu{ "cpu_record", {} };
+    TimingSeries gpu{ "gpu", {} };
+    TimingSeries frame{ "frame", {} };
+    for ( std::uint32_t i{ 0 }; i < options.warmup + options.iterations;
+          ++i ) {
+        const auto frame_start{ steady_clock::now() };
+        vkResetCommandBuffer( command_buffer, 0 );
+
+        VkCommandBufferBeginInfo begin_info{};
+        begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+        if ( vkBeginCommandBuffer( command_buffer, &begin_info )
+             != VK_SUCCESS ) {
+            throw std::runtime_error( "Failed to begin command buffer." );
+        }
+        gpu_timer.begin( command_buffer );
+        scene.record( command_buffer );
+        gpu_timer.end( command_buffer );
+        if ( vkEndCommandBuffer( command_buffer ) != VK_SUCCESS ) {
+            throw std::runtime_error( "Failed to record command buffer." );
+        }
+        const double record_ns{ elapsed_ns( frame_start ) };
+
+        submit_and_wait( device, context.queue, command_buffer,
+                         scene.fence() );
+        const double frame_ns{ elapsed_ns( frame_start ) };
+
+        if ( i < options.warmup ) {
+            continue;
+        }
+        cpu.samples_ns.push_back( record_ns );
+        frame.samples_ns.push_back( frame_ns );
+        if ( gpu_timer.available() ) {
+            gpu.samples_ns.push_back( gpu_timer.elapsed_ns() );
+        }
+    }
+
+    std::cout << options.iterations << " iterations of "
+              << stream.commands.size() << " commands ("
+              << stream.draw_count() << " draws):\n";
+    report( cpu );
+    if ( gpu_timer.available() ) {
+        report( gpu );
+    }
+    else {
+        std::cout << "  gpu: no timestamp support on this queue\n";
+    }
+    report( frame );
+
+    if ( !options.json_path.empty() ) {
+        JsonValue::Object timings{ { cpu.name, cpu.to_json() },
+                                   { frame.name, frame.to_json() } };
+        if ( gpu_timer.available() ) {
+            timings.emplace_back( gpu.name, gpu.to_json() );
+        }
+        std::ofstream file( options.json_path, std::ios::trunc );
+        if ( !file.is_open() ) {
+            throw std::runtime_error( "Couldn't open file: "
+                                      + options.json_path );
+        }
+        JsonValue{ JsonValue::Object{
+                       { "capture", options.capture_path },
+                       { "iterations",
+                         static_cast<double>( options.iterations ) },
+                       { "commands",
+                         static_cast<double>( stream.commands.size() ) },
+                       { "draws", static_cast<double>( stream.draw_count() ) },
+                       { "timings", JsonValue{ std::move( timings ) } } } }
+            .write( file );
+        file << '\n';
+    }
+}
+
+} // namespace
+
+int
+main( int argc, char ** argv ) {
+    ReplayOptions options{};
+    CommandStream stream{};
+    try {
+        options = parse_options( argc, argv );
+        stream = load_command_stream( options.capture_path );
+    }
+    catch ( const std::exception & err ) {
+        std::cerr << err.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    // Declared first, it has to outlive everything allocated through it.
+    HostAllocator   host_allocator;
+    HeadlessContext context{};
+    try {
+        context = HeadlessContext::create( "vk_replay", &host_allocator );
+    }
+    catch ( const std::exception & err ) {
+        std::cerr << "Skipping, no usable Vulkan device: " << err.what()
+                  << std::endl;
+        return EXIT_SKIPPED;
+    }
+
+    try {
+        replay( options, stream, context );
+    }
+    catch ( const std::exception & err ) {
+        std::cerr << err.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}